@@ -0,0 +1,36 @@
+#
+# Copyright (C) 2020 Naomasa Matsubayashi
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to
+# deal in the Software without restriction, including without limitation the
+# rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+# sell copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+# FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+# IN THE SOFTWARE.
+
+if(NOT DRACO_ROOT)
+  find_path(DRACO_INCLUDE_DIRS draco/compression/decode.h)
+  find_library(DRACO_LIBRARIES draco)
+else()
+  find_path(DRACO_INCLUDE_DIRS draco/compression/decode.h NO_DEFAULT_PATH PATHS ${DRACO_ROOT}/include)
+  find_library(DRACO_LIBRARIES draco NO_DEFAULT_PATH PATHS ${DRACO_ROOT}/lib)
+endif()
+if(DRACO_INCLUDE_DIRS AND DRACO_LIBRARIES)
+  set(DRACO_FOUND TRUE)
+else()
+  set(DRACO_FOUND FALSE)
+  set(DRACO_INCLUDE_DIRS)
+  set(DRACO_LIBRARIES)
+endif()
+mark_as_advanced(DRACO_INCLUDE_DIRS DRACO_LIBRARIES)
@@ -21,11 +21,15 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <array>
 #include <vector>
+#include <unordered_map>
 #include <filesystem>
 #include <vulkan/vulkan.hpp>
 #include <fx/gltf.h>
 #include <vw/buffer.h>
+#include <viewer/glb.h>
+#include <viewer/meshlet.h>
 namespace viewer {
   struct buffer_t {
     LIBSTAMP_SETTER( buffer )
@@ -44,10 +48,316 @@ namespace viewer {
     const std::vector< uint8_t > &data
   );
   using buffers_t = std::vector< buffer_t >;
+  // メッシュから参照されたbufferViewだけを用途別のバッファに詰めて転送する
+  constexpr uint32_t vertex_buffer_index = 0u;
+  constexpr uint32_t index_buffer_index = 1u;
+  struct buffer_range_t {
+    buffer_range_t() : view( -1 ), buffer( 0 ), source_offset( 0 ), size( 0 ), offset( 0 ) {}
+    LIBSTAMP_SETTER( view )
+    LIBSTAMP_SETTER( buffer )
+    LIBSTAMP_SETTER( source_offset )
+    LIBSTAMP_SETTER( size )
+    LIBSTAMP_SETTER( offset )
+    // EXT_meshopt_compressionで圧縮されている場合はviewの内容を展開して使う
+    int32_t view;
+    uint32_t buffer;
+    size_t source_offset;
+    size_t size;
+    size_t offset;
+  };
+  // 頂点を生成する際の要素の変換
+  enum class vertex_conversion_t {
+    // sizeバイトをそのまま複製する
+    copy,
+    // floatのcomponents要素を( v - offset ) * scaleして16bit unormにする
+    unorm16,
+    // floatのcomponents要素を8bit snormにする
+    snorm8
+  };
+  // 複数のaccessorから読み込み時に生成するインターリーブされた頂点
+  struct interleaved_attribute_t {
+    interleaved_attribute_t() : view( -1 ), buffer( 0 ), source_offset( 0 ), source_stride( 0 ), size( 0 ), offset( 0 ), conversion( vertex_conversion_t::copy ), components( 0 ), bias{ 0.f, 0.f, 0.f, 0.f }, scale( 1.f ), fill( 0 ), fill_size( 0 ) {}
+    LIBSTAMP_SETTER( view )
+    LIBSTAMP_SETTER( buffer )
+    LIBSTAMP_SETTER( source_offset )
+    LIBSTAMP_SETTER( source_stride )
+    LIBSTAMP_SETTER( size )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( conversion )
+    LIBSTAMP_SETTER( components )
+    LIBSTAMP_SETTER( bias )
+    LIBSTAMP_SETTER( scale )
+    LIBSTAMP_SETTER( fill )
+    LIBSTAMP_SETTER( fill_size )
+    int32_t view;
+    uint32_t buffer;
+    size_t source_offset;
+    size_t source_stride;
+    // 元の要素のバイト数
+    size_t size;
+    size_t offset;
+    vertex_conversion_t conversion;
+    uint32_t components;
+    std::array< float, 4u > bias;
+    float scale;
+    // 広げる場合に元の要素の後ろのfill_sizeバイトに置く値 最大4バイト
+    // Vulkanが足りない要素を補うのと同じく4つ目の要素を1にして、COLOR_0のアルファが0にならないようにする
+    uint32_t fill;
+    uint32_t fill_size;
+  };
+  struct interleaved_range_t {
+    interleaved_range_t() : stride( 0 ), count( 0 ), offset( 0 ), remap( -1 ) {}
+    LIBSTAMP_SETTER( attribute )
+    LIBSTAMP_SETTER( stride )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( remap )
+    std::vector< interleaved_attribute_t > attribute;
+    size_t stride;
+    size_t count;
+    size_t offset;
+    // 0以上の場合はインデックスのバッファのoptimized[remap]の結果に合わせて頂点を並べ替える
+    int32_t remap;
+  };
+  // 読み込み時に頂点キャッシュ、オーバードロー、頂点フェッチに対して最適化するか、meshletに分ける三角形リストのインデックス
+  // 元のインデックスと位置の場所はinterleaved_attribute_tで表す
+  struct optimized_index_t {
+    optimized_index_t() : has_position( false ), optimize( false ), build_meshlet( false ), count( 0 ), vertex_count( 0 ), size( 0 ), offset( 0 ) {}
+    LIBSTAMP_SETTER( index )
+    LIBSTAMP_SETTER( position )
+    LIBSTAMP_SETTER( has_position )
+    LIBSTAMP_SETTER( optimize )
+    LIBSTAMP_SETTER( build_meshlet )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( vertex_count )
+    LIBSTAMP_SETTER( size )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( meshlet )
+    interleaved_attribute_t index;
+    interleaved_attribute_t position;
+    bool has_position;
+    bool optimize;
+    // meshletを作るにはhas_positionが必要
+    bool build_meshlet;
+    size_t count;
+    size_t vertex_count;
+    // 出力するインデックスのバイト数
+    size_t size;
+    size_t offset;
+    // create_bufferが書き込むmeshlet
+    std::vector< meshlet_t > meshlet;
+  };
+  struct lod_level_t {
+    lod_level_t() : target( 0 ), offset( 0 ), count( 0 ), error( 0.f ) {}
+    LIBSTAMP_SETTER( target )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( error )
+    // 確保するインデックスの数
+    size_t target;
+    size_t offset;
+    // create_bufferが書き込む実際のインデックスの数と誤差 目標に届かなかった場合はcountが0になる
+    size_t count;
+    float error;
+  };
+  // 読み込み時に三角形リストを簡略化して作るLODのインデックス
+  // 頂点は元のプリミティブの物を共有する
+  struct lod_range_t {
+    lod_range_t() : has_normal( false ), has_texcoord( false ), optimized( -1 ), count( 0 ), vertex_count( 0 ), size( 0 ) {}
+    LIBSTAMP_SETTER( index )
+    LIBSTAMP_SETTER( position )
+    LIBSTAMP_SETTER( normal )
+    LIBSTAMP_SETTER( texcoord )
+    LIBSTAMP_SETTER( has_normal )
+    LIBSTAMP_SETTER( has_texcoord )
+    LIBSTAMP_SETTER( optimized )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( vertex_count )
+    LIBSTAMP_SETTER( size )
+    LIBSTAMP_SETTER( level )
+    interleaved_attribute_t index;
+    // 位置はfloatの3要素 法線と座標は簡略化の誤差に加える
+    interleaved_attribute_t position;
+    interleaved_attribute_t normal;
+    interleaved_attribute_t texcoord;
+    bool has_normal;
+    bool has_texcoord;
+    // 0以上の場合はインデックスのバッファのoptimized[optimized]で並べ替えた頂点を参照する
+    int32_t optimized;
+    size_t count;
+    size_t vertex_count;
+    // 出力するインデックスのバイト数
+    size_t size;
+    std::vector< lod_level_t > level;
+  };
+  // HLODの代理メッシュに取り込む事ができるプリミティブの三角形リスト
+  // 位置と法線はfloatの3要素
+  struct hlod_source_t {
+    hlod_source_t() : count( 0 ), vertex_count( 0 ), material( 0 ) {}
+    LIBSTAMP_SETTER( index )
+    LIBSTAMP_SETTER( position )
+    LIBSTAMP_SETTER( normal )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( vertex_count )
+    LIBSTAMP_SETTER( material )
+    interleaved_attribute_t index;
+    interleaved_attribute_t position;
+    interleaved_attribute_t normal;
+    size_t count;
+    size_t vertex_count;
+    int32_t material;
+  };
+  // 代理メッシュの頂点は位置、法線、ベースカラーのテクスチャの座標をfloatで詰めた物
+  constexpr size_t hlod_vertex_stride = sizeof( float ) * 8u;
+  // インデックスのバッファのhlod_source[source]をmatrixでシーンの座標系に移した物
+  struct hlod_part_t {
+    hlod_part_t() : source( 0 ), matrix{ 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f }, texcoord{ 0.f, 0.f } {}
+    LIBSTAMP_SETTER( source )
+    LIBSTAMP_SETTER( matrix )
+    LIBSTAMP_SETTER( texcoord )
+    uint32_t source;
+    // 列優先
+    std::array< float, 16u > matrix;
+    // 全ての頂点に与えるテクスチャの座標
+    std::array< float, 2u > texcoord;
+  };
+  // 複数のプリミティブを1つにまとめてから簡略化するHLODの代理メッシュ
+  // 頂点は頂点のバッファのvertex_offsetに、32bitのインデックスはインデックスのバッファのoffsetに置く
+  // 簡略化した後に残った頂点とインデックスの分だけをplace_hlodがバッファの末尾に確保する
+  struct hlod_range_t {
+    hlod_range_t() : vertex_count( 0 ), index_count( 0 ), target( 0 ), vertex_offset( 0 ), offset( 0 ), count( 0 ), used_vertex_count( 0 ), error( 0.f ) {}
+    LIBSTAMP_SETTER( part )
+    LIBSTAMP_SETTER( vertex_count )
+    LIBSTAMP_SETTER( index_count )
+    LIBSTAMP_SETTER( target )
+    LIBSTAMP_SETTER( vertex_offset )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( used_vertex_count )
+    LIBSTAMP_SETTER( error )
+    std::vector< hlod_part_t > part;
+    // まとめた時点の頂点とインデックスの数
+    size_t vertex_count;
+    size_t index_count;
+    // 簡略化の目標のインデックスの数
+    size_t target;
+    size_t vertex_offset;
+    size_t offset;
+    // create_bufferが書き込む実際のインデックスの数、インデックスから参照される頂点の数と誤差
+    size_t count;
+    size_t used_vertex_count;
+    float error;
+  };
+  // 要素の後ろをsource.fillと0で埋めて広げながら置く頂点属性かインデックス
+  // 8bitのインデックスを16bitに、頂点バッファに使えない3要素の頂点属性を4要素にする
+  // コンピュートシェーダが使える場合は元の内容を転送してから広げ、使えない場合はCPUで広げる
+  struct converted_range_t {
+    converted_range_t() : stride( 0 ), count( 0 ), offset( 0 ) {}
+    LIBSTAMP_SETTER( source )
+    LIBSTAMP_SETTER( stride )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( offset )
+    interleaved_attribute_t source;
+    size_t stride;
+    size_t count;
+    size_t offset;
+  };
+  // KHR_draco_mesh_compressionで圧縮されたbufferViewから展開する頂点属性かインデックス
+  struct draco_range_t {
+    draco_range_t() : view( 0 ), attribute( -1 ), component_type( fx::gltf::Accessor::ComponentType::None ), components( 1 ), stride( 0 ), count( 0 ), offset( 0 ), fill( 0 ) {}
+    LIBSTAMP_SETTER( view )
+    LIBSTAMP_SETTER( attribute )
+    LIBSTAMP_SETTER( component_type )
+    LIBSTAMP_SETTER( components )
+    LIBSTAMP_SETTER( stride )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( fill )
+    int32_t view;
+    // Dracoの属性のunique_id 負の場合はインデックス
+    int32_t attribute;
+    fx::gltf::Accessor::ComponentType component_type;
+    uint32_t components;
+    size_t stride;
+    size_t count;
+    size_t offset;
+    // 要素の後ろの広げた部分に置く値
+    uint32_t fill;
+  };
+  struct buffer_layout_t {
+    buffer_layout_t() : size( 0 ) {}
+    LIBSTAMP_SETTER( usage )
+    LIBSTAMP_SETTER( range )
+    LIBSTAMP_SETTER( interleaved )
+    LIBSTAMP_SETTER( converted )
+    LIBSTAMP_SETTER( draco )
+    LIBSTAMP_SETTER( optimized )
+    LIBSTAMP_SETTER( lod )
+    LIBSTAMP_SETTER( hlod_source )
+    LIBSTAMP_SETTER( hlod )
+    LIBSTAMP_SETTER( view_offset )
+    LIBSTAMP_SETTER( size )
+    vk::BufferUsageFlags usage;
+    std::vector< buffer_range_t > range;
+    std::vector< interleaved_range_t > interleaved;
+    std::vector< converted_range_t > converted;
+    std::vector< draco_range_t > draco;
+    std::vector< optimized_index_t > optimized;
+    std::vector< lod_range_t > lod;
+    std::vector< hlod_source_t > hlod_source;
+    std::vector< hlod_range_t > hlod;
+    std::unordered_map< int32_t, size_t > view_offset;
+    size_t size;
+  };
+  using buffer_layouts_t = std::vector< buffer_layout_t >;
+  buffer_layouts_t create_buffer_layout();
+  size_t add_buffer_view(
+    const fx::gltf::Document &doc,
+    buffer_layout_t &layout,
+    int32_t index
+  );
+  // attributeのoffsetとstrideは呼び出し側で決めておく
+  size_t add_interleaved(
+    buffer_layout_t &layout,
+    interleaved_range_t &&range
+  );
+  // コンピュートシェーダが32bit単位で書けるように領域は4の倍数に切り上げる
+  size_t add_converted(
+    buffer_layout_t &layout,
+    converted_range_t &&range
+  );
+  size_t add_draco(
+    buffer_layout_t &layout,
+    draco_range_t &&range
+  );
+  size_t add_optimized_index(
+    buffer_layout_t &layout,
+    optimized_index_t &&index
+  );
+  // 各levelのtarget個分の領域を確保してoffsetを埋め、layout.lod内の番号を返す
+  size_t add_lod(
+    buffer_layout_t &layout,
+    lod_range_t &&range
+  );
+  // インデックスのバッファのhlodに加えてその中での番号を返す 領域はplace_hlodで確保する
+  size_t add_hlod(
+    buffer_layouts_t &layouts,
+    hlod_range_t &&range
+  );
+  // hlodのcountとused_vertex_count個分の領域を頂点とインデックスのバッファの末尾に確保してoffsetを埋める
+  // create_bufferが簡略化の後に呼ぶ キャッシュから読む場合は記録された数で呼ぶ
+  void place_hlod(
+    buffer_layouts_t &layouts
+  );
+  // 生成したLODとHLODのインデックスの数と誤差はlayoutsに書き戻す
+  // contentがnullptrでなければlayout毎に転送した内容をcontentに書き出す
   buffers_t create_buffer(
     const fx::gltf::Document &doc,
     const vw::context_t &context,
-    const std::filesystem::path cd
+    const std::filesystem::path cd,
+    const glb_t &glb,
+    buffer_layouts_t &layouts,
+    std::vector< std::vector< uint8_t > > *content = nullptr
   );
 }
 #endif
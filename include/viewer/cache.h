@@ -0,0 +1,95 @@
+#ifndef VIEWER_CACHE_H
+#define VIEWER_CACHE_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <fx/gltf.h>
+#include <vw/context.h>
+#include <vw/image.h>
+#include <vw/mapped_file.h>
+#include <viewer/buffer.h>
+#include <viewer/mesh.h>
+namespace viewer {
+  // キャッシュのファイルの形式を変えた場合は上げる
+  constexpr uint32_t scene_cache_version = 3u;
+  constexpr uint32_t image_cache_version = 1u;
+  // 転送するbufferの内容と、読み込み時に生成したmeshlet、LOD、HLODの結果
+  // 内容はマップしたファイルをそのまま指す
+  struct scene_cache_t {
+    LIBSTAMP_SETTER( file )
+    LIBSTAMP_SETTER( content )
+    vw::mapped_file_t file;
+    std::vector< std::pair< const uint8_t*, const uint8_t* > > content;
+  };
+  // glTFとそれが参照するbufferのファイルの内容、読み込みのオプション、デバイスが頂点バッファに使える形式から作るキー
+  // イメージはデコードした結果を個別にキャッシュするのでキーに含めない
+  uint64_t get_scene_cache_key(
+    const fx::gltf::Document &doc,
+    const std::filesystem::path &path,
+    const load_options_t &options,
+    const vw::context_t &context
+  );
+  std::filesystem::path get_scene_cache_path(
+    const std::filesystem::path &cache_dir,
+    uint64_t key
+  );
+  // キャッシュが無いか、キー、版、layoutsの大きさが合わない場合はstd::nulloptを返す
+  // 使える場合はcreate_bufferが生成する結果をlayoutsに書き戻す
+  std::optional< scene_cache_t > load_scene_cache(
+    const std::filesystem::path &filename,
+    uint64_t key,
+    buffer_layouts_t &layouts
+  );
+  // contentはcreate_bufferが書き出したlayout毎の内容
+  void save_scene_cache(
+    const std::filesystem::path &filename,
+    uint64_t key,
+    const buffer_layouts_t &layouts,
+    const std::vector< std::vector< uint8_t > > &content
+  );
+  buffers_t load_cached_buffer(
+    const vw::context_t &context,
+    const buffer_layouts_t &layouts,
+    const scene_cache_t &cache
+  );
+  // エンコードされたイメージの内容から作るデコード結果のキャッシュのファイル名
+  std::filesystem::path get_image_cache_path(
+    const std::filesystem::path &cache_dir,
+    const uint8_t *begin,
+    const uint8_t *end
+  );
+  std::optional< vw::pixels_t > load_image_cache(
+    const std::filesystem::path &filename,
+    const std::function< std::shared_ptr< void >( size_t ) > &reserve
+  );
+  void save_image_cache(
+    const std::filesystem::path &filename,
+    const vw::pixels_t &pixels
+  );
+}
+#endif
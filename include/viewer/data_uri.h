@@ -0,0 +1,45 @@
+#ifndef VIEWER_DATA_URI_H
+#define VIEWER_DATA_URI_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <string>
+#include <optional>
+#include <stamp/setter.h>
+namespace viewer {
+  // data:[<media type>];base64,<data>
+  struct data_uri_t {
+    data_uri_t() : begin( nullptr ), end( nullptr ) {}
+    LIBSTAMP_SETTER( media_type )
+    LIBSTAMP_SETTER( begin )
+    LIBSTAMP_SETTER( end )
+    std::string media_type;
+    const char *begin;
+    const char *end;
+  };
+  std::optional< data_uri_t > parse_data_uri(
+    const std::string &uri
+  );
+  std::string get_extension(
+    const std::string &media_type
+  );
+}
+#endif
@@ -22,9 +22,11 @@
  * IN THE SOFTWARE.
  */
 #include <vector>
+#include <memory>
 #include <vulkan/vulkan.hpp>
 #include <stamp/setter.h>
 #include <vw/context.h>
+#include <vw/config.h>
 #include <vw/render_pass.h>
 #include <viewer/mesh.h>
 #include <viewer/light.h>
@@ -35,8 +37,10 @@
 #include <viewer/texture.h>
 #include <viewer/node.h>
 #include <viewer/shader.h>
+#include <viewer/hlod.h>
 namespace viewer {
   struct document_t {
+    document_t() : texture_revision( 0u ) {}
     LIBSTAMP_SETTER( shader )
     LIBSTAMP_SETTER( mesh )
     LIBSTAMP_SETTER( point_light )
@@ -47,6 +51,11 @@ namespace viewer {
     LIBSTAMP_SETTER( image )
     LIBSTAMP_SETTER( texture )
     LIBSTAMP_SETTER( node )
+    LIBSTAMP_SETTER( hlod )
+    LIBSTAMP_SETTER( placeholder )
+    LIBSTAMP_SETTER( image_loader )
+    LIBSTAMP_SETTER( texture_revision )
+    LIBSTAMP_SETTER( applied_texture_revision )
     shader_t shader;
     meshes_t mesh;
     point_lights_t point_light;
@@ -57,8 +66,41 @@ namespace viewer {
     images_t image;
     textures_t texture;
     node_t node;
+    // load_options_tでhlodを指定した場合だけ作る
+    hlod_t hlod;
+    placeholder_t placeholder;
+    std::shared_ptr< image_loader_t > image_loader;
+    uint32_t texture_revision;
+    std::vector< uint32_t > applied_texture_revision;
   };
+  load_options_t get_load_options(
+    const vw::configs_t &config
+  );
+  document_t load_gltf(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    std::filesystem::path path,
+    uint32_t swapchain_size,
+    const std::filesystem::path &shader_dir,
+    int shader_mask,
+    const std::vector< std::vector< viewer::texture_t > >&,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    float aspect_ratio
+  );
   document_t load_gltf(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    std::filesystem::path path,
+    uint32_t swapchain_size,
+    const std::filesystem::path &shader_dir,
+    int shader_mask,
+    const std::vector< std::vector< viewer::texture_t > >&,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    float aspect_ratio,
+    const load_options_t &options
+  );
+  // テクスチャ以外を読み込んだ時点で返り、イメージはupdate_documentを呼ぶ度に届いた物から反映される
+  document_t load_gltf_async(
     const vw::context_t &context,
     const std::vector< vw::render_pass_t > &render_pass,
     std::filesystem::path path,
@@ -69,6 +111,24 @@ namespace viewer {
     const std::vector< buffer_t > &dynamic_uniform_buffer,
     float aspect_ratio
   );
+  document_t load_gltf_async(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    std::filesystem::path path,
+    uint32_t swapchain_size,
+    const std::filesystem::path &shader_dir,
+    int shader_mask,
+    const std::vector< std::vector< viewer::texture_t > >&,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    float aspect_ratio,
+    const load_options_t &options
+  );
+  // current_frameのフェンスを待った後、コマンドを記録する前に呼ぶ
+  bool update_document(
+    const vw::context_t &context,
+    document_t &document,
+    uint32_t current_frame
+  );
 }
 #endif
 
@@ -0,0 +1,48 @@
+#ifndef VIEWER_GLB_H
+#define VIEWER_GLB_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <filesystem>
+#include <fx/gltf.h>
+#include <stamp/setter.h>
+#include <vw/mapped_file.h>
+namespace viewer {
+  struct glb_t {
+    glb_t() : json_begin( nullptr ), json_end( nullptr ), bin_begin( nullptr ), bin_end( nullptr ) {}
+    LIBSTAMP_SETTER( file )
+    LIBSTAMP_SETTER( json_begin )
+    LIBSTAMP_SETTER( json_end )
+    LIBSTAMP_SETTER( bin_begin )
+    LIBSTAMP_SETTER( bin_end )
+    vw::mapped_file_t file;
+    const uint8_t *json_begin;
+    const uint8_t *json_end;
+    const uint8_t *bin_begin;
+    const uint8_t *bin_end;
+  };
+  enum class json_parser_t;
+  bool is_glb( const std::filesystem::path &path );
+  glb_t map_glb( const std::filesystem::path &path );
+  fx::gltf::Document parse_glb( const glb_t &glb, json_parser_t parser );
+}
+#endif
+
@@ -0,0 +1,126 @@
+#ifndef VIEWER_HLOD_H
+#define VIEWER_HLOD_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <fx/gltf.h>
+#include <stamp/setter.h>
+#include <vw/context.h>
+#include <vw/render_pass.h>
+#include <vw/image.h>
+#include <viewer/buffer.h>
+#include <viewer/sampler.h>
+#include <viewer/texture.h>
+#include <viewer/shader.h>
+#include <viewer/mesh.h>
+#include <viewer/node.h>
+namespace viewer {
+  // 葉のクラスタに入れるインスタンスの数の上限
+  constexpr size_t hlod_leaf_size = 8u;
+  // 1つのクラスタを分ける数 2の冪にする
+  constexpr size_t hlod_branches = 8u;
+  // メッシュを持つノードのシーン中での配置
+  struct hlod_instance_t {
+    hlod_instance_t() : matrix( 1.f ), mesh( 0 ) {}
+    LIBSTAMP_SETTER( matrix )
+    LIBSTAMP_SETTER( mesh )
+    glm::mat4 matrix;
+    int32_t mesh;
+  };
+  // 空間的に近いインスタンスをまとめたクラスタ
+  // 子を持つクラスタは子孫の全てのインスタンスを1つにまとめて簡略化した代理メッシュを持つ
+  struct hlod_cluster_t {
+    hlod_cluster_t() : range( -1 ), proxy( -1 ), error( 0.f ), min( 0.f, 0.f, 0.f ), max( 0.f, 0.f, 0.f ) {}
+    LIBSTAMP_SETTER( child )
+    LIBSTAMP_SETTER( instance )
+    LIBSTAMP_SETTER( range )
+    LIBSTAMP_SETTER( proxy )
+    LIBSTAMP_SETTER( error )
+    LIBSTAMP_SETTER( min )
+    LIBSTAMP_SETTER( max )
+    std::vector< uint32_t > child;
+    // 葉のクラスタだけが持つ
+    std::vector< hlod_instance_t > instance;
+    // インデックスのバッファのhlod[range]で代理メッシュを作る 負の場合は代理メッシュを作らない
+    int32_t range;
+    // hlod_t::proxy[proxy]が代理メッシュ 負の場合は常に子を描く
+    int32_t proxy;
+    // 代理メッシュと子孫の代理メッシュのシーンの座標系での元の形状からの距離の最大値
+    float error;
+    // シーンの座標系での範囲
+    glm::vec3 min;
+    glm::vec3 max;
+  };
+  struct hlod_t {
+    LIBSTAMP_SETTER( cluster )
+    LIBSTAMP_SETTER( palette )
+    LIBSTAMP_SETTER( palette_texture )
+    LIBSTAMP_SETTER( proxy )
+    // 先頭が根 子は親より後に並ぶ
+    std::vector< hlod_cluster_t > cluster;
+    // マテリアル毎のベースカラーを1texelずつ横に並べたテクスチャ 代理メッシュはこれをベースカラーのテクスチャとして共有する
+    vw::image_t palette;
+    texture_t palette_texture;
+    std::vector< primitive_t > proxy;
+  };
+  // ノードの木を平らにしてインスタンスを空間的にクラスタに分け、代理メッシュをlayoutsに加える
+  // 代理メッシュの領域は簡略化した後にcreate_bufferが確保する
+  // create_meshにhlodを指定したload_options_tを渡した後、create_bufferの前に呼ぶ
+  hlod_t create_hlod_cluster(
+    const fx::gltf::Document &doc,
+    const node_t &node,
+    const meshes_t &meshes,
+    buffer_layouts_t &layouts
+  );
+  // create_bufferで生成した代理メッシュを描くプリミティブとパレットを作る
+  void create_hlod_proxy(
+    const fx::gltf::Document &doc,
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    uint32_t push_constant_size,
+    const shader_t &shader,
+    uint32_t swapchain_size,
+    const std::vector< std::vector< viewer::texture_t > >&,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const sampler_t &sampler,
+    const buffer_layouts_t &layouts,
+    hlod_t &hlod
+  );
+  // draw_nodeの代わりに使い、誤差が画面上でlodのthreshold以下になるクラスタは子孫を描かずに代理メッシュを描く
+  // cullingが有効な場合は視錐台の外にあるクラスタを描かない
+  void draw_hlod(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const hlod_t &hlod,
+    const meshes_t &meshes,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod,
+    const meshlet_culling_t &culling
+  );
+}
+#endif
@@ -22,18 +22,64 @@
  * IN THE SOFTWARE.
  */
 #include <vector>
+#include <memory>
+#include <string>
 #include <filesystem>
 #include <vulkan/vulkan.hpp>
 #include <fx/gltf.h>
 #include <vw/image.h>
+#include <vw/decode_queue.h>
+#include <vw/file_reader.h>
 namespace viewer {
   struct image_t {
+    LIBSTAMP_SETTER( image )
     LIBSTAMP_SETTER( unorm )
     LIBSTAMP_SETTER( srgb )
-    vw::image_t unorm;
-    vw::image_t srgb;
+    vw::image_t image;
+    vk::UniqueHandle< vk::ImageView, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > unorm;
+    vk::UniqueHandle< vk::ImageView, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > srgb;
   };
   using images_t = std::vector< image_t >;
+  struct view_usage_t {
+    view_usage_t() : unorm( false ), srgb( false ) {}
+    LIBSTAMP_SETTER( unorm )
+    LIBSTAMP_SETTER( srgb )
+    bool unorm;
+    bool srgb;
+  };
+  // バックグラウンドでデコード中のイメージ
+  struct image_loader_t {
+    LIBSTAMP_SETTER( path )
+    LIBSTAMP_SETTER( usage )
+    LIBSTAMP_SETTER( queue )
+    LIBSTAMP_SETTER( reader )
+    std::vector< std::string > path;
+    std::vector< view_usage_t > usage;
+    std::shared_ptr< vw::decode_queue_t > queue;
+    std::shared_ptr< vw::file_reader_t > reader;
+  };
+  // デコードするスレッドがイメージファイルをreaderで読んでデコードする
+  // ファイルの内容もデコード先と同じくデコードに使うメモリの上限に数える
+  // cache_dirが空でなければデコードした結果をそこに保存し、次回からはデコードせずに読む
+  std::shared_ptr< image_loader_t > start_image_loading(
+    const fx::gltf::Document &doc,
+    const std::filesystem::path cd,
+    const std::shared_ptr< vw::file_reader_t > &reader,
+    size_t thread_count,
+    const std::filesystem::path &cache_dir
+  );
+  std::vector< size_t > update_image(
+    const vw::context_t &context,
+    image_loader_t &loader,
+    images_t &images,
+    size_t budget
+  );
+  // 残っている全てのイメージのデコードと転送を待つ
+  std::vector< size_t > finish_image_loading(
+    const vw::context_t &context,
+    image_loader_t &loader,
+    images_t &images
+  );
   images_t create_image(
     const fx::gltf::Document &doc,
     const vw::context_t &context,
@@ -0,0 +1,107 @@
+#ifndef VIEWER_IMPOSTOR_H
+#define VIEWER_IMPOSTOR_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <glm/vec3.hpp>
+#include <stamp/setter.h>
+#include <vw/context.h>
+#include <vw/render_pass.h>
+#include <vw/framebuffer.h>
+#include <vw/pipeline.h>
+#include <viewer/buffer.h>
+#include <viewer/sampler.h>
+#include <viewer/texture.h>
+#include <viewer/mesh.h>
+#include <viewer/node.h>
+#include <viewer/document.h>
+namespace viewer {
+  // 1つのメッシュを水平方向に何方向から焼き込むか shaders/special8.vertと合わせる
+  constexpr uint32_t impostor_views = 8u;
+  // アトラスの1辺に並ぶタイルの数 shaders/special8.vertと合わせる
+  constexpr uint32_t impostor_columns = 16u;
+  // 1方向分のタイルの1辺のピクセル数
+  constexpr uint32_t impostor_tile_size = 64u;
+  struct impostor_atlas_t {
+    LIBSTAMP_SETTER( color )
+    LIBSTAMP_SETTER( normal )
+    LIBSTAMP_SETTER( color_texture )
+    LIBSTAMP_SETTER( normal_texture )
+    LIBSTAMP_SETTER( descriptor_set )
+    // ベースカラーと被覆率
+    vw::framebuffer_t color;
+    // メッシュの座標系での法線を[0,1]に詰めた物と被覆率
+    vw::framebuffer_t normal;
+    texture_t color_texture;
+    texture_t normal_texture;
+    std::vector< descriptor_set_t > descriptor_set;
+  };
+  struct impostor_t {
+    impostor_t() : atlas( -1 ), first_tile( 0u ), center( 0.f, 0.f, 0.f ), radius( 0.f ) {}
+    LIBSTAMP_SETTER( atlas )
+    LIBSTAMP_SETTER( first_tile )
+    LIBSTAMP_SETTER( center )
+    LIBSTAMP_SETTER( radius )
+    // 負の場合はインポスタを持たない
+    int32_t atlas;
+    // first_tileからimpostor_views個のタイルに方向毎の絵が並ぶ
+    uint32_t first_tile;
+    // メッシュの座標系での境界球
+    glm::vec3 center;
+    float radius;
+  };
+  struct impostors_t {
+    LIBSTAMP_SETTER( sampler )
+    LIBSTAMP_SETTER( atlas )
+    LIBSTAMP_SETTER( mesh )
+    LIBSTAMP_SETTER( pipeline )
+    sampler_t sampler;
+    std::vector< impostor_atlas_t > atlas;
+    // 添字がメッシュの番号
+    std::vector< impostor_t > mesh;
+    vw::pipeline_t pipeline;
+  };
+  // 全てのメッシュをrender_pass[ bake_pipeline_index ]でアトラスに焼き込み、render_pass[ draw_pipeline_index ]で描くパイプラインを作る
+  // bake_pipeline_indexのレンダーパスはimpostorを指定して作りload_gltfに渡しておく
+  // テクスチャを参照するのでcurrent_frameのデスクリプタセットにイメージが揃ってから呼ぶ
+  impostors_t create_impostor(
+    const vw::context_t &context,
+    document_t &document,
+    const std::vector< vw::render_pass_t > &render_pass,
+    uint32_t bake_pipeline_index,
+    uint32_t draw_pipeline_index,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    uint32_t current_frame
+  );
+  // draw_nodeがuse_impostorで描かなかったメッシュをカメラの方を向いた四角形で描く
+  void draw_impostor(
+    vk::CommandBuffer &commands,
+    const node_t &node,
+    const meshes_t &meshes,
+    const impostors_t &impostors,
+    uint32_t current_frame,
+    const lod_selector_t &lod
+  );
+}
+#endif
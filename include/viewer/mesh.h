@@ -21,6 +21,7 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <filesystem>
 #include <vulkan/vulkan.hpp>
 #include <glm/mat4x4.hpp>
 #include <glm/vec4.hpp>
@@ -34,6 +35,7 @@
 #include <viewer/texture.h>
 #include <viewer/shader.h>
 #include <viewer/buffer.h>
+#include <viewer/parse.h>
 namespace viewer {
   struct buffer_view_t {
     buffer_view_t() : index( 0 ), offset( 0 ) {}
@@ -42,12 +44,74 @@ namespace viewer {
     uint32_t index;
     uint32_t offset;
   };
+  // 頂点属性をバッファに置く方法
+  enum class vertex_layout_t {
+    // bufferViewをそのまま属性毎のストリームとして使う
+    separate,
+    // 全ての属性を1つのストリームにインターリーブする
+    interleaved,
+    // 位置とそれ以外の属性の2つのストリームにインターリーブする
+    split_position
+  };
+  // 読み込み時に行う変換の指定
+  struct load_options_t {
+    load_options_t() : vertex_layout( vertex_layout_t::separate ), quantize( false ), optimize( false ), lod_levels( 0 ), meshlet( false ), hlod( false ), json_parser( json_parser_t::dom ) {}
+    LIBSTAMP_SETTER( vertex_layout )
+    LIBSTAMP_SETTER( quantize )
+    LIBSTAMP_SETTER( optimize )
+    LIBSTAMP_SETTER( lod_levels )
+    LIBSTAMP_SETTER( meshlet )
+    LIBSTAMP_SETTER( hlod )
+    LIBSTAMP_SETTER( cache_dir )
+    LIBSTAMP_SETTER( json_parser )
+    vertex_layout_t vertex_layout;
+    // 浮動小数点数の頂点属性を位置は16bit unorm、法線と接線は8bit snorm、[0,1]に収まるUVは16bit unormにする
+    bool quantize;
+    // 三角形リストのインデックスを頂点キャッシュとオーバードローに対して並べ替え、頂点を参照される順に並べ直す
+    bool optimize;
+    // 三角形リストを簡略化して作るLODの段数 1段毎に三角形の数を半分にする
+    uint32_t lod_levels;
+    // 三角形リストのインデックスをmeshletの順に並べ替え、meshlet毎に視錐台と裏向きの判定ができるようにする
+    bool meshlet;
+    // 空間的に近いノードのメッシュをまとめて簡略化したHLODの代理メッシュを作る
+    bool hlod;
+    // 空でなければ処理したbufferの内容とデコードしたイメージをこのディレクトリに保存して次回の読み込みで使う
+    std::filesystem::path cache_dir;
+    json_parser_t json_parser;
+  };
+  enum class placeholder_type_t {
+    white,
+    black,
+    normal
+  };
+  struct texture_binding_t {
+    texture_binding_t() : binding( 0 ), texture( 0 ), srgb( false ), placeholder( placeholder_type_t::white ) {}
+    LIBSTAMP_SETTER( binding )
+    LIBSTAMP_SETTER( texture )
+    LIBSTAMP_SETTER( srgb )
+    LIBSTAMP_SETTER( placeholder )
+    uint32_t binding;
+    int32_t texture;
+    bool srgb;
+    placeholder_type_t placeholder;
+  };
   struct descriptor_set_t {
     LIBSTAMP_SETTER( descriptor_set )
     std::vector< vk::UniqueHandle< vk::DescriptorSet, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > descriptor_set;
   };
+  // インデックスのバッファのoffsetからcount個のインデックスで描く簡略化したプリミティブ
+  struct lod_t {
+    lod_t() : offset( 0 ), count( 0 ), error( 0.f ) {}
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( error )
+    uint32_t offset;
+    uint32_t count;
+    // メッシュの座標系での元の形状からの距離
+    float error;
+  };
   struct primitive_t {
-    primitive_t() : indexed( false ), count( 0 ) {}
+    primitive_t() : indexed( false ), count( 0 ), dequantize( 1.f ), double_sided( false ), lod_range( -1 ), generated_index( -1 ), hlod_source( -1 ) {}
     LIBSTAMP_SETTER( pipeline )
     LIBSTAMP_SETTER( vertex_buffer )
     LIBSTAMP_SETTER( indexed )
@@ -58,8 +122,17 @@ namespace viewer {
     LIBSTAMP_SETTER( min )
     LIBSTAMP_SETTER( max )
     LIBSTAMP_SETTER( uniform_buffer )
+    LIBSTAMP_SETTER( texture_binding )
+    LIBSTAMP_SETTER( dequantize )
+    LIBSTAMP_SETTER( double_sided )
+    LIBSTAMP_SETTER( lod_range )
+    LIBSTAMP_SETTER( lod )
+    LIBSTAMP_SETTER( generated_index )
+    LIBSTAMP_SETTER( meshlet )
+    LIBSTAMP_SETTER( hlod_source )
     std::vector< vw::pipeline_t > pipeline;
-    std::unordered_map< uint32_t, buffer_view_t > vertex_buffer;
+    // 添字がバインディングの番号
+    std::vector< buffer_view_t > vertex_buffer;
     bool indexed;
     buffer_view_t index_buffer;
     std::vector< descriptor_set_t > descriptor_set;
@@ -68,6 +141,20 @@ namespace viewer {
     glm::vec3 min;
     glm::vec3 max;
     buffer_t uniform_buffer;
+    std::vector< texture_binding_t > texture_binding;
+    // 量子化した位置を元の座標に戻す行列 描画時にノードの行列に掛ける
+    glm::mat4 dequantize;
+    bool double_sided;
+    // インデックスのバッファのlod[lod_range]から作るLOD 負の場合はLODを作らない
+    int32_t lod_range;
+    // 詳細な物から順に並べる
+    std::vector< lod_t > lod;
+    // インデックスのバッファのoptimized[generated_index]で読み込み時に作ったインデックス 負の場合はbufferViewをそのまま使う
+    int32_t generated_index;
+    // offsetとcountはこのプリミティブのインデックスの中での位置
+    std::vector< meshlet_t > meshlet;
+    // インデックスのバッファのhlod_source[hlod_source]でHLODの代理メッシュに取り込む 負の場合は取り込めない
+    int32_t hlod_source;
   };
   struct uniforms_t {
     LIBSTAMP_SETTER( base_color )
@@ -120,14 +207,51 @@ namespace viewer {
     std::array< float, 5u > light_z;
   };
   struct mesh_t {
+    mesh_t() : impostor( false ) {}
     LIBSTAMP_SETTER( primitive )
     LIBSTAMP_SETTER( min )
     LIBSTAMP_SETTER( max )
+    LIBSTAMP_SETTER( impostor )
     std::vector< primitive_t > primitive;
     glm::vec3 min;
     glm::vec3 max;
+    // create_impostorでインポスタを焼き込んだ場合はtrue
+    bool impostor;
   };
   using meshes_t = std::vector< mesh_t >;
+  // 読み込み時に作った頂点とインデックスで描くプリミティブを作る
+  // 頂点はhlod_vertex_strideバイト毎に位置、法線、テクスチャの座標をfloatで詰めた物で、テクスチャはベースカラーだけを使う
+  primitive_t create_generated_primitive(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    uint32_t push_constant_size,
+    const shader_t &shader,
+    uint32_t swapchain_size,
+    const std::vector< std::vector< viewer::texture_t > >&,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const uniforms_t &uniforms,
+    const texture_t &base_color,
+    bool double_sided,
+    const buffer_view_t &vertex_buffer,
+    const buffer_view_t &index_buffer,
+    uint32_t count,
+    const glm::vec3 &min,
+    const glm::vec3 &max
+  );
+  void update_texture_descriptor_set(
+    const vw::context_t &context,
+    const primitive_t &primitive,
+    const textures_t &textures,
+    const placeholder_t &placeholder,
+    uint32_t frame
+  );
+  void update_texture_descriptor_set(
+    const vw::context_t &context,
+    const meshes_t &meshes,
+    const textures_t &textures,
+    const placeholder_t &placeholder,
+    uint32_t frame
+  );
   mesh_t create_mesh(
     const fx::gltf::Document &doc,
     int32_t index,
@@ -139,7 +263,9 @@ namespace viewer {
     uint32_t swapchain_size,
     int shader_mask,
     const std::vector< std::vector< viewer::texture_t > >&,
-    const std::vector< buffer_t > &dynamic_uniform_buffer
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const load_options_t &options,
+    buffer_layouts_t &layouts
   );
   meshes_t create_mesh(
     const fx::gltf::Document &doc,
@@ -151,7 +277,19 @@ namespace viewer {
     uint32_t swapchain_size,
     int shader_mask,
     const std::vector< std::vector< viewer::texture_t > >&,
-    const std::vector< buffer_t > &dynamic_uniform_buffer
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const load_options_t &options,
+    buffer_layouts_t &layouts
+  );
+  // create_bufferで生成したLODをプリミティブに反映する
+  void update_lod(
+    meshes_t &meshes,
+    const buffer_layouts_t &layouts
+  );
+  // create_bufferで生成したmeshletをプリミティブに反映する
+  void update_meshlet(
+    meshes_t &meshes,
+    const buffer_layouts_t &layouts
   );
 }
 #endif
@@ -0,0 +1,53 @@
+#ifndef VIEWER_MESHLET_H
+#define VIEWER_MESHLET_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace viewer {
+  constexpr size_t default_meshlet_vertices = 64u;
+  constexpr size_t default_meshlet_triangles = 124u;
+  // インデックスのoffset番目からcount個で描く三角形のまとまり
+  struct meshlet_t {
+    uint32_t offset;
+    uint32_t count;
+    std::array< float, 3u > center;
+    float radius;
+    // 全ての三角形の法線がaxisからなす角の範囲 視点から見て全て裏を向いている場合に描かずに済ませるのに使う
+    // dot( center - eye, axis ) >= cutoff * length( center - eye ) + radiusなら全ての三角形が裏を向いている
+    std::array< float, 3u > axis;
+    float cutoff;
+  };
+  // 頂点がmax_vertices個以下、三角形がmax_triangles個以下になるように隣接する三角形をまとめ、まとめた三角形が連続するようにindexを並べ替える
+  // positionはstrideバイト毎に並んだfloatの3要素
+  std::vector< meshlet_t > build_meshlets(
+    std::vector< uint32_t > &index,
+    const uint8_t *position,
+    size_t stride,
+    size_t vertex_count,
+    size_t max_vertices = default_meshlet_vertices,
+    size_t max_triangles = default_meshlet_triangles
+  );
+}
+#endif
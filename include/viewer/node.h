@@ -69,6 +69,85 @@ namespace viewer {
     const vw::context_t &context,
     const meshes_t &mesh
   );
+  // 誤差が画面上でこのピクセル数以下になる最も粗いLODを選ぶ
+  constexpr float default_lod_threshold = 1.f;
+  // 影の輪郭の崩れは目立ちにくいので影を描くパスではより粗いLODを選ぶ
+  constexpr float default_shadow_lod_threshold = 4.f;
+  // draw_nodeがプリミティブ毎にLODを選ぶ基準
+  struct lod_selector_t {
+    lod_selector_t() : eye( 0.f, 0.f, 0.f ), pixels_per_unit( 0.f ), orthographic( false ), threshold( 0.f ), impostor_distance( 0.f ) {}
+    LIBSTAMP_SETTER( eye )
+    LIBSTAMP_SETTER( pixels_per_unit )
+    LIBSTAMP_SETTER( orthographic )
+    LIBSTAMP_SETTER( threshold )
+    LIBSTAMP_SETTER( impostor_distance )
+    glm::vec3 eye;
+    // 視点からの距離が1の位置で長さ1が画面上で何ピクセルになるか 平行投影では距離に依らない
+    float pixels_per_unit;
+    bool orthographic;
+    // 0の場合は常に元のプリミティブを描く
+    float threshold;
+    // 境界球の中心が視点からこれより遠いメッシュはdraw_nodeで描かずにdraw_impostorで描く 0の場合はインポスタを使わない
+    float impostor_distance;
+  };
+  // heightは描画先のピクセル数での高さ
+  lod_selector_t get_lod_selector(
+    const glm::mat4 &projection,
+    const glm::mat4 &camera,
+    uint32_t height,
+    float threshold = default_lod_threshold
+  );
+  lod_selector_t get_shadow_lod_selector(
+    const glm::mat4 &projection,
+    const glm::mat4 &camera,
+    uint32_t height,
+    float threshold = default_shadow_lod_threshold
+  );
+  // プリミティブのパイプラインとデスクリプタセット、頂点バッファを設定する インデックスのバッファは呼び出し側で設定する
+  void bind_primitive(
+    vk::CommandBuffer &commands,
+    const primitive_t &primitive,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const glm::mat4 &matrix,
+    int32_t fid
+  );
+  bool use_impostor(
+    const mesh_t &mesh,
+    const glm::mat4 &matrix,
+    const lod_selector_t &selector
+  );
+  // draw_nodeでmeshlet毎に視錐台の外にある物と全ての三角形が裏を向いている物を描かずに済ませる基準
+  struct meshlet_culling_t {
+    meshlet_culling_t() : enabled( false ), view_projection( 1.f ), eye( 0.f, 0.f, 0.f ), back_side( false ) {}
+    LIBSTAMP_SETTER( enabled )
+    LIBSTAMP_SETTER( view_projection )
+    LIBSTAMP_SETTER( eye )
+    LIBSTAMP_SETTER( back_side )
+    bool enabled;
+    glm::mat4 view_projection;
+    glm::vec3 eye;
+    // 表面をカリングして裏面を描くパスではtrueにし、全ての三角形が表を向いているmeshletを除く
+    bool back_side;
+  };
+  meshlet_culling_t get_meshlet_culling(
+    const glm::mat4 &projection,
+    const glm::mat4 &camera,
+    bool back_side = false
+  );
+  // 1つのメッシュをmatrixの位置に描く use_impostorが真になるメッシュは描かない
+  void draw_mesh(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const mesh_t &mesh,
+    const glm::mat4 &matrix,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod,
+    const meshlet_culling_t &culling
+  );
   void draw_node(
     const vw::context_t &context,
     vk::CommandBuffer &commands,
@@ -78,6 +157,27 @@ namespace viewer {
     uint32_t current_frame,
     uint32_t pipeline_index
   );
+  void draw_node(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const node_t &node,
+    const meshes_t &meshes,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod
+  );
+  void draw_node(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const node_t &node,
+    const meshes_t &meshes,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod,
+    const meshlet_culling_t &culling
+  );
   point_lights_t get_point_lights(
     const node_t &node,
     const point_lights_t &lights
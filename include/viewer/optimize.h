@@ -0,0 +1,73 @@
+#ifndef VIEWER_OPTIMIZE_H
+#define VIEWER_OPTIMIZE_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace viewer {
+  constexpr size_t default_vertex_cache_size = 16u;
+  // クラスタを分割しても頂点キャッシュの効率がこの割合より悪くならないようにする
+  constexpr float default_overdraw_threshold = 1.05f;
+  // 三角形リストを大きさcache_sizeのFIFOの頂点キャッシュで処理した時の三角形あたりのキャッシュミスの数
+  float get_acmr(
+    const std::vector< uint32_t > &index,
+    size_t vertex_count,
+    size_t cache_size = default_vertex_cache_size
+  );
+  // Tipsifyで頂点キャッシュに載っている頂点を使う三角形が続くように並べ替える
+  std::vector< uint32_t > optimize_vertex_cache(
+    const std::vector< uint32_t > &index,
+    size_t vertex_count,
+    size_t cache_size = default_vertex_cache_size
+  );
+  // 頂点キャッシュの最適化の結果をクラスタに分け、外側を向いたクラスタが先に描かれるように並べ替える
+  // positionはstrideバイト毎に並んだfloatの3要素
+  std::vector< uint32_t > optimize_overdraw(
+    const std::vector< uint32_t > &index,
+    const uint8_t *position,
+    size_t stride,
+    size_t vertex_count,
+    size_t cache_size = default_vertex_cache_size,
+    float threshold = default_overdraw_threshold
+  );
+  // 頂点を初めて参照される順に並べ直してindexを書き換え、新しい頂点番号から元の頂点番号への対応を返す
+  // 参照されない頂点は末尾に置く
+  std::vector< uint32_t > optimize_vertex_fetch(
+    std::vector< uint32_t > &index,
+    size_t vertex_count
+  );
+  struct optimized_indices_t {
+    std::vector< uint32_t > index;
+    std::vector< uint32_t > remap;
+    float acmr_before;
+    float acmr_after;
+  };
+  // positionがnullptrの場合はオーバードロー向けの並べ替えを行わない
+  optimized_indices_t optimize_indices(
+    const std::vector< uint32_t > &index,
+    const uint8_t *position,
+    size_t stride,
+    size_t vertex_count
+  );
+}
+#endif
@@ -0,0 +1,58 @@
+#ifndef VIEWER_PARSE_H
+#define VIEWER_PARSE_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <filesystem>
+#include <string>
+#include <fx/gltf.h>
+#include <viewer/glb.h>
+namespace viewer {
+  enum class json_parser_t {
+    // nlohmann::jsonでDOMを作ってからfx::gltfで変換する
+    dom,
+    // 要素の多いnodes, meshes, accessors, bufferViewsはDOMを作らずに直接読む
+    lean
+  };
+  fx::gltf::Document parse_gltf(
+    const uint8_t *begin,
+    const uint8_t *end,
+    json_parser_t parser = json_parser_t::dom
+  );
+  fx::gltf::Document parse_gltf_lean(
+    const uint8_t *begin,
+    const uint8_t *end
+  );
+  // extensionsAndExtrasからnameの拡張を取り出す 無ければnullptr
+  const nlohmann::json *get_extension(
+    const nlohmann::json &extensions_and_extras,
+    const std::string &name
+  );
+  // EXT_meshopt_compressionで展開後のデータの置き場所としてだけ使われるbuffer
+  bool is_fallback_buffer( const fx::gltf::Buffer &buffer );
+  fx::gltf::Document load_document(
+    const std::filesystem::path &path,
+    glb_t &glb,
+    json_parser_t parser = json_parser_t::dom
+  );
+}
+#endif
+
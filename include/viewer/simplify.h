@@ -0,0 +1,49 @@
+#ifndef VIEWER_SIMPLIFY_H
+#define VIEWER_SIMPLIFY_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+namespace viewer {
+  // 頂点属性の差を位置の誤差に換算する際の、メッシュの大きさに対する比率
+  constexpr float default_attribute_weight = 0.05f;
+  struct simplified_indices_t {
+    std::vector< uint32_t > index;
+    // 元のメッシュの面からの距離で表した誤差の最大値
+    float error;
+  };
+  // 二次誤差を使った辺の縮約で三角形リストを簡略化し、target_index_countの各要素以下のインデックス数になった時点の結果を返す
+  // target_index_countは降順で並べておく 境界の頂点は動かさないので目標に届かなかった場合はそれより多いインデックスが返る
+  // positionは頂点毎にfloatの3要素、attributeは頂点毎にfloatのattribute_count要素を詰めて並べる
+  // 同じ位置にある属性の異なる頂点は継ぎ目として扱い、継ぎ目に沿わない縮約は行わない
+  std::vector< simplified_indices_t > simplify(
+    const std::vector< uint32_t > &index,
+    const float *position,
+    const float *attribute,
+    size_t attribute_count,
+    size_t vertex_count,
+    const std::vector< size_t > &target_index_count,
+    float attribute_weight = default_attribute_weight
+  );
+}
+#endif
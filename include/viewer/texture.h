@@ -30,10 +30,28 @@
 #include <viewer/sampler.h>
 namespace viewer {
   struct texture_t {
+    texture_t() : source( -1 ) {}
     LIBSTAMP_SETTER( unorm )
     LIBSTAMP_SETTER( srgb )
+    LIBSTAMP_SETTER( source )
     vk::DescriptorImageInfo unorm;
     vk::DescriptorImageInfo srgb;
+    int32_t source;
+  };
+  // イメージの読み込みが終わるまでの間テクスチャの代わりに使う1x1のテクスチャ
+  struct placeholder_t {
+    LIBSTAMP_SETTER( white )
+    LIBSTAMP_SETTER( black )
+    LIBSTAMP_SETTER( normal )
+    LIBSTAMP_SETTER( white_texture )
+    LIBSTAMP_SETTER( black_texture )
+    LIBSTAMP_SETTER( normal_texture )
+    vw::image_t white;
+    vw::image_t black;
+    vw::image_t normal;
+    texture_t white_texture;
+    texture_t black_texture;
+    texture_t normal_texture;
   };
   using textures_t = std::vector< texture_t >;
   texture_t create_texture(
@@ -62,6 +80,14 @@ namespace viewer {
     const samplers_t &samplers,
     const sampler_t &default_samplers
   );
+  void update_texture(
+    texture_t &texture,
+    const image_t &image
+  );
+  placeholder_t create_placeholder(
+    const vw::context_t &context,
+    const sampler_t &sampler
+  );
 }
 #endif
 
@@ -0,0 +1,35 @@
+#ifndef VW_BASE64_H
+#define VW_BASE64_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstddef>
+#include <cstdint>
+namespace vw {
+  size_t get_base64_decoded_size( const char *begin, const char *end );
+  // [begin,end)をデコードしてoutに書き込み、書き込んだバイト数を返す
+  // outにはget_base64_decoded_sizeバイトの領域が必要
+  size_t decode_base64( const char *begin, const char *end, uint8_t *out );
+  size_t decode_base64_scalar( const char *begin, const char *end, uint8_t *out );
+  // デコード結果のうち[offset,offset+size)の部分だけをoutに書き込む
+  void decode_base64( const char *begin, const char *end, size_t offset, size_t size, uint8_t *out );
+}
+#endif
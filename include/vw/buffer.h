@@ -22,7 +22,9 @@
  * IN THE SOFTWARE.
  */
 #include <memory>
+#include <functional>
 #include <string>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 #include <vw/context.h>
 #include <vw/exceptions.h>
@@ -35,6 +37,20 @@ namespace vw {
     std::shared_ptr< vk::Buffer > buffer;
     std::shared_ptr< VmaAllocation > allocation;
   };
+  // fillが設定されている場合はbegin,endの代わりにfillでsizeバイトを生成する
+  struct buffer_region_t {
+    buffer_region_t() : begin( nullptr ), end( nullptr ), offset( 0 ), size( 0 ) {}
+    LIBSTAMP_SETTER( begin )
+    LIBSTAMP_SETTER( end )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( size )
+    LIBSTAMP_SETTER( fill )
+    const uint8_t *begin;
+    const uint8_t *end;
+    size_t offset;
+    size_t size;
+    std::function< void( size_t, size_t, uint8_t* ) > fill;
+  };
   buffer_t get_buffer(
     const context_t &context,
     const vk::BufferCreateInfo &buffer_create_info,
@@ -44,6 +60,18 @@ namespace vw {
     const vk::CommandBuffer &commands,
     const buffer_t &buffer
   );
+  buffer_t load_buffer(
+    const context_t &context,
+    const std::vector< buffer_region_t > &regions,
+    size_t size,
+    vk::BufferUsageFlags usage
+  );
+  buffer_t load_buffer(
+    const context_t &context,
+    const uint8_t *begin,
+    const uint8_t *end,
+    vk::BufferUsageFlags usage
+  );
   buffer_t load_buffer(
     const context_t &context,
     const std::vector< uint8_t > &data,
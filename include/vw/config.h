@@ -25,7 +25,7 @@
 #include <stamp/setter.h>
 namespace vw {
   struct configs_t {
-    configs_t() : list( false ), device_index( 0 ), width( 0 ), height( 0 ), fullscreen( false ), validation( false ), direct( false ), purple( false ), light( false ), shader_mask( 0 ) {}
+    configs_t() : list( false ), device_index( 0 ), width( 0 ), height( 0 ), fullscreen( false ), validation( false ), direct( false ), purple( false ), light( false ), shader_mask( 0 ), vertex_layout( "separate" ), quantize( false ), optimize( false ), lod_levels( 0 ), meshlet( false ), impostor_distance( 0.f ), hlod( false ), json_parser( "dom" ) {}
     LIBSTAMP_SETTER( prog_name )
     LIBSTAMP_SETTER( list )
     LIBSTAMP_SETTER( device_index )
@@ -40,6 +40,15 @@ namespace vw {
     LIBSTAMP_SETTER( light )
     LIBSTAMP_SETTER( shader )
     LIBSTAMP_SETTER( shader_mask )
+    LIBSTAMP_SETTER( vertex_layout )
+    LIBSTAMP_SETTER( quantize )
+    LIBSTAMP_SETTER( optimize )
+    LIBSTAMP_SETTER( lod_levels )
+    LIBSTAMP_SETTER( meshlet )
+    LIBSTAMP_SETTER( impostor_distance )
+    LIBSTAMP_SETTER( hlod )
+    LIBSTAMP_SETTER( cache )
+    LIBSTAMP_SETTER( json_parser )
     std::string prog_name; 
     bool list;
     unsigned int device_index;
@@ -54,6 +63,15 @@ namespace vw {
     bool light;
     std::string shader;
     int shader_mask;
+    std::string vertex_layout;
+    bool quantize;
+    bool optimize;
+    unsigned int lod_levels;
+    bool meshlet;
+    float impostor_distance;
+    bool hlod;
+    std::string cache;
+    std::string json_parser;
   };
   configs_t parse_configs( int argc, const char *argv[] );
 }
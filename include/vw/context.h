@@ -21,6 +21,8 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <string>
+#include <filesystem>
 #include <vector>
 #include <memory>
 #include <variant>
@@ -82,20 +84,25 @@ namespace vw {
     bool left;
     bool right;
   };
+  class uploader_t;
+  class converter_t;
+  class pipeline_registry_t;
   struct window_info_t {
     LIBSTAMP_SETTER( window )
     std::shared_ptr< GLFWwindow > window;
   };
   struct context_t {
-    context_t() : graphics_queue_index( 0 ), present_queue_index( 0 ), surface_format( vk::Format::eUndefined ), swapchain_image_count( 0 ), width( 0 ), height( 0 ), input_state( new input_state_t() ) {}
+    context_t() : graphics_queue_index( 0 ), present_queue_index( 0 ), transfer_queue_index( 0 ), surface_format( vk::Format::eUndefined ), swapchain_image_count( 0 ), warm_pipeline_cache( false ), width( 0 ), height( 0 ), input_state( new input_state_t() ) {}
     LIBSTAMP_SETTER( physical_device )
     LIBSTAMP_SETTER( surface )
     LIBSTAMP_SETTER( window )
     LIBSTAMP_SETTER( graphics_queue_index )
     LIBSTAMP_SETTER( present_queue_index )
+    LIBSTAMP_SETTER( transfer_queue_index )
     LIBSTAMP_SETTER( device )
     LIBSTAMP_SETTER( graphics_command_pool )
     LIBSTAMP_SETTER( present_command_pool )
+    LIBSTAMP_SETTER( transfer_command_pool )
     LIBSTAMP_SETTER( surface_format )
     LIBSTAMP_SETTER( swapchain_extent )
     LIBSTAMP_SETTER( swapchain_image_count )
@@ -105,17 +112,25 @@ namespace vw {
     LIBSTAMP_SETTER( descriptor_set )
     LIBSTAMP_SETTER( allocator )
     LIBSTAMP_SETTER( pipeline_cache )
+    LIBSTAMP_SETTER( pipeline_registry )
+    LIBSTAMP_SETTER( pipeline_cache_path )
+    LIBSTAMP_SETTER( warm_pipeline_cache )
     LIBSTAMP_SETTER( width )
     LIBSTAMP_SETTER( height )
     LIBSTAMP_SETTER( input_state )
+    LIBSTAMP_SETTER( vertex_buffer_formats )
+    LIBSTAMP_SETTER( converter )
+    LIBSTAMP_SETTER( uploader )
     vk::PhysicalDevice physical_device;
     vk::UniqueHandle<vk::SurfaceKHR, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > surface;
     std::variant< display_info_t, window_info_t > window;
     uint32_t graphics_queue_index; 
     uint32_t present_queue_index;
+    uint32_t transfer_queue_index;
     vk::UniqueHandle<vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > device;
     vk::UniqueHandle<vk::CommandPool, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > graphics_command_pool;
     vk::UniqueHandle<vk::CommandPool, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > present_command_pool;
+    vk::UniqueHandle<vk::CommandPool, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > transfer_command_pool;
     vk::SurfaceFormatKHR surface_format;
     vk::Extent2D swapchain_extent;
     uint32_t swapchain_image_count;
@@ -125,9 +140,19 @@ namespace vw {
     std::vector< vk::UniqueHandle< vk::DescriptorSet, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > descriptor_set;
     std::shared_ptr< VmaAllocator > allocator;
     vk::UniqueHandle< vk::PipelineCache, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > pipeline_cache;
+    std::shared_ptr< pipeline_registry_t > pipeline_registry;
+    // 空の場合パイプラインキャッシュをファイルに保存しない
+    std::filesystem::path pipeline_cache_path;
+    // 起動時にファイルからパイプラインキャッシュを読み込めた
+    bool warm_pipeline_cache;
     unsigned int width;
     unsigned int height;
     std::shared_ptr< input_state_t > input_state;
+    // glTFのaccessorで表せる形式の内、頂点バッファに使える物
+    std::vector< vk::Format > vertex_buffer_formats;
+    // uploaderが転送の完了を待つ間に使うのでuploaderより先に破棄しない
+    std::shared_ptr< converter_t > converter;
+    std::shared_ptr< uploader_t > uploader;
   };
   void create_surface(
     context_t &context,
@@ -152,7 +177,29 @@ namespace vw {
   void create_allocator(
     context_t &context 
   );
+  // cache_dirが空でなければデバイス毎のファイルからキャッシュを読み込む
   void create_pipeline_cache(
+    context_t &context,
+    const std::filesystem::path &cache_dir = std::filesystem::path()
+  );
+  void save_pipeline_cache(
+    const context_t &context
+  );
+  void create_pipeline_registry(
+    context_t &context
+  );
+  void create_format_support(
+    context_t &context
+  );
+  bool is_vertex_buffer_format_supported(
+    const context_t &context,
+    vk::Format format
+  );
+  void create_converter(
+    context_t &context,
+    const std::string &shader_dir
+  );
+  void create_uploader(
     context_t &context
   );
   void on_key_event( GLFWwindow *raw_window, int key, int, int action, int );
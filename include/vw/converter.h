@@ -0,0 +1,91 @@
+#ifndef VW_CONVERTER_H
+#define VW_CONVERTER_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <vw/context.h>
+#include <vw/buffer.h>
+namespace vw {
+  class uploader_t;
+  // sourceのsource_offsetからsource_strideおきにsizeバイトずつ読み
+  // destinationのoffsetからstrideおきに書いて残りを0で埋める
+  // 8bitのインデックスを16bitに、3要素の頂点属性を4要素に広げるのに使う
+  struct buffer_conversion_t {
+    buffer_conversion_t() : source_offset( 0 ), source_stride( 0 ), size( 0 ), offset( 0 ), stride( 0 ), count( 0 ), fill( 0 ) {}
+    LIBSTAMP_SETTER( source_offset )
+    LIBSTAMP_SETTER( source_stride )
+    LIBSTAMP_SETTER( size )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( stride )
+    LIBSTAMP_SETTER( count )
+    LIBSTAMP_SETTER( fill )
+    size_t source_offset;
+    size_t source_stride;
+    size_t size;
+    // 4の倍数
+    size_t offset;
+    size_t stride;
+    size_t count;
+    // 要素のsizeバイト目から4バイトに置く値 それ以降は0で埋める
+    uint32_t fill;
+  };
+  // 転送したバッファの要素をグラフィクスキューのコンピュートシェーダで詰め直す
+  class converter_t {
+  public:
+    converter_t(
+      const context_t &context,
+      const std::string &filename
+    );
+    converter_t( const converter_t& ) = delete;
+    converter_t &operator=( const converter_t& ) = delete;
+    // sourceとdestinationはeStorageBufferを付けて作り、転送のコマンドを積んだ後に呼ぶ事
+    void convert(
+      uploader_t &uploader,
+      const buffer_t &source,
+      const buffer_t &destination,
+      const std::vector< buffer_conversion_t > &conversions
+    );
+    // 1つのディスクリプタで指せるバッファの大きさ
+    size_t get_max_range() const { return max_range; }
+  private:
+    vk::Device device;
+    uint32_t max_group_count;
+    size_t max_range;
+    vk::UniqueHandle< vk::ShaderModule, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > shader;
+    vk::UniqueHandle< vk::DescriptorSetLayout, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > descriptor_set_layout;
+    vk::UniqueHandle< vk::PipelineLayout, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > pipeline_layout;
+    vk::UniqueHandle< vk::Pipeline, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > pipeline;
+    vk::UniqueHandle< vk::DescriptorPool, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > descriptor_pool;
+    std::shared_ptr< std::mutex > guard;
+  };
+  void convert_buffer(
+    const context_t &context,
+    const buffer_t &source,
+    const buffer_t &destination,
+    const std::vector< buffer_conversion_t > &conversions
+  );
+}
+#endif
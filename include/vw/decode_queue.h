@@ -0,0 +1,55 @@
+#ifndef VW_DECODE_QUEUE_H
+#define VW_DECODE_QUEUE_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <memory>
+#include <optional>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <vw/image.h>
+namespace vw {
+  class decode_queue_t {
+  public:
+    using reserve_t = std::function< std::shared_ptr< void >( size_t ) >;
+    using job_t = std::function< pixels_t( const reserve_t& ) >;
+    decode_queue_t(
+      std::vector< job_t > &&jobs,
+      size_t thread_count,
+      size_t memory_limit
+    );
+    decode_queue_t( const decode_queue_t& ) = delete;
+    decode_queue_t &operator=( const decode_queue_t& ) = delete;
+    ~decode_queue_t();
+    std::optional< std::pair< size_t, pixels_t > > pop();
+    std::optional< std::pair< size_t, pixels_t > > try_pop();
+    bool done() const;
+    size_t size() const;
+    struct state_t;
+  private:
+    std::shared_ptr< state_t > state;
+    std::vector< std::thread > threads;
+  };
+}
+#endif
+
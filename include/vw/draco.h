@@ -0,0 +1,59 @@
+#ifndef VW_DRACO_H
+#define VW_DRACO_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <fx/gltf.h>
+namespace vw {
+  // KHR_draco_mesh_compressionのデコード結果
+  // HAVE_DRACOが無い場合decode_dracoは常に失敗する
+  struct draco_mesh_t;
+  bool is_draco_available();
+  std::shared_ptr< draco_mesh_t > decode_draco(
+    const uint8_t *begin,
+    const uint8_t *end
+  );
+  size_t get_point_count( const draco_mesh_t &mesh );
+  size_t get_index_count( const draco_mesh_t &mesh );
+  // unique_idの属性の[first,first+count)番目の頂点をtypeのcomponents要素に変換してstrideバイト毎に書き込む
+  void copy_draco_attribute(
+    const draco_mesh_t &mesh,
+    uint32_t unique_id,
+    fx::gltf::Accessor::ComponentType type,
+    uint32_t components,
+    size_t stride,
+    size_t first,
+    size_t count,
+    uint8_t *out
+  );
+  // [first,first+count)番目のインデックスをindex_sizeバイトで書き込む
+  void copy_draco_indices(
+    const draco_mesh_t &mesh,
+    size_t index_size,
+    size_t first,
+    size_t count,
+    uint8_t *out
+  );
+}
+#endif
@@ -28,6 +28,9 @@ namespace vw {
   LIBSTAMP_EXCEPTION( runtime_error, unable_to_load_shader, "シェーダを読み込む事ができない" )
   LIBSTAMP_EXCEPTION( runtime_error, invalid_gltf, "不正なGLTF" )
   LIBSTAMP_EXCEPTION( runtime_error, invalid_argument, "不正な引数" )
+  LIBSTAMP_EXCEPTION( runtime_error, unable_to_load_file, "ファイルを読み込む事ができない" )
+  LIBSTAMP_EXCEPTION( runtime_error, invalid_base64, "不正なbase64" )
+  LIBSTAMP_EXCEPTION( runtime_error, invalid_compressed_data, "不正な圧縮データ" )
 }
 
 #endif
@@ -0,0 +1,72 @@
+#ifndef VW_FILE_READER_H
+#define VW_FILE_READER_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stamp/setter.h>
+#include <vw/mapped_file.h>
+namespace vw {
+  // NVMeのキューを埋める為に1MiB単位の読み込みをこの数だけ同時に発行する
+  constexpr size_t default_file_queue_depth = 64u;
+  // io_uringが使えない場合にpreadを行うスレッドの数
+  constexpr size_t default_file_thread_count = 8u;
+  struct read_request_t {
+    read_request_t() : offset( 0 ), size( whole_file ) {}
+    LIBSTAMP_SETTER( filename )
+    LIBSTAMP_SETTER( offset )
+    LIBSTAMP_SETTER( size )
+    static constexpr size_t whole_file = std::numeric_limits< size_t >::max();
+    std::string filename;
+    size_t offset;
+    // ファイルの終端を超える部分は読まれない
+    size_t size;
+  };
+  // 複数のファイルの読み込みをまとめて発行する
+  // liburingが使える場合はio_uring、そうでなければpreadを行うスレッドプールで読む
+  // 読み込んだ内容はmapped_file_tとして返される
+  class file_reader_t {
+  public:
+    using file_t = std::shared_future< mapped_file_t >;
+    file_reader_t(
+      size_t queue_depth,
+      size_t thread_count
+    );
+    file_reader_t( const file_reader_t& ) = delete;
+    file_reader_t &operator=( const file_reader_t& ) = delete;
+    // 発行済みの読み込みが終わるのを待つ
+    // まだ発行されていない読み込みは破棄される
+    ~file_reader_t();
+    std::vector< file_t > read( const std::vector< read_request_t > &requests );
+    file_t read( const std::string &filename );
+    const char *get_backend() const;
+    struct state_t;
+  private:
+    std::shared_ptr< state_t > state;
+    std::vector< std::thread > threads;
+  };
+}
+#endif
@@ -22,27 +22,42 @@
  * IN THE SOFTWARE.
  */
 #include <iostream>
+#include <functional>
 #include <memory>
 #include <string>
+#include <vector>
 #include <vulkan/vulkan.hpp>
 #include <vw/context.h>
 #include <vw/buffer.h>
 #include <vw/exceptions.h>
 namespace vw {
   struct image_t {
-    image_t() : width( 0 ), height( 0 ) {}
+    image_t() : width( 0 ), height( 0 ), mipmap_count( 1 ) {}
     LIBSTAMP_SETTER( image )
     LIBSTAMP_SETTER( allocation )
     LIBSTAMP_SETTER( image_view )
     LIBSTAMP_SETTER( width )
     LIBSTAMP_SETTER( height )
     LIBSTAMP_SETTER( format )
+    LIBSTAMP_SETTER( mipmap_count )
     std::shared_ptr< vk::Image > image;
     std::shared_ptr< VmaAllocation > allocation;
     vk::UniqueHandle< vk::ImageView, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > image_view;
     unsigned int width;
     unsigned int height;
     vk::Format format;
+    uint32_t mipmap_count;
+  };
+  struct pixels_t {
+    pixels_t() : width( 0 ), height( 0 ) {}
+    LIBSTAMP_SETTER( width )
+    LIBSTAMP_SETTER( height )
+    LIBSTAMP_SETTER( data )
+    LIBSTAMP_SETTER( reservation )
+    uint32_t width;
+    uint32_t height;
+    std::vector< uint8_t > data;
+    std::shared_ptr< void > reservation;
   };
   uint32_t get_pot( uint32_t v );
   image_t get_image(
@@ -50,6 +65,36 @@ namespace vw {
     const vk::ImageCreateInfo &image_create_info,
     VmaMemoryUsage usage
   );
+  pixels_t decode_image(
+    const std::string &filename,
+    const std::function< std::shared_ptr< void >( size_t ) > &reserve = std::function< std::shared_ptr< void >( size_t ) >()
+  );
+  // formatはOpenImageIOがファイルの種類を判別する為の拡張子
+  pixels_t decode_image(
+    const uint8_t *begin,
+    const uint8_t *end,
+    const std::string &format,
+    const std::function< std::shared_ptr< void >( size_t ) > &reserve = std::function< std::shared_ptr< void >( size_t ) >()
+  );
+  image_t load_image(
+    const context_t &context,
+    const pixels_t &pixels,
+    vk::ImageUsageFlagBits usage,
+    bool mipmap,
+    const std::vector< vk::Format > &formats
+  );
+  vk::UniqueHandle< vk::ImageView, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > create_image_view(
+    const context_t &context,
+    const image_t &image,
+    vk::Format format
+  );
+  image_t load_image(
+    const context_t &context,
+    const pixels_t &pixels,
+    vk::ImageUsageFlagBits usage,
+    bool mipmap,
+    bool srgb
+  );
   image_t load_image(
     const context_t &context,
     const std::string &filename,
@@ -0,0 +1,41 @@
+#ifndef VW_MAPPED_FILE_H
+#define VW_MAPPED_FILE_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <stamp/setter.h>
+namespace vw {
+  struct mapped_file_t {
+    mapped_file_t() : size( 0 ) {}
+    LIBSTAMP_SETTER( data )
+    LIBSTAMP_SETTER( size )
+    const uint8_t *begin() const { return data.get(); }
+    const uint8_t *end() const { return data.get() + size; }
+    std::shared_ptr< uint8_t > data;
+    size_t size;
+  };
+  mapped_file_t map_file( const std::string &filename );
+}
+#endif
+
@@ -0,0 +1,52 @@
+#ifndef VW_MESHOPT_H
+#define VW_MESHOPT_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstddef>
+#include <cstdint>
+namespace vw {
+  // EXT_meshopt_compressionのmode
+  enum class meshopt_mode_t {
+    attributes,
+    triangles,
+    indices
+  };
+  // EXT_meshopt_compressionのfilter
+  enum class meshopt_filter_t {
+    none,
+    octahedral,
+    quaternion,
+    exponential
+  };
+  // [begin,end)をstrideバイトの要素count個に展開してoutに書き込む
+  // outにはcount * strideバイトの領域が必要
+  void decode_meshopt(
+    const uint8_t *begin,
+    const uint8_t *end,
+    size_t count,
+    size_t stride,
+    meshopt_mode_t mode,
+    meshopt_filter_t filter,
+    uint8_t *out
+  );
+}
+#endif
@@ -21,6 +21,10 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vulkan/vulkan.hpp>
 #include <vw/config.h>
 #include <vw/context.h>
@@ -29,9 +33,53 @@ namespace vw {
   struct pipeline_t {
     LIBSTAMP_SETTER( pipeline_layout )
     LIBSTAMP_SETTER( pipeline )
-    vk::UniqueHandle< vk::PipelineLayout, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > pipeline_layout;
-    vk::UniqueHandle< vk::Pipeline, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > pipeline;
+    std::shared_ptr< vk::PipelineLayout > pipeline_layout;
+    std::shared_ptr< vk::Pipeline > pipeline;
   };
+  struct pipeline_statistics_t {
+    pipeline_statistics_t() : hit( 0 ), miss( 0 ), creation_time( 0.0 ) {}
+    LIBSTAMP_SETTER( hit )
+    LIBSTAMP_SETTER( miss )
+    LIBSTAMP_SETTER( creation_time )
+    size_t hit;
+    size_t miss;
+    // パイプラインの作成にかかったミリ秒
+    double creation_time;
+  };
+  // シェーダ、頂点入力、カリング、ブレンド、互換なレンダーパスが全て同じパイプラインを使い回す
+  // 使われなくなったパイプラインは破棄されるように弱い参照だけを持つ
+  // パイプラインレイアウトはデスクリプタセットレイアウトとプッシュ定数の組毎に1つだけ作ってcontextが持ち続ける
+  class pipeline_registry_t {
+  public:
+    pipeline_t get(
+      const context_t &context,
+      const render_pass_t &render_pass,
+      uint32_t push_constant_size,
+      const vk::ShaderModule &vs,
+      const vk::ShaderModule &fs,
+      const std::vector< vk::VertexInputBindingDescription > &vertex_input_binding,
+      const std::vector< vk::VertexInputAttributeDescription > &vertex_input_attribute,
+      bool cull,
+      bool blend,
+      bool back_side
+    );
+    std::shared_ptr< vk::PipelineLayout > get_pipeline_layout(
+      const context_t &context,
+      const std::vector< vk::DescriptorSetLayout > &descriptor_set_layout,
+      const std::vector< vk::PushConstantRange > &push_constant_range
+    );
+    pipeline_statistics_t get_statistics() const;
+  private:
+    struct key_hash_t {
+      size_t operator()( const std::string &key ) const;
+    };
+    mutable std::mutex guard;
+    std::unordered_map< std::string, std::weak_ptr< vk::Pipeline >, key_hash_t > pipelines;
+    pipeline_statistics_t statistics;
+    std::mutex layout_guard;
+    std::unordered_map< std::string, std::shared_ptr< vk::PipelineLayout >, key_hash_t > pipeline_layouts;
+  };
+  // context.pipeline_registryがあれば同じ状態のパイプラインを共有する
   pipeline_t create_pipeline(
     const context_t &context,
     const render_pass_t &render_pass,
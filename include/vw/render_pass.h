@@ -30,12 +30,15 @@ namespace vw {
     LIBSTAMP_SETTER( attachments )
     LIBSTAMP_SETTER( render_pass )
     LIBSTAMP_SETTER( shadow )
+    LIBSTAMP_SETTER( impostor )
     std::vector< vk::AttachmentDescription > attachments;
     vk::UniqueHandle< vk::RenderPass, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > render_pass;
     bool shadow;
+    // インポスタのアトラスに焼き込むパス
+    bool impostor;
   };
   render_pass_t create_render_pass(
-    const context_t &context, bool off_screen = false, bool shadow = false
+    const context_t &context, bool off_screen = false, bool shadow = false, bool impostor = false
   );
 }
 #endif
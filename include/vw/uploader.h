@@ -0,0 +1,128 @@
+#ifndef VW_UPLOADER_H
+#define VW_UPLOADER_H
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <memory>
+#include <deque>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <vw/context.h>
+#include <vw/buffer.h>
+#include <vw/image.h>
+namespace vw {
+  // ステージングバッファをリングとして使い回し、複数の転送を1つのコマンドバッファにまとめて送る
+  // stageで得た領域からのコピーは次にstageを呼ぶ前にget_commandsのコマンドバッファに積む事
+  // 転送専用のキューがある場合get_commandsは転送キューで、get_graphics_commandsはその完了後にグラフィクスキューで実行される
+  // 転送キューで書いたリソースはrelease_bufferかrelease_imageでグラフィクスキューに所有権を移してから使う
+  class uploader_t {
+  public:
+    struct staging_t {
+      vk::Buffer buffer;
+      vk::DeviceSize offset;
+      uint8_t *data;
+      size_t size;
+    };
+    uploader_t(
+      const context_t &context,
+      size_t capacity
+    );
+    ~uploader_t();
+    uploader_t( const uploader_t& ) = delete;
+    uploader_t &operator=( const uploader_t& ) = delete;
+    staging_t stage( size_t size );
+    void commit( const staging_t &staging );
+    vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &get_commands();
+    vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &get_graphics_commands();
+    void begin_transfer( const image_t &image, uint32_t mip_count );
+    void release_buffer( const buffer_t &buffer );
+    void release_image(
+      const image_t &image,
+      uint32_t mip_base,
+      uint32_t mip_count,
+      vk::ImageLayout from,
+      vk::ImageLayout to
+    );
+    // 積んだコマンドの完了を待ってからobjectを破棄する
+    void retain( std::shared_ptr< void > object );
+    void flush( bool wait );
+    void begin_batch();
+    void end_batch();
+    void abort_batch();
+    bool in_batch() const { return batch_depth != 0u; }
+    bool is_dedicated() const { return transfer_queue_index != graphics_queue_index; }
+    size_t get_capacity() const { return capacity; }
+  private:
+    struct submission_t {
+      vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > transfer_commands;
+      vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > graphics_commands;
+      vk::UniqueHandle< vk::Fence, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > fence;
+      vk::UniqueHandle< vk::Semaphore, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > semaphore;
+      std::vector< std::shared_ptr< void > > retained;
+      size_t consumed;
+    };
+    void submit();
+    bool retire( bool wait );
+    vk::Device device;
+    std::shared_ptr< VmaAllocator > allocator;
+    uint32_t transfer_queue_index;
+    uint32_t graphics_queue_index;
+    vk::Queue transfer_queue;
+    vk::Queue graphics_queue;
+    vk::UniqueHandle< vk::CommandPool, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > transfer_command_pool;
+    vk::UniqueHandle< vk::CommandPool, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > graphics_command_pool;
+    buffer_t ring;
+    std::shared_ptr< uint8_t > mapped;
+    size_t capacity;
+    size_t alignment;
+    size_t head;
+    size_t used;
+    size_t batch_head;
+    size_t batch_consumed;
+    unsigned int batch_depth;
+    vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > transfer_commands;
+    vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > graphics_commands;
+    std::vector< std::shared_ptr< void > > retained;
+    std::deque< submission_t > in_flight;
+    std::vector< vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > free_transfer_commands;
+    std::vector< vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > free_graphics_commands;
+    std::vector< vk::UniqueHandle< vk::Fence, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > free_fences;
+    std::vector< vk::UniqueHandle< vk::Semaphore, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > free_semaphores;
+  };
+  class upload_batch_t {
+  public:
+    upload_batch_t( const context_t &context );
+    ~upload_batch_t();
+    upload_batch_t( const upload_batch_t& ) = delete;
+    upload_batch_t &operator=( const upload_batch_t& ) = delete;
+    void submit();
+  private:
+    std::shared_ptr< uploader_t > uploader;
+  };
+  std::shared_ptr< uploader_t > get_uploader(
+    const context_t &context,
+    size_t size
+  );
+  void finish_upload(
+    uploader_t &uploader
+  );
+}
+#endif
@@ -229,6 +229,18 @@ echo special4.frag
 cat special4.frag|${GLSLI}|${GLSLC} -fshader-stage=frag -o special4.frag.spv --target-env=vulkan1.2 -
 echo special5.vert
 cat special5.vert|${GLSLI}|${GLSLC} -fshader-stage=vert -o special5.vert.spv --target-env=vulkan1.2 -
+echo special6.vert
+cat special6.vert|${GLSLI}|${GLSLC} -fshader-stage=vert -o special6.vert.spv --target-env=vulkan1.2 -
+echo special6.frag
+cat special6.frag|${GLSLI}|${GLSLC} -fshader-stage=frag -o special6.frag.spv --target-env=vulkan1.2 -
+echo special7.frag
+cat special7.frag|${GLSLI}|${GLSLC} -fshader-stage=frag -o special7.frag.spv --target-env=vulkan1.2 -
+echo special8.vert
+cat special8.vert|${GLSLI}|${GLSLC} -fshader-stage=vert -o special8.vert.spv --target-env=vulkan1.2 -
+echo special8.frag
+cat special8.frag|${GLSLI}|${GLSLC} -fshader-stage=frag -o special8.frag.spv --target-env=vulkan1.2 -
 
 echo add.comp
 cat add.comp|${GLSLI}|${GLSLC} -fshader-stage=comp -o add.comp.spv --target-env=vulkan1.2 -
+echo convert.comp
+cat convert.comp|${GLSLI}|${GLSLC} -fshader-stage=comp -o convert.comp.spv --target-env=vulkan1.2 -
@@ -0,0 +1,25 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 input_position;
+layout (location = 1) in vec3 input_normal;
+layout (location = 3) in vec2 input_texcoord0;
+
+#include "push_constants.h"
+
+layout (location = 1) out vec3 output_normal;
+layout (location = 3) out vec2 output_tex_coord;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main() {
+  output_normal = input_normal;
+  output_tex_coord = input_texcoord0;
+  gl_Position = push_constants.world_matrix * vec4( input_position.xyz, 1.0 );
+}
+
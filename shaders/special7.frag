@@ -0,0 +1,20 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 1) in vec3 input_normal;
+layout (location = 3) in vec2 input_texcoord;
+layout (location = 0) out vec4 output_color;
+
+#include "push_constants.h"
+
+void main()  {
+  if( push_constants.fid == 0 ) {
+    output_color = vec4( uniforms.base_color.rgb, 1 );
+  }
+  else {
+    output_color = vec4( normalize( input_normal ) * 0.5 + 0.5, 1 );
+  }
+}
+
@@ -0,0 +1,31 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec4 input_position;
+layout (location = 3) in vec2 input_texcoord;
+layout (location = 0) out vec4 output_color;
+
+#include "constants.h"
+#include "push_constants.h"
+#include "lighting.h"
+
+layout(binding = 1) uniform sampler2D impostor_color;
+layout(binding = 3) uniform sampler2D impostor_normal;
+
+void main()  {
+  vec4 color = texture( impostor_color, input_texcoord );
+  if( color.a < 0.5 ) discard;
+  // 背景は0で消してあるので被覆率で割ると縁の色と法線が戻る
+  vec4 normal = texture( impostor_normal, input_texcoord );
+  vec3 N = normalize( mat3( push_constants.world_matrix ) * ( normal.xyz / normal.a * 2.0 - 1.0 ) );
+  vec3 pos = input_position.xyz;
+  vec3 V = normalize(dynamic_uniforms.eye_pos.xyz-pos);
+  vec3 L = normalize(dynamic_uniforms.light_pos.xyz-pos);
+  vec3 diffuse_color = color.rgb / color.a;
+  float ambient = 0.05;
+  vec3 linear = light( L, V, N, diffuse_color, 1.0, 0.0, ambient, vec3( 0, 0, 0 ), dynamic_uniforms.light_energy );
+  output_color = vec4( gamma(linear), 1 );
+}
+
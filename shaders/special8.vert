@@ -0,0 +1,43 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+#include "constants.h"
+#include "push_constants.h"
+
+// viewer/impostor.hのimpostor_viewsとimpostor_columnsに合わせる
+const int views = 8;
+const int columns = 16;
+
+layout (location = 0) out vec4 output_position;
+layout (location = 3) out vec2 output_tex_coord;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+const vec2 corners[ 6 ] = vec2[](
+  vec2( -1, -1 ), vec2( 1, -1 ), vec2( 1, 1 ),
+  vec2( -1, -1 ), vec2( 1, 1 ), vec2( -1, 1 )
+);
+
+void main() {
+  // world_matrixは境界球を原点を中心とする半径1の球に写す座標系からの変換
+  vec3 eye = ( inverse( push_constants.world_matrix ) * vec4( dynamic_uniforms.eye_pos.xyz, 1.0 ) ).xyz;
+  vec3 dir = vec3( eye.x, 0, eye.z );
+  dir = dot( dir, dir ) > 0.0 ? normalize( dir ) : vec3( 0, 0, 1 );
+  int view = int( round( atan( dir.x, dir.z ) / ( 2.0 * pi / float( views ) ) ) );
+  view = ( view % views + views ) % views;
+  vec3 up = vec3( 0, 1, 0 );
+  vec3 right = cross( -dir, up );
+  vec2 corner = corners[ gl_VertexIndex ];
+  vec4 pos = push_constants.world_matrix * vec4( right * corner.x + up * corner.y, 1.0 );
+  int tile = push_constants.fid + view;
+  vec2 origin = vec2( tile % columns, tile / columns );
+  output_tex_coord = ( origin + ( 0.5 - 0.5 * corner ) ) / float( columns );
+  output_position = pos;
+  gl_Position = dynamic_uniforms.projection_matrix * dynamic_uniforms.camera_matrix * pos;
+}
+
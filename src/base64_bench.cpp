@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <vw/base64.h>
+std::string encode_base64( const std::vector< uint8_t > &data ) {
+  static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string encoded;
+  encoded.reserve( ( data.size() + 2u ) / 3u * 4u );
+  for( size_t i = 0u; i < data.size(); i += 3u ) {
+    const uint32_t v =
+      ( uint32_t( data[ i ] ) << 16 ) |
+      ( i + 1u < data.size() ? uint32_t( data[ i + 1u ] ) << 8 : 0u ) |
+      ( i + 2u < data.size() ? uint32_t( data[ i + 2u ] ) : 0u );
+    encoded += table[ ( v >> 18 ) & 0x3F ];
+    encoded += table[ ( v >> 12 ) & 0x3F ];
+    encoded += i + 1u < data.size() ? table[ ( v >> 6 ) & 0x3F ] : '=';
+    encoded += i + 2u < data.size() ? table[ v & 0x3F ] : '=';
+  }
+  return encoded;
+}
+template< typename F >
+double measure( unsigned int repeat, F &&f ) {
+  double best = std::numeric_limits< double >::max();
+  for( unsigned int i = 0u; i != repeat; ++i ) {
+    const auto begin = std::chrono::high_resolution_clock::now();
+    f();
+    const auto end = std::chrono::high_resolution_clock::now();
+    best = std::min( best, std::chrono::duration< double, std::milli >( end - begin ).count() );
+  }
+  return best;
+}
+int main( int argc, const char *argv[] ) {
+  namespace po = boost::program_options;
+  po::options_description desc( "Options" );
+  std::vector< size_t > sizes;
+  unsigned int repeat = 5u;
+  desc.add_options()
+    ( "help,h", "show this message" )
+    ( "size,s", po::value< std::vector< size_t > >( &sizes )->multitoken(), "decoded sizes in bytes" )
+    ( "repeat,r", po::value< unsigned int >( &repeat )->default_value( 5u ), "repeat count" );
+  po::variables_map vm;
+  po::store( po::parse_command_line( argc, argv, desc ), vm );
+  po::notify( vm );
+  if( vm.count( "help" ) ) {
+    std::cout << desc << std::endl;
+    exit( 0 );
+  }
+  if( sizes.empty() ) sizes = { 4096u, 1024u * 1024u, 64u * 1024u * 1024u };
+  std::mt19937 rng( 0u );
+  std::uniform_int_distribution< unsigned int > dist( 0u, 255u );
+  for( const auto size: sizes ) {
+    std::vector< uint8_t > source( size );
+    for( auto &v: source ) v = uint8_t( dist( rng ) );
+    const auto encoded = encode_base64( source );
+    const char *begin = encoded.data();
+    const char *end = begin + encoded.size();
+    std::vector< uint8_t > scalar_out( vw::get_base64_decoded_size( begin, end ) );
+    std::vector< uint8_t > simd_out( scalar_out.size() );
+    const double scalar_time = measure( repeat, [&]() {
+      vw::decode_base64_scalar( begin, end, scalar_out.data() );
+    } );
+    const double simd_time = measure( repeat, [&]() {
+      vw::decode_base64( begin, end, simd_out.data() );
+    } );
+    if( scalar_out != source || simd_out != source ) {
+      std::cerr << "デコード結果が一致しない" << std::endl;
+      return 1;
+    }
+    const auto throughput = [&]( double ms ) { return double( encoded.size() ) / ( ms * 1.0e-3 ) / 1.0e9; };
+    std::cout << "サイズ " << size << "バイト" << std::endl;
+    std::cout << "  decode_base64_scalar : " << scalar_time << "ms (" << throughput( scalar_time ) << "GB/s)" << std::endl;
+    std::cout << "  decode_base64        : " << simd_time << "ms (" << throughput( simd_time ) << "GB/s)" << std::endl;
+  }
+}
@@ -215,13 +215,22 @@ int main( int argc, const char *argv[] ) {
     .setPVertexBindingDescriptions( vertex_input_binding.data() );
 
   vw::pipeline_t pipeline;
-  pipeline.set_pipeline_layout( context.device->createPipelineLayoutUnique(
-    vk::PipelineLayoutCreateInfo()
-      .setSetLayoutCount( context.descriptor_set_layout.size() )
-      .setPSetLayouts( raw_descriptor_set_layout.data() )
-      .setPushConstantRangeCount( push_constant_range.size() )
-      .setPPushConstantRanges( push_constant_range.data() )
-  ) );
+  const vk::Device device = *context.device;
+  pipeline.emplace_pipeline_layout(
+    new vk::PipelineLayout( device.createPipelineLayout(
+      vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount( context.descriptor_set_layout.size() )
+        .setPSetLayouts( raw_descriptor_set_layout.data() )
+        .setPushConstantRangeCount( push_constant_range.size() )
+        .setPPushConstantRanges( push_constant_range.data() )
+    ) ),
+    [device]( vk::PipelineLayout *p ) {
+      if( p ) {
+        device.destroyPipelineLayout( *p );
+        delete p;
+      }
+    }
+  );
   const auto tessellation_info = 
     vk::PipelineTessellationStateCreateInfo()
       .setPatchControlPoints( 1 );
@@ -246,7 +255,14 @@ int main( int argc, const char *argv[] ) {
   auto raw_pipeline = context.device->createGraphicsPipelines(
     *context.pipeline_cache, pipeline_create_info
   );
-  vk::ObjectDestroy< vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > deleter( *context.device, nullptr, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE () );
-  pipeline.set_pipeline( vk::UniqueHandle< vk::Pipeline, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE >( raw_pipeline.value[ 0 ], deleter ) );
+  pipeline.emplace_pipeline(
+    new vk::Pipeline( raw_pipeline.value[ 0 ] ),
+    [device]( vk::Pipeline *p ) {
+      if( p ) {
+        device.destroyPipeline( *p );
+        delete p;
+      }
+    }
+  );
 }
 
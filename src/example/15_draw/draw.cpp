@@ -53,6 +53,8 @@
 #include <vw/wait_for_idle.h>
 #include <vw/command_buffer.h>
 #include <viewer/document.h>
+#include <viewer/impostor.h>
+#include <viewer/hlod.h>
 
 
 
@@ -142,6 +144,8 @@ int main( int argc, const char *argv[] ) {
     );
     std::vector< vw::render_pass_t > render_pass;
     render_pass.emplace_back( vw::create_render_pass( context ) );
+    if( config.impostor_distance > 0.f )
+      render_pass.emplace_back( vw::create_render_pass( context, true, false, true ) );
     auto framebuffer = vw::create_framebuffer(
       context, render_pass[ 0 ]
     );
@@ -159,7 +163,7 @@ int main( int argc, const char *argv[] ) {
       temporary_dynamic_uniform_buffer.emplace_back(
         viewer::create_staging_buffer( context, sizeof( viewer::dynamic_uniforms_t ) )
       );
-    viewer::document_t document = viewer::load_gltf(
+    viewer::document_t document = viewer::load_gltf_async(
       context,
       render_pass,
       std::filesystem::path( config.input ),
@@ -168,7 +172,8 @@ int main( int argc, const char *argv[] ) {
       config.shader_mask,
       extra_textures,
       dynamic_uniform_buffer,
-      float( context.width )/float( context.height )
+      float( context.width )/float( context.height ),
+      viewer::get_load_options( config )
     );
     auto center = ( document.node.min + document.node.max ) / 2.f;
     auto scale = std::abs( glm::length( document.node.max - document.node.min ) );
@@ -204,6 +209,8 @@ int main( int argc, const char *argv[] ) {
       light_pos = point_lights[ 0 ].location;
       std::cout << light_energy << " " << light_pos[ 0 ] << " " << light_pos[ 1 ] << " " << light_pos[ 2 ] << std::endl;
     }
+    viewer::impostors_t impostors;
+    bool impostor_baked = !( config.impostor_distance > 0.f );
     while( !context.input_state->quit ) {
       if( context.input_state->a ) camera_angle += 0.01 * M_PI/2;
       if( context.input_state->d ) camera_angle -= 0.01 * M_PI/2;
@@ -231,6 +238,12 @@ int main( int argc, const char *argv[] ) {
       auto reset_fences_result = context.device->resetFences( 1, &*fe.fence[ 0 ] );
       if( reset_fences_result != vk::Result::eSuccess )
         vk::throwResultException( reset_fences_result, "waitForFences failed" );
+      const bool loading = viewer::update_document( context, document, current_frame );
+      // テクスチャが揃ってからインポスタを焼き込む
+      if( !impostor_baked && !loading ) {
+        impostors = viewer::create_impostor( context, document, render_pass, 1u, 0u, dynamic_uniform_buffer, current_frame );
+        impostor_baked = true;
+      }
       auto &gcb = command_buffer[ current_frame ];
       gcb->reset( vk::CommandBufferResetFlags( 0 ) );
       auto image_index = context.device->acquireNextImageKHR( *context.swapchain, UINT64_MAX, *fe.image_acquired_semaphore, vk::Fence() );
@@ -264,14 +277,39 @@ int main( int argc, const char *argv[] ) {
       gcb->beginRenderPass( &pass_info, vk::SubpassContents::eInline );
       gcb->setViewport( 0, 1, &viewport );
       gcb->setScissor( 0, 1, &scissor );
-      viewer::draw_node(
-        context,
+      const auto lod_selector = viewer::get_lod_selector( projection, lookat, context.height )
+        .set_impostor_distance( config.impostor_distance );
+      if( config.hlod )
+        viewer::draw_hlod(
+          context,
+          *gcb,
+          document.hlod,
+          document.mesh,
+          document.buffer,
+          current_frame,
+          0u,
+          lod_selector,
+          viewer::get_meshlet_culling( projection, lookat )
+        );
+      else
+        viewer::draw_node(
+          context,
+          *gcb,
+          document.node,
+          document.mesh,
+          document.buffer,
+          current_frame,
+          0u,
+          lod_selector,
+          viewer::get_meshlet_culling( projection, lookat )
+        );
+      viewer::draw_impostor(
         *gcb,
         document.node,
         document.mesh,
-        document.buffer,
+        impostors,
         current_frame,
-        0u
+        lod_selector
       );
       gcb->endRenderPass();
       gcb->end();
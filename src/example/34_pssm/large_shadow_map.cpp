@@ -378,6 +378,7 @@ int main( int argc, const char *argv[] ) {
       vw::wait_for_sync( begin_time );
     }
     vw::wait_for_idle( context );
+    vw::save_pipeline_cache( context );
   }
 }
 
@@ -231,7 +231,8 @@ int main( int argc, const char *argv[] ) {
       config.shader_mask,
       extra_textures,
       dynamic_uniform_buffer,
-      float( context.width )/float( context.height )
+      float( context.width )/float( context.height ),
+      viewer::get_load_options( config )
     );
     auto center = ( document.node.min + document.node.max ) / 2.f;
     auto scale = std::abs( glm::length( document.node.max - document.node.min ) );
@@ -404,6 +405,14 @@ int main( int argc, const char *argv[] ) {
         gcb->beginRenderPass( &pass_info, vk::SubpassContents::eInline );
         gcb->setViewport( 0, 1, &viewport[ i ] );
         gcb->setScissor( 0, 1, &scissor[ i ] );
+        // 影のカスケードは光源から見た大きさで、最後のパスはカメラから見た大きさでLODを選ぶ
+        const bool shadow_pass = i < light_projection_matrix.size();
+        const auto lod_selector = shadow_pass ?
+          viewer::get_shadow_lod_selector( light_projection_matrix[ i ], light_view_matrix[ i ], fb.height ) :
+          viewer::get_lod_selector( full_projection, lookat, fb.height );
+        const auto meshlet_culling = shadow_pass ?
+          viewer::get_meshlet_culling( light_projection_matrix[ i ], light_view_matrix[ i ], true ) :
+          viewer::get_meshlet_culling( full_projection, lookat );
         viewer::draw_node(
           context,
           *gcb,
@@ -411,7 +420,9 @@ int main( int argc, const char *argv[] ) {
           document.mesh,
           document.buffer,
           current_frame,
-          i
+          i,
+          lod_selector,
+          meshlet_culling
         );
         gcb->endRenderPass();
 
@@ -445,6 +456,7 @@ int main( int argc, const char *argv[] ) {
       vw::wait_for_sync( begin_time );
     }
     vw::wait_for_idle( context );
+    vw::save_pipeline_cache( context );
   }
 }
 
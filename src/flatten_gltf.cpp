@@ -0,0 +1,668 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <filesystem>
+#include <boost/program_options.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <fx/gltf.h>
+#include <vw/mapped_file.h>
+#include <vw/base64.h>
+#include <vw/exceptions.h>
+#include <viewer/glb.h>
+#include <viewer/parse.h>
+#include <viewer/data_uri.h>
+using source_t = std::pair< const uint8_t*, const uint8_t* >;
+// 入力のbufferの内容 外部ファイルはマップし、data URIはデコードしておく
+struct sources_t {
+  std::vector< vw::mapped_file_t > file;
+  std::vector< std::vector< uint8_t > > decoded;
+  std::vector< source_t > buffer;
+};
+sources_t load_sources(
+  const fx::gltf::Document &doc,
+  const std::filesystem::path &cd,
+  const viewer::glb_t &glb
+) {
+  sources_t sources;
+  sources.decoded.resize( doc.buffers.size() );
+  sources.buffer.resize( doc.buffers.size(), source_t( nullptr, nullptr ) );
+  for( size_t index = 0u; index != doc.buffers.size(); ++index ) {
+    const auto &buffer = doc.buffers[ index ];
+    if( buffer.uri.empty() ) sources.buffer[ index ] = source_t( glb.bin_begin, glb.bin_end );
+    else if( const auto uri = viewer::parse_data_uri( buffer.uri ); uri ) {
+      auto &decoded = sources.decoded[ index ];
+      decoded.resize( vw::get_base64_decoded_size( uri->begin, uri->end ) );
+      decoded.resize( vw::decode_base64( uri->begin, uri->end, decoded.data() ) );
+      sources.buffer[ index ] = source_t( decoded.data(), decoded.data() + decoded.size() );
+    }
+    else {
+      auto path = std::filesystem::path( buffer.uri );
+      if( path.is_relative() ) path = cd / path;
+      sources.file.push_back( vw::map_file( path.string() ) );
+      sources.buffer[ index ] = source_t( sources.file.back().begin(), sources.file.back().end() );
+    }
+    if( size_t( std::distance( sources.buffer[ index ].first, sources.buffer[ index ].second ) ) < size_t( buffer.byteLength ) ) throw vw::invalid_gltf( "bufferの内容が指定された長さに満たない", __FILE__, __LINE__ );
+  }
+  return sources;
+}
+size_t get_component_size( fx::gltf::Accessor::ComponentType type ) {
+  if( type == fx::gltf::Accessor::ComponentType::Byte ) return 1u;
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedByte ) return 1u;
+  if( type == fx::gltf::Accessor::ComponentType::Short ) return 2u;
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedShort ) return 2u;
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedInt ) return 4u;
+  if( type == fx::gltf::Accessor::ComponentType::Float ) return 4u;
+  throw vw::invalid_gltf( "不正なaccessorの要素の型", __FILE__, __LINE__ );
+}
+size_t get_component_count( fx::gltf::Accessor::Type type ) {
+  if( type == fx::gltf::Accessor::Type::Scalar ) return 1u;
+  if( type == fx::gltf::Accessor::Type::Vec2 ) return 2u;
+  if( type == fx::gltf::Accessor::Type::Vec3 ) return 3u;
+  if( type == fx::gltf::Accessor::Type::Vec4 ) return 4u;
+  if( type == fx::gltf::Accessor::Type::Mat2 ) return 4u;
+  if( type == fx::gltf::Accessor::Type::Mat3 ) return 9u;
+  if( type == fx::gltf::Accessor::Type::Mat4 ) return 16u;
+  throw vw::invalid_gltf( "不正なaccessorの型", __FILE__, __LINE__ );
+}
+size_t get_element_size( const fx::gltf::Accessor &accessor ) {
+  const size_t component_size = get_component_size( accessor.componentType );
+  const bool matrix =
+    accessor.type == fx::gltf::Accessor::Type::Mat2 ||
+    accessor.type == fx::gltf::Accessor::Type::Mat3 ||
+    accessor.type == fx::gltf::Accessor::Type::Mat4;
+  // 列毎に4バイト境界に揃える必要がある行列は詰めて並べられない
+  if( matrix && component_size < 4u ) throw vw::invalid_gltf( "要素が4バイト未満の行列のaccessorには対応していない", __FILE__, __LINE__ );
+  return component_size * get_component_count( accessor.type );
+}
+source_t get_view(
+  const fx::gltf::Document &doc,
+  const sources_t &sources,
+  int32_t index
+) {
+  if( index < 0 || doc.bufferViews.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+  const auto &view = doc.bufferViews[ index ];
+  if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+  if( size_t( view.byteOffset ) + size_t( view.byteLength ) > size_t( doc.buffers[ view.buffer ].byteLength ) ) throw vw::invalid_gltf( "bufferViewがbufferの範囲を超えている", __FILE__, __LINE__ );
+  const uint8_t *begin = sources.buffer[ view.buffer ].first + view.byteOffset;
+  return source_t( begin, begin + view.byteLength );
+}
+// count個のsize要素をstride毎にbufferViewのoffsetから読んで詰めて並べる
+void read_elements(
+  const fx::gltf::Document &doc,
+  const sources_t &sources,
+  int32_t view_index,
+  size_t offset,
+  size_t size,
+  size_t count,
+  uint8_t *out
+) {
+  if( count == 0u ) return;
+  const auto [begin,end] = get_view( doc, sources, view_index );
+  const size_t stride = doc.bufferViews[ view_index ].byteStride ? doc.bufferViews[ view_index ].byteStride : size;
+  if( offset + stride * ( count - 1u ) + size > size_t( std::distance( begin, end ) ) ) throw vw::invalid_gltf( "指定された要素数に対してbufferViewが小さすぎる", __FILE__, __LINE__ );
+  for( size_t i = 0u; i != count; ++i )
+    std::memcpy( out + i * size, begin + offset + i * stride, size );
+}
+uint32_t read_index( const uint8_t *data, fx::gltf::Accessor::ComponentType type ) {
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedByte ) return *data;
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedShort ) {
+    uint16_t value;
+    std::memcpy( &value, data, sizeof( value ) );
+    return value;
+  }
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedInt ) {
+    uint32_t value;
+    std::memcpy( &value, data, sizeof( value ) );
+    return value;
+  }
+  throw vw::invalid_gltf( "インデックスに使えない型", __FILE__, __LINE__ );
+}
+// 疎なaccessorは値を適用した密な配列にする
+std::vector< uint8_t > read_accessor(
+  const fx::gltf::Document &doc,
+  const sources_t &sources,
+  int32_t index
+) {
+  if( index < 0 || doc.accessors.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたaccessorが存在しない", __FILE__, __LINE__ );
+  const auto &accessor = doc.accessors[ index ];
+  const size_t size = get_element_size( accessor );
+  std::vector< uint8_t > data( size * accessor.count, 0u );
+  if( accessor.bufferView >= 0 )
+    read_elements( doc, sources, accessor.bufferView, accessor.byteOffset, size, accessor.count, data.data() );
+  if( !accessor.sparse.empty() ) {
+    const auto &sparse = accessor.sparse;
+    const size_t index_size = get_component_size( sparse.indices.componentType );
+    std::vector< uint8_t > indices( index_size * sparse.count );
+    std::vector< uint8_t > values( size * sparse.count );
+    read_elements( doc, sources, sparse.indices.bufferView, sparse.indices.byteOffset, index_size, sparse.count, indices.data() );
+    read_elements( doc, sources, sparse.values.bufferView, sparse.values.byteOffset, size, sparse.count, values.data() );
+    for( size_t i = 0u; i != size_t( sparse.count ); ++i ) {
+      const auto target = read_index( indices.data() + i * index_size, sparse.indices.componentType );
+      if( target >= accessor.count ) throw vw::invalid_gltf( "疎なaccessorの添字が要素数を超えている", __FILE__, __LINE__ );
+      std::copy( values.data() + i * size, values.data() + ( i + 1u ) * size, data.data() + target * size );
+    }
+  }
+  return data;
+}
+float read_component( const uint8_t *data, fx::gltf::Accessor::ComponentType type, bool normalized ) {
+  if( type == fx::gltf::Accessor::ComponentType::Float ) {
+    float value;
+    std::memcpy( &value, data, sizeof( value ) );
+    return value;
+  }
+  if( type == fx::gltf::Accessor::ComponentType::Byte ) {
+    const auto value = *reinterpret_cast< const int8_t* >( data );
+    return normalized ? std::max( float( value ) / 127.f, -1.f ) : float( value );
+  }
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedByte )
+    return normalized ? float( *data ) / 255.f : float( *data );
+  if( type == fx::gltf::Accessor::ComponentType::Short ) {
+    int16_t value;
+    std::memcpy( &value, data, sizeof( value ) );
+    return normalized ? std::max( float( value ) / 32767.f, -1.f ) : float( value );
+  }
+  if( type == fx::gltf::Accessor::ComponentType::UnsignedShort ) {
+    uint16_t value;
+    std::memcpy( &value, data, sizeof( value ) );
+    return normalized ? float( value ) / 65535.f : float( value );
+  }
+  throw vw::invalid_gltf( "頂点属性に使えない型", __FILE__, __LINE__ );
+}
+// 量子化されていてもfloatに戻して読む
+std::vector< float > read_float_accessor(
+  const fx::gltf::Document &doc,
+  const sources_t &sources,
+  int32_t index
+) {
+  const auto data = read_accessor( doc, sources, index );
+  const auto &accessor = doc.accessors[ index ];
+  const size_t component_size = get_component_size( accessor.componentType );
+  std::vector< float > value( data.size() / component_size );
+  for( size_t i = 0u; i != value.size(); ++i )
+    value[ i ] = read_component( data.data() + i * component_size, accessor.componentType, accessor.normalized );
+  return value;
+}
+std::vector< uint32_t > read_indices(
+  const fx::gltf::Document &doc,
+  const sources_t &sources,
+  const fx::gltf::Primitive &primitive,
+  size_t vertex_count
+) {
+  std::vector< uint32_t > indices;
+  if( primitive.indices < 0 ) {
+    indices.resize( vertex_count );
+    for( size_t i = 0u; i != vertex_count; ++i ) indices[ i ] = uint32_t( i );
+    return indices;
+  }
+  const auto data = read_accessor( doc, sources, primitive.indices );
+  const auto type = doc.accessors[ primitive.indices ].componentType;
+  const size_t size = get_component_size( type );
+  indices.resize( data.size() / size );
+  for( size_t i = 0u; i != indices.size(); ++i ) {
+    indices[ i ] = read_index( data.data() + i * size, type );
+    if( indices[ i ] >= vertex_count ) throw vw::invalid_gltf( "インデックスが頂点の数を超えている", __FILE__, __LINE__ );
+  }
+  return indices;
+}
+// ストリップとファンをリストに直して、同じ種類のプリミティブをまとめられるようにする
+fx::gltf::Primitive::Mode get_list_mode( fx::gltf::Primitive::Mode mode ) {
+  if( mode == fx::gltf::Primitive::Mode::Points ) return fx::gltf::Primitive::Mode::Points;
+  if(
+    mode == fx::gltf::Primitive::Mode::Lines ||
+    mode == fx::gltf::Primitive::Mode::LineLoop ||
+    mode == fx::gltf::Primitive::Mode::LineStrip
+  ) return fx::gltf::Primitive::Mode::Lines;
+  return fx::gltf::Primitive::Mode::Triangles;
+}
+std::vector< uint32_t > to_list(
+  fx::gltf::Primitive::Mode mode,
+  const std::vector< uint32_t > &indices
+) {
+  std::vector< uint32_t > list;
+  const size_t count = indices.size();
+  if( mode == fx::gltf::Primitive::Mode::LineStrip || mode == fx::gltf::Primitive::Mode::LineLoop ) {
+    for( size_t i = 0u; i + 1u < count; ++i ) list.insert( list.end(), { indices[ i ], indices[ i + 1u ] } );
+    if( mode == fx::gltf::Primitive::Mode::LineLoop && count > 2u ) list.insert( list.end(), { indices[ count - 1u ], indices[ 0 ] } );
+  }
+  else if( mode == fx::gltf::Primitive::Mode::TriangleStrip ) {
+    for( size_t i = 0u; i + 2u < count; ++i ) {
+      if( i % 2u ) list.insert( list.end(), { indices[ i + 1u ], indices[ i ], indices[ i + 2u ] } );
+      else list.insert( list.end(), { indices[ i ], indices[ i + 1u ], indices[ i + 2u ] } );
+    }
+  }
+  else if( mode == fx::gltf::Primitive::Mode::TriangleFan ) {
+    for( size_t i = 1u; i + 1u < count; ++i ) list.insert( list.end(), { indices[ 0 ], indices[ i ], indices[ i + 1u ] } );
+  }
+  else list = indices;
+  return list;
+}
+glm::mat4 get_local_matrix( const fx::gltf::Node &node ) {
+  if( node.matrix != fx::gltf::defaults::IdentityMatrix ) return glm::make_mat4( node.matrix.data() );
+  return
+    glm::translate( glm::mat4( 1.f ), glm::vec3( node.translation[ 0 ], node.translation[ 1 ], node.translation[ 2 ] ) ) *
+    glm::mat4_cast( glm::quat( node.rotation[ 3 ], node.rotation[ 0 ], node.rotation[ 1 ], node.rotation[ 2 ] ) ) *
+    glm::scale( glm::mat4( 1.f ), glm::vec3( node.scale[ 0 ], node.scale[ 1 ], node.scale[ 2 ] ) );
+}
+bool has_extensions( const nlohmann::json &extensions_and_extras ) {
+  return extensions_and_extras.is_object() && extensions_and_extras.find( "extensions" ) != extensions_and_extras.end();
+}
+// 位置、法線、接線は変換を焼き込む為にfloatにする それ以外の頂点属性はそのまま繋げる
+bool is_baked_attribute( const std::string &name ) {
+  return name == "POSITION" || name == "NORMAL" || name == "TANGENT";
+}
+using attribute_key_t = std::tuple< std::string, fx::gltf::Accessor::ComponentType, fx::gltf::Accessor::Type, bool >;
+using group_key_t = std::tuple< int32_t, fx::gltf::Primitive::Mode, std::vector< attribute_key_t > >;
+group_key_t get_group_key(
+  const fx::gltf::Document &doc,
+  const fx::gltf::Primitive &primitive
+) {
+  std::vector< attribute_key_t > attributes;
+  for( const auto &[name,index]: primitive.attributes ) {
+    if( doc.accessors.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたaccessorが存在しない", __FILE__, __LINE__ );
+    const auto &accessor = doc.accessors[ index ];
+    if( is_baked_attribute( name ) ) attributes.emplace_back( name, fx::gltf::Accessor::ComponentType::Float, accessor.type, false );
+    else attributes.emplace_back( name, accessor.componentType, accessor.type, accessor.normalized );
+  }
+  std::sort( attributes.begin(), attributes.end() );
+  return group_key_t( primitive.material, get_list_mode( primitive.mode ), std::move( attributes ) );
+}
+struct instance_t {
+  const fx::gltf::Primitive *primitive;
+  glm::mat4 matrix;
+};
+// 出力するGLBのバイナリチャンク
+class writer_t {
+public:
+  writer_t( fx::gltf::Document &doc_ ) : doc( doc_ ) {}
+  int32_t add_view( const uint8_t *begin, const uint8_t *end, fx::gltf::BufferView::TargetType target ) {
+    data.resize( ( data.size() + 3u ) / 4u * 4u, 0u );
+    fx::gltf::BufferView view;
+    view.buffer = 0;
+    view.byteOffset = uint32_t( data.size() );
+    view.byteLength = uint32_t( std::distance( begin, end ) );
+    view.target = target;
+    data.insert( data.end(), begin, end );
+    doc.bufferViews.push_back( std::move( view ) );
+    return int32_t( doc.bufferViews.size() - 1u );
+  }
+  // accessorの形式はbaseから引き継ぎ、内容はdataに置き換える
+  int32_t add_accessor( fx::gltf::Accessor base, const std::vector< uint8_t > &data, fx::gltf::BufferView::TargetType target ) {
+    base.bufferView = data.empty() ? -1 : add_view( data.data(), data.data() + data.size(), target );
+    base.byteOffset = 0u;
+    base.sparse = fx::gltf::Accessor::Sparse();
+    doc.accessors.push_back( std::move( base ) );
+    return int32_t( doc.accessors.size() - 1u );
+  }
+  void finish() {
+    data.resize( ( data.size() + 3u ) / 4u * 4u, 0u );
+    fx::gltf::Buffer buffer;
+    buffer.byteLength = uint32_t( data.size() );
+    buffer.data = std::move( data );
+    doc.buffers.assign( 1u, std::move( buffer ) );
+  }
+private:
+  fx::gltf::Document &doc;
+  std::vector< uint8_t > data;
+};
+template< typename T >
+std::vector< uint8_t > to_bytes( const std::vector< T > &value ) {
+  const auto begin = reinterpret_cast< const uint8_t* >( value.data() );
+  return std::vector< uint8_t >( begin, begin + value.size() * sizeof( T ) );
+}
+// 同じマテリアルと頂点属性の組み合わせのインスタンスを、変換を焼き込んだ1つのプリミティブにまとめる
+fx::gltf::Primitive merge_primitives(
+  const fx::gltf::Document &doc,
+  const sources_t &sources,
+  const group_key_t &key,
+  const std::vector< instance_t > &instances,
+  writer_t &writer
+) {
+  std::map< std::string, std::vector< uint8_t > > raw;
+  std::map< std::string, std::vector< float > > baked;
+  std::vector< uint32_t > indices;
+  size_t vertex_count = 0u;
+  glm::vec3 min( std::numeric_limits< float >::max() );
+  glm::vec3 max( std::numeric_limits< float >::lowest() );
+  for( const auto &instance: instances ) {
+    const auto &primitive = *instance.primitive;
+    const auto position = primitive.attributes.find( "POSITION" );
+    size_t count = 0u;
+    if( position != primitive.attributes.end() ) count = doc.accessors[ position->second ].count;
+    else if( !primitive.attributes.empty() ) count = doc.accessors[ primitive.attributes.begin()->second ].count;
+    const glm::mat3 linear( instance.matrix );
+    const glm::mat3 normal_matrix = glm::inverseTranspose( linear );
+    const bool flip = glm::determinant( linear ) < 0.f;
+    for( const auto &[name,index]: primitive.attributes ) {
+      if( doc.accessors[ index ].count != count ) throw vw::invalid_gltf( "頂点属性の要素数が揃っていない", __FILE__, __LINE__ );
+      if( !is_baked_attribute( name ) ) {
+        const auto data = read_accessor( doc, sources, index );
+        auto &dest = raw[ name ];
+        dest.insert( dest.end(), data.begin(), data.end() );
+        continue;
+      }
+      const auto value = read_float_accessor( doc, sources, index );
+      const size_t components = get_component_count( doc.accessors[ index ].type );
+      auto &dest = baked[ name ];
+      for( size_t v = 0u; v != count; ++v ) {
+        const float *src = value.data() + v * components;
+        if( name == "POSITION" ) {
+          const glm::vec3 p( instance.matrix * glm::vec4( src[ 0 ], src[ 1 ], src[ 2 ], 1.f ) );
+          min = glm::min( min, p );
+          max = glm::max( max, p );
+          dest.insert( dest.end(), { p.x, p.y, p.z } );
+        }
+        else if( name == "NORMAL" ) {
+          const auto n = normal_matrix * glm::vec3( src[ 0 ], src[ 1 ], src[ 2 ] );
+          const float length = glm::length( n );
+          const auto normalized = length > 0.f ? n / length : n;
+          dest.insert( dest.end(), { normalized.x, normalized.y, normalized.z } );
+        }
+        else {
+          const auto t = linear * glm::vec3( src[ 0 ], src[ 1 ], src[ 2 ] );
+          const float length = glm::length( t );
+          const auto normalized = length > 0.f ? t / length : t;
+          dest.insert( dest.end(), { normalized.x, normalized.y, normalized.z, flip ? -src[ 3 ] : src[ 3 ] } );
+        }
+      }
+    }
+    auto local = to_list( primitive.mode, read_indices( doc, sources, primitive, count ) );
+    // 裏返る変換では三角形の向きを戻す
+    if( flip && std::get< 1 >( key ) == fx::gltf::Primitive::Mode::Triangles )
+      for( size_t i = 0u; i + 2u < local.size(); i += 3u ) std::swap( local[ i + 1u ], local[ i + 2u ] );
+    for( const auto index: local ) indices.push_back( uint32_t( vertex_count + index ) );
+    vertex_count += count;
+  }
+  fx::gltf::Primitive merged;
+  merged.material = std::get< 0 >( key );
+  merged.mode = std::get< 1 >( key );
+  for( const auto &[name,component_type,type,normalized]: std::get< 2 >( key ) ) {
+    fx::gltf::Accessor accessor;
+    accessor.componentType = component_type;
+    accessor.type = type;
+    accessor.normalized = normalized;
+    accessor.count = uint32_t( vertex_count );
+    if( name == "POSITION" && vertex_count ) {
+      accessor.min = { min.x, min.y, min.z };
+      accessor.max = { max.x, max.y, max.z };
+    }
+    const auto data = is_baked_attribute( name ) ? to_bytes( baked[ name ] ) : raw[ name ];
+    merged.attributes[ name ] = uint32_t( writer.add_accessor( accessor, data, fx::gltf::BufferView::TargetType::ArrayBuffer ) );
+  }
+  fx::gltf::Accessor accessor;
+  accessor.type = fx::gltf::Accessor::Type::Scalar;
+  accessor.count = uint32_t( indices.size() );
+  // 最大値はプリミティブリスタートに予約されているので使わない
+  if( vertex_count < std::numeric_limits< uint16_t >::max() ) {
+    accessor.componentType = fx::gltf::Accessor::ComponentType::UnsignedShort;
+    merged.indices = writer.add_accessor( accessor, to_bytes( std::vector< uint16_t >( indices.begin(), indices.end() ) ), fx::gltf::BufferView::TargetType::ElementArrayBuffer );
+  }
+  else {
+    accessor.componentType = fx::gltf::Accessor::ComponentType::UnsignedInt;
+    merged.indices = writer.add_accessor( accessor, to_bytes( indices ), fx::gltf::BufferView::TargetType::ElementArrayBuffer );
+  }
+  return merged;
+}
+std::string get_mime_type( std::string extension ) {
+  std::transform( extension.begin(), extension.end(), extension.begin(), []( unsigned char c ) { return std::tolower( c ); } );
+  if( extension == ".png" ) return "image/png";
+  if( extension == ".jpg" || extension == ".jpeg" ) return "image/jpeg";
+  if( extension == ".ktx2" ) return "image/ktx2";
+  if( extension == ".webp" ) return "image/webp";
+  return "";
+}
+int main( int argc, const char *argv[] ) {
+  namespace po = boost::program_options;
+  po::options_description desc( "Options" );
+  std::string input;
+  std::string output;
+  desc.add_options()
+    ( "help,h", "show this message" )
+    ( "input,i", po::value< std::string >(&input), "glTF file path" )
+    ( "output,o", po::value< std::string >(&output), "output GLB file path" );
+  po::variables_map vm;
+  po::store( po::parse_command_line( argc, argv, desc ), vm );
+  po::notify( vm );
+  if( vm.count( "help" ) ) {
+    std::cout << desc << std::endl;
+    exit( 0 );
+  }
+  if( !vm.count( "input" ) || !vm.count( "output" ) ) {
+    std::cerr << "入力ファイルと出力ファイルが指定されていません " << std::endl;
+    std::cerr << desc << std::endl;
+    exit( 1 );
+  }
+  const auto path = std::filesystem::path( input );
+  viewer::glb_t glb;
+  const auto doc = viewer::load_document( path, glb );
+  for( const auto &list: { doc.extensionsUsed, doc.extensionsRequired } )
+    for( const auto &name: list )
+      if( name == "EXT_meshopt_compression" || name == "KHR_draco_mesh_compression" )
+        throw vw::invalid_gltf( "圧縮されたbufferViewを含むglTFには対応していない 展開してから入力する必要がある: " + name );
+  const auto sources = load_sources( doc, path.parent_path(), glb );
+  // アニメーションの対象とスキンの関節は動くのでノードとして残す
+  std::vector< bool > referenced( doc.nodes.size(), false );
+  const auto reference = [&]( int32_t index ) {
+    if( index < 0 || doc.nodes.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたnodeが存在しない", __FILE__, __LINE__ );
+    referenced[ index ] = true;
+  };
+  for( const auto &animation: doc.animations )
+    for( const auto &channel: animation.channels ) reference( channel.target.node );
+  for( const auto &skin: doc.skins ) {
+    for( const auto joint: skin.joints ) reference( int32_t( joint ) );
+    if( skin.skeleton >= 0 ) reference( skin.skeleton );
+  }
+  const auto is_static_mesh = [&]( const fx::gltf::Node &node ) {
+    if( node.mesh < 0 || node.skin >= 0 || !node.weights.empty() ) return false;
+    if( doc.meshes.size() <= size_t( node.mesh ) ) throw vw::invalid_gltf( "参照されたmeshが存在しない", __FILE__, __LINE__ );
+    const auto &mesh = doc.meshes[ node.mesh ];
+    if( !mesh.weights.empty() || has_extensions( mesh.extensionsAndExtras ) ) return false;
+    for( const auto &primitive: mesh.primitives )
+      if( !primitive.targets.empty() || has_extensions( primitive.extensionsAndExtras ) ) return false;
+    return true;
+  };
+  // 複数のシーンから参照されるノードはどこか1つででも動くなら焼き込まない
+  std::vector< bool > dynamic( doc.nodes.size(), false );
+  std::vector< bool > visiting( doc.nodes.size(), false );
+  std::function< void( int32_t, bool ) > find_dynamic = [&]( int32_t index, bool animated ) {
+    if( index < 0 || doc.nodes.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたnodeが存在しない", __FILE__, __LINE__ );
+    if( visiting[ index ] ) throw vw::invalid_gltf( "ノードの親子関係が循環している", __FILE__, __LINE__ );
+    animated = animated || referenced[ index ];
+    if( animated ) dynamic[ index ] = true;
+    visiting[ index ] = true;
+    for( const auto child: doc.nodes[ index ].children ) find_dynamic( child, animated );
+    visiting[ index ] = false;
+  };
+  for( const auto &scene: doc.scenes )
+    for( const auto root: scene.nodes )
+      find_dynamic( int32_t( root ), false );
+  // シーン毎に動かないノードのメッシュをワールド座標に変換して集める
+  std::vector< bool > flattened( doc.nodes.size(), false );
+  std::vector< std::map< group_key_t, std::vector< instance_t > > > groups( doc.scenes.size() );
+  size_t draws_before = 0u;
+  std::function< void( size_t, int32_t, const glm::mat4& ) > collect = [&]( size_t scene, int32_t index, const glm::mat4 &upper ) {
+    const auto &node = doc.nodes[ index ];
+    const auto matrix = upper * get_local_matrix( node );
+    if( node.mesh >= 0 && node.mesh < int32_t( doc.meshes.size() ) ) draws_before += doc.meshes[ node.mesh ].primitives.size();
+    if( !dynamic[ index ] && is_static_mesh( node ) ) {
+      flattened[ index ] = true;
+      for( const auto &primitive: doc.meshes[ node.mesh ].primitives )
+        groups[ scene ][ get_group_key( doc, primitive ) ].push_back( instance_t{ &primitive, matrix } );
+    }
+    for( const auto child: node.children ) collect( scene, child, matrix );
+  };
+  for( size_t scene = 0u; scene != doc.scenes.size(); ++scene )
+    for( const auto root: doc.scenes[ scene ].nodes )
+      collect( scene, int32_t( root ), glm::mat4( 1.f ) );
+  std::vector< bool > keep_mesh( doc.nodes.size(), false );
+  for( size_t index = 0u; index != doc.nodes.size(); ++index )
+    keep_mesh[ index ] = doc.nodes[ index ].mesh >= 0 && !flattened[ index ];
+  // 何も持たなくなったノードは取り除く
+  std::vector< bool > has_parent( doc.nodes.size(), false );
+  for( const auto &node: doc.nodes )
+    for( const auto child: node.children ) {
+      if( child < 0 || doc.nodes.size() <= size_t( child ) ) throw vw::invalid_gltf( "参照されたnodeが存在しない", __FILE__, __LINE__ );
+      has_parent[ child ] = true;
+    }
+  std::vector< bool > keep( doc.nodes.size(), false );
+  std::function< bool( int32_t ) > mark = [&]( int32_t index ) {
+    const auto &node = doc.nodes[ index ];
+    bool k = keep_mesh[ index ] || node.camera >= 0 || node.skin >= 0 || referenced[ index ] || has_extensions( node.extensionsAndExtras );
+    for( const auto child: node.children )
+      if( mark( child ) ) k = true;
+    keep[ index ] = k;
+    return k;
+  };
+  for( size_t index = 0u; index != doc.nodes.size(); ++index )
+    if( !has_parent[ index ] ) mark( int32_t( index ) );
+  std::vector< int32_t > node_map( doc.nodes.size(), -1 );
+  int32_t node_count = 0;
+  for( size_t index = 0u; index != doc.nodes.size(); ++index )
+    if( keep[ index ] ) node_map[ index ] = node_count++;
+  fx::gltf::Document out = doc;
+  out.accessors.clear();
+  out.bufferViews.clear();
+  out.buffers.clear();
+  out.meshes.clear();
+  out.nodes.clear();
+  writer_t writer( out );
+  std::unordered_map< int32_t, int32_t > accessor_map;
+  const auto copy_accessor = [&]( int32_t index, fx::gltf::BufferView::TargetType target ) {
+    if( const auto found = accessor_map.find( index ); found != accessor_map.end() ) return found->second;
+    const auto data = read_accessor( doc, sources, index );
+    const auto copied = writer.add_accessor( doc.accessors[ index ], data, target );
+    accessor_map.insert( std::make_pair( index, copied ) );
+    return copied;
+  };
+  std::unordered_map< int32_t, int32_t > mesh_map;
+  size_t draws_after = 0u;
+  const auto copy_mesh = [&]( int32_t index ) {
+    if( const auto found = mesh_map.find( index ); found != mesh_map.end() ) return found->second;
+    auto mesh = doc.meshes[ index ];
+    for( auto &primitive: mesh.primitives ) {
+      if( primitive.indices >= 0 ) primitive.indices = copy_accessor( primitive.indices, fx::gltf::BufferView::TargetType::ElementArrayBuffer );
+      for( auto &[name,accessor]: primitive.attributes )
+        accessor = uint32_t( copy_accessor( int32_t( accessor ), fx::gltf::BufferView::TargetType::ArrayBuffer ) );
+      for( auto &target: primitive.targets )
+        for( auto &[name,accessor]: target )
+          accessor = uint32_t( copy_accessor( int32_t( accessor ), fx::gltf::BufferView::TargetType::ArrayBuffer ) );
+    }
+    out.meshes.push_back( std::move( mesh ) );
+    mesh_map.insert( std::make_pair( index, int32_t( out.meshes.size() - 1u ) ) );
+    return int32_t( out.meshes.size() - 1u );
+  };
+  for( size_t index = 0u; index != doc.nodes.size(); ++index ) {
+    if( !keep[ index ] ) continue;
+    auto node = doc.nodes[ index ];
+    if( keep_mesh[ index ] ) {
+      node.mesh = copy_mesh( node.mesh );
+      draws_after += out.meshes[ node.mesh ].primitives.size();
+    }
+    else node.mesh = -1;
+    std::vector< int32_t > children;
+    for( const auto child: node.children )
+      if( keep[ child ] ) children.push_back( node_map[ child ] );
+    node.children = std::move( children );
+    out.nodes.push_back( std::move( node ) );
+  }
+  for( size_t scene = 0u; scene != doc.scenes.size(); ++scene ) {
+    auto &roots = out.scenes[ scene ].nodes;
+    roots.clear();
+    for( const auto root: doc.scenes[ scene ].nodes )
+      if( keep[ root ] ) roots.push_back( uint32_t( node_map[ root ] ) );
+    if( groups[ scene ].empty() ) continue;
+    fx::gltf::Mesh mesh;
+    mesh.name = "flattened";
+    for( const auto &[key,instances]: groups[ scene ] )
+      mesh.primitives.push_back( merge_primitives( doc, sources, key, instances, writer ) );
+    draws_after += mesh.primitives.size();
+    out.meshes.push_back( std::move( mesh ) );
+    fx::gltf::Node node;
+    node.name = "flattened";
+    node.mesh = int32_t( out.meshes.size() - 1u );
+    out.nodes.push_back( std::move( node ) );
+    roots.push_back( uint32_t( out.nodes.size() - 1u ) );
+  }
+  for( auto &animation: out.animations ) {
+    for( auto &sampler: animation.samplers ) {
+      sampler.input = copy_accessor( sampler.input, fx::gltf::BufferView::TargetType::None );
+      sampler.output = copy_accessor( sampler.output, fx::gltf::BufferView::TargetType::None );
+    }
+    for( auto &channel: animation.channels )
+      channel.target.node = node_map[ channel.target.node ];
+  }
+  for( auto &skin: out.skins ) {
+    if( skin.inverseBindMatrices >= 0 ) skin.inverseBindMatrices = copy_accessor( skin.inverseBindMatrices, fx::gltf::BufferView::TargetType::None );
+    for( auto &joint: skin.joints ) joint = uint32_t( node_map[ joint ] );
+    if( skin.skeleton >= 0 ) skin.skeleton = node_map[ skin.skeleton ];
+  }
+  // イメージもGLBに埋め込んで1つのファイルにする
+  for( auto &image: out.images ) {
+    std::vector< uint8_t > data;
+    if( image.uri.empty() ) {
+      const auto [begin,end] = get_view( doc, sources, image.bufferView );
+      data.assign( begin, end );
+    }
+    else if( const auto uri = viewer::parse_data_uri( image.uri ); uri ) {
+      data.resize( vw::get_base64_decoded_size( uri->begin, uri->end ) );
+      data.resize( vw::decode_base64( uri->begin, uri->end, data.data() ) );
+      if( image.mimeType.empty() ) image.mimeType = uri->media_type;
+    }
+    else {
+      auto image_path = std::filesystem::path( image.uri );
+      if( image_path.is_relative() ) image_path = path.parent_path() / image_path;
+      if( image.mimeType.empty() ) image.mimeType = get_mime_type( image_path.extension().string() );
+      if( image.mimeType.empty() ) {
+        std::cerr << "種類が分からないイメージは埋め込まずに参照する: " << image.uri << std::endl;
+        image.uri = std::filesystem::absolute( image_path ).string();
+        continue;
+      }
+      const auto file = vw::map_file( image_path.string() );
+      data.assign( file.begin(), file.end() );
+    }
+    image.uri.clear();
+    image.bufferView = writer.add_view( data.data(), data.data() + data.size(), fx::gltf::BufferView::TargetType::None );
+  }
+  writer.finish();
+  fx::gltf::Save( out, output, true );
+  std::cout << "ノード " << doc.nodes.size() << " -> " << out.nodes.size() << std::endl;
+  std::cout << "描画するプリミティブ " << draws_before << " -> " << draws_after << std::endl;
+  std::cout << "accessor " << doc.accessors.size() << " -> " << out.accessors.size() << std::endl;
+  std::cout << "buffer " << out.buffers.front().byteLength << "バイト" << std::endl;
+}
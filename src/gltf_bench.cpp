@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <boost/program_options.hpp>
+#include <fx/gltf.h>
+#include <vw/mapped_file.h>
+#include <viewer/parse.h>
+std::string generate_document( size_t node_count, const std::string &bin ) {
+  std::string json;
+  json.reserve( node_count * 400u );
+  json += "{\"asset\":{\"version\":\"2.0\"},\"scene\":0,\"scenes\":[{\"nodes\":[";
+  for( size_t i = 0u; i != node_count; ++i ) {
+    if( i ) json += ',';
+    json += std::to_string( i );
+  }
+  json += "]}],\"nodes\":[";
+  for( size_t i = 0u; i != node_count; ++i ) {
+    if( i ) json += ',';
+    json += "{\"mesh\":" + std::to_string( i ) + ",\"translation\":[" + std::to_string( float( i ) * 0.5f ) + ",0.0,-1.5],\"rotation\":[0.0,0.7071068,0.0,0.7071068],\"scale\":[1.0,1.0,1.0]}";
+  }
+  json += "],\"meshes\":[";
+  for( size_t i = 0u; i != node_count; ++i ) {
+    if( i ) json += ',';
+    json += "{\"primitives\":[{\"attributes\":{\"POSITION\":" + std::to_string( i * 2u ) + "},\"indices\":" + std::to_string( i * 2u + 1u ) + ",\"material\":0}]}";
+  }
+  json += "],\"accessors\":[";
+  for( size_t i = 0u; i != node_count; ++i ) {
+    if( i ) json += ',';
+    json += "{\"bufferView\":0,\"componentType\":5126,\"count\":3,\"type\":\"VEC3\",\"min\":[0.0,0.0,0.0],\"max\":[1.0,1.0,0.0]},";
+    json += "{\"bufferView\":1,\"componentType\":5123,\"count\":3,\"type\":\"SCALAR\"}";
+  }
+  json += "],\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":36},{\"buffer\":0,\"byteOffset\":36,\"byteLength\":6}],";
+  json += "\"buffers\":[{\"uri\":\"" + bin + "\",\"byteLength\":44}],";
+  json += "\"materials\":[{\"pbrMetallicRoughness\":{\"baseColorFactor\":[1.0,1.0,1.0,1.0]}}]}";
+  return json;
+}
+template< typename F >
+double measure( unsigned int repeat, F &&f ) {
+  double best = std::numeric_limits< double >::max();
+  for( unsigned int i = 0u; i != repeat; ++i ) {
+    const auto begin = std::chrono::high_resolution_clock::now();
+    f();
+    const auto end = std::chrono::high_resolution_clock::now();
+    best = std::min( best, std::chrono::duration< double, std::milli >( end - begin ).count() );
+  }
+  return best;
+}
+int main( int argc, const char *argv[] ) {
+  namespace po = boost::program_options;
+  po::options_description desc( "Options" );
+  std::vector< size_t > node_counts;
+  unsigned int repeat = 3u;
+  std::string dir;
+  desc.add_options()
+    ( "help,h", "show this message" )
+    ( "nodes,n", po::value< std::vector< size_t > >( &node_counts )->multitoken(), "node counts" )
+    ( "repeat,r", po::value< unsigned int >( &repeat )->default_value( 3u ), "repeat count" )
+    ( "dir,d", po::value< std::string >( &dir )->default_value( std::filesystem::temp_directory_path().string() ), "working directory" );
+  po::variables_map vm;
+  po::store( po::parse_command_line( argc, argv, desc ), vm );
+  po::notify( vm );
+  if( vm.count( "help" ) ) {
+    std::cout << desc << std::endl;
+    exit( 0 );
+  }
+  if( node_counts.empty() ) node_counts = { 1000u, 100000u, 1000000u };
+  const auto bin_path = std::filesystem::path( dir ) / "gltf_bench.bin";
+  {
+    std::ofstream bin( bin_path.string(), std::ios::out | std::ios::binary );
+    const std::vector< char > zero( 44u, 0 );
+    bin.write( zero.data(), zero.size() );
+  }
+  fx::gltf::ReadQuotas quotas;
+  quotas.MaxFileSize = std::numeric_limits< uint32_t >::max();
+  for( const auto node_count: node_counts ) {
+    const auto path = std::filesystem::path( dir ) / ( "gltf_bench_" + std::to_string( node_count ) + ".gltf" );
+    {
+      const auto json = generate_document( node_count, bin_path.filename().string() );
+      std::ofstream file( path.string(), std::ios::out | std::ios::binary );
+      file.write( json.data(), json.size() );
+    }
+    const auto file_size = std::filesystem::file_size( path );
+    size_t fx_nodes = 0u;
+    const double fx_time = measure( repeat, [&]() {
+      fx_nodes = fx::gltf::LoadFromText( path.string(), quotas ).nodes.size();
+    } );
+    size_t dom_nodes = 0u;
+    const double dom_time = measure( repeat, [&]() {
+      const auto file = vw::map_file( path.string() );
+      dom_nodes = viewer::parse_gltf( file.begin(), file.end(), viewer::json_parser_t::dom ).nodes.size();
+    } );
+    size_t lean_nodes = 0u;
+    const double lean_time = measure( repeat, [&]() {
+      const auto file = vw::map_file( path.string() );
+      lean_nodes = viewer::parse_gltf( file.begin(), file.end(), viewer::json_parser_t::lean ).nodes.size();
+    } );
+    std::cout << "ノード数 " << node_count << " (" << file_size / 1024u << "KiB)" << std::endl;
+    std::cout << "  fx::gltf::LoadFromText : " << fx_time << "ms (" << fx_nodes << " nodes)" << std::endl;
+    std::cout << "  viewer::parse_gltf dom : " << dom_time << "ms (" << dom_nodes << " nodes)" << std::endl;
+    std::cout << "  viewer::parse_gltf lean: " << lean_time << "ms (" << lean_nodes << " nodes) x" << dom_time / lean_time << std::endl;
+    std::filesystem::remove( path );
+  }
+  std::filesystem::remove( bin_path );
+}
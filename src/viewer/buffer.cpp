@@ -19,10 +19,31 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <optional>
+#include <functional>
+#include <unordered_map>
+#include <utility>
 #include <vulkan/vulkan.hpp>
 #include <fx/gltf.h>
 #include <vw/buffer.h>
+#include <vw/mapped_file.h>
+#include <vw/base64.h>
+#include <vw/meshopt.h>
+#include <vw/draco.h>
+#include <vw/parallel.h>
+#include <vw/converter.h>
+#include <vw/to_size.h>
+#include <vw/exceptions.h>
 #include <viewer/buffer.h>
+#include <viewer/data_uri.h>
+#include <viewer/parse.h>
+#include <viewer/optimize.h>
+#include <viewer/simplify.h>
 namespace viewer {
   buffer_t create_uniform_buffer(
     const vw::context_t &context,
@@ -51,23 +72,1024 @@ namespace viewer {
         vw::load_buffer( context, data, vk::BufferUsageFlagBits::eUniformBuffer )
       );
   }
+  namespace {
+    constexpr size_t buffer_view_alignment = 16u;
+    struct interleaved_source_t {
+      const uint8_t *data;
+      size_t stride;
+      size_t size;
+      size_t offset;
+      vertex_conversion_t conversion;
+      uint32_t components;
+      std::array< float, 4u > bias;
+      float scale;
+      uint32_t fill;
+      uint32_t fill_size;
+    };
+    // 広げた要素の元の内容の後ろにfillを置く
+    void write_fill(
+      uint32_t fill,
+      size_t fill_size,
+      uint8_t *dest
+    ) {
+      for( size_t i = 0u; i != std::min( fill_size, sizeof( uint32_t ) ); ++i )
+        dest[ i ] = uint8_t( fill >> ( i * 8u ) );
+    }
+    void convert_attribute(
+      const interleaved_source_t &attr,
+      const uint8_t *src,
+      uint8_t *dest
+    ) {
+      if( attr.conversion == vertex_conversion_t::copy ) {
+        std::copy( src, src + attr.size, dest );
+        write_fill( attr.fill, attr.fill_size, dest + attr.size );
+        return;
+      }
+      std::array< float, 4u > value;
+      std::memcpy( value.data(), src, sizeof( float ) * attr.components );
+      if( attr.conversion == vertex_conversion_t::unorm16 ) {
+        for( uint32_t i = 0u; i != attr.components; ++i ) {
+          const float normalized = std::clamp( ( value[ i ] - attr.bias[ i ] ) * attr.scale, 0.f, 1.f );
+          const uint16_t quantized = uint16_t( std::lround( normalized * 65535.f ) );
+          std::memcpy( dest + i * sizeof( uint16_t ), &quantized, sizeof( uint16_t ) );
+        }
+      }
+      else {
+        for( uint32_t i = 0u; i != attr.components; ++i ) {
+          const float normalized = std::clamp( value[ i ], -1.f, 1.f );
+          dest[ i ] = uint8_t( int8_t( std::lround( normalized * 127.f ) ) );
+        }
+      }
+    }
+    // インターリーブされた頂点列の[offset,offset+size)の部分を生成する
+    // remapがある場合はvertex番目の頂点をremap[vertex]番目の頂点から作る
+    void interleave(
+      const std::vector< interleaved_source_t > &attrs,
+      const uint32_t *remap,
+      size_t stride,
+      size_t offset,
+      size_t size,
+      uint8_t *out
+    ) {
+      std::vector< uint8_t > partial( stride );
+      for( size_t vertex = offset / stride; vertex * stride < offset + size; ++vertex ) {
+        const size_t vertex_begin = vertex * stride;
+        const bool whole = vertex_begin >= offset && vertex_begin + stride <= offset + size;
+        uint8_t *dest = whole ? out + ( vertex_begin - offset ) : partial.data();
+        std::fill( dest, dest + stride, 0u );
+        const size_t source = remap ? remap[ vertex ] : vertex;
+        for( const auto &attr: attrs )
+          convert_attribute( attr, attr.data + attr.stride * source, dest + attr.offset );
+        if( !whole ) {
+          const size_t copy_begin = std::max( vertex_begin, offset );
+          const size_t copy_end = std::min( vertex_begin + stride, offset + size );
+          std::copy( partial.data() + ( copy_begin - vertex_begin ), partial.data() + ( copy_end - vertex_begin ), out + ( copy_begin - offset ) );
+        }
+      }
+    }
+    // 転送する領域をsizeバイトのメモリ上に並べる 領域同士は重ならないので並列に書き出す
+    std::vector< uint8_t > materialize(
+      const std::vector< vw::buffer_region_t > &regions,
+      size_t size
+    ) {
+      std::vector< uint8_t > data( size, 0u );
+      vw::parallel_for( regions.size(), [&]( size_t i ) {
+        const auto &region = regions[ i ];
+        const size_t length = region.fill ? region.size : size_t( std::distance( region.begin, region.end ) );
+        if( region.offset + length > size ) throw vw::invalid_argument( "転送する領域がバッファの範囲を超えている", __FILE__, __LINE__ );
+        if( region.fill ) region.fill( 0u, length, data.data() + region.offset );
+        else std::copy( region.begin, region.end, data.data() + region.offset );
+      } );
+      return data;
+    }
+    // strideバイトの要素の列の[offset,offset+size)の部分をgenerateで生成する
+    void fill_elements(
+      size_t stride,
+      size_t offset,
+      size_t size,
+      uint8_t *out,
+      const std::function< void( size_t, size_t, uint8_t* ) > &generate
+    ) {
+      std::vector< uint8_t > partial( stride );
+      for( size_t element = offset / stride; element * stride < offset + size; ) {
+        const size_t element_begin = element * stride;
+        if( element_begin >= offset && element_begin + stride <= offset + size ) {
+          const size_t count = ( offset + size - element_begin ) / stride;
+          generate( element, count, out + ( element_begin - offset ) );
+          element += count;
+          continue;
+        }
+        generate( element, 1u, partial.data() );
+        const size_t copy_begin = std::max( element_begin, offset );
+        const size_t copy_end = std::min( element_begin + stride, offset + size );
+        std::copy( partial.data() + ( copy_begin - element_begin ), partial.data() + ( copy_end - element_begin ), out + ( copy_begin - offset ) );
+        ++element;
+      }
+    }
+    std::vector< uint32_t > read_indices(
+      const uint8_t *source,
+      size_t size,
+      size_t stride,
+      size_t count
+    ) {
+      std::vector< uint32_t > index( count );
+      for( size_t i = 0u; i != count; ++i ) {
+        if( size == 1u ) index[ i ] = source[ i * stride ];
+        else if( size == 2u ) {
+          uint16_t value;
+          std::memcpy( &value, source + i * stride, sizeof( uint16_t ) );
+          index[ i ] = value;
+        }
+        else std::memcpy( &index[ i ], source + i * stride, sizeof( uint32_t ) );
+      }
+      return index;
+    }
+    // 32bitのインデックスをsizeバイトに詰めてoffsetバイト目からsizeバイト分を書き出す
+    void write_indices(
+      const uint32_t *index,
+      size_t size,
+      size_t offset,
+      size_t length,
+      uint8_t *out
+    ) {
+      fill_elements( size, offset, length, out, [&]( size_t first, size_t count, uint8_t *dest ) {
+        for( size_t k = 0u; k != count; ++k ) {
+          if( size == 1u ) dest[ k ] = uint8_t( index[ first + k ] );
+          else if( size == 2u ) {
+            const uint16_t narrow = uint16_t( index[ first + k ] );
+            std::memcpy( dest + k * 2u, &narrow, 2u );
+          }
+          else std::memcpy( dest + k * 4u, index + first + k, 4u );
+        }
+      } );
+    }
+    // 列優先の4x4行列で位置を移す
+    std::array< float, 3u > transform_position(
+      const std::array< float, 16u > &m,
+      const float *v
+    ) {
+      return std::array< float, 3u >{
+        m[ 0 ] * v[ 0 ] + m[ 4 ] * v[ 1 ] + m[ 8 ] * v[ 2 ] + m[ 12 ],
+        m[ 1 ] * v[ 0 ] + m[ 5 ] * v[ 1 ] + m[ 9 ] * v[ 2 ] + m[ 13 ],
+        m[ 2 ] * v[ 0 ] + m[ 6 ] * v[ 1 ] + m[ 10 ] * v[ 2 ] + m[ 14 ]
+      };
+    }
+    // 法線は左上の3x3の余因子行列で移す 行列式が負の場合は向きを反転する
+    std::array< float, 9u > get_normal_matrix(
+      const std::array< float, 16u > &m
+    ) {
+      const auto cross = []( size_t a, size_t b ) {
+        return std::array< float, 3u >{
+          m[ a + 1u ] * m[ b + 2u ] - m[ a + 2u ] * m[ b + 1u ],
+          m[ a + 2u ] * m[ b ] - m[ a ] * m[ b + 2u ],
+          m[ a ] * m[ b + 1u ] - m[ a + 1u ] * m[ b ]
+        };
+      };
+      const auto x = cross( 4u, 8u );
+      const auto y = cross( 8u, 0u );
+      const auto z = cross( 0u, 4u );
+      const float sign = m[ 0 ] * x[ 0 ] + m[ 1 ] * x[ 1 ] + m[ 2 ] * x[ 2 ] < 0.f ? -1.f : 1.f;
+      return std::array< float, 9u >{
+        x[ 0 ] * sign, x[ 1 ] * sign, x[ 2 ] * sign,
+        y[ 0 ] * sign, y[ 1 ] * sign, y[ 2 ] * sign,
+        z[ 0 ] * sign, z[ 1 ] * sign, z[ 2 ] * sign
+      };
+    }
+    std::array< float, 3u > transform_normal(
+      const std::array< float, 9u > &m,
+      const float *v
+    ) {
+      std::array< float, 3u > n{
+        m[ 0 ] * v[ 0 ] + m[ 3 ] * v[ 1 ] + m[ 6 ] * v[ 2 ],
+        m[ 1 ] * v[ 0 ] + m[ 4 ] * v[ 1 ] + m[ 7 ] * v[ 2 ],
+        m[ 2 ] * v[ 0 ] + m[ 5 ] * v[ 1 ] + m[ 8 ] * v[ 2 ]
+      };
+      const float length = std::sqrt( n[ 0 ] * n[ 0 ] + n[ 1 ] * n[ 1 ] + n[ 2 ] * n[ 2 ] );
+      if( length > 0.f )
+        for( auto &e: n ) e /= length;
+      return n;
+    }
+    struct meshopt_view_t {
+      uint32_t buffer;
+      size_t offset;
+      size_t size;
+      size_t stride;
+      size_t count;
+      vw::meshopt_mode_t mode;
+      vw::meshopt_filter_t filter;
+    };
+    std::optional< meshopt_view_t > get_meshopt_view(
+      const fx::gltf::Document &doc,
+      size_t index
+    ) {
+      const auto &view = doc.bufferViews[ index ];
+      const auto extension = get_extension( view.extensionsAndExtras, "EXT_meshopt_compression" );
+      if( !extension ) return std::nullopt;
+      meshopt_view_t compressed;
+      std::string mode;
+      std::string filter;
+      try {
+        const int64_t buffer = extension->at( "buffer" ).get< int64_t >();
+        if( buffer < 0 || doc.buffers.size() <= size_t( buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+        compressed.buffer = uint32_t( buffer );
+        compressed.offset = extension->value( "byteOffset", size_t( 0u ) );
+        compressed.size = extension->at( "byteLength" ).get< size_t >();
+        compressed.stride = extension->at( "byteStride" ).get< size_t >();
+        compressed.count = extension->at( "count" ).get< size_t >();
+        mode = extension->at( "mode" ).get< std::string >();
+        filter = extension->value( "filter", std::string( "NONE" ) );
+      }
+      catch( const nlohmann::json::exception& ) {
+        throw vw::invalid_gltf( "EXT_meshopt_compressionの内容が不正", __FILE__, __LINE__ );
+      }
+      if( mode == "ATTRIBUTES" ) compressed.mode = vw::meshopt_mode_t::attributes;
+      else if( mode == "TRIANGLES" ) compressed.mode = vw::meshopt_mode_t::triangles;
+      else if( mode == "INDICES" ) compressed.mode = vw::meshopt_mode_t::indices;
+      else throw vw::invalid_gltf( "EXT_meshopt_compressionの未知のmode", __FILE__, __LINE__ );
+      if( filter == "NONE" ) compressed.filter = vw::meshopt_filter_t::none;
+      else if( filter == "OCTAHEDRAL" ) compressed.filter = vw::meshopt_filter_t::octahedral;
+      else if( filter == "QUATERNION" ) compressed.filter = vw::meshopt_filter_t::quaternion;
+      else if( filter == "EXPONENTIAL" ) compressed.filter = vw::meshopt_filter_t::exponential;
+      else throw vw::invalid_gltf( "EXT_meshopt_compressionの未知のfilter", __FILE__, __LINE__ );
+      if( compressed.offset + compressed.size > size_t( doc.buffers[ compressed.buffer ].byteLength ) ) throw vw::invalid_gltf( "圧縮されたデータがbufferの範囲を超えている", __FILE__, __LINE__ );
+      if( compressed.count * compressed.stride != size_t( view.byteLength ) ) throw vw::invalid_gltf( "bufferViewの長さが展開後の大きさと一致しない", __FILE__, __LINE__ );
+      return compressed;
+    }
+  }
+  buffer_layouts_t create_buffer_layout() {
+    buffer_layouts_t layouts( 2u );
+    layouts[ vertex_buffer_index ].set_usage( vk::BufferUsageFlagBits::eVertexBuffer );
+    layouts[ index_buffer_index ].set_usage( vk::BufferUsageFlagBits::eIndexBuffer );
+    return layouts;
+  }
+  size_t add_buffer_view(
+    const fx::gltf::Document &doc,
+    buffer_layout_t &layout,
+    int32_t index
+  ) {
+    if( index < 0 || doc.bufferViews.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+    const auto existing = layout.view_offset.find( index );
+    if( existing != layout.view_offset.end() ) return existing->second;
+    const auto &view = doc.bufferViews[ index ];
+    if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+    if( size_t( view.byteOffset ) + size_t( view.byteLength ) > size_t( doc.buffers[ view.buffer ].byteLength ) ) throw vw::invalid_gltf( "bufferViewがbufferの範囲を超えている", __FILE__, __LINE__ );
+    const size_t offset = ( ( layout.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+    layout.range.push_back(
+      buffer_range_t()
+        .set_view( index )
+        .set_buffer( view.buffer )
+        .set_source_offset( view.byteOffset )
+        .set_size( view.byteLength )
+        .set_offset( offset )
+    );
+    layout.size = offset + view.byteLength;
+    layout.view_offset.insert( std::make_pair( index, offset ) );
+    return offset;
+  }
+  size_t add_interleaved(
+    buffer_layout_t &layout,
+    interleaved_range_t &&range
+  ) {
+    const size_t offset = ( ( layout.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+    range.set_offset( offset );
+    layout.size = offset + range.stride * range.count;
+    layout.interleaved.push_back( std::move( range ) );
+    return offset;
+  }
+  size_t add_converted(
+    buffer_layout_t &layout,
+    converted_range_t &&range
+  ) {
+    const size_t offset = ( ( layout.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+    range.set_offset( offset );
+    layout.size = offset + ( range.stride * range.count + 3u ) / 4u * 4u;
+    layout.converted.push_back( std::move( range ) );
+    return offset;
+  }
+  size_t add_draco(
+    buffer_layout_t &layout,
+    draco_range_t &&range
+  ) {
+    const size_t offset = ( ( layout.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+    range.set_offset( offset );
+    layout.size = offset + range.stride * range.count;
+    layout.draco.push_back( std::move( range ) );
+    return offset;
+  }
+  size_t add_optimized_index(
+    buffer_layout_t &layout,
+    optimized_index_t &&index
+  ) {
+    const size_t offset = ( ( layout.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+    index.set_offset( offset );
+    layout.size = offset + index.size * index.count;
+    layout.optimized.push_back( std::move( index ) );
+    return offset;
+  }
+  size_t add_lod(
+    buffer_layout_t &layout,
+    lod_range_t &&range
+  ) {
+    for( auto &level: range.level ) {
+      const size_t offset = ( ( layout.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+      level.set_offset( offset );
+      layout.size = offset + range.size * level.target;
+    }
+    layout.lod.push_back( std::move( range ) );
+    return layout.lod.size() - 1u;
+  }
+  size_t add_hlod(
+    buffer_layouts_t &layouts,
+    hlod_range_t &&range
+  ) {
+    if( layouts.size() <= index_buffer_index ) throw vw::invalid_argument( "頂点とインデックスのバッファが無い", __FILE__, __LINE__ );
+    auto &index = layouts[ index_buffer_index ];
+    index.hlod.push_back( std::move( range ) );
+    return index.hlod.size() - 1u;
+  }
+  void place_hlod(
+    buffer_layouts_t &layouts
+  ) {
+    if( layouts.size() <= index_buffer_index ) return;
+    auto &vertex = layouts[ vertex_buffer_index ];
+    auto &index = layouts[ index_buffer_index ];
+    for( auto &range: index.hlod ) {
+      const size_t vertex_offset = ( ( vertex.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+      range.set_vertex_offset( vertex_offset );
+      vertex.size = vertex_offset + hlod_vertex_stride * range.used_vertex_count;
+      const size_t offset = ( ( index.size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+      range.set_offset( offset );
+      index.size = offset + sizeof( uint32_t ) * range.count;
+    }
+  }
   buffers_t create_buffer(
     const fx::gltf::Document &doc,
     const vw::context_t &context,
-    const std::filesystem::path cd
+    const std::filesystem::path cd,
+    const glb_t &glb,
+    buffer_layouts_t &layouts,
+    std::vector< std::vector< uint8_t > > *content
   ) {
-    buffers_t buffers;
-    for( const auto &buffer: doc.buffers ) {
-      auto buffer_path = std::filesystem::path( buffer.uri );
+    std::vector< std::optional< data_uri_t > > embedded( doc.buffers.size() );
+    for( size_t index = 0u; index != doc.buffers.size(); ++index ) {
+      embedded[ index ] = parse_data_uri( doc.buffers[ index ].uri );
+      if( embedded[ index ] ) {
+        const size_t decoded_size = vw::get_base64_decoded_size( embedded[ index ]->begin, embedded[ index ]->end );
+        if( decoded_size < size_t( doc.buffers[ index ].byteLength ) ) throw vw::invalid_gltf( "bufferの内容が指定された長さに満たない", __FILE__, __LINE__ );
+      }
+    }
+    std::vector< std::optional< meshopt_view_t > > meshopt( doc.bufferViews.size() );
+    for( size_t index = 0u; index != doc.bufferViews.size(); ++index )
+      meshopt[ index ] = get_meshopt_view( doc, index );
+    const auto get_meshopt = [&]( int32_t view ) -> const std::optional< meshopt_view_t >& {
+      static const std::optional< meshopt_view_t > none;
+      return view >= 0 && size_t( view ) < meshopt.size() ? meshopt[ view ] : none;
+    };
+    // 参照されている範囲を調べ、圧縮されたbufferViewは展開後の置き場所ではなく圧縮されたデータの範囲を数える
+    std::vector< std::pair< size_t, size_t > > span( doc.buffers.size(), std::make_pair( std::numeric_limits< size_t >::max(), size_t( 0u ) ) );
+    const auto add_span = [&]( uint32_t buffer, size_t begin, size_t end ) {
+      span[ buffer ].first = std::min( span[ buffer ].first, begin );
+      span[ buffer ].second = std::max( span[ buffer ].second, end );
+    };
+    const auto add_uncompressed_span = [&]( uint32_t buffer, size_t begin, size_t end ) {
+      if( is_fallback_buffer( doc.buffers[ buffer ] ) ) throw vw::invalid_gltf( "EXT_meshopt_compressionのfallbackのbufferが圧縮されていないbufferViewから参照されている", __FILE__, __LINE__ );
+      add_span( buffer, begin, end );
+    };
+    const auto add_attribute_span = [&]( const interleaved_attribute_t &attr, size_t count ) {
+      if( const auto &compressed = get_meshopt( attr.view ); compressed )
+        add_span( compressed->buffer, compressed->offset, compressed->offset + compressed->size );
+      else if( count ) add_uncompressed_span( attr.buffer, attr.source_offset, attr.source_offset + attr.source_stride * ( count - 1u ) + attr.size );
+    };
+    std::vector< int32_t > draco_views;
+    for( const auto &layout: layouts ) {
+      for( const auto &range: layout.range ) {
+        if( const auto &compressed = get_meshopt( range.view ); compressed )
+          add_span( compressed->buffer, compressed->offset, compressed->offset + compressed->size );
+        else add_uncompressed_span( range.buffer, range.source_offset, range.source_offset + range.size );
+      }
+      for( const auto &range: layout.interleaved )
+        for( const auto &attr: range.attribute )
+          add_attribute_span( attr, range.count );
+      for( const auto &optimized: layout.optimized ) {
+        add_attribute_span( optimized.index, optimized.count );
+        if( optimized.has_position ) add_attribute_span( optimized.position, optimized.vertex_count );
+      }
+      for( const auto &source: layout.hlod_source ) {
+        add_attribute_span( source.index, source.count );
+        add_attribute_span( source.position, source.vertex_count );
+        add_attribute_span( source.normal, source.vertex_count );
+      }
+      for( const auto &range: layout.draco ) {
+        if( range.view < 0 || doc.bufferViews.size() <= size_t( range.view ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+        const auto &view = doc.bufferViews[ range.view ];
+        if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+        if( size_t( view.byteOffset ) + size_t( view.byteLength ) > size_t( doc.buffers[ view.buffer ].byteLength ) ) throw vw::invalid_gltf( "bufferViewがbufferの範囲を超えている", __FILE__, __LINE__ );
+        add_uncompressed_span( view.buffer, view.byteOffset, size_t( view.byteOffset ) + size_t( view.byteLength ) );
+        if( std::find( draco_views.begin(), draco_views.end(), range.view ) == draco_views.end() ) draco_views.push_back( range.view );
+      }
+    }
+    // 外部ファイルのbufferはマップしてステージングバッファへの書き込みで参照された部分だけを読ませる
+    // 読んだページはファイルに戻せるので、常駐するメモリがbufferの大きさに比例しない
+    std::vector< vw::mapped_file_t > sources;
+    std::vector< std::pair< const uint8_t*, const uint8_t* > > source_range( doc.buffers.size(), std::make_pair( nullptr, nullptr ) );
+    for( size_t index = 0u; index != doc.buffers.size(); ++index ) {
+      if( doc.buffers[ index ].uri.empty() || embedded[ index ] || span[ index ].first >= span[ index ].second ) continue;
+      auto buffer_path = std::filesystem::path( doc.buffers[ index ].uri );
       if( buffer_path.is_relative() ) buffer_path = cd / buffer_path;
-      buffers.push_back(
-        buffer_t()
-          .set_buffer(
-            vw::load_buffer_from_file( context, buffer_path.string(), vk::BufferUsageFlagBits::eVertexBuffer|vk::BufferUsageFlagBits::eIndexBuffer )
-          )
-      );
+      sources.push_back( vw::map_file( buffer_path.string() ) );
+      source_range[ index ] = std::make_pair( sources.back().begin(), sources.back().end() );
+    }
+    for( size_t index = 0u; index != doc.buffers.size(); ++index )
+      if( doc.buffers[ index ].uri.empty() && !is_fallback_buffer( doc.buffers[ index ] ) ) source_range[ index ] = std::make_pair( glb.bin_begin, glb.bin_end );
+    // インターリーブする頂点の生成や圧縮の展開には任意の位置を読む必要がある為、data URIは先にデコードしておく
+    std::vector< std::vector< uint8_t > > decoded( doc.buffers.size() );
+    const auto decode_embedded = [&]( uint32_t buffer ) {
+      if( !embedded[ buffer ] || !decoded[ buffer ].empty() ) return;
+      const auto &uri = *embedded[ buffer ];
+      decoded[ buffer ].resize( vw::get_base64_decoded_size( uri.begin, uri.end ) );
+      decoded[ buffer ].resize( vw::decode_base64( uri.begin, uri.end, decoded[ buffer ].data() ) );
+      source_range[ buffer ] = std::make_pair( decoded[ buffer ].data(), decoded[ buffer ].data() + decoded[ buffer ].size() );
+    };
+    const auto decode_attribute_embedded = [&]( const interleaved_attribute_t &attr ) {
+      if( const auto &compressed = get_meshopt( attr.view ); compressed ) decode_embedded( compressed->buffer );
+      else decode_embedded( attr.buffer );
+    };
+    for( const auto &layout: layouts ) {
+      for( const auto &range: layout.range )
+        if( const auto &compressed = get_meshopt( range.view ); compressed ) decode_embedded( compressed->buffer );
+      for( const auto &range: layout.interleaved )
+        for( const auto &attr: range.attribute )
+          decode_attribute_embedded( attr );
+      for( const auto &range: layout.converted )
+        decode_attribute_embedded( range.source );
+      for( const auto &optimized: layout.optimized ) {
+        decode_attribute_embedded( optimized.index );
+        if( optimized.has_position ) decode_attribute_embedded( optimized.position );
+      }
+      for( const auto &lod: layout.lod ) {
+        if( lod.optimized < 0 ) decode_attribute_embedded( lod.index );
+        decode_attribute_embedded( lod.position );
+        if( lod.has_normal ) decode_attribute_embedded( lod.normal );
+        if( lod.has_texcoord ) decode_attribute_embedded( lod.texcoord );
+      }
+      for( const auto &source: layout.hlod_source ) {
+        decode_attribute_embedded( source.index );
+        decode_attribute_embedded( source.position );
+        decode_attribute_embedded( source.normal );
+      }
+    }
+    for( const auto view: draco_views )
+      decode_embedded( doc.bufferViews[ view ].buffer );
+    const auto get_source = [&]( uint32_t buffer, size_t source_offset, size_t size ) {
+      const auto [begin,end] = source_range[ buffer ];
+      if( size == 0u ) return begin;
+      if( !begin ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+      if( size_t( std::distance( begin, end ) ) < source_offset + size ) throw vw::invalid_gltf( "bufferの内容が指定された長さに満たない", __FILE__, __LINE__ );
+      return begin + source_offset;
+    };
+    size_t compressed_size = 0u;
+    size_t expanded_size = 0u;
+    // インターリーブの元になる圧縮されたbufferViewとDracoのメッシュは並列に展開しておく
+    std::vector< int32_t > expand_views;
+    std::unordered_map< int32_t, std::vector< uint8_t > > expanded;
+    const auto expand = [&]( const interleaved_attribute_t &attr ) {
+      const auto &compressed = get_meshopt( attr.view );
+      if( !compressed || expanded.find( attr.view ) != expanded.end() ) return;
+      expanded.insert( std::make_pair( attr.view, std::vector< uint8_t >( compressed->count * compressed->stride ) ) );
+      expand_views.push_back( attr.view );
+      compressed_size += compressed->size;
+      expanded_size += compressed->count * compressed->stride;
+    };
+    for( const auto &layout: layouts ) {
+      for( const auto &range: layout.interleaved )
+        for( const auto &attr: range.attribute )
+          expand( attr );
+      for( const auto &range: layout.converted )
+        expand( range.source );
+      for( const auto &optimized: layout.optimized ) {
+        expand( optimized.index );
+        if( optimized.has_position ) expand( optimized.position );
+      }
+      for( const auto &lod: layout.lod ) {
+        if( lod.optimized < 0 ) expand( lod.index );
+        expand( lod.position );
+        if( lod.has_normal ) expand( lod.normal );
+        if( lod.has_texcoord ) expand( lod.texcoord );
+      }
+      for( const auto &source: layout.hlod_source ) {
+        expand( source.index );
+        expand( source.position );
+        expand( source.normal );
+      }
+    }
+    std::vector< const uint8_t* > expand_source;
+    expand_source.reserve( expand_views.size() );
+    for( const auto view: expand_views ) {
+      const auto &compressed = *get_meshopt( view );
+      expand_source.push_back( get_source( compressed.buffer, compressed.offset, compressed.size ) );
+    }
+    std::vector< const uint8_t* > draco_source;
+    draco_source.reserve( draco_views.size() );
+    for( const auto view: draco_views ) {
+      const auto &source_view = doc.bufferViews[ view ];
+      draco_source.push_back( get_source( source_view.buffer, source_view.byteOffset, source_view.byteLength ) );
+      compressed_size += source_view.byteLength;
+    }
+    std::vector< std::shared_ptr< vw::draco_mesh_t > > draco_decoded( draco_views.size() );
+    vw::parallel_for( expand_views.size() + draco_views.size(), [&]( size_t i ) {
+      if( i < expand_views.size() ) {
+        const auto &compressed = *get_meshopt( expand_views[ i ] );
+        const uint8_t *source = expand_source[ i ];
+        vw::decode_meshopt( source, source + compressed.size, compressed.count, compressed.stride, compressed.mode, compressed.filter, expanded.at( expand_views[ i ] ).data() );
+      }
+      else {
+        const size_t j = i - expand_views.size();
+        const uint8_t *source = draco_source[ j ];
+        draco_decoded[ j ] = vw::decode_draco( source, source + doc.bufferViews[ draco_views[ j ] ].byteLength );
+      }
+    } );
+    std::unordered_map< int32_t, std::shared_ptr< vw::draco_mesh_t > > draco_meshes;
+    for( size_t i = 0u; i != draco_views.size(); ++i )
+      draco_meshes.insert( std::make_pair( draco_views[ i ], std::move( draco_decoded[ i ] ) ) );
+    const auto get_attribute_source = [&]( const interleaved_attribute_t &attr, size_t count ) {
+      const size_t source_size = count ? attr.source_stride * ( count - 1u ) + attr.size : 0u;
+      if( const auto &compressed = get_meshopt( attr.view ); compressed ) {
+        const auto &data = expanded.at( attr.view );
+        const size_t offset = attr.source_offset - doc.bufferViews[ attr.view ].byteOffset;
+        if( data.size() < offset + source_size ) throw vw::invalid_gltf( "bufferViewの内容が指定された長さに満たない", __FILE__, __LINE__ );
+        return static_cast< const uint8_t* >( data.data() + offset );
+      }
+      return get_source( attr.buffer, attr.source_offset, source_size );
+    };
+    // インデックスの最適化とmeshletへの分割はプリミティブ毎に並列に行う
+    std::vector< optimized_index_t > no_optimized;
+    auto &optimized_requests = layouts.size() > index_buffer_index ? layouts[ index_buffer_index ].optimized : no_optimized;
+    std::vector< std::pair< const uint8_t*, const uint8_t* > > optimize_source;
+    optimize_source.reserve( optimized_requests.size() );
+    for( const auto &optimized: optimized_requests )
+      optimize_source.push_back( std::make_pair(
+        get_attribute_source( optimized.index, optimized.count ),
+        optimized.has_position ? get_attribute_source( optimized.position, optimized.vertex_count ) : nullptr
+      ) );
+    std::vector< optimized_indices_t > optimized_indices( optimized_requests.size() );
+    std::vector< std::vector< meshlet_t > > optimized_meshlets( optimized_requests.size() );
+    vw::parallel_for( optimized_requests.size(), [&]( size_t i ) {
+      const auto &optimized = optimized_requests[ i ];
+      const auto [index,position] = optimize_source[ i ];
+      auto source = read_indices( index, optimized.index.size, optimized.index.source_stride, optimized.count );
+      if( optimized.optimize )
+        optimized_indices[ i ] = optimize_indices( source, position, optimized.position.source_stride, optimized.vertex_count );
+      else optimized_indices[ i ] = optimized_indices_t{ std::move( source ), std::vector< uint32_t >(), 0.f, 0.f };
+      if( optimized.build_meshlet && position ) {
+        // 並べ替えた後の頂点番号で位置を引けるようにする
+        const auto &remap = optimized_indices[ i ].remap;
+        std::vector< float > remapped;
+        if( !remap.empty() ) {
+          remapped.resize( optimized.vertex_count * 3u );
+          for( size_t v = 0u; v != optimized.vertex_count; ++v )
+            std::memcpy( remapped.data() + v * 3u, position + remap[ v ] * optimized.position.source_stride, sizeof( float ) * 3u );
+        }
+        optimized_meshlets[ i ] = build_meshlets(
+          optimized_indices[ i ].index,
+          remap.empty() ? position : reinterpret_cast< const uint8_t* >( remapped.data() ),
+          remap.empty() ? optimized.position.source_stride : sizeof( float ) * 3u,
+          optimized.vertex_count
+        );
+      }
+    } );
+    size_t meshlet_count = 0u;
+    for( size_t i = 0u; i != optimized_requests.size(); ++i ) {
+      meshlet_count += optimized_meshlets[ i ].size();
+      optimized_requests[ i ].set_meshlet( std::move( optimized_meshlets[ i ] ) );
+    }
+    // LODもプリミティブ毎に並列に簡略化する 並べ替えたプリミティブは並べ替えた後の頂点番号で簡略化する
+    std::vector< lod_range_t > no_lod;
+    auto &lod_requests = layouts.size() > index_buffer_index ? layouts[ index_buffer_index ].lod : no_lod;
+    std::vector< std::array< const uint8_t*, 4u > > lod_source;
+    lod_source.reserve( lod_requests.size() );
+    for( const auto &lod: lod_requests )
+      lod_source.push_back( std::array< const uint8_t*, 4u >{
+        lod.optimized < 0 ? get_attribute_source( lod.index, lod.count ) : nullptr,
+        get_attribute_source( lod.position, lod.vertex_count ),
+        lod.has_normal ? get_attribute_source( lod.normal, lod.vertex_count ) : nullptr,
+        lod.has_texcoord ? get_attribute_source( lod.texcoord, lod.vertex_count ) : nullptr
+      } );
+    std::vector< std::vector< simplified_indices_t > > simplified( lod_requests.size() );
+    vw::parallel_for( lod_requests.size(), [&]( size_t i ) {
+      const auto &lod = lod_requests[ i ];
+      const auto &source = lod_source[ i ];
+      std::vector< uint32_t > index;
+      const uint32_t *remap = nullptr;
+      if( lod.optimized >= 0 ) {
+        if( optimized_indices.size() <= size_t( lod.optimized ) || optimized_indices[ lod.optimized ].remap.size() < lod.vertex_count ) throw vw::invalid_argument( "頂点の並べ替えの対応が無い", __FILE__, __LINE__ );
+        index = optimized_indices[ lod.optimized ].index;
+        remap = optimized_indices[ lod.optimized ].remap.data();
+      }
+      else index = read_indices( source[ 0 ], lod.index.size, lod.index.source_stride, lod.count );
+      const size_t attribute_count = ( lod.has_normal ? 3u : 0u ) + ( lod.has_texcoord ? 2u : 0u );
+      std::vector< float > position( lod.vertex_count * 3u );
+      std::vector< float > attribute( lod.vertex_count * attribute_count );
+      for( size_t v = 0u; v != lod.vertex_count; ++v ) {
+        const size_t from = remap ? remap[ v ] : v;
+        std::memcpy( position.data() + v * 3u, source[ 1 ] + from * lod.position.source_stride, sizeof( float ) * 3u );
+        float *dest = attribute.data() + v * attribute_count;
+        if( lod.has_normal ) {
+          std::memcpy( dest, source[ 2 ] + from * lod.normal.source_stride, sizeof( float ) * 3u );
+          dest += 3u;
+        }
+        if( lod.has_texcoord ) std::memcpy( dest, source[ 3 ] + from * lod.texcoord.source_stride, sizeof( float ) * 2u );
+      }
+      std::vector< size_t > target;
+      for( const auto &level: lod.level ) target.push_back( level.target );
+      simplified[ i ] = simplify( index, position.data(), attribute_count ? attribute.data() : nullptr, attribute_count, lod.vertex_count, target );
+      for( auto &level: simplified[ i ] )
+        level.index = optimize_vertex_cache( level.index, lod.vertex_count );
+    } );
+    size_t lod_levels = 0u;
+    for( size_t i = 0u; i != lod_requests.size(); ++i ) {
+      size_t previous = lod_requests[ i ].count;
+      for( size_t j = 0u; j != lod_requests[ i ].level.size(); ++j ) {
+        auto &level = lod_requests[ i ].level[ j ];
+        const auto &result = simplified[ i ][ j ];
+        // 目標に届かなかったか、1つ前のLODからほとんど減らなかったLODは使わない
+        if( result.index.empty() || result.index.size() > level.target || result.index.size() * 8u > previous * 7u ) {
+          level.set_count( 0u );
+          continue;
+        }
+        level.set_count( result.index.size() );
+        level.set_error( result.error );
+        previous = result.index.size();
+        ++lod_levels;
+      }
+    }
+    // HLODの代理メッシュはクラスタ毎に並列にシーンの座標系でまとめてから簡略化する
+    std::vector< hlod_source_t > no_hlod_source;
+    std::vector< hlod_range_t > no_hlod;
+    const auto &hlod_sources = layouts.size() > index_buffer_index ? layouts[ index_buffer_index ].hlod_source : no_hlod_source;
+    auto &hlod_requests = layouts.size() > index_buffer_index ? layouts[ index_buffer_index ].hlod : no_hlod;
+    std::vector< std::array< const uint8_t*, 3u > > hlod_source_data;
+    hlod_source_data.reserve( hlod_sources.size() );
+    for( const auto &source: hlod_sources )
+      hlod_source_data.push_back( std::array< const uint8_t*, 3u >{
+        get_attribute_source( source.index, source.count ),
+        get_attribute_source( source.position, source.vertex_count ),
+        get_attribute_source( source.normal, source.vertex_count )
+      } );
+    std::vector< std::vector< float > > hlod_vertices( hlod_requests.size() );
+    std::vector< simplified_indices_t > hlod_indices( hlod_requests.size() );
+    vw::parallel_for( hlod_requests.size(), [&]( size_t i ) {
+      const auto &hlod = hlod_requests[ i ];
+      auto &vertex = hlod_vertices[ i ];
+      vertex.assign( hlod.vertex_count * 8u, 0.f );
+      // 法線とテクスチャの座標を簡略化の誤差に加え、異なるマテリアルの境目を継ぎ目として残す
+      std::vector< float > position( hlod.vertex_count * 3u );
+      std::vector< float > attribute( hlod.vertex_count * 5u );
+      std::vector< uint32_t > index;
+      index.reserve( hlod.index_count );
+      size_t base = 0u;
+      for( const auto &part: hlod.part ) {
+        if( hlod_sources.size() <= part.source ) throw vw::invalid_argument( "参照されたHLODの元のプリミティブが存在しない", __FILE__, __LINE__ );
+        const auto &source = hlod_sources[ part.source ];
+        const auto &data = hlod_source_data[ part.source ];
+        if( base + source.vertex_count > hlod.vertex_count || index.size() + source.count > hlod.index_count ) throw vw::invalid_argument( "HLODの領域が足りない", __FILE__, __LINE__ );
+        const auto normal_matrix = get_normal_matrix( part.matrix );
+        for( size_t v = 0u; v != source.vertex_count; ++v ) {
+          std::array< float, 3u > p;
+          std::array< float, 3u > n;
+          std::memcpy( p.data(), data[ 1 ] + v * source.position.source_stride, sizeof( float ) * 3u );
+          std::memcpy( n.data(), data[ 2 ] + v * source.normal.source_stride, sizeof( float ) * 3u );
+          const auto moved = transform_position( part.matrix, p.data() );
+          const auto turned = transform_normal( normal_matrix, n.data() );
+          float *dest = vertex.data() + ( base + v ) * 8u;
+          std::copy( moved.begin(), moved.end(), dest );
+          std::copy( turned.begin(), turned.end(), dest + 3u );
+          std::copy( part.texcoord.begin(), part.texcoord.end(), dest + 6u );
+          std::copy( dest, dest + 3u, position.data() + ( base + v ) * 3u );
+          std::copy( dest + 3u, dest + 8u, attribute.data() + ( base + v ) * 5u );
+        }
+        for( const auto value: read_indices( data[ 0 ], source.index.size, source.index.source_stride, source.count ) ) {
+          if( value >= source.vertex_count ) throw vw::invalid_gltf( "インデックスが頂点の数を超えている", __FILE__, __LINE__ );
+          index.push_back( uint32_t( base + value ) );
+        }
+        base += source.vertex_count;
+      }
+      auto simplified = simplify( index, position.data(), attribute.data(), 5u, hlod.vertex_count, std::vector< size_t >{ hlod.target } );
+      // 目標に届かなくてもまとめるだけで描画の回数は減るので、簡略化できなかった場合はまとめた物をそのまま使う
+      if( simplified.empty() || simplified.front().index.empty() ) hlod_indices[ i ] = simplified_indices_t{ std::move( index ), 0.f };
+      else hlod_indices[ i ] = std::move( simplified.front() );
+      hlod_indices[ i ].index = optimize_vertex_cache( hlod_indices[ i ].index, hlod.vertex_count );
+      // 簡略化で参照されなくなった頂点は置かず、残った頂点を最初に参照された順に詰める
+      std::vector< uint32_t > remap( hlod.vertex_count, std::numeric_limits< uint32_t >::max() );
+      std::vector< float > compact;
+      for( auto &value: hlod_indices[ i ].index ) {
+        if( remap[ value ] == std::numeric_limits< uint32_t >::max() ) {
+          remap[ value ] = uint32_t( compact.size() / 8u );
+          compact.insert( compact.end(), vertex.data() + size_t( value ) * 8u, vertex.data() + size_t( value + 1u ) * 8u );
+        }
+        value = remap[ value ];
+      }
+      vertex = std::move( compact );
+    } );
+    size_t hlod_triangles = 0u;
+    size_t hlod_simplified_triangles = 0u;
+    size_t hlod_vertex_count = 0u;
+    size_t hlod_used_vertex_count = 0u;
+    for( size_t i = 0u; i != hlod_requests.size(); ++i ) {
+      hlod_requests[ i ].set_count( hlod_indices[ i ].index.size() );
+      hlod_requests[ i ].set_used_vertex_count( hlod_vertices[ i ].size() / 8u );
+      hlod_requests[ i ].set_error( hlod_indices[ i ].error );
+      hlod_triangles += hlod_requests[ i ].index_count / 3u;
+      hlod_simplified_triangles += hlod_requests[ i ].count / 3u;
+      hlod_vertex_count += hlod_requests[ i ].vertex_count;
+      hlod_used_vertex_count += hlod_requests[ i ].used_vertex_count;
+    }
+    place_hlod( layouts );
+    size_t total = 0u;
+    for( const auto &buffer: doc.buffers ) total += buffer.byteLength;
+    size_t uploaded = 0u;
+    size_t converted_on_gpu = 0u;
+    size_t converted_on_cpu = 0u;
+    buffers_t buffers;
+    if( content ) content->assign( layouts.size(), std::vector< uint8_t >() );
+    for( const auto &layout: layouts ) {
+      if( layout.size == 0u ) {
+        buffers.push_back( buffer_t() );
+        continue;
+      }
+      std::vector< vw::buffer_region_t > regions;
+      regions.reserve( layout.range.size() + layout.interleaved.size() + layout.converted.size() + layout.draco.size() );
+      for( const auto &range: layout.interleaved ) {
+        std::vector< interleaved_source_t > attrs;
+        for( const auto &attr: range.attribute ) {
+          const uint8_t *source = get_attribute_source( attr, range.count );
+          attrs.push_back( interleaved_source_t{ source, attr.source_stride, attr.size, attr.offset, attr.conversion, attr.components, attr.bias, attr.scale, attr.fill, attr.fill_size } );
+        }
+        const uint32_t *remap = nullptr;
+        if( range.remap >= 0 ) {
+          if( optimized_indices.size() <= size_t( range.remap ) || optimized_indices[ range.remap ].remap.size() < range.count ) throw vw::invalid_argument( "頂点の並べ替えの対応が無い", __FILE__, __LINE__ );
+          remap = optimized_indices[ range.remap ].remap.data();
+        }
+        regions.push_back(
+          vw::buffer_region_t()
+            .set_offset( range.offset )
+            .set_size( range.stride * range.count )
+            .set_fill(
+              [attrs,remap,stride=range.stride]( size_t offset, size_t size, uint8_t *out ) {
+                interleave( attrs, remap, stride, offset, size, out );
+              }
+            )
+        );
+      }
+      // 広げる前の内容を詰めたバッファと広げた先のバッファの両方をディスクリプタで指せればコンピュートシェーダで広げる
+      std::vector< size_t > conversion_offset;
+      size_t conversion_source_size = 0u;
+      for( const auto &range: layout.converted ) {
+        const size_t offset = ( ( conversion_source_size + buffer_view_alignment - 1u ) / buffer_view_alignment ) * buffer_view_alignment;
+        conversion_offset.push_back( offset );
+        conversion_source_size = offset + ( range.count ? range.source.source_stride * ( range.count - 1u ) + range.source.size : 0u );
+      }
+      // 転送する内容を書き出す場合はCPUで広げる
+      const bool convert_on_gpu =
+        !content && conversion_source_size != 0u && context.converter &&
+        ( layout.size + 3u ) / 4u * 4u <= context.converter->get_max_range() &&
+        ( conversion_source_size + 3u ) / 4u * 4u <= context.converter->get_max_range();
+      std::vector< vw::buffer_region_t > conversion_source;
+      std::vector< vw::buffer_conversion_t > conversions;
+      for( size_t i = 0u; i != layout.converted.size(); ++i ) {
+        const auto &range = layout.converted[ i ];
+        const uint8_t *source = get_attribute_source( range.source, range.count );
+        if( convert_on_gpu ) {
+          const size_t source_size = range.count ? range.source.source_stride * ( range.count - 1u ) + range.source.size : 0u;
+          conversion_source.push_back(
+            vw::buffer_region_t()
+              .set_begin( source )
+              .set_end( source + source_size )
+              .set_offset( conversion_offset[ i ] )
+          );
+          conversions.push_back(
+            vw::buffer_conversion_t()
+              .set_source_offset( conversion_offset[ i ] )
+              .set_source_stride( range.source.source_stride )
+              .set_size( range.source.size )
+              .set_offset( range.offset )
+              .set_stride( range.stride )
+              .set_count( range.count )
+              .set_fill( range.source.fill )
+          );
+          ++converted_on_gpu;
+          continue;
+        }
+        regions.push_back(
+          vw::buffer_region_t()
+            .set_offset( range.offset )
+            .set_size( range.stride * range.count )
+            .set_fill(
+              [source,range]( size_t offset, size_t size, uint8_t *out ) {
+                fill_elements( range.stride, offset, size, out, [&]( size_t first, size_t count, uint8_t *dest ) {
+                  std::fill( dest, dest + range.stride * count, 0u );
+                  for( size_t k = 0u; k != count; ++k ) {
+                    const uint8_t *element = source + ( first + k ) * range.source.source_stride;
+                    std::copy( element, element + range.source.size, dest + k * range.stride );
+                    write_fill( range.source.fill, range.stride - range.source.size, dest + k * range.stride + range.source.size );
+                  }
+                } );
+              }
+            )
+        );
+        ++converted_on_cpu;
+      }
+      if( !layout.optimized.empty() && &layout != &layouts[ index_buffer_index ] ) throw vw::invalid_argument( "最適化するインデックスはインデックスのバッファにしか置けない", __FILE__, __LINE__ );
+      for( size_t i = 0u; i != layout.optimized.size(); ++i ) {
+        const auto &optimized = layout.optimized[ i ];
+        const uint32_t *index = optimized_indices[ i ].index.data();
+        regions.push_back(
+          vw::buffer_region_t()
+            .set_offset( optimized.offset )
+            .set_size( optimized.size * optimized.count )
+            .set_fill(
+              [index,size=optimized.size]( size_t offset, size_t length, uint8_t *out ) {
+                write_indices( index, size, offset, length, out );
+              }
+            )
+        );
+      }
+      if( !layout.lod.empty() && &layout != &layouts[ index_buffer_index ] ) throw vw::invalid_argument( "LODのインデックスはインデックスのバッファにしか置けない", __FILE__, __LINE__ );
+      for( size_t i = 0u; i != layout.lod.size(); ++i ) {
+        const auto &lod = layout.lod[ i ];
+        for( size_t j = 0u; j != lod.level.size(); ++j ) {
+          const auto &level = lod.level[ j ];
+          if( level.count == 0u ) continue;
+          const uint32_t *index = simplified[ i ][ j ].index.data();
+          regions.push_back(
+            vw::buffer_region_t()
+              .set_offset( level.offset )
+              .set_size( lod.size * level.count )
+              .set_fill(
+                [index,size=lod.size]( size_t offset, size_t length, uint8_t *out ) {
+                  write_indices( index, size, offset, length, out );
+                }
+              )
+          );
+        }
+      }
+      if( !layout.hlod.empty() && &layout != &layouts[ index_buffer_index ] ) throw vw::invalid_argument( "HLODのインデックスはインデックスのバッファにしか置けない", __FILE__, __LINE__ );
+      for( size_t i = 0u; i != layout.hlod.size(); ++i ) {
+        const uint32_t *index = hlod_indices[ i ].index.data();
+        regions.push_back(
+          vw::buffer_region_t()
+            .set_offset( layout.hlod[ i ].offset )
+            .set_size( sizeof( uint32_t ) * layout.hlod[ i ].count )
+            .set_fill(
+              [index]( size_t offset, size_t length, uint8_t *out ) {
+                write_indices( index, sizeof( uint32_t ), offset, length, out );
+              }
+            )
+        );
+      }
+      // HLODの頂点はインデックスのバッファのhlodが指す頂点のバッファの位置に置く
+      if( &layout == &layouts[ vertex_buffer_index ] )
+        for( size_t i = 0u; i != hlod_requests.size(); ++i ) {
+          const auto vertex = reinterpret_cast< const uint8_t* >( hlod_vertices[ i ].data() );
+          regions.push_back(
+            vw::buffer_region_t()
+              .set_begin( vertex )
+              .set_end( vertex + hlod_vertex_stride * hlod_requests[ i ].used_vertex_count )
+              .set_offset( hlod_requests[ i ].vertex_offset )
+          );
+        }
+      for( const auto &range: layout.range ) {
+        // 圧縮されたbufferViewはステージングバッファに直接展開する
+        // ステージングバッファより大きい場合だけ展開した結果を一旦保持する
+        if( const auto &compressed = get_meshopt( range.view ); compressed ) {
+          const uint8_t *source = get_source( compressed->buffer, compressed->offset, compressed->size );
+          regions.push_back(
+            vw::buffer_region_t()
+              .set_offset( range.offset )
+              .set_size( range.size )
+              .set_fill(
+                [source,compressed=*compressed,cache=std::make_shared< std::vector< uint8_t > >()]( size_t offset, size_t size, uint8_t *out ) {
+                  if( offset == 0u && size == compressed.count * compressed.stride ) {
+                    vw::decode_meshopt( source, source + compressed.size, compressed.count, compressed.stride, compressed.mode, compressed.filter, out );
+                    return;
+                  }
+                  if( cache->empty() ) {
+                    cache->resize( compressed.count * compressed.stride );
+                    vw::decode_meshopt( source, source + compressed.size, compressed.count, compressed.stride, compressed.mode, compressed.filter, cache->data() );
+                  }
+                  std::copy( cache->data() + offset, cache->data() + offset + size, out );
+                }
+              )
+          );
+          compressed_size += compressed->size;
+          expanded_size += range.size;
+          continue;
+        }
+        // data URIはデコード済みのコピーを作らずステージングバッファに直接デコードする
+        if( const auto &uri = embedded[ range.buffer ]; uri && decoded[ range.buffer ].empty() ) {
+          const char *encoded_begin = uri->begin;
+          const char *encoded_end = uri->end;
+          const size_t source_offset = range.source_offset;
+          regions.push_back(
+            vw::buffer_region_t()
+              .set_offset( range.offset )
+              .set_size( range.size )
+              .set_fill(
+                [encoded_begin,encoded_end,source_offset]( size_t offset, size_t size, uint8_t *out ) {
+                  vw::decode_base64( encoded_begin, encoded_end, source_offset + offset, size, out );
+                }
+              )
+          );
+          continue;
+        }
+        const uint8_t *source = get_source( range.buffer, range.source_offset, range.size );
+        regions.push_back(
+          vw::buffer_region_t()
+            .set_begin( source )
+            .set_end( source + range.size )
+            .set_offset( range.offset )
+        );
+      }
+      for( const auto &range: layout.draco ) {
+        const auto mesh = draco_meshes.at( range.view );
+        if( range.count > ( range.attribute < 0 ? vw::get_index_count( *mesh ) : vw::get_point_count( *mesh ) ) ) throw vw::invalid_gltf( "Dracoで圧縮されたメッシュの要素数が足りない", __FILE__, __LINE__ );
+        regions.push_back(
+          vw::buffer_region_t()
+            .set_offset( range.offset )
+            .set_size( range.stride * range.count )
+            .set_fill(
+              [mesh,range]( size_t offset, size_t size, uint8_t *out ) {
+                fill_elements( range.stride, offset, size, out, [&]( size_t first, size_t count, uint8_t *dest ) {
+                  if( range.attribute < 0 ) vw::copy_draco_indices( *mesh, range.stride, first, count, dest );
+                  else {
+                    std::fill( dest, dest + range.stride * count, 0u );
+                    vw::copy_draco_attribute( *mesh, uint32_t( range.attribute ), range.component_type, range.components, range.stride, first, count, dest );
+                    const size_t size = vw::to_size( range.component_type ) * range.components;
+                    if( range.stride > size )
+                      for( size_t k = 0u; k != count; ++k )
+                        write_fill( range.fill, range.stride - size, dest + k * range.stride + size );
+                  }
+                } );
+              }
+            )
+        );
+        expanded_size += range.stride * range.count;
+      }
+      if( convert_on_gpu ) {
+        // シェーダは32bit単位で読み書きするので両方のバッファを4の倍数に切り上げる
+        const auto source = vw::load_buffer( context, conversion_source, ( conversion_source_size + 3u ) / 4u * 4u, vk::BufferUsageFlagBits::eStorageBuffer );
+        const auto destination = vw::load_buffer( context, regions, ( layout.size + 3u ) / 4u * 4u, layout.usage | vk::BufferUsageFlagBits::eStorageBuffer );
+        vw::convert_buffer( context, source, destination, conversions );
+        buffers.push_back( buffer_t().set_buffer( destination ) );
+      }
+      else if( content ) {
+        // 書き出した内容をそのまま転送してキャッシュにも保存できるようにする
+        auto &data = ( *content )[ std::distance( layouts.data(), &layout ) ];
+        data = materialize( regions, layout.size );
+        buffers.push_back(
+          buffer_t()
+            .set_buffer(
+              vw::load_buffer( context, data, layout.usage )
+            )
+        );
+      }
+      else
+        buffers.push_back(
+          buffer_t()
+            .set_buffer(
+              vw::load_buffer( context, regions, layout.size, layout.usage )
+            )
+        );
+      uploaded += layout.size;
+    }
+    std::cout << "bufferの" << total << "バイト中 " << uploaded << "バイトを転送" << std::endl;
+    if( compressed_size )
+      std::cout << "圧縮された" << compressed_size << "バイトを " << expanded_size << "バイトに展開" << std::endl;
+    {
+      size_t primitives = 0u;
+      double triangles = 0.0;
+      double misses_before = 0.0;
+      double misses_after = 0.0;
+      for( size_t i = 0u; i != optimized_indices.size(); ++i ) {
+        if( !optimized_requests[ i ].optimize ) continue;
+        const auto &optimized = optimized_indices[ i ];
+        ++primitives;
+        triangles += double( optimized.index.size() / 3u );
+        misses_before += double( optimized.acmr_before ) * double( optimized.index.size() / 3u );
+        misses_after += double( optimized.acmr_after ) * double( optimized.index.size() / 3u );
+      }
+      if( triangles > 0.0 )
+        std::cout << primitives << "個のプリミティブの" << triangles << "三角形を最適化 ACMR " << misses_before / triangles << " -> " << misses_after / triangles << std::endl;
     }
+    if( converted_on_gpu )
+      std::cout << converted_on_gpu << "個の頂点属性とインデックスをコンピュートシェーダで広げて転送" << std::endl;
+    if( converted_on_cpu )
+      std::cout << converted_on_cpu << "個の頂点属性とインデックスをCPUで広げて転送" << std::endl;
+    if( meshlet_count )
+      std::cout << meshlet_count << "個のmeshletを生成" << std::endl;
+    if( !lod_requests.empty() )
+      std::cout << lod_requests.size() << "個のプリミティブに" << lod_levels << "段のLODを生成" << std::endl;
+    if( !hlod_requests.empty() )
+      std::cout << hlod_requests.size() << "個のHLODの代理メッシュを生成 " << hlod_triangles << "三角形 -> " << hlod_simplified_triangles << "三角形 " << hlod_vertex_count << "頂点 -> " << hlod_used_vertex_count << "頂点" << std::endl;
     return buffers;
   }
 }
-
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <tuple>
+#include <system_error>
+#include <vw/hash.h>
+#include <vw/buffer.h>
+#include <vw/exceptions.h>
+#include <viewer/cache.h>
+#include <viewer/data_uri.h>
+#include <viewer/parse.h>
+namespace viewer {
+  namespace {
+    constexpr char scene_cache_magic[ 8 ] = { 'V', 'W', 'S', 'C', 'E', 'N', 'E', '\0' };
+    constexpr char image_cache_magic[ 8 ] = { 'V', 'W', 'I', 'M', 'A', 'G', 'E', '\0' };
+    // mmapした内容をそのままバッファに転送できるように各layoutの内容の先頭を揃える
+    constexpr size_t scene_cache_alignment = 64u;
+    template< typename T >
+    void write_value( std::vector< uint8_t > &out, T value ) {
+      const auto begin = reinterpret_cast< const uint8_t* >( &value );
+      out.insert( out.end(), begin, begin + sizeof( T ) );
+    }
+    // 範囲外を読もうとした場合は以降の読み込みを全て失敗させる
+    class cache_reader_t {
+    public:
+      cache_reader_t( const uint8_t *begin, const uint8_t *end ) : head( begin ), tail( end ), failed( false ) {}
+      template< typename T >
+      T read() {
+        T value = T();
+        read( reinterpret_cast< uint8_t* >( &value ), sizeof( T ) );
+        return value;
+      }
+      void read( uint8_t *out, size_t size ) {
+        if( failed || size_t( std::distance( head, tail ) ) < size ) {
+          failed = true;
+          return;
+        }
+        std::copy( head, head + size, out );
+        head += size;
+      }
+      const uint8_t *get_head() const { return head; }
+      bool good() const { return !failed; }
+    private:
+      const uint8_t *head;
+      const uint8_t *tail;
+      bool failed;
+    };
+    std::string to_hex( uint64_t value ) {
+      std::ostringstream stream;
+      stream << std::hex << std::setw( 16 ) << std::setfill( '0' ) << value;
+      return stream.str();
+    }
+    // 書きかけのファイルを読まないように一時ファイルに書いてから置き換える
+    void write_file(
+      const std::filesystem::path &filename,
+      const std::vector< std::pair< const uint8_t*, const uint8_t* > > &chunks
+    ) {
+      std::error_code ec;
+      if( filename.has_parent_path() ) std::filesystem::create_directories( filename.parent_path(), ec );
+      auto temporary = filename;
+      temporary += ".tmp";
+      {
+        std::ofstream stream( temporary, std::ios::binary | std::ios::trunc );
+        for( const auto &[begin,end]: chunks )
+          if( stream ) stream.write( reinterpret_cast< const char* >( begin ), std::distance( begin, end ) );
+        if( !stream ) {
+          std::cerr << "キャッシュを書き込めない: " << temporary.string() << std::endl;
+          std::filesystem::remove( temporary, ec );
+          return;
+        }
+      }
+      std::filesystem::rename( temporary, filename, ec );
+      if( ec ) {
+        std::cerr << "キャッシュを置き換えられない: " << filename.string() << " " << ec.message() << std::endl;
+        std::filesystem::remove( temporary, ec );
+      }
+    }
+    std::optional< vw::mapped_file_t > map_cache( const std::filesystem::path &filename ) {
+      std::error_code ec;
+      if( !std::filesystem::is_regular_file( filename, ec ) ) return std::nullopt;
+      try {
+        return vw::map_file( filename.string() );
+      }
+      catch( const std::exception &e ) {
+        std::cerr << "キャッシュを読めない: " << filename.string() << " " << e.what() << std::endl;
+        return std::nullopt;
+      }
+    }
+  }
+  uint64_t get_scene_cache_key(
+    const fx::gltf::Document &doc,
+    const std::filesystem::path &path,
+    const load_options_t &options,
+    const vw::context_t &context
+  ) {
+    const auto file = vw::map_file( path.string() );
+    uint64_t key = vw::hash( file.begin(), file.end(), scene_cache_version );
+    // data URIとGLBのバイナリチャンクは元のファイルの内容に含まれている
+    for( const auto &buffer: doc.buffers ) {
+      if( buffer.uri.empty() || parse_data_uri( buffer.uri ) || is_fallback_buffer( buffer ) ) continue;
+      auto buffer_path = std::filesystem::path( buffer.uri );
+      if( buffer_path.is_relative() ) buffer_path = path.parent_path() / buffer_path;
+      const auto source = vw::map_file( buffer_path.string() );
+      key = vw::hash( source.begin(), source.end(), key );
+    }
+    std::vector< uint8_t > state;
+    write_value( state, uint32_t( options.vertex_layout ) );
+    write_value( state, uint8_t( options.quantize ) );
+    write_value( state, uint8_t( options.optimize ) );
+    write_value( state, uint32_t( options.lod_levels ) );
+    write_value( state, uint8_t( options.meshlet ) );
+    write_value( state, uint8_t( options.hlod ) );
+    // 頂点バッファに使える形式によって広げる頂点属性とインデックスが変わる
+    for( const auto format: context.vertex_buffer_formats )
+      write_value( state, uint32_t( format ) );
+    return vw::hash( state.data(), state.data() + state.size(), key );
+  }
+  std::filesystem::path get_scene_cache_path(
+    const std::filesystem::path &cache_dir,
+    uint64_t key
+  ) {
+    return cache_dir / ( to_hex( key ) + ".scene" );
+  }
+  std::optional< scene_cache_t > load_scene_cache(
+    const std::filesystem::path &filename,
+    uint64_t key,
+    buffer_layouts_t &layouts
+  ) {
+    auto file = map_cache( filename );
+    if( !file ) return std::nullopt;
+    cache_reader_t reader( file->begin(), file->end() );
+    char magic[ 8 ];
+    reader.read( reinterpret_cast< uint8_t* >( magic ), sizeof( magic ) );
+    const auto version = reader.read< uint32_t >();
+    const auto layout_count = reader.read< uint32_t >();
+    const auto stored_key = reader.read< uint64_t >();
+    if(
+      !reader.good() ||
+      std::memcmp( magic, scene_cache_magic, sizeof( magic ) ) ||
+      version != scene_cache_version ||
+      layout_count != layouts.size() ||
+      stored_key != key
+    ) return std::nullopt;
+    scene_cache_t cache;
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      const auto offset = reader.read< uint64_t >();
+      const auto size = reader.read< uint64_t >();
+      if( !reader.good() || offset > file->size || file->size - offset < size ) return std::nullopt;
+      cache.content.push_back( std::make_pair( file->begin() + offset, file->begin() + offset + size ) );
+    }
+    // 全て読めることを確かめてからlayoutsに書き戻す
+    std::vector< std::vector< std::vector< meshlet_t > > > meshlets( layouts.size() );
+    std::vector< std::vector< std::vector< std::pair< uint64_t, float > > > > levels( layouts.size() );
+    std::vector< std::vector< std::tuple< uint64_t, uint64_t, float > > > hlods( layouts.size() );
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      const auto &layout = layouts[ i ];
+      if( reader.read< uint64_t >() != layout.optimized.size() ) return std::nullopt;
+      for( size_t j = 0u; j != layout.optimized.size(); ++j ) {
+        const auto count = reader.read< uint64_t >();
+        if( !reader.good() || count > size_t( std::distance( reader.get_head(), file->end() ) ) / sizeof( meshlet_t ) ) return std::nullopt;
+        std::vector< meshlet_t > meshlet( count );
+        reader.read( reinterpret_cast< uint8_t* >( meshlet.data() ), sizeof( meshlet_t ) * count );
+        meshlets[ i ].push_back( std::move( meshlet ) );
+      }
+      if( reader.read< uint64_t >() != layout.lod.size() ) return std::nullopt;
+      for( const auto &lod: layout.lod ) {
+        if( reader.read< uint64_t >() != lod.level.size() ) return std::nullopt;
+        levels[ i ].emplace_back();
+        for( size_t j = 0u; j != lod.level.size(); ++j ) {
+          const auto count = reader.read< uint64_t >();
+          levels[ i ].back().push_back( std::make_pair( count, reader.read< float >() ) );
+        }
+      }
+      if( reader.read< uint64_t >() != layout.hlod.size() ) return std::nullopt;
+      for( size_t j = 0u; j != layout.hlod.size(); ++j ) {
+        const auto count = reader.read< uint64_t >();
+        const auto used_vertex_count = reader.read< uint64_t >();
+        if( count > layout.hlod[ j ].index_count || used_vertex_count > layout.hlod[ j ].vertex_count ) return std::nullopt;
+        hlods[ i ].push_back( std::make_tuple( count, used_vertex_count, reader.read< float >() ) );
+      }
+      if( !reader.good() ) return std::nullopt;
+    }
+    // 代理メッシュは記録された簡略化の後の大きさで置いてからlayoutの大きさを比べる
+    // 合わない場合はcreate_bufferが置き直せるように置く前の大きさに戻す
+    std::vector< size_t > unplaced_size;
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      unplaced_size.push_back( layouts[ i ].size );
+      for( size_t j = 0u; j != layouts[ i ].hlod.size(); ++j ) {
+        layouts[ i ].hlod[ j ].set_count( std::get< 0 >( hlods[ i ][ j ] ) );
+        layouts[ i ].hlod[ j ].set_used_vertex_count( std::get< 1 >( hlods[ i ][ j ] ) );
+      }
+    }
+    place_hlod( layouts );
+    for( size_t i = 0u; i != layouts.size(); ++i )
+      if( size_t( std::distance( cache.content[ i ].first, cache.content[ i ].second ) ) != layouts[ i ].size ) {
+        for( size_t j = 0u; j != layouts.size(); ++j ) layouts[ j ].size = unplaced_size[ j ];
+        return std::nullopt;
+      }
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      auto &layout = layouts[ i ];
+      for( size_t j = 0u; j != layout.optimized.size(); ++j )
+        layout.optimized[ j ].set_meshlet( std::move( meshlets[ i ][ j ] ) );
+      for( size_t j = 0u; j != layout.lod.size(); ++j )
+        for( size_t k = 0u; k != layout.lod[ j ].level.size(); ++k ) {
+          layout.lod[ j ].level[ k ].set_count( levels[ i ][ j ][ k ].first );
+          layout.lod[ j ].level[ k ].set_error( levels[ i ][ j ][ k ].second );
+        }
+      for( size_t j = 0u; j != layout.hlod.size(); ++j )
+        layout.hlod[ j ].set_error( std::get< 2 >( hlods[ i ][ j ] ) );
+    }
+    cache.set_file( std::move( *file ) );
+    return cache;
+  }
+  void save_scene_cache(
+    const std::filesystem::path &filename,
+    uint64_t key,
+    const buffer_layouts_t &layouts,
+    const std::vector< std::vector< uint8_t > > &content
+  ) {
+    if( content.size() != layouts.size() ) throw vw::invalid_argument( "キャッシュに書き込む内容とlayoutの数が合わない", __FILE__, __LINE__ );
+    std::vector< uint8_t > metadata;
+    for( const auto &layout: layouts ) {
+      write_value( metadata, uint64_t( layout.optimized.size() ) );
+      for( const auto &optimized: layout.optimized ) {
+        write_value( metadata, uint64_t( optimized.meshlet.size() ) );
+        const auto begin = reinterpret_cast< const uint8_t* >( optimized.meshlet.data() );
+        metadata.insert( metadata.end(), begin, begin + sizeof( meshlet_t ) * optimized.meshlet.size() );
+      }
+      write_value( metadata, uint64_t( layout.lod.size() ) );
+      for( const auto &lod: layout.lod ) {
+        write_value( metadata, uint64_t( lod.level.size() ) );
+        for( const auto &level: lod.level ) {
+          write_value( metadata, uint64_t( level.count ) );
+          write_value( metadata, level.error );
+        }
+      }
+      write_value( metadata, uint64_t( layout.hlod.size() ) );
+      for( const auto &hlod: layout.hlod ) {
+        write_value( metadata, uint64_t( hlod.count ) );
+        write_value( metadata, uint64_t( hlod.used_vertex_count ) );
+        write_value( metadata, hlod.error );
+      }
+    }
+    const size_t header_size = sizeof( scene_cache_magic ) + sizeof( uint32_t ) * 2u + sizeof( uint64_t ) + sizeof( uint64_t ) * 2u * layouts.size();
+    size_t tail = header_size + metadata.size();
+    std::vector< uint8_t > header;
+    header.insert( header.end(), scene_cache_magic, scene_cache_magic + sizeof( scene_cache_magic ) );
+    write_value( header, scene_cache_version );
+    write_value( header, uint32_t( layouts.size() ) );
+    write_value( header, key );
+    std::vector< std::vector< uint8_t > > padding;
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      if( content[ i ].size() != layouts[ i ].size ) throw vw::invalid_argument( "キャッシュに書き込む内容の大きさがlayoutと合わない", __FILE__, __LINE__ );
+      const size_t offset = ( tail + scene_cache_alignment - 1u ) / scene_cache_alignment * scene_cache_alignment;
+      padding.emplace_back( offset - tail, 0u );
+      write_value( header, uint64_t( offset ) );
+      write_value( header, uint64_t( content[ i ].size() ) );
+      tail = offset + content[ i ].size();
+    }
+    std::vector< std::pair< const uint8_t*, const uint8_t* > > chunks;
+    chunks.push_back( std::make_pair( header.data(), header.data() + header.size() ) );
+    chunks.push_back( std::make_pair( metadata.data(), metadata.data() + metadata.size() ) );
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      chunks.push_back( std::make_pair( padding[ i ].data(), padding[ i ].data() + padding[ i ].size() ) );
+      chunks.push_back( std::make_pair( content[ i ].data(), content[ i ].data() + content[ i ].size() ) );
+    }
+    write_file( filename, chunks );
+  }
+  buffers_t load_cached_buffer(
+    const vw::context_t &context,
+    const buffer_layouts_t &layouts,
+    const scene_cache_t &cache
+  ) {
+    if( cache.content.size() != layouts.size() ) throw vw::invalid_argument( "キャッシュとlayoutの数が合わない", __FILE__, __LINE__ );
+    buffers_t buffers;
+    for( size_t i = 0u; i != layouts.size(); ++i ) {
+      if( layouts[ i ].size == 0u ) {
+        buffers.push_back( buffer_t() );
+        continue;
+      }
+      const auto [begin,end] = cache.content[ i ];
+      buffers.push_back(
+        buffer_t()
+          .set_buffer(
+            vw::load_buffer( context, begin, end, layouts[ i ].usage )
+          )
+      );
+    }
+    return buffers;
+  }
+  std::filesystem::path get_image_cache_path(
+    const std::filesystem::path &cache_dir,
+    const uint8_t *begin,
+    const uint8_t *end
+  ) {
+    return cache_dir / ( to_hex( vw::hash( begin, end, image_cache_version ) ) + ".image" );
+  }
+  std::optional< vw::pixels_t > load_image_cache(
+    const std::filesystem::path &filename,
+    const std::function< std::shared_ptr< void >( size_t ) > &reserve
+  ) {
+    const auto file = map_cache( filename );
+    if( !file ) return std::nullopt;
+    cache_reader_t reader( file->begin(), file->end() );
+    char magic[ 8 ];
+    reader.read( reinterpret_cast< uint8_t* >( magic ), sizeof( magic ) );
+    const auto version = reader.read< uint32_t >();
+    const auto width = reader.read< uint32_t >();
+    const auto height = reader.read< uint32_t >();
+    reader.read< uint32_t >();
+    if(
+      !reader.good() ||
+      std::memcmp( magic, image_cache_magic, sizeof( magic ) ) ||
+      version != image_cache_version ||
+      size_t( std::distance( reader.get_head(), file->end() ) ) != size_t( width ) * size_t( height ) * 4u
+    ) return std::nullopt;
+    vw::pixels_t pixels;
+    pixels.set_width( width );
+    pixels.set_height( height );
+    if( reserve ) pixels.set_reservation( reserve( size_t( width ) * size_t( height ) * 4u ) );
+    pixels.data.assign( reader.get_head(), file->end() );
+    return pixels;
+  }
+  void save_image_cache(
+    const std::filesystem::path &filename,
+    const vw::pixels_t &pixels
+  ) {
+    if( pixels.data.size() != size_t( pixels.width ) * size_t( pixels.height ) * 4u ) throw vw::invalid_argument( "キャッシュに書き込むイメージの大きさが合わない", __FILE__, __LINE__ );
+    std::vector< uint8_t > header;
+    header.insert( header.end(), image_cache_magic, image_cache_magic + sizeof( image_cache_magic ) );
+    write_value( header, image_cache_version );
+    write_value( header, pixels.width );
+    write_value( header, pixels.height );
+    write_value( header, uint32_t( 0u ) );
+    write_file(
+      filename,
+      std::vector< std::pair< const uint8_t*, const uint8_t* > >{
+        std::make_pair( header.data(), header.data() + header.size() ),
+        std::make_pair( pixels.data.data(), pixels.data.data() + pixels.data.size() )
+      }
+    );
+  }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <vw/exceptions.h>
+#include <viewer/data_uri.h>
+namespace viewer {
+  std::optional< data_uri_t > parse_data_uri(
+    const std::string &uri
+  ) {
+    if( uri.compare( 0, 5, "data:" ) ) return std::nullopt;
+    const auto comma = uri.find( ',' );
+    if( comma == std::string::npos ) throw vw::invalid_gltf( "不正なデータURI", __FILE__, __LINE__ );
+    const std::string header = uri.substr( 5, comma - 5 );
+    const std::string suffix = ";base64";
+    if( header.size() < suffix.size() || header.compare( header.size() - suffix.size(), suffix.size(), suffix ) )
+      throw vw::invalid_gltf( "base64以外のデータURIには対応していない", __FILE__, __LINE__ );
+    return data_uri_t()
+      .set_media_type( header.substr( 0, header.size() - suffix.size() ) )
+      .set_begin( uri.data() + comma + 1 )
+      .set_end( uri.data() + uri.size() );
+  }
+  std::string get_extension(
+    const std::string &media_type
+  ) {
+    if( media_type == "image/png" ) return "png";
+    if( media_type == "image/jpeg" ) return "jpg";
+    if( media_type == "image/ktx2" ) return "ktx2";
+    if( media_type == "image/webp" ) return "webp";
+    const auto slash = media_type.find( '/' );
+    if( slash == std::string::npos ) return media_type;
+    return media_type.substr( slash + 1 );
+  }
+}
@@ -20,16 +20,212 @@
  * IN THE SOFTWARE.
  */
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
 #include <vw/shader.h>
 #include <vw/pipeline.h>
 #include <vw/framebuffer.h>
 #include <vw/image.h>
 #include <vw/buffer.h>
+#include <vw/uploader.h>
+#include <vw/file_reader.h>
 #include <vw/wait_for_idle.h>
 #include <viewer/document.h>
 #include <viewer/mesh.h>
 #include <viewer/shader.h>
+#include <viewer/glb.h>
+#include <viewer/parse.h>
+#include <viewer/cache.h>
 namespace viewer {
+  namespace {
+    constexpr size_t upload_budget_per_frame = 32u * 1024u * 1024u;
+    void apply_image(
+      document_t &document,
+      const std::vector< size_t > &loaded
+    ) {
+      for( const auto index: loaded )
+        for( auto &texture: document.texture )
+          if( texture.source == int32_t( index ) ) update_texture( texture, document.image[ index ] );
+      if( !loaded.empty() ) ++document.texture_revision;
+    }
+    document_t load_gltf_internal(
+      const vw::context_t &context,
+      const std::vector< vw::render_pass_t > &render_pass,
+      std::filesystem::path path,
+      uint32_t swapchain_size,
+      const std::filesystem::path &shader_dir,
+      int shader_mask,
+      const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+      const std::vector< buffer_t > &dynamic_uniform_buffer,
+      float aspect_ratio,
+      const load_options_t &options,
+      bool async
+    ) {
+      const auto begin_time = std::chrono::high_resolution_clock::now();
+      const auto begin_pipeline_statistics = context.pipeline_registry ?
+        context.pipeline_registry->get_statistics() :
+        vw::pipeline_statistics_t();
+      glb_t glb;
+      fx::gltf::Document doc = load_document( path, glb, options.json_parser );
+      document_t document;
+      vw::upload_batch_t upload_batch( context );
+      shader_t shader;
+      for( auto &path: std::filesystem::directory_iterator( shader_dir ) ) {
+        auto flag = get_shader_flag( path.path() );
+        if( flag ) {
+          shader.emplace(
+            *flag,
+            vw::get_shader( context, path.path().string() )
+          );
+        }
+      }
+      size_t pcsize = sizeof( push_constants_t );
+      auto buffer_layouts = create_buffer_layout();
+      document.set_sampler( viewer::create_sampler(
+        doc,
+        context
+      ) );
+      document.set_default_sampler( viewer::create_default_sampler(
+        context
+      ) );
+      document.set_placeholder( viewer::create_placeholder(
+        context,
+        document.default_sampler
+      ) );
+      // イメージファイルはデコードするスレッドがreaderで読む
+      auto reader = std::make_shared< vw::file_reader_t >(
+        vw::default_file_queue_depth,
+        vw::default_file_thread_count
+      );
+      std::cout << "ファイルの読み込みに" << reader->get_backend() << "を使用" << std::endl;
+      document.set_image( images_t( doc.images.size() ) );
+      auto image_loader = viewer::start_image_loading(
+        doc,
+        path.parent_path(),
+        reader,
+        async ?
+          std::max( std::thread::hardware_concurrency(), 2u ) - 1u :
+          std::thread::hardware_concurrency(),
+        options.cache_dir
+      );
+      document.set_texture( viewer::create_texture(
+        doc,
+        context,
+        document.image,
+        document.sampler,
+        document.default_sampler
+      ) );
+      document.set_mesh( viewer::create_mesh(
+        doc,
+        context,
+        render_pass,
+        pcsize,
+        shader,
+        document.texture,
+        swapchain_size,
+        shader_mask,
+        extra_textures,
+        dynamic_uniform_buffer,
+        options,
+        buffer_layouts
+      ) );
+      document.set_shader( std::move( shader ) );
+      document.set_point_light( viewer::create_point_light(
+        doc
+      ) );
+      document.set_camera( viewer::create_camera(
+        doc,
+        aspect_ratio
+      ) );
+      /// load light
+      document.set_node( viewer::create_node(
+        doc,
+        context,
+        document.mesh
+      ) );
+      // HLODの代理メッシュはノードの配置が決まってからbufferの読み込みと一緒に作る
+      if( options.hlod )
+        document.set_hlod( viewer::create_hlod_cluster(
+          doc,
+          document.node,
+          document.mesh,
+          buffer_layouts
+        ) );
+      // レイアウトはglTFと読み込みのオプションから決まるので、キャッシュがあればbufferの処理を全て省く
+      std::optional< scene_cache_t > cache;
+      std::filesystem::path cache_path;
+      if( !options.cache_dir.empty() ) {
+        const auto key = get_scene_cache_key( doc, path, options, context );
+        cache_path = get_scene_cache_path( options.cache_dir, key );
+        cache = load_scene_cache( cache_path, key, buffer_layouts );
+        if( cache ) document.set_buffer( load_cached_buffer( context, buffer_layouts, *cache ) );
+        else {
+          std::vector< std::vector< uint8_t > > content;
+          document.set_buffer( viewer::create_buffer(
+            doc,
+            context,
+            path.parent_path(),
+            glb,
+            buffer_layouts,
+            &content
+          ) );
+          save_scene_cache( cache_path, key, buffer_layouts, content );
+        }
+      }
+      else
+        document.set_buffer( viewer::create_buffer(
+          doc,
+          context,
+          path.parent_path(),
+          glb,
+          buffer_layouts
+        ) );
+      viewer::update_lod( document.mesh, buffer_layouts );
+      viewer::update_meshlet( document.mesh, buffer_layouts );
+      if( options.hlod )
+        viewer::create_hlod_proxy(
+          doc,
+          context,
+          render_pass,
+          pcsize,
+          document.shader,
+          swapchain_size,
+          extra_textures,
+          dynamic_uniform_buffer,
+          document.default_sampler,
+          buffer_layouts,
+          document.hlod
+        );
+      if( async ) document.set_image_loader( image_loader );
+      else apply_image( document, finish_image_loading( context, *image_loader, document.image ) );
+      for( uint32_t i = 0u; i != swapchain_size; ++i )
+        update_texture_descriptor_set( context, document.mesh, document.texture, document.placeholder, i );
+      document.set_applied_texture_revision( std::vector< uint32_t >( swapchain_size, document.texture_revision ) );
+      upload_batch.submit();
+      const auto end_time = std::chrono::high_resolution_clock::now();
+      const auto elapsed = std::chrono::duration< double, std::milli >( end_time - begin_time ).count();
+      if( cache ) std::cout << "キャッシュから読み込み(warm): " << elapsed << "ms " << cache_path.string() << std::endl;
+      else if( !cache_path.empty() ) std::cout << "キャッシュを作成して読み込み(cold): " << elapsed << "ms " << cache_path.string() << std::endl;
+      else std::cout << "読み込み(cold): " << elapsed << "ms" << std::endl;
+      if( context.pipeline_registry ) {
+        const auto end_pipeline_statistics = context.pipeline_registry->get_statistics();
+        const auto hit = end_pipeline_statistics.hit - begin_pipeline_statistics.hit;
+        const auto miss = end_pipeline_statistics.miss - begin_pipeline_statistics.miss;
+        const auto creation_time = end_pipeline_statistics.creation_time - begin_pipeline_statistics.creation_time;
+        if( hit + miss ) {
+          // 共有できたパイプラインは作成済みのものと同じ時間がかかったはずだとみなす
+          const double saved = miss ? creation_time / miss * hit : 0.0;
+          std::cout << ( context.warm_pipeline_cache ? "パイプライン(warm): 要求 " : "パイプライン(cold): 要求 " ) << hit + miss << " 共有 " << hit << " 作成 " << miss <<
+            " ヒット率 " << double( hit ) / double( hit + miss ) * 100.0 << "% 作成時間 " << creation_time <<
+            "ms 削減(推定) " << saved << "ms" << std::endl;
+        }
+        // 新しく作ったパイプラインを次回の起動で使えるように保存しておく
+        if( miss ) vw::save_pipeline_cache( context );
+      }
+      return document;
+    }
+  }
   document_t load_gltf(
     const vw::context_t &context,
     const std::vector< vw::render_pass_t > &render_pass,
@@ -41,69 +237,84 @@ namespace viewer {
     const std::vector< buffer_t > &dynamic_uniform_buffer,
     float aspect_ratio
   ) {
-    fx::gltf::Document doc = fx::gltf::LoadFromText( path.string() );
-    document_t document;
-    shader_t shader;
-    for( auto &path: std::filesystem::directory_iterator( shader_dir ) ) {
-      auto flag = get_shader_flag( path.path() );
-      if( flag ) {
-        shader.emplace(
-          *flag,
-          vw::get_shader( context, path.path().string() )
-        );
-      }
+    return load_gltf( context, render_pass, path, swapchain_size, shader_dir, shader_mask, extra_textures, dynamic_uniform_buffer, aspect_ratio, load_options_t() );
+  }
+  document_t load_gltf(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    std::filesystem::path path,
+    uint32_t swapchain_size,
+    const std::filesystem::path &shader_dir,
+    int shader_mask,
+    const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    float aspect_ratio,
+    const load_options_t &options
+  ) {
+    return load_gltf_internal( context, render_pass, path, swapchain_size, shader_dir, shader_mask, extra_textures, dynamic_uniform_buffer, aspect_ratio, options, false );
+  }
+  document_t load_gltf_async(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    std::filesystem::path path,
+    uint32_t swapchain_size,
+    const std::filesystem::path &shader_dir,
+    int shader_mask,
+    const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    float aspect_ratio
+  ) {
+    return load_gltf_async( context, render_pass, path, swapchain_size, shader_dir, shader_mask, extra_textures, dynamic_uniform_buffer, aspect_ratio, load_options_t() );
+  }
+  document_t load_gltf_async(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    std::filesystem::path path,
+    uint32_t swapchain_size,
+    const std::filesystem::path &shader_dir,
+    int shader_mask,
+    const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    float aspect_ratio,
+    const load_options_t &options
+  ) {
+    return load_gltf_internal( context, render_pass, path, swapchain_size, shader_dir, shader_mask, extra_textures, dynamic_uniform_buffer, aspect_ratio, options, true );
+  }
+  load_options_t get_load_options(
+    const vw::configs_t &config
+  ) {
+    load_options_t options;
+    if( config.vertex_layout == "separate" ) options.set_vertex_layout( vertex_layout_t::separate );
+    else if( config.vertex_layout == "interleaved" ) options.set_vertex_layout( vertex_layout_t::interleaved );
+    else if( config.vertex_layout == "split_position" ) options.set_vertex_layout( vertex_layout_t::split_position );
+    else throw vw::invalid_argument( "不正な頂点レイアウト: " + config.vertex_layout );
+    options.set_quantize( config.quantize );
+    options.set_optimize( config.optimize );
+    options.set_lod_levels( config.lod_levels );
+    options.set_meshlet( config.meshlet );
+    options.set_hlod( config.hlod );
+    options.set_cache_dir( config.cache );
+    if( config.json_parser == "dom" ) options.set_json_parser( json_parser_t::dom );
+    else if( config.json_parser == "lean" ) options.set_json_parser( json_parser_t::lean );
+    else throw vw::invalid_argument( "不正なJSONパーサ: " + config.json_parser );
+    return options;
+  }
+  bool update_document(
+    const vw::context_t &context,
+    document_t &document,
+    uint32_t current_frame
+  ) {
+    if( document.image_loader ) {
+      apply_image( document, update_image( context, *document.image_loader, document.image, upload_budget_per_frame ) );
+      if( document.image_loader->queue->done() ) document.image_loader.reset();
+    }
+    if(
+      current_frame < document.applied_texture_revision.size() &&
+      document.applied_texture_revision[ current_frame ] != document.texture_revision
+    ) {
+      update_texture_descriptor_set( context, document.mesh, document.texture, document.placeholder, current_frame );
+      document.applied_texture_revision[ current_frame ] = document.texture_revision;
     }
-    size_t pcsize = sizeof( push_constants_t );
-    document.set_sampler( viewer::create_sampler(
-      doc,
-      context
-    ) );
-    document.set_default_sampler( viewer::create_default_sampler(
-      context
-    ) );
-    document.set_image( viewer::create_image(
-      doc,
-      context,
-      path.parent_path()
-    ) );
-    document.set_texture( viewer::create_texture(
-      doc,
-      context,
-      document.image,
-      document.sampler,
-      document.default_sampler
-    ) );
-    document.set_mesh( viewer::create_mesh(
-      doc,
-      context,
-      render_pass,
-      pcsize,
-      shader,
-      document.texture,
-      swapchain_size,
-      shader_mask,
-      extra_textures,
-      dynamic_uniform_buffer
-    ) );
-    document.set_point_light( viewer::create_point_light(
-      doc
-    ) );
-    document.set_camera( viewer::create_camera(
-      doc,
-      aspect_ratio
-    ) );
-    document.set_buffer( viewer::create_buffer(
-      doc,
-      context,
-      path.parent_path()
-    ) );
-    /// load light
-    document.set_node( viewer::create_node(
-      doc,
-      context,
-      document.mesh
-    ) );
-    return document;
+    return bool( document.image_loader );
   }
 }
-
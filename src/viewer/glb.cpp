@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+#include <vw/exceptions.h>
+#include <viewer/glb.h>
+#include <viewer/parse.h>
+namespace viewer {
+  namespace {
+    constexpr uint32_t glb_magic = 0x46546C67u;
+    constexpr uint32_t glb_version = 2u;
+    constexpr uint32_t glb_chunk_json = 0x4E4F534Au;
+    constexpr uint32_t glb_chunk_bin = 0x004E4942u;
+    uint32_t read_u32( const uint8_t *p ) {
+      uint32_t v;
+      std::memcpy( &v, p, sizeof( uint32_t ) );
+      return v;
+    }
+  }
+  bool is_glb( const std::filesystem::path &path ) {
+    auto ext = path.extension().string();
+    std::transform( ext.begin(), ext.end(), ext.begin(), []( char c ) { return std::tolower( c ); } );
+    return ext == ".glb";
+  }
+  glb_t map_glb( const std::filesystem::path &path ) {
+    glb_t glb;
+    glb.set_file( vw::map_file( path.string() ) );
+    const uint8_t *head = glb.file.begin();
+    const uint8_t *end = glb.file.end();
+    if( std::distance( head, end ) < 12 ) throw vw::invalid_gltf( "GLBヘッダが無い", __FILE__, __LINE__ );
+    if( read_u32( head ) != glb_magic ) throw vw::invalid_gltf( "GLBではない", __FILE__, __LINE__ );
+    if( read_u32( head + 4 ) != glb_version ) throw vw::invalid_gltf( "未対応のGLBバージョン", __FILE__, __LINE__ );
+    if( read_u32( head + 8 ) > glb.file.size ) throw vw::invalid_gltf( "GLBが途中で切れている", __FILE__, __LINE__ );
+    end = head + read_u32( head + 8 );
+    head += 12;
+    while( std::distance( head, end ) >= 8 ) {
+      const uint32_t length = read_u32( head );
+      const uint32_t type = read_u32( head + 4 );
+      head += 8;
+      if( std::distance( head, end ) < std::ptrdiff_t( length ) ) throw vw::invalid_gltf( "GLBチャンクが途中で切れている", __FILE__, __LINE__ );
+      if( type == glb_chunk_json && !glb.json_begin ) {
+        glb.set_json_begin( head );
+        glb.set_json_end( head + length );
+      }
+      else if( type == glb_chunk_bin && !glb.bin_begin ) {
+        glb.set_bin_begin( head );
+        glb.set_bin_end( head + length );
+      }
+      head += std::min( std::ptrdiff_t( ( length + 3u ) & ~3u ), std::distance( head, end ) );
+    }
+    if( !glb.json_begin ) throw vw::invalid_gltf( "GLBにJSONチャンクが無い", __FILE__, __LINE__ );
+    return glb;
+  }
+  fx::gltf::Document parse_glb( const glb_t &glb, json_parser_t parser ) {
+    auto doc = parse_gltf( glb.json_begin, glb.json_end, parser );
+    for( size_t i = 0u; i != doc.buffers.size(); ++i ) {
+      const auto &buffer = doc.buffers[ i ];
+      if( buffer.uri.empty() && !is_fallback_buffer( buffer ) ) {
+        if( i != 0u || !glb.bin_begin ) throw vw::invalid_gltf( "GLBにBINチャンクが無い", __FILE__, __LINE__ );
+        if( size_t( std::distance( glb.bin_begin, glb.bin_end ) ) < buffer.byteLength ) throw vw::invalid_gltf( "BINチャンクが小さすぎる", __FILE__, __LINE__ );
+      }
+    }
+    return doc;
+  }
+}
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <vw/exceptions.h>
+#include <viewer/hlod.h>
+namespace viewer {
+  namespace {
+    // これより少ない三角形になるまでは簡略化しない
+    constexpr size_t min_hlod_triangles = 64u;
+    struct hlod_item_t {
+      hlod_instance_t instance;
+      glm::vec3 min;
+      glm::vec3 max;
+      glm::vec3 center;
+    };
+    void flatten(
+      const node_t &node,
+      const meshes_t &meshes,
+      std::vector< hlod_item_t > &items
+    ) {
+      for( const auto &n: node.children )
+        flatten( n, meshes, items );
+      if( !node.has_mesh ) return;
+      if( node.mesh < 0 || meshes.size() <= size_t( node.mesh ) ) throw vw::invalid_argument( "参照されたmeshが存在しない", __FILE__, __LINE__ );
+      const auto &mesh = meshes[ node.mesh ];
+      if( mesh.primitive.empty() ) return;
+      hlod_item_t item;
+      item.instance.set_matrix( node.matrix ).set_mesh( node.mesh );
+      item.min = glm::vec3( std::numeric_limits< float >::max() );
+      item.max = glm::vec3( std::numeric_limits< float >::lowest() );
+      for( uint32_t corner = 0u; corner != 8u; ++corner ) {
+        const glm::vec3 local(
+          ( corner & 1u ) ? mesh.max[ 0 ] : mesh.min[ 0 ],
+          ( corner & 2u ) ? mesh.max[ 1 ] : mesh.min[ 1 ],
+          ( corner & 4u ) ? mesh.max[ 2 ] : mesh.min[ 2 ]
+        );
+        const auto world = glm::vec3( node.matrix * glm::vec4( local, 1.f ) );
+        item.min = glm::min( item.min, world );
+        item.max = glm::max( item.max, world );
+      }
+      item.center = ( item.min + item.max ) * 0.5f;
+      items.push_back( item );
+    }
+    using item_iterator = std::vector< hlod_item_t >::iterator;
+    // 中心の広がりが最も大きい軸の中央値で2つに分ける事を繰り返し、最大hlod_branches個の子を作る
+    uint32_t build_cluster(
+      item_iterator begin,
+      item_iterator end,
+      std::vector< hlod_cluster_t > &clusters
+    ) {
+      const uint32_t index = clusters.size();
+      clusters.emplace_back();
+      glm::vec3 min( std::numeric_limits< float >::max() );
+      glm::vec3 max( std::numeric_limits< float >::lowest() );
+      for( auto item = begin; item != end; ++item ) {
+        min = glm::min( min, item->min );
+        max = glm::max( max, item->max );
+      }
+      clusters[ index ].set_min( min ).set_max( max );
+      if( size_t( std::distance( begin, end ) ) <= hlod_leaf_size ) {
+        for( auto item = begin; item != end; ++item )
+          clusters[ index ].instance.push_back( item->instance );
+        return index;
+      }
+      std::vector< std::pair< item_iterator, item_iterator > > groups{ std::make_pair( begin, end ) };
+      while( groups.size() < hlod_branches ) {
+        std::vector< std::pair< item_iterator, item_iterator > > next;
+        for( const auto &[first,last]: groups ) {
+          if( std::distance( first, last ) < 2 ) {
+            next.emplace_back( first, last );
+            continue;
+          }
+          glm::vec3 center_min( std::numeric_limits< float >::max() );
+          glm::vec3 center_max( std::numeric_limits< float >::lowest() );
+          for( auto item = first; item != last; ++item ) {
+            center_min = glm::min( center_min, item->center );
+            center_max = glm::max( center_max, item->center );
+          }
+          const auto extent = center_max - center_min;
+          const int axis = extent[ 0 ] >= extent[ 1 ] && extent[ 0 ] >= extent[ 2 ] ? 0 : extent[ 1 ] >= extent[ 2 ] ? 1 : 2;
+          const auto middle = first + std::distance( first, last ) / 2;
+          std::nth_element( first, middle, last, [axis]( const auto &l, const auto &r ) { return l.center[ axis ] < r.center[ axis ]; } );
+          next.emplace_back( first, middle );
+          next.emplace_back( middle, last );
+        }
+        if( next.size() == groups.size() ) break;
+        groups = std::move( next );
+      }
+      std::vector< uint32_t > child;
+      for( const auto &[first,last]: groups )
+        child.push_back( build_cluster( first, last, clusters ) );
+      clusters[ index ].set_child( std::move( child ) );
+      return index;
+    }
+    uint32_t get_height(
+      const std::vector< hlod_cluster_t > &clusters,
+      uint32_t index
+    ) {
+      uint32_t height = 0u;
+      for( const auto c: clusters[ index ].child )
+        height = std::max( height, get_height( clusters, c ) + 1u );
+      return height;
+    }
+    // 子孫の全てのインスタンスのプリミティブを集める 取り込めないプリミティブがあった場合はfalseを返す
+    bool collect_parts(
+      const fx::gltf::Document &doc,
+      const std::vector< hlod_cluster_t > &clusters,
+      uint32_t index,
+      const meshes_t &meshes,
+      const std::vector< hlod_source_t > &sources,
+      std::vector< hlod_part_t > &parts
+    ) {
+      const auto &cluster = clusters[ index ];
+      for( const auto c: cluster.child )
+        if( !collect_parts( doc, clusters, c, meshes, sources, parts ) ) return false;
+      const float palette_width = float( std::max( doc.materials.size(), size_t( 1u ) ) );
+      for( const auto &instance: cluster.instance ) {
+        std::array< float, 16u > matrix;
+        for( uint32_t column = 0u; column != 4u; ++column )
+          for( uint32_t row = 0u; row != 4u; ++row )
+            matrix[ column * 4u + row ] = instance.matrix[ column ][ row ];
+        for( const auto &primitive: meshes[ instance.mesh ].primitive ) {
+          if( primitive.hlod_source < 0 || sources.size() <= size_t( primitive.hlod_source ) ) return false;
+          const auto &source = sources[ primitive.hlod_source ];
+          // 代理メッシュは不透明なので半透明のマテリアルを含むクラスタはまとめない
+          if( source.material < 0 || doc.materials.size() <= size_t( source.material ) ) return false;
+          if( doc.materials[ source.material ].alphaMode == fx::gltf::Material::AlphaMode::Blend ) return false;
+          parts.push_back(
+            hlod_part_t()
+              .set_source( uint32_t( primitive.hlod_source ) )
+              .set_matrix( matrix )
+              .set_texcoord( std::array< float, 2u >{ ( float( source.material ) + 0.5f ) / palette_width, 0.5f } )
+          );
+        }
+      }
+      return true;
+    }
+    bool use_proxy(
+      const hlod_cluster_t &cluster,
+      const lod_selector_t &selector
+    ) {
+      if( cluster.proxy < 0 || !( selector.threshold > 0.f ) || !( selector.pixels_per_unit > 0.f ) ) return false;
+      float pixels = selector.pixels_per_unit;
+      if( !selector.orthographic ) {
+        // クラスタの境界球の視点に最も近い点での大きさで判断する
+        const auto center = ( cluster.min + cluster.max ) * 0.5f;
+        const float radius = glm::length( cluster.max - cluster.min ) * 0.5f;
+        const float distance = glm::length( center - selector.eye ) - radius;
+        if( !( distance > 0.f ) ) return false;
+        pixels /= distance;
+      }
+      return cluster.error * pixels <= selector.threshold;
+    }
+    void draw_cluster(
+      const vw::context_t &context,
+      vk::CommandBuffer &commands,
+      const hlod_t &hlod,
+      uint32_t index,
+      const meshes_t &meshes,
+      const buffers_t &buffers,
+      uint32_t current_frame,
+      uint32_t pipeline_index,
+      const lod_selector_t &lod_selector,
+      const meshlet_culling_t &culling,
+      const std::array< glm::vec4, 6u > &planes
+    ) {
+      const auto &cluster = hlod.cluster[ index ];
+      if( culling.enabled ) {
+        const auto center = ( cluster.min + cluster.max ) * 0.5f;
+        const float radius = glm::length( cluster.max - cluster.min ) * 0.5f;
+        const bool visible = std::all_of( planes.begin(), planes.end(), [&]( const auto &plane ) {
+          return glm::dot( glm::vec3( plane ), center ) + plane[ 3 ] >= -radius;
+        } );
+        if( !visible ) return;
+      }
+      if( use_proxy( cluster, lod_selector ) ) {
+        const auto &proxy = hlod.proxy[ cluster.proxy ];
+        bind_primitive( commands, proxy, buffers, current_frame, pipeline_index, glm::mat4( 1.f ), pipeline_index );
+        commands.bindIndexBuffer( *buffers[ proxy.index_buffer.index ].buffer.buffer, proxy.index_buffer.offset, proxy.index_buffer_type );
+        commands.drawIndexed( proxy.count, 1, 0, 0, 0 );
+        return;
+      }
+      for( const auto c: cluster.child )
+        draw_cluster( context, commands, hlod, c, meshes, buffers, current_frame, pipeline_index, lod_selector, culling, planes );
+      for( const auto &instance: cluster.instance )
+        draw_mesh( context, commands, meshes[ instance.mesh ], instance.matrix, buffers, current_frame, pipeline_index, lod_selector, culling );
+    }
+  }
+  hlod_t create_hlod_cluster(
+    const fx::gltf::Document &doc,
+    const node_t &node,
+    const meshes_t &meshes,
+    buffer_layouts_t &layouts
+  ) {
+    if( layouts.size() <= index_buffer_index ) throw vw::invalid_argument( "頂点とインデックスのバッファが無い", __FILE__, __LINE__ );
+    std::vector< hlod_item_t > items;
+    flatten( node, meshes, items );
+    hlod_t hlod;
+    if( items.empty() ) return hlod;
+    build_cluster( items.begin(), items.end(), hlod.cluster );
+    // 高さhのクラスタの代理メッシュは子孫の三角形を4^h分の1に減らす
+    // 1つ下の段の全ての代理メッシュを合わせた物のおよそ4分の1になり、遠くでまとめて描くほど粗くなる
+    for( uint32_t index = 0u; index != hlod.cluster.size(); ++index ) {
+      if( hlod.cluster[ index ].child.empty() ) continue;
+      std::vector< hlod_part_t > parts;
+      if( !collect_parts( doc, hlod.cluster, index, meshes, layouts[ index_buffer_index ].hlod_source, parts ) || parts.empty() ) continue;
+      size_t vertex_count = 0u;
+      size_t index_count = 0u;
+      for( const auto &part: parts ) {
+        const auto &source = layouts[ index_buffer_index ].hlod_source[ part.source ];
+        vertex_count += source.vertex_count;
+        index_count += source.count;
+      }
+      if( vertex_count > std::numeric_limits< uint32_t >::max() || index_count == 0u ) continue;
+      const uint32_t height = std::min( get_height( hlod.cluster, index ), 15u );
+      const size_t triangles = std::max( ( index_count / 3u ) >> ( 2u * height ), min_hlod_triangles );
+      hlod.cluster[ index ].set_range( int32_t( add_hlod(
+        layouts,
+        hlod_range_t()
+          .set_part( std::move( parts ) )
+          .set_vertex_count( vertex_count )
+          .set_index_count( index_count )
+          .set_target( std::min( triangles * 3u, index_count ) )
+      ) ) );
+    }
+    std::cout << items.size() << "個のインスタンスを" << hlod.cluster.size() << "個のHLODのクラスタに分割" << std::endl;
+    return hlod;
+  }
+  void create_hlod_proxy(
+    const fx::gltf::Document &doc,
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    uint32_t push_constant_size,
+    const shader_t &shader,
+    uint32_t swapchain_size,
+    const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const sampler_t &sampler,
+    const buffer_layouts_t &layouts,
+    hlod_t &hlod
+  ) {
+    if( hlod.cluster.empty() ) return;
+    if( layouts.size() <= index_buffer_index ) throw vw::invalid_argument( "頂点とインデックスのバッファが無い", __FILE__, __LINE__ );
+    const auto &ranges = layouts[ index_buffer_index ].hlod;
+    const auto &sources = layouts[ index_buffer_index ].hlod_source;
+    // テクスチャを持つマテリアルもベースカラーの係数だけで近似する
+    // 係数はcreate_primitiveのuniformと同じくsRGBとして扱うのでsRGBのイメージにそのまま詰める
+    std::vector< uint8_t > pixels;
+    for( const auto &material: doc.materials )
+      for( const auto value: material.pbrMetallicRoughness.baseColorFactor )
+        pixels.push_back( uint8_t( std::lround( std::clamp( value, 0.f, 1.f ) * 255.f ) ) );
+    if( pixels.empty() ) pixels = std::vector< uint8_t >{ 255u, 255u, 255u, 255u };
+    hlod.set_palette( vw::load_image(
+      context,
+      vw::pixels_t()
+        .set_width( uint32_t( pixels.size() / 4u ) )
+        .set_height( 1u )
+        .set_data( pixels ),
+      vk::ImageUsageFlagBits::eSampled,
+      false,
+      true
+    ) );
+    hlod.set_palette_texture( create_texture( hlod.palette, sampler ) );
+    hlod.palette_texture.set_srgb( hlod.palette_texture.unorm );
+    hlod.proxy.clear();
+    for( auto &cluster: hlod.cluster ) {
+      cluster.set_proxy( -1 );
+      if( cluster.range < 0 ) continue;
+      if( ranges.size() <= size_t( cluster.range ) ) throw vw::invalid_argument( "参照されたHLODが存在しない", __FILE__, __LINE__ );
+      const auto &range = ranges[ cluster.range ];
+      if( range.count == 0u ) continue;
+      float roughness = 0.f;
+      float metalness = 0.f;
+      bool double_sided = false;
+      for( const auto &part: range.part ) {
+        const auto &material = doc.materials[ sources[ part.source ].material ];
+        roughness += material.pbrMetallicRoughness.roughnessFactor;
+        metalness += material.pbrMetallicRoughness.metallicFactor;
+        double_sided = double_sided || material.doubleSided;
+      }
+      roughness /= float( range.part.size() );
+      metalness /= float( range.part.size() );
+      cluster.set_proxy( int32_t( hlod.proxy.size() ) );
+      cluster.set_error( range.error );
+      hlod.proxy.push_back( create_generated_primitive(
+        context,
+        render_pass,
+        push_constant_size,
+        shader,
+        swapchain_size,
+        extra_textures,
+        dynamic_uniform_buffer,
+        uniforms_t()
+          .set_base_color( glm::vec4( 1.f, 1.f, 1.f, 1.f ) )
+          .set_emissive( glm::vec4( 0.f, 0.f, 0.f, 1.f ) )
+          .set_roughness( roughness )
+          .set_metalness( metalness )
+          .set_normal_scale( 1.f )
+          .set_occlusion_strength( 1.f ),
+        hlod.palette_texture,
+        double_sided,
+        buffer_view_t().set_index( vertex_buffer_index ).set_offset( uint32_t( range.vertex_offset ) ),
+        buffer_view_t().set_index( index_buffer_index ).set_offset( uint32_t( range.offset ) ),
+        uint32_t( range.count ),
+        cluster.min,
+        cluster.max
+      ) );
+    }
+    // 親の代理メッシュを選んだ時に子より細かく見えないように誤差を子孫の最大値に揃える
+    for( size_t index = hlod.cluster.size(); index != 0u; --index ) {
+      auto &cluster = hlod.cluster[ index - 1u ];
+      for( const auto c: cluster.child )
+        cluster.set_error( std::max( cluster.error, hlod.cluster[ c ].error ) );
+    }
+  }
+  void draw_hlod(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const hlod_t &hlod,
+    const meshes_t &meshes,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod_selector,
+    const meshlet_culling_t &culling
+  ) {
+    if( hlod.cluster.empty() ) return;
+    // クラスタの範囲はシーンの座標系なので視錐台の平面も一度だけ求めておく
+    const auto &clip = culling.view_projection;
+    const auto row = [&]( int i ) { return glm::vec4( clip[ 0 ][ i ], clip[ 1 ][ i ], clip[ 2 ][ i ], clip[ 3 ][ i ] ); };
+    std::array< glm::vec4, 6u > planes{
+      row( 3 ) + row( 0 ), row( 3 ) - row( 0 ),
+      row( 3 ) + row( 1 ), row( 3 ) - row( 1 ),
+      row( 3 ) + row( 2 ), row( 3 ) - row( 2 )
+    };
+    for( auto &plane: planes ) {
+      const float length = glm::length( glm::vec3( plane ) );
+      if( length > 0.f ) plane /= length;
+    }
+    draw_cluster( context, commands, hlod, 0u, meshes, buffers, current_frame, pipeline_index, lod_selector, culling, planes );
+  }
+}
@@ -20,35 +20,203 @@
  * IN THE SOFTWARE.
  */
 #include <iostream>
+#include <optional>
+#include <thread>
 #include <vulkan/vulkan.hpp>
 #include <fx/gltf.h>
 #include <vw/image.h>
 #include <vw/command_buffer.h>
+#include <vw/decode_queue.h>
+#include <vw/uploader.h>
+#include <vw/base64.h>
 #include <viewer/image.h>
+#include <viewer/data_uri.h>
+#include <viewer/cache.h>
 namespace viewer {
-  images_t create_image(
+  namespace {
+    constexpr size_t decode_memory_limit = 512u * 1024u * 1024u;
+    void mark_texture(
+      const fx::gltf::Document &doc,
+      std::vector< view_usage_t > &usage,
+      int32_t index,
+      bool srgb
+    ) {
+      if( index < 0 || doc.textures.size() <= size_t( index ) ) return;
+      const auto source = doc.textures[ index ].source;
+      if( source < 0 || usage.size() <= size_t( source ) ) return;
+      if( srgb ) usage[ source ].srgb = true;
+      else usage[ source ].unorm = true;
+    }
+    std::vector< view_usage_t > get_view_usage(
+      const fx::gltf::Document &doc
+    ) {
+      std::vector< view_usage_t > usage( doc.images.size() );
+      for( const auto &material: doc.materials ) {
+        mark_texture( doc, usage, material.pbrMetallicRoughness.baseColorTexture.index, true );
+        mark_texture( doc, usage, material.pbrMetallicRoughness.metallicRoughnessTexture.index, false );
+        mark_texture( doc, usage, material.normalTexture.index, false );
+        mark_texture( doc, usage, material.occlusionTexture.index, false );
+        mark_texture( doc, usage, material.emissiveTexture.index, true );
+      }
+      for( auto &u: usage )
+        if( !u.unorm && !u.srgb ) u.unorm = true;
+      return usage;
+    }
+    void load_image(
+      const vw::context_t &context,
+      image_t &image,
+      const vw::pixels_t &pixels,
+      const view_usage_t &usage
+    ) {
+      // sRGBのビューが必要な場合はミップマップをリニアな空間で生成する為にsRGBをイメージのフォーマットにする
+      std::vector< vk::Format > formats;
+      if( usage.srgb ) formats.push_back( vk::Format::eR8G8B8A8Srgb );
+      if( usage.unorm ) formats.push_back( vk::Format::eR8G8B8A8Unorm );
+      image.set_image(
+        vw::load_image( context, pixels, vk::ImageUsageFlagBits::eSampled, true, formats )
+      );
+      if( usage.unorm ) image.set_unorm( vw::create_image_view( context, image.image, vk::Format::eR8G8B8A8Unorm ) );
+      if( usage.srgb ) image.set_srgb( vw::create_image_view( context, image.image, vk::Format::eR8G8B8A8Srgb ) );
+    }
+    // エンコードされた内容の分をデコード先と合わせて予約し直す
+    // 別々に予約したままデコード先の予約を待つと、エンコードされた内容を抱えたスレッド同士で待ち合う事がある
+    // 合わせた予約はデコードした結果が取り出されるまで残る
+    vw::decode_queue_t::reserve_t merge_reservation(
+      const vw::decode_queue_t::reserve_t &reserve,
+      std::shared_ptr< void > &encoded,
+      size_t encoded_size
+    ) {
+      return [&reserve,&encoded,encoded_size]( size_t size ) {
+        if( !encoded ) return reserve( size );
+        encoded.reset();
+        return reserve( encoded_size + size );
+      };
+    }
+    // cache_dirが空でなければエンコードされた内容が同じイメージのデコード結果を使い回す
+    vw::pixels_t decode_cached_image(
+      const uint8_t *begin,
+      const uint8_t *end,
+      const std::string &format,
+      const vw::decode_queue_t::reserve_t &reserve,
+      const std::filesystem::path &cache_dir
+    ) {
+      if( cache_dir.empty() ) return vw::decode_image( begin, end, format, reserve );
+      const auto filename = get_image_cache_path( cache_dir, begin, end );
+      if( auto cached = load_image_cache( filename, reserve ); cached ) return std::move( *cached );
+      auto pixels = vw::decode_image( begin, end, format, reserve );
+      save_image_cache( filename, pixels );
+      return pixels;
+    }
+  }
+  std::shared_ptr< image_loader_t > start_image_loading(
     const fx::gltf::Document &doc,
+    const std::filesystem::path cd,
+    const std::shared_ptr< vw::file_reader_t > &reader,
+    size_t thread_count,
+    const std::filesystem::path &cache_dir
+  ) {
+    auto loader = std::make_shared< image_loader_t >();
+    std::vector< vw::decode_queue_t::job_t > jobs( doc.images.size() );
+    loader->path.resize( doc.images.size() );
+    for( size_t index = 0u; index != doc.images.size(); ++index ) {
+      const auto &image = doc.images[ index ];
+      if( const auto uri = parse_data_uri( image.uri ); uri ) {
+        // デコードはワーカースレッドで行う為、base64の文字列はジョブが所有する
+        auto encoded = std::make_shared< std::string >( uri->begin, uri->end );
+        const auto format = get_extension( image.mimeType.empty() ? uri->media_type : image.mimeType );
+        loader->path[ index ] = "data:" + uri->media_type;
+        jobs[ index ] = [encoded,format,cache_dir]( const vw::decode_queue_t::reserve_t &reserve ) {
+          const char *begin = encoded->data();
+          const char *end = begin + encoded->size();
+          const size_t decoded_size = vw::get_base64_decoded_size( begin, end );
+          auto reservation = reserve( decoded_size );
+          std::vector< uint8_t > decoded( decoded_size );
+          decoded.resize( vw::decode_base64( begin, end, decoded.data() ) );
+          return decode_cached_image( decoded.data(), decoded.data() + decoded.size(), format, merge_reservation( reserve, reservation, decoded_size ), cache_dir );
+        };
+        continue;
+      }
+      auto path = std::filesystem::path( image.uri );
+      if( path.is_relative() ) path = cd / path;
+      loader->path[ index ] = path.string();
+      auto extension = path.extension().string();
+      if( !extension.empty() ) extension = extension.substr( 1u );
+      const auto format = extension.empty() ? get_extension( image.mimeType ) : extension;
+      // ファイルの内容もデコードに使うメモリとして数え、予約できてから読む
+      jobs[ index ] = [reader,filename=path.string(),format,cache_dir]( const vw::decode_queue_t::reserve_t &reserve ) {
+        std::error_code ec;
+        const auto file_size = std::filesystem::file_size( filename, ec );
+        const size_t encoded_size = ec ? 0u : size_t( file_size );
+        auto reservation = reserve( encoded_size );
+        const auto data = reader->read( filename ).get();
+        return decode_cached_image( data.begin(), data.end(), format, merge_reservation( reserve, reservation, encoded_size ), cache_dir );
+      };
+    }
+    loader->set_reader( reader );
+    loader->set_usage( get_view_usage( doc ) );
+    loader->set_queue( std::make_shared< vw::decode_queue_t >(
+      std::move( jobs ),
+      thread_count,
+      decode_memory_limit
+    ) );
+    return loader;
+  }
+  std::vector< size_t > update_image(
     const vw::context_t &context,
-    const std::filesystem::path cd
+    image_loader_t &loader,
+    images_t &images,
+    size_t budget
   ) {
-    images_t images;
-    unsigned int cur = 1u;
-    for( const auto &image: doc.images ) {
-      auto image_path = std::filesystem::path( image.uri );
-      if( image_path.is_relative() ) image_path = cd / image_path;
-      images.push_back( image_t() );
-      std::cout << "[" << cur << "/" << doc.images.size() <<  "] " << image_path.string() << " をロード中..." << std::flush;
-      const vk::UniqueHandle< vk::Semaphore, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > null_semaphore;
-      images.back().set_unorm(
-        vw::load_image( context, image_path.string(), vk::ImageUsageFlagBits::eSampled, true, false )
-      );
-      images.back().set_srgb(
-        vw::load_image( context, image_path.string(), vk::ImageUsageFlagBits::eSampled, true, true )
-      );
+    std::vector< size_t > loaded;
+    vw::upload_batch_t upload_batch( context );
+    size_t uploaded = 0u;
+    while( uploaded < budget ) {
+      std::optional< std::pair< size_t, vw::pixels_t > > decoded;
+      try {
+        decoded = loader.queue->try_pop();
+      }
+      catch( const std::exception &e ) {
+        std::cerr << "イメージを読み込めない: " << e.what() << std::endl;
+        continue;
+      }
+      if( !decoded ) break;
+      const auto &[index,pixels] = *decoded;
+      load_image( context, images[ index ], pixels, loader.usage[ index ] );
+      loaded.push_back( index );
+      uploaded += pixels.data.size();
+    }
+    upload_batch.submit();
+    return loaded;
+  }
+  std::vector< size_t > finish_image_loading(
+    const vw::context_t &context,
+    image_loader_t &loader,
+    images_t &images
+  ) {
+    std::vector< size_t > loaded;
+    while( auto decoded = loader.queue->pop() ) {
+      const auto &[index,pixels] = *decoded;
+      std::cout << "[" << loaded.size() + 1u << "/" << loader.queue->size() <<  "] " << loader.path[ index ] << " をロード中..." << std::flush;
+      load_image( context, images[ index ], pixels, loader.usage[ index ] );
       std::cout << " OK" << std::endl;
-      ++cur;
+      loaded.push_back( index );
     }
+    return loaded;
+  }
+  images_t create_image(
+    const fx::gltf::Document &doc,
+    const vw::context_t &context,
+    const std::filesystem::path cd
+  ) {
+    auto loader = start_image_loading(
+      doc,
+      cd,
+      std::make_shared< vw::file_reader_t >( vw::default_file_queue_depth, vw::default_file_thread_count ),
+      std::thread::hardware_concurrency(),
+      std::filesystem::path()
+    );
+    images_t images( doc.images.size() );
+    finish_image_loading( context, *loader, images );
     return images;
   }
 }
-
@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <vw/command_buffer.h>
+#include <vw/wait_for_idle.h>
+#include <vw/exceptions.h>
+#include <viewer/impostor.h>
+namespace viewer {
+  namespace {
+    constexpr uint32_t impostor_atlas_size = impostor_columns * impostor_tile_size;
+    constexpr uint32_t impostors_per_atlas = impostor_columns * impostor_columns / impostor_views;
+    // viewの方向からメッシュの境界球がタイルにちょうど収まるように平行投影する
+    // 焼き込みと描画でタイル上の向きが一致するようにカメラと同じくlhrhを掛ける
+    glm::mat4 get_bake_matrix(
+      const impostor_t &impostor,
+      uint32_t view
+    ) {
+      const auto lhrh = glm::mat4(-1,0,0,0,0,-1,0,0,0,0,1,0,0,0,0,1);
+      const float angle = 2.f * float( M_PI ) * float( view ) / float( impostor_views );
+      const glm::vec3 dir( std::sin( angle ), 0.f, std::cos( angle ) );
+      const float r = impostor.radius;
+      return lhrh *
+        glm::orthoRH_ZO( -r, r, -r, r, r, 3.f * r ) *
+        glm::lookAt( impostor.center + dir * 2.f * r, impostor.center, glm::vec3( 0.f, 1.f, 0.f ) );
+    }
+    vw::framebuffer_t create_atlas_framebuffer(
+      const vw::context_t &context,
+      const vw::render_pass_t &render_pass
+    ) {
+      // create_framebufferはスワップチェーンのイメージの数だけ作るが焼き込みには1つあれば良い
+      vw::framebuffer_t framebuffer;
+      framebuffer.set_color_image( vw::get_image(
+        context,
+        vk::ImageCreateInfo()
+          .setImageType( vk::ImageType::e2D )
+          .setFormat( vk::Format::eR32G32B32A32Sfloat )
+          .setExtent( { impostor_atlas_size, impostor_atlas_size, 1 } )
+          .setMipLevels( 1 )
+          .setArrayLayers( 1 )
+          .setUsage( vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst ),
+        VMA_MEMORY_USAGE_GPU_ONLY
+      ) );
+      framebuffer.color_image.set_image_view(
+        context.device->createImageViewUnique(
+          vk::ImageViewCreateInfo()
+            .setImage( *framebuffer.color_image.image )
+            .setViewType( vk::ImageViewType::e2D )
+            .setFormat( vk::Format::eR32G32B32A32Sfloat )
+            .setSubresourceRange( vk::ImageSubresourceRange( vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 ) )
+        )
+      );
+      framebuffer.set_depth_image( vw::get_image(
+        context,
+        vk::ImageCreateInfo()
+          .setImageType( vk::ImageType::e2D )
+          .setFormat( vk::Format::eD16Unorm )
+          .setExtent( { impostor_atlas_size, impostor_atlas_size, 1 } )
+          .setMipLevels( 1 )
+          .setArrayLayers( 1 )
+          .setUsage( vk::ImageUsageFlagBits::eDepthStencilAttachment ),
+        VMA_MEMORY_USAGE_GPU_ONLY
+      ) );
+      framebuffer.set_depth_image_view(
+        context.device->createImageViewUnique(
+          vk::ImageViewCreateInfo()
+            .setImage( *framebuffer.depth_image.image )
+            .setViewType( vk::ImageViewType::e2D )
+            .setFormat( vk::Format::eD16Unorm )
+            .setSubresourceRange( vk::ImageSubresourceRange( vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 ) )
+        )
+      );
+      // ミップを作らないのでカラーイメージのビューをそのままアタッチメントに使う
+      const std::array< vk::ImageView, 2 > attachments{
+        *framebuffer.color_image.image_view,
+        *framebuffer.depth_image_view
+      };
+      framebuffer.set_framebuffer(
+        context.device->createFramebufferUnique(
+          vk::FramebufferCreateInfo()
+            .setRenderPass( *render_pass.render_pass )
+            .setAttachmentCount( attachments.size() )
+            .setPAttachments( attachments.data() )
+            .setWidth( impostor_atlas_size )
+            .setHeight( impostor_atlas_size )
+            .setLayers( 1 )
+        )
+      );
+      framebuffer.set_width( impostor_atlas_size );
+      framebuffer.set_height( impostor_atlas_size );
+      return framebuffer;
+    }
+    void draw_impostor_node(
+      vk::CommandBuffer &commands,
+      const node_t &node,
+      const meshes_t &meshes,
+      const impostors_t &impostors,
+      uint32_t current_frame,
+      const lod_selector_t &lod_selector,
+      bool &pipeline_bound,
+      int32_t &bound_atlas
+    ) {
+      for( const auto &n: node.children )
+        draw_impostor_node( commands, n, meshes, impostors, current_frame, lod_selector, pipeline_bound, bound_atlas );
+      if( !node.has_mesh || impostors.mesh.size() <= size_t( node.mesh ) ) return;
+      const auto &impostor = impostors.mesh[ node.mesh ];
+      if( impostor.atlas < 0 || !use_impostor( meshes[ node.mesh ], node.matrix, lod_selector ) ) return;
+      if( !pipeline_bound ) {
+        commands.bindPipeline( vk::PipelineBindPoint::eGraphics, *impostors.pipeline.pipeline );
+        pipeline_bound = true;
+      }
+      if( bound_atlas != impostor.atlas ) {
+        const std::vector< vk::DescriptorSet > descriptor_set{
+          *impostors.atlas[ impostor.atlas ].descriptor_set[ current_frame ].descriptor_set[ 0 ]
+        };
+        commands.bindDescriptorSets(
+          vk::PipelineBindPoint::eGraphics,
+          *impostors.pipeline.pipeline_layout,
+          0,
+          descriptor_set,
+          {}
+        );
+        bound_atlas = impostor.atlas;
+      }
+      auto pc = push_constants_t()
+        .set_world_matrix(
+          node.matrix *
+          glm::translate( glm::mat4( 1.f ), impostor.center ) *
+          glm::scale( glm::mat4( 1.f ), glm::vec3( impostor.radius ) )
+        )
+        .set_fid( int32_t( impostor.first_tile ) );
+      commands.pushConstants( *impostors.pipeline.pipeline_layout, vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, 0, sizeof( push_constants_t ), &pc );
+      commands.draw( 6, 1, 0, 0 );
+    }
+  }
+  impostors_t create_impostor(
+    const vw::context_t &context,
+    document_t &document,
+    const std::vector< vw::render_pass_t > &render_pass,
+    uint32_t bake_pipeline_index,
+    uint32_t draw_pipeline_index,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    uint32_t current_frame
+  ) {
+    if( render_pass.size() <= bake_pipeline_index || !render_pass[ bake_pipeline_index ].impostor )
+      throw vw::invalid_argument( "インポスタを焼き込むレンダーパスではない", __FILE__, __LINE__ );
+    if( render_pass.size() <= draw_pipeline_index )
+      throw vw::invalid_argument( "レンダーパスが存在しない", __FILE__, __LINE__ );
+    if( dynamic_uniform_buffer.size() < context.descriptor_set_layout.size() )
+      throw vw::invalid_argument( "dynamic uniform bufferが足りない", __FILE__, __LINE__ );
+    const auto vs = document.shader.find( shader_flag_t( int( shader_flag_t::vertex )|int( shader_flag_t::special ) | 8 ) );
+    const auto fs = document.shader.find( shader_flag_t( int( shader_flag_t::fragment )|int( shader_flag_t::special ) | 8 ) );
+    if( vs == document.shader.end() || fs == document.shader.end() )
+      throw vw::unable_to_load_shader( "必要なシェーダがない", __FILE__, __LINE__ );
+    const auto &bake_pass = render_pass[ bake_pipeline_index ];
+    impostors_t impostors;
+    impostors.set_sampler( create_nomip_sampler( context ) );
+    // 1枚のアトラスにimpostors_per_atlas個のメッシュを詰める
+    std::vector< impostor_t > mesh_impostor( document.mesh.size() );
+    std::vector< std::vector< size_t > > page;
+    for( size_t i = 0u; i != document.mesh.size(); ++i ) {
+      const auto &mesh = document.mesh[ i ];
+      if( mesh.primitive.empty() ) continue;
+      const float radius = glm::length( mesh.max - mesh.min ) * 0.5f;
+      if( !( radius > 0.f ) ) continue;
+      if( page.empty() || page.back().size() == impostors_per_atlas ) page.emplace_back();
+      mesh_impostor[ i ]
+        .set_atlas( int32_t( page.size() - 1u ) )
+        .set_first_tile( uint32_t( page.back().size() ) * impostor_views )
+        .set_center( ( mesh.min + mesh.max ) * 0.5f )
+        .set_radius( radius );
+      page.back().push_back( i );
+    }
+    auto commands = vw::get_command_buffer( context, true );
+    commands->begin(
+      vk::CommandBufferBeginInfo()
+        .setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+    );
+    const std::array< vk::ClearValue, 2 > clear_values{
+      vk::ClearColorValue( std::array< float, 4u >{ 0.0f, 0.0f, 0.0f, 0.0f } ),
+      vk::ClearDepthStencilValue( 1.f, 0 )
+    };
+    for( const auto &meshes: page ) {
+      impostor_atlas_t atlas;
+      atlas.set_color( create_atlas_framebuffer( context, bake_pass ) );
+      atlas.set_normal( create_atlas_framebuffer( context, bake_pass ) );
+      // fidが0ならベースカラーを、1なら法線を書く
+      for( int32_t fid = 0; fid != 2; ++fid ) {
+        const auto &fb = fid ? atlas.normal : atlas.color;
+        auto const pass_info = vk::RenderPassBeginInfo()
+          .setRenderPass( *bake_pass.render_pass )
+          .setFramebuffer( *fb.framebuffer )
+          .setRenderArea( vk::Rect2D( vk::Offset2D( 0, 0 ), vk::Extent2D( fb.width, fb.height ) ) )
+          .setClearValueCount( clear_values.size() )
+          .setPClearValues( clear_values.data() );
+        commands->beginRenderPass( &pass_info, vk::SubpassContents::eInline );
+        for( const auto index: meshes ) {
+          const auto &impostor = mesh_impostor[ index ];
+          for( uint32_t view = 0u; view != impostor_views; ++view ) {
+            const uint32_t tile = impostor.first_tile + view;
+            const int32_t x = int32_t( tile % impostor_columns * impostor_tile_size );
+            const int32_t y = int32_t( tile / impostor_columns * impostor_tile_size );
+            const auto viewport =
+              vk::Viewport()
+                .setX( float( x ) )
+                .setY( float( y ) )
+                .setWidth( float( impostor_tile_size ) )
+                .setHeight( float( impostor_tile_size ) )
+                .setMinDepth( 0.0f )
+                .setMaxDepth( 1.0f );
+            const vk::Rect2D scissor( vk::Offset2D( x, y ), vk::Extent2D( impostor_tile_size, impostor_tile_size ) );
+            commands->setViewport( 0, 1, &viewport );
+            commands->setScissor( 0, 1, &scissor );
+            const auto matrix = get_bake_matrix( impostor, view );
+            for( const auto &primitive: document.mesh[ index ].primitive ) {
+              bind_primitive( *commands, primitive, document.buffer, current_frame, bake_pipeline_index, matrix, fid );
+              if( !primitive.indexed ) {
+                commands->draw( primitive.count, 1, 0, 0 );
+              }
+              else {
+                commands->bindIndexBuffer( *document.buffer[ primitive.index_buffer.index ].buffer.buffer, primitive.index_buffer.offset, primitive.index_buffer_type );
+                commands->drawIndexed( primitive.count, 1, 0, 0, 0 );
+              }
+            }
+          }
+        }
+        commands->endRenderPass();
+      }
+      impostors.atlas.push_back( std::move( atlas ) );
+    }
+    commands->end();
+    auto graphics_queue = context.device->getQueue( context.graphics_queue_index, 0 );
+    graphics_queue.submit(
+      vk::SubmitInfo()
+        .setCommandBufferCount( 1 )
+        .setPCommandBuffers( &*commands ),
+      vk::Fence()
+    );
+    vw::wait_for_idle( context );
+    std::vector< vk::DescriptorSetLayout > layout;
+    layout.reserve( context.descriptor_set_layout.size() );
+    std::transform( context.descriptor_set_layout.begin(), context.descriptor_set_layout.end(), std::back_inserter( layout ), []( const auto &v ) { return *v; } );
+    for( auto &atlas: impostors.atlas ) {
+      atlas.set_color_texture( create_texture( atlas.color.color_image, impostors.sampler ) );
+      atlas.set_normal_texture( create_texture( atlas.normal.color_image, impostors.sampler ) );
+      for( unsigned int i = 0; i != layout.size(); ++i ) {
+        atlas.descriptor_set.push_back( descriptor_set_t() );
+        atlas.descriptor_set.back().set_descriptor_set(
+          context.device->allocateDescriptorSetsUnique(
+            vk::DescriptorSetAllocateInfo()
+              .setDescriptorPool( *context.descriptor_pool )
+              .setDescriptorSetCount( 1 )
+              .setPSetLayouts( layout.data() + i )
+          )
+        );
+        auto dynamic_uniform_buffer_info =
+          vk::DescriptorBufferInfo()
+            .setBuffer( *dynamic_uniform_buffer[ i ].buffer.buffer )
+            .setOffset( 0u )
+            .setRange( sizeof( dynamic_uniforms_t ) );
+        const std::vector< vk::WriteDescriptorSet > updates{
+          vk::WriteDescriptorSet()
+            .setDstSet( *atlas.descriptor_set.back().descriptor_set[ 0 ] )
+            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+            .setDescriptorCount( 1 )
+            .setPImageInfo( &atlas.color_texture.unorm )
+            .setDstBinding( 1 ),
+          vk::WriteDescriptorSet()
+            .setDstSet( *atlas.descriptor_set.back().descriptor_set[ 0 ] )
+            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+            .setDescriptorCount( 1 )
+            .setPImageInfo( &atlas.normal_texture.unorm )
+            .setDstBinding( 3 ),
+          vk::WriteDescriptorSet()
+            .setDstSet( *atlas.descriptor_set.back().descriptor_set[ 0 ] )
+            .setDescriptorType( vk::DescriptorType::eUniformBuffer )
+            .setDescriptorCount( 1 )
+            .setPBufferInfo( &dynamic_uniform_buffer_info )
+            .setDstBinding( 7 )
+        };
+        context.device->updateDescriptorSets( updates, nullptr );
+      }
+    }
+    impostors.set_pipeline(
+      vw::create_pipeline(
+        context, render_pass[ draw_pipeline_index ], sizeof( push_constants_t ), *vs->second, *fs->second,
+        {},
+        {},
+        false,
+        false,
+        false
+      )
+    );
+    for( size_t i = 0u; i != document.mesh.size(); ++i )
+      document.mesh[ i ].set_impostor( mesh_impostor[ i ].atlas >= 0 );
+    impostors.set_mesh( std::move( mesh_impostor ) );
+    std::cout << impostors.atlas.size() << "枚のアトラスに" << std::count_if( document.mesh.begin(), document.mesh.end(), []( const auto &m ) { return m.impostor; } ) << "個のインポスタを焼き込み" << std::endl;
+    return impostors;
+  }
+  void draw_impostor(
+    vk::CommandBuffer &commands,
+    const node_t &node,
+    const meshes_t &meshes,
+    const impostors_t &impostors,
+    uint32_t current_frame,
+    const lod_selector_t &lod_selector
+  ) {
+    if( impostors.atlas.empty() || !( lod_selector.impostor_distance > 0.f ) ) return;
+    bool pipeline_bound = false;
+    int32_t bound_atlas = -1;
+    draw_impostor_node( commands, node, meshes, impostors, current_frame, lod_selector, pipeline_bound, bound_atlas );
+  }
+}
@@ -20,15 +20,276 @@
  * IN THE SOFTWARE.
  */
 #include <iostream>
+#include <algorithm>
 #include <vulkan/vulkan.hpp>
 #include <fx/gltf.h>
 #include <glm/mat4x4.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <stamp/exception.h>
 #include <viewer/mesh.h>
+#include <viewer/parse.h>
 #include <vw/exceptions.h>
 #include <vw/to_size.h>
+#include <vw/draco.h>
 #include <glm/gtx/string_cast.hpp>
 namespace viewer {
+  namespace {
+    // これより少ない三角形になるLODは作らない
+    constexpr size_t min_lod_triangles = 64u;
+    struct source_attribute_t {
+      uint32_t location;
+      const fx::gltf::Accessor *accessor;
+      uint32_t size;
+      uint32_t stride;
+      vk::Format format;
+      // 生成する場合の頂点内での大きさ
+      uint32_t dest_size;
+      bool generate;
+      interleaved_attribute_t conversion;
+      // KHR_draco_mesh_compressionの属性のunique_id 圧縮されていない場合は負
+      int32_t draco;
+    };
+    // 4要素に広げた頂点属性の足した要素に置く値
+    // Vulkanが足りない要素を補うのと同じく3つ目は0、4つ目は1にする
+    uint32_t get_widened_fill(
+      const fx::gltf::Accessor &accessor
+    ) {
+      using component_t = fx::gltf::Accessor::ComponentType;
+      uint32_t one = 1u;
+      if( accessor.componentType == component_t::Float ) one = 0x3F800000u;
+      else if( accessor.normalized ) {
+        if( accessor.componentType == component_t::UnsignedByte ) one = 0xFFu;
+        else if( accessor.componentType == component_t::Byte ) one = 0x7Fu;
+        else if( accessor.componentType == component_t::UnsignedShort ) one = 0xFFFFu;
+        else if( accessor.componentType == component_t::Short ) one = 0x7FFFu;
+      }
+      const uint32_t shift = ( 3u - vw::to_size( accessor.type ) ) * vw::to_size( accessor.componentType ) * 8u;
+      return shift < 32u ? one << shift : 0u;
+    }
+    bool has_extension(
+      const std::vector< std::string > &extensions,
+      const std::string &name
+    ) {
+      return std::find( extensions.begin(), extensions.end(), name ) != extensions.end();
+    }
+    // KHR_mesh_quantizationが無い場合に使える型はPOSITION、NORMAL、TANGENTがfloat、TEXCOORDがfloatと正規化された符号なし整数のみ
+    void validate_attribute(
+      uint32_t location,
+      const fx::gltf::Accessor &accessor,
+      bool quantization
+    ) {
+      using component_t = fx::gltf::Accessor::ComponentType;
+      const auto type = accessor.componentType;
+      const bool is_float = type == component_t::Float;
+      const bool is_8_16 = type == component_t::Byte || type == component_t::UnsignedByte || type == component_t::Short || type == component_t::UnsignedShort;
+      const bool is_signed_8_16 = type == component_t::Byte || type == component_t::Short;
+      const bool is_unsigned_8_16 = type == component_t::UnsignedByte || type == component_t::UnsignedShort;
+      bool valid = true;
+      if( location == 0u ) valid = is_float || ( quantization && is_8_16 );
+      else if( location == 1u || location == 2u ) valid = is_float || ( quantization && accessor.normalized && is_signed_8_16 );
+      else if( location == 3u || location == 4u ) valid = is_float || ( accessor.normalized && is_unsigned_8_16 ) || ( quantization && is_8_16 );
+      if( !valid ) {
+        if( quantization ) throw vw::invalid_gltf( "頂点属性に使用できない型", __FILE__, __LINE__ );
+        else throw vw::invalid_gltf( "KHR_mesh_quantizationなしでは使用できない頂点属性の型", __FILE__, __LINE__ );
+      }
+    }
+    void quantize_attribute(
+      const vw::context_t &context,
+      source_attribute_t &attr,
+      bool rigged,
+      glm::mat4 &dequantize
+    ) {
+      const auto &accessor = *attr.accessor;
+      const auto set = [&]( vertex_conversion_t conversion, uint32_t components, vk::Format format, uint32_t dest_size ) {
+        if( !vw::is_vertex_buffer_format_supported( context, format ) ) return false;
+        attr.conversion.set_conversion( conversion );
+        attr.conversion.set_components( components );
+        attr.format = format;
+        attr.dest_size = dest_size;
+        attr.generate = true;
+        return true;
+      };
+      if( attr.location == 0u && accessor.type == fx::gltf::Accessor::Type::Vec3 ) {
+        // スキニングの行列は量子化前の座標を前提にしているので変換しない
+        if( rigged || accessor.min.size() < 3u || accessor.max.size() < 3u ) return;
+        const glm::vec3 min( accessor.min[ 0 ], accessor.min[ 1 ], accessor.min[ 2 ] );
+        const glm::vec3 max( accessor.max[ 0 ], accessor.max[ 1 ], accessor.max[ 2 ] );
+        // 法線がノードの行列で正しく変換されるように全ての軸で同じ拡大率を使う
+        float extent = std::max( std::max( max[ 0 ] - min[ 0 ], max[ 1 ] - min[ 1 ] ), max[ 2 ] - min[ 2 ] );
+        if( !( extent > 0.f ) ) extent = 1.f;
+        if( !set( vertex_conversion_t::unorm16, 3u, vk::Format::eR16G16B16A16Unorm, 8u ) ) return;
+        attr.conversion.set_bias( std::array< float, 4u >{ min[ 0 ], min[ 1 ], min[ 2 ], 0.f } );
+        attr.conversion.set_scale( 1.f / extent );
+        dequantize = glm::scale( glm::translate( glm::mat4( 1.f ), min ), glm::vec3( extent, extent, extent ) );
+      }
+      else if( attr.location == 1u && accessor.type == fx::gltf::Accessor::Type::Vec3 )
+        set( vertex_conversion_t::snorm8, 3u, vk::Format::eR8G8B8A8Snorm, 4u );
+      else if( attr.location == 2u && accessor.type == fx::gltf::Accessor::Type::Vec4 )
+        set( vertex_conversion_t::snorm8, 4u, vk::Format::eR8G8B8A8Snorm, 4u );
+      else if( ( attr.location == 3u || attr.location == 4u ) && accessor.type == fx::gltf::Accessor::Type::Vec2 ) {
+        // 繰り返すUVは[0,1]に収まらないのでminとmaxで範囲が分かる場合だけ変換する
+        if( accessor.min.size() < 2u || accessor.max.size() < 2u ) return;
+        if( accessor.min[ 0 ] < 0.f || accessor.min[ 1 ] < 0.f || accessor.max[ 0 ] > 1.f || accessor.max[ 1 ] > 1.f ) return;
+        set( vertex_conversion_t::unorm16, 2u, vk::Format::eR16G16Unorm, 4u );
+      }
+    }
+    // レンダーパス毎にパイプラインを作る 影とインポスタのパスでは専用のシェーダを使う
+    std::vector< vw::pipeline_t > create_pipelines(
+      const vw::context_t &context,
+      const std::vector< vw::render_pass_t > &render_pass,
+      uint32_t push_constant_size,
+      const shader_t &shader,
+      shader_flag_t vs_flag,
+      shader_flag_t fs_flag,
+      bool has_base_color_texture,
+      const std::vector< vk::VertexInputBindingDescription > &vertex_input_binding,
+      const std::vector< vk::VertexInputAttributeDescription > &vertex_input_attribute,
+      bool double_sided,
+      bool blend
+    ) {
+      auto vs = shader.find( vs_flag );
+      if( vs == shader.end() ) throw vw::invalid_gltf( "必要なシェーダがない", __FILE__, __LINE__ );
+      auto fs = shader.find( fs_flag );
+      if( fs == shader.end() ) {
+        throw vw::invalid_gltf( "必要なシェーダがない", __FILE__, __LINE__ );
+      }
+      auto shadow_vs = shader.find( shader_flag_t( int( shader_flag_t::vertex )|int(shader_flag_t::special) | 5 ) );
+      auto shadow_fs = shader.find( shader_flag_t( int( shader_flag_t::fragment )|int(shader_flag_t::special) | 4 ) );
+      // インポスタにはライティング前のベースカラーと法線を焼き込む
+      auto impostor_vs = shader.find( shader_flag_t( int( shader_flag_t::vertex )|int(shader_flag_t::special) | 6 ) );
+      auto impostor_fs = shader.find( shader_flag_t( int( shader_flag_t::fragment )|int(shader_flag_t::special) | ( has_base_color_texture ? 6 : 7 ) ) );
+      std::vector< vw::pipeline_t > pipelines;
+      for( const auto &r: render_pass ) {
+        if( r.impostor ) {
+          if( impostor_vs == shader.end() || impostor_fs == shader.end() ) throw vw::invalid_gltf( "必要なシェーダがない", __FILE__, __LINE__ );
+          pipelines.emplace_back(
+            vw::create_pipeline(
+              context, r, push_constant_size, *impostor_vs->second, *impostor_fs->second,
+              vertex_input_binding,
+              vertex_input_attribute,
+              !double_sided,
+              false,
+              false
+            )
+          );
+        }
+        else if( r.shadow )
+          pipelines.emplace_back(
+            vw::create_pipeline(
+              context, r, push_constant_size, *shadow_vs->second, *shadow_fs->second,
+              vertex_input_binding,
+              vertex_input_attribute,
+              !double_sided,
+              blend,
+              true
+            )
+          );
+        else
+          pipelines.emplace_back(
+            vw::create_pipeline(
+              context, r, push_constant_size, *vs->second, *fs->second,
+              vertex_input_binding,
+              vertex_input_attribute,
+              !double_sided,
+              blend,
+              false
+            )
+          );
+      }
+      return pipelines;
+    }
+    // スワップチェーンのイメージ毎にデスクリプタセットを作り、テクスチャ以外を書き込む
+    std::vector< descriptor_set_t > create_descriptor_set(
+      const vw::context_t &context,
+      uint32_t swapchain_size,
+      const buffer_t &uniform_buffer,
+      const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+      const std::vector< buffer_t > &dynamic_uniform_buffer
+    ) {
+      std::vector< descriptor_set_t > descriptor_set;
+      std::vector< vk::DescriptorSetLayout > layout;
+      layout.reserve( context.descriptor_set_layout.size() );
+      std::transform( context.descriptor_set_layout.begin(), context.descriptor_set_layout.end(), std::back_inserter( layout ), []( const auto &v ) { return *v; } );
+      for( unsigned int i = 0; i != swapchain_size; ++i ) {
+        descriptor_set.push_back( descriptor_set_t() );
+        descriptor_set.back().set_descriptor_set(
+          context.device->allocateDescriptorSetsUnique(
+            vk::DescriptorSetAllocateInfo()
+              .setDescriptorPool( *context.descriptor_pool )
+              .setDescriptorSetCount( 1 )
+              .setPSetLayouts( layout.data() + i )
+          )
+        );
+        auto uniform_buffer_info =
+          vk::DescriptorBufferInfo()
+            .setBuffer( *uniform_buffer.buffer.buffer )
+            .setOffset( 0u )
+            .setRange( sizeof( uniforms_t ) );
+        auto dynamic_uniform_buffer_info =
+          vk::DescriptorBufferInfo()
+            .setBuffer( *dynamic_uniform_buffer[ i ].buffer.buffer )
+            .setOffset( 0u )
+            .setRange( sizeof( dynamic_uniforms_t ) );
+      
+        std::vector< vk::WriteDescriptorSet > updates {
+          vk::WriteDescriptorSet()
+            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
+            .setDescriptorType( vk::DescriptorType::eUniformBuffer )
+            .setDescriptorCount( 1 )
+            .setPBufferInfo( &uniform_buffer_info )
+            .setDstBinding( 0 ),
+          vk::WriteDescriptorSet()
+            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
+            .setDescriptorType( vk::DescriptorType::eUniformBuffer )
+            .setDescriptorCount( 1 )
+            .setPBufferInfo( &dynamic_uniform_buffer_info )
+            .setDstBinding( 7 ),
+        };
+        if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 1u ) {
+          updates.push_back(
+            vk::WriteDescriptorSet()
+              .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
+              .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+              .setDescriptorCount( 1 )
+              .setPImageInfo( &extra_textures[ i ][ 0 ].unorm )
+              .setDstBinding( 6 )
+          );
+        }
+        if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 2u ) {
+          updates.push_back(
+            vk::WriteDescriptorSet()
+              .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
+              .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+              .setDescriptorCount( 1 )
+              .setPImageInfo( &extra_textures[ i ][ 1 ].unorm )
+              .setDstBinding( 8 )
+          );
+        }
+        if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 3u ) {
+          updates.push_back(
+            vk::WriteDescriptorSet()
+              .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
+              .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+              .setDescriptorCount( 1 )
+              .setPImageInfo( &extra_textures[ i ][ 2 ].unorm )
+              .setDstBinding( 9 )
+          );
+        }
+        if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 4u ) {
+          updates.push_back(
+            vk::WriteDescriptorSet()
+              .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
+              .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+              .setDescriptorCount( 1 )
+              .setPImageInfo( &extra_textures[ i ][ 3 ].unorm )
+              .setDstBinding( 10 )
+          );
+        }
+        context.device->updateDescriptorSets( updates, nullptr );
+      }
+      return descriptor_set;
+    }
+  }
   primitive_t create_primitive(
     const fx::gltf::Document &doc,
     const fx::gltf::Primitive &primitive,
@@ -40,11 +301,14 @@ namespace viewer {
     uint32_t swapchain_size,
     int shader_mask,
     const std::vector< std::vector< viewer::texture_t > > &extra_textures,
-    const std::vector< buffer_t > &dynamic_uniform_buffer
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const load_options_t &options,
+    buffer_layouts_t &layouts
   ) {
+    const auto vertex_layout = options.vertex_layout;
     if( primitive.material < 0 || doc.materials.size() <= size_t( primitive.material ) ) throw vw::invalid_gltf( "参照されたmaterialが存在しない", __FILE__, __LINE__ );
     const auto &material = doc.materials[ primitive.material ];
-    std::unordered_map< uint32_t, buffer_view_t > vertex_buffer;
+    std::vector< buffer_view_t > vertex_buffer;
     std::vector< vk::VertexInputBindingDescription > vertex_input_binding;
     std::vector< vk::VertexInputAttributeDescription > vertex_input_attribute;
     const std::unordered_map< std::string, uint32_t > attr2index{
@@ -62,6 +326,23 @@ namespace viewer {
     bool has_tangent = false;
     glm::vec3 min( -1, -1, -1 );
     glm::vec3 max( 1, 1, 1 );
+    const bool quantization = has_extension( doc.extensionsUsed, "KHR_mesh_quantization" );
+    glm::mat4 dequantize( 1.f );
+    // Dracoに対応していない場合は圧縮されていないbufferViewがあればそちらを使う
+    int32_t draco_view = -1;
+    std::unordered_map< std::string, int32_t > draco_attribute;
+    if( const auto draco = get_extension( primitive.extensionsAndExtras, "KHR_draco_mesh_compression" ); draco && vw::is_draco_available() ) {
+      try {
+        draco_view = draco->at( "bufferView" ).get< int32_t >();
+        for( const auto &item: draco->at( "attributes" ).items() )
+          draco_attribute.insert( std::make_pair( item.key(), item.value().get< int32_t >() ) );
+      }
+      catch( const nlohmann::json::exception& ) {
+        throw vw::invalid_gltf( "KHR_draco_mesh_compressionの内容が不正", __FILE__, __LINE__ );
+      }
+      if( draco_view < 0 || doc.bufferViews.size() <= size_t( draco_view ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+    }
+    std::vector< source_attribute_t > attributes;
     for( const auto &[target,index]: primitive.attributes ) {
       auto binding = attr2index.find( target );
       if( binding != attr2index.end() ) {
@@ -81,28 +362,196 @@ namespace viewer {
             max[ 2 ] = accessor.max[ 2 ];
           }
         } 
-        if( accessor.bufferView < 0 || doc.bufferViews.size() <= size_t( accessor.bufferView ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
-        const auto &view = doc.bufferViews[ accessor.bufferView ];
-        if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+        const auto compressed = draco_attribute.find( target );
+        const int32_t draco_id = compressed != draco_attribute.end() ? compressed->second : -1;
         const uint32_t default_stride = vw::to_size( accessor.componentType, accessor.type );
-        const uint32_t stride = view.byteStride ? view.byteStride : default_stride;
-        const uint32_t max_count = ( view.byteLength - ( accessor.byteOffset ) ) / stride;
-        if( accessor.count > max_count ) throw vw::invalid_gltf( "指定された要素数に対してbufferViewが小さすぎる" );
+        uint32_t stride = default_stride;
+        if( draco_id < 0 ) {
+          if( accessor.bufferView < 0 || doc.bufferViews.size() <= size_t( accessor.bufferView ) ) {
+            if( !draco_attribute.empty() || !get_extension( primitive.extensionsAndExtras, "KHR_draco_mesh_compression" ) )
+              throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+            throw vw::invalid_gltf( "KHR_draco_mesh_compressionに対応せずにビルドされている", __FILE__, __LINE__ );
+          }
+          const auto &view = doc.bufferViews[ accessor.bufferView ];
+          stride = view.byteStride ? view.byteStride : default_stride;
+          const uint32_t max_count = ( view.byteLength - ( accessor.byteOffset ) ) / stride;
+          if( accessor.count > max_count ) throw vw::invalid_gltf( "指定された要素数に対してbufferViewが小さすぎる" );
+        }
         vertex_count = std::min( vertex_count, accessor.count );
-        const uint32_t offset = accessor.byteOffset + view.byteOffset;
+        validate_attribute( binding->second, accessor, quantization );
+        source_attribute_t attr{ binding->second, &accessor, default_stride, stride, vw::to_vulkan_format( accessor.componentType, accessor.type, accessor.normalized ), default_stride, false, interleaved_attribute_t(), draco_id };
+        if( !vw::is_vertex_buffer_format_supported( context, attr.format ) ) {
+          // 3要素の8bitや16bitの形式は頂点バッファに使えない事があるので4要素に広げる
+          // 別々のバッファに置く場合は転送後にコンピュートシェーダで広げる
+          attr.format = vw::to_vulkan_format( accessor.componentType, fx::gltf::Accessor::Type::Vec4, accessor.normalized );
+          attr.dest_size = vw::to_size( accessor.componentType, fx::gltf::Accessor::Type::Vec4 );
+          attr.generate = true;
+          attr.conversion.set_fill( get_widened_fill( accessor ) );
+          attr.conversion.set_fill_size( attr.dest_size - attr.size );
+          if( attr.dest_size < attr.size || !vw::is_vertex_buffer_format_supported( context, attr.format ) )
+            throw vw::invalid_gltf( "頂点属性の型がこのデバイスで使用できない", __FILE__, __LINE__ );
+        }
+        attributes.push_back( attr );
+      }
+    }
+    std::sort( attributes.begin(), attributes.end(), []( const auto &l, const auto &r ) { return l.location < r.location; } );
+    if( options.quantize )
+      for( auto &attr: attributes )
+        if( attr.draco < 0 && attr.accessor->componentType == fx::gltf::Accessor::ComponentType::Float )
+          quantize_attribute( context, attr, rigged, dequantize );
+    // Dracoで圧縮された頂点属性は展開しながら属性毎のバッファに書き出す
+    for( const auto &attr: attributes ) {
+      if( attr.draco < 0 ) continue;
+      const uint32_t offset = add_draco(
+        layouts[ vertex_buffer_index ],
+        draco_range_t()
+          .set_view( draco_view )
+          .set_attribute( attr.draco )
+          .set_component_type( attr.accessor->componentType )
+          .set_components( vw::to_size( attr.accessor->type ) )
+          .set_stride( attr.dest_size )
+          .set_count( attr.accessor->count )
+          .set_fill( attr.conversion.fill )
+      );
+      const uint32_t binding = vertex_buffer.size();
+      vertex_input_binding.push_back(
+        vk::VertexInputBindingDescription()
+          .setBinding( binding )
+          .setStride( attr.dest_size )
+          .setInputRate( vk::VertexInputRate::eVertex )
+      );
+      vertex_input_attribute.push_back(
+        vk::VertexInputAttributeDescription()
+          .setLocation( attr.location )
+          .setBinding( binding )
+          .setFormat( attr.format )
+      );
+      vertex_buffer.push_back( buffer_view_t().set_index( vertex_buffer_index ).set_offset( offset ) );
+    }
+    attributes.erase( std::remove_if( attributes.begin(), attributes.end(), []( const auto &attr ) { return attr.draco >= 0; } ), attributes.end() );
+    // インデックスを最適化する場合は頂点もその順序に並べ替えるので全ての属性を生成する経路で書き出す
+    const bool triangle_list = primitive.indices >= 0 && draco_view < 0 && primitive.mode == fx::gltf::Primitive::Mode::Triangles;
+    const bool optimize = options.optimize && triangle_list;
+    const auto find_float_attribute = [&]( uint32_t location, fx::gltf::Accessor::Type type ) {
+      return std::find_if( attributes.begin(), attributes.end(), [&]( const auto &attr ) {
+        return
+          attr.location == location &&
+          attr.accessor->componentType == fx::gltf::Accessor::ComponentType::Float &&
+          attr.accessor->type == type;
+      } );
+    };
+    const auto get_attribute_source = [&]( const source_attribute_t &attr ) {
+      const auto &view = doc.bufferViews[ attr.accessor->bufferView ];
+      return interleaved_attribute_t()
+        .set_view( attr.accessor->bufferView )
+        .set_buffer( view.buffer )
+        .set_source_offset( size_t( view.byteOffset ) + size_t( attr.accessor->byteOffset ) )
+        .set_source_stride( attr.stride )
+        .set_size( attr.size )
+        .set_fill( attr.conversion.fill )
+        .set_fill_size( attr.conversion.fill_size );
+    };
+    const int32_t remap = optimize ? int32_t( layouts[ index_buffer_index ].optimized.size() ) : -1;
+    // meshletに分ける場合は頂点はそのままでインデックスだけを並べ替える
+    const bool meshlet = options.meshlet && triangle_list && find_float_attribute( 0u, fx::gltf::Accessor::Type::Vec3 ) != attributes.end();
+    const bool generate_index = optimize || meshlet;
+    // バインディングの番号は0から詰めて振り、draw_nodeで1回のbindVertexBuffersで済むようにする
+    std::vector< std::vector< source_attribute_t > > streams;
+    if( vertex_layout == vertex_layout_t::separate ) {
+      for( const auto &attr: attributes ) {
+        if( attr.generate && !optimize && attr.conversion.conversion == vertex_conversion_t::copy ) {
+          const auto &view = doc.bufferViews[ attr.accessor->bufferView ];
+          if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+          if( size_t( view.byteOffset ) + size_t( view.byteLength ) > size_t( doc.buffers[ view.buffer ].byteLength ) ) throw vw::invalid_gltf( "bufferViewがbufferの範囲を超えている", __FILE__, __LINE__ );
+          const uint32_t offset = add_converted(
+            layouts[ vertex_buffer_index ],
+            converted_range_t()
+              .set_source( get_attribute_source( attr ) )
+              .set_stride( attr.dest_size )
+              .set_count( attr.accessor->count )
+          );
+          const uint32_t binding = vertex_buffer.size();
+          vertex_input_binding.push_back(
+            vk::VertexInputBindingDescription()
+              .setBinding( binding )
+              .setStride( attr.dest_size )
+              .setInputRate( vk::VertexInputRate::eVertex )
+          );
+          vertex_input_attribute.push_back(
+            vk::VertexInputAttributeDescription()
+              .setLocation( attr.location )
+              .setBinding( binding )
+              .setFormat( attr.format )
+          );
+          vertex_buffer.push_back( buffer_view_t().set_index( vertex_buffer_index ).set_offset( offset ) );
+          continue;
+        }
+        if( attr.generate || optimize ) {
+          streams.push_back( { attr } );
+          continue;
+        }
+        const uint32_t offset = attr.accessor->byteOffset + add_buffer_view( doc, layouts[ vertex_buffer_index ], attr.accessor->bufferView );
+        const uint32_t binding = vertex_buffer.size();
         vertex_input_binding.push_back(
           vk::VertexInputBindingDescription()
-            .setBinding( binding->second )
-            .setStride( stride )
+            .setBinding( binding )
+            .setStride( attr.stride )
             .setInputRate( vk::VertexInputRate::eVertex )
         );
         vertex_input_attribute.push_back(
           vk::VertexInputAttributeDescription()
-            .setLocation( binding->second )
-            .setBinding( binding->second )
-            .setFormat( vw::to_vulkan_format( accessor.componentType, accessor.type, accessor.normalized ) )
+            .setLocation( attr.location )
+            .setBinding( binding )
+            .setFormat( attr.format )
         );
-        vertex_buffer.insert( std::make_pair( binding->second, buffer_view_t().set_index( view.buffer ).set_offset( offset ) ) );
+        vertex_buffer.push_back( buffer_view_t().set_index( vertex_buffer_index ).set_offset( offset ) );
+      }
+    }
+    else {
+      for( const auto &attr: attributes ) {
+        if( streams.empty() || ( vertex_layout == vertex_layout_t::split_position && attr.location != 0u && streams.back().front().location == 0u ) )
+          streams.emplace_back();
+        streams.back().push_back( attr );
+      }
+    }
+    if( vertex_count != 0u ) {
+      for( const auto &stream: streams ) {
+        const uint32_t binding = vertex_buffer.size();
+        interleaved_range_t range;
+        size_t stride = 0u;
+        for( const auto &attr: stream ) {
+          const auto &view = doc.bufferViews[ attr.accessor->bufferView ];
+          if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+          if( size_t( view.byteOffset ) + size_t( view.byteLength ) > size_t( doc.buffers[ view.buffer ].byteLength ) ) throw vw::invalid_gltf( "bufferViewがbufferの範囲を超えている", __FILE__, __LINE__ );
+          range.attribute.push_back(
+            interleaved_attribute_t( attr.conversion )
+              .set_view( attr.accessor->bufferView )
+              .set_buffer( view.buffer )
+              .set_source_offset( size_t( view.byteOffset ) + size_t( attr.accessor->byteOffset ) )
+              .set_source_stride( attr.stride )
+              .set_size( attr.size )
+              .set_offset( stride )
+          );
+          vertex_input_attribute.push_back(
+            vk::VertexInputAttributeDescription()
+              .setLocation( attr.location )
+              .setBinding( binding )
+              .setFormat( attr.format )
+              .setOffset( stride )
+          );
+          stride += ( attr.dest_size + 3u ) / 4u * 4u;
+        }
+        range.set_stride( stride );
+        range.set_count( vertex_count );
+        range.set_remap( remap );
+        const uint32_t offset = add_interleaved( layouts[ vertex_buffer_index ], std::move( range ) );
+        vertex_input_binding.push_back(
+          vk::VertexInputBindingDescription()
+            .setBinding( binding )
+            .setStride( stride )
+            .setInputRate( vk::VertexInputRate::eVertex )
+        );
+        vertex_buffer.push_back( buffer_view_t().set_index( vertex_buffer_index ).set_offset( offset ) );
       }
     }
     if( vertex_count == std::numeric_limits< uint32_t >::max() )
@@ -113,8 +562,6 @@ namespace viewer {
     auto vs_flag = shader_flag_t::vertex;
     if( rigged ) vs_flag = shader_flag_t( int( vs_flag )|int( shader_flag_t::skin ) );
     if( has_tangent ) vs_flag = shader_flag_t( int( vs_flag )|int( shader_flag_t::tangent ) );
-    auto vs = shader.find( vs_flag );
-    if( vs == shader.end() ) throw vw::invalid_gltf( "必要なシェーダがない", __FILE__, __LINE__ );
     auto fs_flag = shader_flag_t::fragment;
     if( has_tangent ) fs_flag = shader_flag_t( int( fs_flag )|int( shader_flag_t::tangent ) );
     if( material.pbrMetallicRoughness.baseColorTexture.index != -1 )
@@ -130,50 +577,169 @@ namespace viewer {
     if( extra_textures.size() == swapchain_size && extra_textures[ 0 ].size() >= 1u )
       fs_flag = shader_flag_t( int( fs_flag )|int( shader_flag_t::shadow ) );
     if( shader_mask ) fs_flag = shader_flag_t( shader_mask );
-    auto fs = shader.find( fs_flag );
-    if( fs == shader.end() ) {
-      throw vw::invalid_gltf( "必要なシェーダがない", __FILE__, __LINE__ );
-    }
-    auto shadow_vs = shader.find( shader_flag_t( int( shader_flag_t::vertex )|int(shader_flag_t::special) | 5 ) );
-    auto shadow_fs = shader.find( shader_flag_t( int( shader_flag_t::fragment )|int(shader_flag_t::special) | 4 ) );
-    std::vector< vw::pipeline_t > pipelines;
-    for( const auto &r: render_pass ) {
-      if( r.shadow )
-        pipelines.emplace_back(
-          vw::create_pipeline(
-            context, r, push_constant_size, *shadow_vs->second, *shadow_fs->second,
-            vertex_input_binding,
-            vertex_input_attribute,
-            !material.doubleSided,
-            material.alphaMode == fx::gltf::Material::AlphaMode::Blend,
-            true
-          )
-        );
-      else
-        pipelines.emplace_back(
-          vw::create_pipeline(
-            context, r, push_constant_size, *vs->second, *fs->second,
-            vertex_input_binding,
-            vertex_input_attribute,
-            !material.doubleSided,
-            material.alphaMode == fx::gltf::Material::AlphaMode::Blend,
-            false
-          )
-        );
-    }
-    primitive_.set_pipeline( std::move( pipelines ) );
+    primitive_.set_pipeline( create_pipelines(
+      context,
+      render_pass,
+      push_constant_size,
+      shader,
+      vs_flag,
+      fs_flag,
+      material.pbrMetallicRoughness.baseColorTexture.index != -1,
+      vertex_input_binding,
+      vertex_input_attribute,
+      material.doubleSided,
+      material.alphaMode == fx::gltf::Material::AlphaMode::Blend
+    ) );
     primitive_.set_vertex_buffer( vertex_buffer );
+    primitive_.set_dequantize( dequantize );
+    primitive_.set_double_sided( material.doubleSided );
     if( primitive.indices >= 0 ) {
       if( doc.accessors.size() <= size_t( primitive.indices ) ) throw vw::invalid_gltf( "参照されたaccessorsが存在しない", __FILE__, __LINE__ );
       const auto &accessor = doc.accessors[ primitive.indices ];
-      if( accessor.bufferView < 0 || doc.bufferViews.size() <= size_t( accessor.bufferView ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
-      const auto &view = doc.bufferViews[ accessor.bufferView ];
-      if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
-      const uint32_t offset = accessor.byteOffset + view.byteOffset;
-      primitive_.set_indexed( true );
-      primitive_.set_index_buffer( buffer_view_t().set_index( view.buffer ).set_offset( offset ) );
-      primitive_.set_index_buffer_type( vw::to_vulkan_index_type( accessor.componentType ) );
-      primitive_.set_count( accessor.count );
+      if( generate_index ) {
+        if( accessor.bufferView < 0 || doc.bufferViews.size() <= size_t( accessor.bufferView ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+        const auto &view = doc.bufferViews[ accessor.bufferView ];
+        if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+        const size_t source_size = vw::to_size( accessor.componentType );
+        const size_t source_stride = view.byteStride ? view.byteStride : source_size;
+        if( accessor.count && size_t( accessor.byteOffset ) + source_stride * ( accessor.count - 1u ) + source_size > size_t( view.byteLength ) )
+          throw vw::invalid_gltf( "指定された要素数に対してbufferViewが小さすぎる", __FILE__, __LINE__ );
+        // 頂点が65535個以下なら16bitのインデックスに詰める
+        const bool narrow = vertex_count <= std::numeric_limits< uint16_t >::max();
+        optimized_index_t optimized;
+        optimized
+          .set_index(
+            interleaved_attribute_t()
+              .set_view( accessor.bufferView )
+              .set_buffer( view.buffer )
+              .set_source_offset( size_t( view.byteOffset ) + size_t( accessor.byteOffset ) )
+              .set_source_stride( source_stride )
+              .set_size( source_size )
+          )
+          .set_optimize( optimize )
+          .set_build_meshlet( meshlet )
+          .set_count( accessor.count )
+          .set_vertex_count( vertex_count )
+          .set_size( narrow ? 2u : 4u );
+        // オーバードロー向けの並べ替えには浮動小数点数の位置が必要
+        if( const auto position = find_float_attribute( 0u, fx::gltf::Accessor::Type::Vec3 ); position != attributes.end() )
+          optimized
+            .set_position( get_attribute_source( *position ) )
+            .set_has_position( true );
+        primitive_.set_generated_index( int32_t( layouts[ index_buffer_index ].optimized.size() ) );
+        const uint32_t offset = add_optimized_index( layouts[ index_buffer_index ], std::move( optimized ) );
+        primitive_.set_indexed( true );
+        primitive_.set_index_buffer( buffer_view_t().set_index( index_buffer_index ).set_offset( offset ) );
+        primitive_.set_index_buffer_type( narrow ? vk::IndexType::eUint16 : vk::IndexType::eUint32 );
+        primitive_.set_count( accessor.count );
+      }
+      else {
+        // VK_EXT_index_type_uint8に頼らず8bitのインデックスは16bitに広げる
+        const bool widen = accessor.componentType == fx::gltf::Accessor::ComponentType::UnsignedByte;
+        uint32_t offset = 0u;
+        if( draco_view >= 0 )
+          offset = add_draco(
+            layouts[ index_buffer_index ],
+            draco_range_t()
+              .set_view( draco_view )
+              .set_component_type( accessor.componentType )
+              .set_stride( widen ? sizeof( uint16_t ) : vw::to_size( accessor.componentType ) )
+              .set_count( accessor.count )
+          );
+        else if( widen ) {
+          if( accessor.bufferView < 0 || doc.bufferViews.size() <= size_t( accessor.bufferView ) ) throw vw::invalid_gltf( "参照されたbufferViewが存在しない", __FILE__, __LINE__ );
+          const auto &view = doc.bufferViews[ accessor.bufferView ];
+          if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+          const size_t source_stride = view.byteStride ? view.byteStride : 1u;
+          if( accessor.count && size_t( accessor.byteOffset ) + source_stride * ( accessor.count - 1u ) + 1u > size_t( view.byteLength ) )
+            throw vw::invalid_gltf( "指定された要素数に対してbufferViewが小さすぎる", __FILE__, __LINE__ );
+          offset = add_converted(
+            layouts[ index_buffer_index ],
+            converted_range_t()
+              .set_source(
+                interleaved_attribute_t()
+                  .set_view( accessor.bufferView )
+                  .set_buffer( view.buffer )
+                  .set_source_offset( size_t( view.byteOffset ) + size_t( accessor.byteOffset ) )
+                  .set_source_stride( source_stride )
+                  .set_size( 1u )
+              )
+              .set_stride( sizeof( uint16_t ) )
+              .set_count( accessor.count )
+          );
+        }
+        else offset = accessor.byteOffset + add_buffer_view( doc, layouts[ index_buffer_index ], accessor.bufferView );
+        primitive_.set_indexed( true );
+        primitive_.set_index_buffer( buffer_view_t().set_index( index_buffer_index ).set_offset( offset ) );
+        primitive_.set_index_buffer_type( widen ? vk::IndexType::eUint16 : vw::to_vulkan_index_type( accessor.componentType ) );
+        primitive_.set_count( accessor.count );
+      }
+      // LODは元の頂点を共有し、インデックスだけを簡略化した物に差し替える
+      const auto position = find_float_attribute( 0u, fx::gltf::Accessor::Type::Vec3 );
+      if(
+        options.lod_levels && draco_view < 0 &&
+        primitive.mode == fx::gltf::Primitive::Mode::Triangles &&
+        position != attributes.end() &&
+        accessor.count / 3u >= min_lod_triangles * 2u
+      ) {
+        lod_range_t lod;
+        lod
+          .set_position( get_attribute_source( *position ) )
+          .set_optimized( optimize ? int32_t( layouts[ index_buffer_index ].optimized.size() - 1u ) : -1 )
+          .set_count( accessor.count )
+          .set_vertex_count( vertex_count )
+          .set_size( primitive_.index_buffer_type == vk::IndexType::eUint16 ? 2u : 4u );
+        if( !optimize ) {
+          const auto &view = doc.bufferViews[ accessor.bufferView ];
+          lod.set_index(
+            interleaved_attribute_t()
+              .set_view( accessor.bufferView )
+              .set_buffer( view.buffer )
+              .set_source_offset( size_t( view.byteOffset ) + size_t( accessor.byteOffset ) )
+              .set_source_stride( view.byteStride ? view.byteStride : vw::to_size( accessor.componentType ) )
+              .set_size( vw::to_size( accessor.componentType ) )
+          );
+        }
+        if( const auto normal = find_float_attribute( 1u, fx::gltf::Accessor::Type::Vec3 ); normal != attributes.end() )
+          lod.set_normal( get_attribute_source( *normal ) ).set_has_normal( true );
+        if( const auto texcoord = find_float_attribute( 3u, fx::gltf::Accessor::Type::Vec2 ); texcoord != attributes.end() )
+          lod.set_texcoord( get_attribute_source( *texcoord ) ).set_has_texcoord( true );
+        for( uint32_t level = 1u; level <= options.lod_levels; ++level ) {
+          const size_t triangles = ( accessor.count / 3u ) >> level;
+          if( triangles < min_lod_triangles ) break;
+          lod.level.push_back( lod_level_t().set_target( triangles * 3u ) );
+        }
+        primitive_.set_lod_range( int32_t( add_lod( layouts[ index_buffer_index ], std::move( lod ) ) ) );
+      }
+      // HLODの代理メッシュには元のaccessorから読んだ位置と法線をシーンの座標系に移して取り込む
+      const auto normal = find_float_attribute( 1u, fx::gltf::Accessor::Type::Vec3 );
+      if(
+        options.hlod && draco_view < 0 && !rigged &&
+        primitive.mode == fx::gltf::Primitive::Mode::Triangles &&
+        position != attributes.end() && normal != attributes.end() &&
+        accessor.count % 3u == 0u &&
+        accessor.bufferView >= 0 && doc.bufferViews.size() > size_t( accessor.bufferView )
+      ) {
+        const auto &view = doc.bufferViews[ accessor.bufferView ];
+        if( view.buffer < 0 || doc.buffers.size() <= size_t( view.buffer ) ) throw vw::invalid_gltf( "参照されたbufferが存在しない", __FILE__, __LINE__ );
+        layouts[ index_buffer_index ].hlod_source.push_back(
+          hlod_source_t()
+            .set_index(
+              interleaved_attribute_t()
+                .set_view( accessor.bufferView )
+                .set_buffer( view.buffer )
+                .set_source_offset( size_t( view.byteOffset ) + size_t( accessor.byteOffset ) )
+                .set_source_stride( view.byteStride ? view.byteStride : vw::to_size( accessor.componentType ) )
+                .set_size( vw::to_size( accessor.componentType ) )
+            )
+            .set_position( get_attribute_source( *position ) )
+            .set_normal( get_attribute_source( *normal ) )
+            .set_count( accessor.count )
+            .set_vertex_count( vertex_count )
+            .set_material( primitive.material )
+        );
+        primitive_.set_hlod_source( int32_t( layouts[ index_buffer_index ].hlod_source.size() - 1u ) );
+      }
     }
     else {
       primitive_.set_indexed( false );
@@ -202,165 +768,32 @@ namespace viewer {
       context,
       std::vector< uint8_t >{ uniform_bytes_begin, uniform_bytes_end }
     );
-    std::vector< descriptor_set_t > descriptor_set;
-    std::vector< vk::DescriptorSetLayout > layout;
-    layout.reserve( context.descriptor_set_layout.size() );
-    std::transform( context.descriptor_set_layout.begin(), context.descriptor_set_layout.end(), std::back_inserter( layout ), []( const auto &v ) { return *v; } );
-    for( unsigned int i = 0; i != swapchain_size; ++i ) {
-      descriptor_set.push_back( descriptor_set_t() );
-      descriptor_set.back().set_descriptor_set(
-        context.device->allocateDescriptorSetsUnique(
-          vk::DescriptorSetAllocateInfo()
-            .setDescriptorPool( *context.descriptor_pool )
-            .setDescriptorSetCount( 1 )
-            .setPSetLayouts( layout.data() + i )
-        )
+    std::vector< texture_binding_t > texture_binding;
+    const auto bind_texture = [&]( int32_t index, uint32_t binding, bool srgb, placeholder_type_t placeholder ) {
+      if( index < 0 ) return;
+      if( textures.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
+      texture_binding.push_back(
+        texture_binding_t()
+          .set_binding( binding )
+          .set_texture( index )
+          .set_srgb( srgb )
+          .set_placeholder( placeholder )
       );
-      auto uniform_buffer_info =
-        vk::DescriptorBufferInfo()
-          .setBuffer( *uniform_buffer.buffer.buffer )
-          .setOffset( 0u )
-          .setRange( sizeof( uniforms_t ) );
-      auto dynamic_uniform_buffer_info =
-        vk::DescriptorBufferInfo()
-          .setBuffer( *dynamic_uniform_buffer[ i ].buffer.buffer )
-          .setOffset( 0u )
-          .setRange( sizeof( dynamic_uniforms_t ) );
-      
-      std::vector< vk::WriteDescriptorSet > updates {
-        vk::WriteDescriptorSet()
-          .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-          .setDescriptorType( vk::DescriptorType::eUniformBuffer )
-          .setDescriptorCount( 1 )
-          .setPBufferInfo( &uniform_buffer_info )
-          .setDstBinding( 0 ),
-        vk::WriteDescriptorSet()
-          .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-          .setDescriptorType( vk::DescriptorType::eUniformBuffer )
-          .setDescriptorCount( 1 )
-          .setPBufferInfo( &dynamic_uniform_buffer_info )
-          .setDstBinding( 7 ),
-      };
-      const auto bct = material.pbrMetallicRoughness.baseColorTexture.index;
-      if( bct >= 0 ) {
-        if( textures.size() <= size_t( bct ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
-        const auto &bct_texture = textures[ bct ];
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &bct_texture.srgb )
-            .setDstBinding( 1 )
-        );
-      }
-      const auto mrt = material.pbrMetallicRoughness.metallicRoughnessTexture.index;
-      if( mrt >= 0 ) {
-        if( textures.size() <= size_t( mrt ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
-        const auto &mrt_texture = textures[ mrt ];
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &mrt_texture.unorm )
-            .setDstBinding( 2 )
-        );
-      }
-      const auto nt = material.normalTexture.index;
-      if( nt >= 0 ) {
-        if( textures.size() <= size_t( nt ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
-        const auto &nt_texture = textures[ nt ];
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &nt_texture.unorm )
-            .setDstBinding( 3 )
-        );
-      }
-      const auto oct = material.occlusionTexture.index;
-      if( oct >= 0 ) {
-        if( textures.size() <= size_t( oct ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
-        const auto &oct_texture = textures[ oct ];
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &oct_texture.unorm )
-            .setDstBinding( 4 )
-        );
-      }
-      const auto emt = material.emissiveTexture.index;
-      if( emt >= 0 ) {
-        if( textures.size() <= size_t( emt ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
-        const auto &emt_texture = textures[ emt ];
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &emt_texture.srgb )
-            .setDstBinding( 5 )
-        );
-      }
-      if( emt >= 0 ) {
-        if( textures.size() <= size_t( emt ) ) throw vw::invalid_gltf( "参照されたtextureが存在しない", __FILE__, __LINE__ );
-        const auto &emt_texture = textures[ emt ];
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &emt_texture.srgb )
-            .setDstBinding( 5 )
-        );
-      }
-      if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 1u ) {
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &extra_textures[ i ][ 0 ].unorm )
-            .setDstBinding( 6 )
-        );
-      }
-      if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 2u ) {
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &extra_textures[ i ][ 1 ].unorm )
-            .setDstBinding( 8 )
-        );
-      }
-      if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 3u ) {
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &extra_textures[ i ][ 2 ].unorm )
-            .setDstBinding( 9 )
-        );
-      }
-      if( extra_textures.size() == swapchain_size && extra_textures[ i ].size() >= 4u ) {
-        updates.push_back(
-          vk::WriteDescriptorSet()
-            .setDstSet( *descriptor_set.back().descriptor_set[ 0 ] )
-            .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
-            .setDescriptorCount( 1 )
-            .setPImageInfo( &extra_textures[ i ][ 3 ].unorm )
-            .setDstBinding( 10 )
-        );
-      }
-      context.device->updateDescriptorSets( updates, nullptr );
-    }
+    };
+    bind_texture( material.pbrMetallicRoughness.baseColorTexture.index, 1, true, placeholder_type_t::white );
+    bind_texture( material.pbrMetallicRoughness.metallicRoughnessTexture.index, 2, false, placeholder_type_t::white );
+    bind_texture( material.normalTexture.index, 3, false, placeholder_type_t::normal );
+    bind_texture( material.occlusionTexture.index, 4, false, placeholder_type_t::white );
+    bind_texture( material.emissiveTexture.index, 5, true, placeholder_type_t::black );
+    auto descriptor_set = create_descriptor_set(
+      context,
+      swapchain_size,
+      uniform_buffer,
+      extra_textures,
+      dynamic_uniform_buffer
+    );
     primitive_.set_descriptor_set( descriptor_set ); 
+    primitive_.set_texture_binding( texture_binding );
     primitive_.set_min( min );
     primitive_.set_max( max );
     primitive_.set_uniform_buffer(
@@ -368,6 +801,149 @@ namespace viewer {
     );
     return primitive_;
   }
+  primitive_t create_generated_primitive(
+    const vw::context_t &context,
+    const std::vector< vw::render_pass_t > &render_pass,
+    uint32_t push_constant_size,
+    const shader_t &shader,
+    uint32_t swapchain_size,
+    const std::vector< std::vector< viewer::texture_t > > &extra_textures,
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const uniforms_t &uniforms,
+    const texture_t &base_color,
+    bool double_sided,
+    const buffer_view_t &vertex_buffer,
+    const buffer_view_t &index_buffer,
+    uint32_t count,
+    const glm::vec3 &min,
+    const glm::vec3 &max
+  ) {
+    const std::vector< vk::VertexInputBindingDescription > vertex_input_binding{
+      vk::VertexInputBindingDescription()
+        .setBinding( 0 )
+        .setStride( hlod_vertex_stride )
+        .setInputRate( vk::VertexInputRate::eVertex )
+    };
+    const std::vector< vk::VertexInputAttributeDescription > vertex_input_attribute{
+      vk::VertexInputAttributeDescription()
+        .setLocation( 0 )
+        .setBinding( 0 )
+        .setFormat( vk::Format::eR32G32B32Sfloat )
+        .setOffset( 0 ),
+      vk::VertexInputAttributeDescription()
+        .setLocation( 1 )
+        .setBinding( 0 )
+        .setFormat( vk::Format::eR32G32B32Sfloat )
+        .setOffset( sizeof( float ) * 3u ),
+      vk::VertexInputAttributeDescription()
+        .setLocation( 3 )
+        .setBinding( 0 )
+        .setFormat( vk::Format::eR32G32Sfloat )
+        .setOffset( sizeof( float ) * 6u )
+    };
+    auto fs_flag = shader_flag_t( int( shader_flag_t::fragment )|int( shader_flag_t::base_color ) );
+    if( extra_textures.size() == swapchain_size && extra_textures[ 0 ].size() >= 1u )
+      fs_flag = shader_flag_t( int( fs_flag )|int( shader_flag_t::shadow ) );
+    primitive_t primitive;
+    primitive.set_pipeline( create_pipelines(
+      context,
+      render_pass,
+      push_constant_size,
+      shader,
+      shader_flag_t::vertex,
+      fs_flag,
+      true,
+      vertex_input_binding,
+      vertex_input_attribute,
+      double_sided,
+      false
+    ) );
+    primitive.set_vertex_buffer( std::vector< buffer_view_t >{ vertex_buffer } );
+    primitive.set_double_sided( double_sided );
+    primitive.set_indexed( true );
+    primitive.set_index_buffer( index_buffer );
+    primitive.set_index_buffer_type( vk::IndexType::eUint32 );
+    primitive.set_count( count );
+    auto uniforms_ = uniforms;
+    auto uniform_bytes_begin = reinterpret_cast< uint8_t* >( reinterpret_cast< void* >( &uniforms_ ) );
+    auto uniform_bytes_end = uniform_bytes_begin + sizeof( uniforms_t );
+    auto uniform_buffer = create_uniform_buffer(
+      context,
+      std::vector< uint8_t >{ uniform_bytes_begin, uniform_bytes_end }
+    );
+    auto descriptor_set = create_descriptor_set(
+      context,
+      swapchain_size,
+      uniform_buffer,
+      extra_textures,
+      dynamic_uniform_buffer
+    );
+    // 読み込み時に作ったテクスチャは後から差し替わらないのでここで書き込んでおく
+    for( const auto &set: descriptor_set ) {
+      const auto update =
+        vk::WriteDescriptorSet()
+          .setDstSet( *set.descriptor_set[ 0 ] )
+          .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+          .setDescriptorCount( 1 )
+          .setPImageInfo( &base_color.srgb )
+          .setDstBinding( 1 );
+      context.device->updateDescriptorSets( update, nullptr );
+    }
+    primitive.set_descriptor_set( descriptor_set );
+    primitive.set_min( min );
+    primitive.set_max( max );
+    primitive.set_uniform_buffer( uniform_buffer );
+    return primitive;
+  }
+  void update_texture_descriptor_set(
+    const vw::context_t &context,
+    const primitive_t &primitive,
+    const textures_t &textures,
+    const placeholder_t &placeholder,
+    uint32_t frame
+  ) {
+    if( primitive.descriptor_set.size() <= frame ) return;
+    std::vector< vk::DescriptorImageInfo > infos;
+    infos.reserve( primitive.texture_binding.size() );
+    std::vector< vk::WriteDescriptorSet > updates;
+    for( const auto &b: primitive.texture_binding ) {
+      const auto &texture = textures[ b.texture ];
+      const auto &info = b.srgb ? texture.srgb : texture.unorm;
+      if( info.imageView ) infos.push_back( info );
+      else {
+        const auto &fallback =
+          b.placeholder == placeholder_type_t::normal ? placeholder.normal_texture :
+          b.placeholder == placeholder_type_t::black ? placeholder.black_texture :
+          placeholder.white_texture;
+        infos.push_back( b.srgb ? fallback.srgb : fallback.unorm );
+      }
+      if( !infos.back().imageView ) {
+        infos.pop_back();
+        continue;
+      }
+      updates.push_back(
+        vk::WriteDescriptorSet()
+          .setDstSet( *primitive.descriptor_set[ frame ].descriptor_set[ 0 ] )
+          .setDescriptorType( vk::DescriptorType::eCombinedImageSampler )
+          .setDescriptorCount( 1 )
+          .setPImageInfo( &infos.back() )
+          .setDstBinding( b.binding )
+      );
+    }
+    if( !updates.empty() )
+      context.device->updateDescriptorSets( updates, nullptr );
+  }
+  void update_texture_descriptor_set(
+    const vw::context_t &context,
+    const meshes_t &meshes,
+    const textures_t &textures,
+    const placeholder_t &placeholder,
+    uint32_t frame
+  ) {
+    for( const auto &mesh: meshes )
+      for( const auto &primitive: mesh.primitive )
+        update_texture_descriptor_set( context, primitive, textures, placeholder, frame );
+  }
   
   mesh_t create_mesh(
     const fx::gltf::Document &doc,
@@ -380,7 +956,9 @@ namespace viewer {
     uint32_t swapchain_size,
     int shader_mask,
     const std::vector< std::vector< viewer::texture_t > > &extra_textures,
-    const std::vector< buffer_t > &dynamic_uniform_buffer
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const load_options_t &options,
+    buffer_layouts_t &layouts
   ) {
     if( index < 0 || doc.meshes.size() <= size_t( index ) ) throw vw::invalid_gltf( "参照されたmeshが存在しない", __FILE__, __LINE__ );
     const auto &mesh = doc.meshes[ index ];
@@ -407,7 +985,9 @@ namespace viewer {
         swapchain_size,
         shader_mask,
         extra_textures,
-        dynamic_uniform_buffer
+        dynamic_uniform_buffer,
+        options,
+        layouts
       ) );
       min[ 0 ] = std::min( min[ 0 ], mesh_.primitive.back().min[ 0 ] );
       min[ 1 ] = std::min( min[ 1 ], mesh_.primitive.back().min[ 1 ] );
@@ -430,12 +1010,47 @@ namespace viewer {
     uint32_t swapchain_size,
     int shader_mask,
     const std::vector< std::vector< viewer::texture_t > > &extra_textures,
-    const std::vector< buffer_t > &dynamic_uniform_buffer
+    const std::vector< buffer_t > &dynamic_uniform_buffer,
+    const load_options_t &options,
+    buffer_layouts_t &layouts
   ) {
     meshes_t mesh;
     for( uint32_t i = 0; i != doc.meshes.size(); ++i )
-      mesh.push_back( create_mesh( doc, i, context, render_pass, push_constant_size, shader, textures, swapchain_size, shader_mask, extra_textures, dynamic_uniform_buffer ) );
+      mesh.push_back( create_mesh( doc, i, context, render_pass, push_constant_size, shader, textures, swapchain_size, shader_mask, extra_textures, dynamic_uniform_buffer, options, layouts ) );
     return mesh;
   }
+  void update_lod(
+    meshes_t &meshes,
+    const buffer_layouts_t &layouts
+  ) {
+    for( auto &mesh: meshes )
+      for( auto &primitive: mesh.primitive ) {
+        primitive.lod.clear();
+        if( primitive.lod_range < 0 ) continue;
+        if( layouts.size() <= index_buffer_index || layouts[ index_buffer_index ].lod.size() <= size_t( primitive.lod_range ) )
+          throw vw::invalid_argument( "参照されたLODが存在しない", __FILE__, __LINE__ );
+        for( const auto &level: layouts[ index_buffer_index ].lod[ primitive.lod_range ].level )
+          if( level.count )
+            primitive.lod.push_back(
+              lod_t()
+                .set_offset( level.offset )
+                .set_count( level.count )
+                .set_error( level.error )
+            );
+      }
+  }
+  void update_meshlet(
+    meshes_t &meshes,
+    const buffer_layouts_t &layouts
+  ) {
+    for( auto &mesh: meshes )
+      for( auto &primitive: mesh.primitive ) {
+        primitive.meshlet.clear();
+        if( primitive.generated_index < 0 ) continue;
+        if( layouts.size() <= index_buffer_index || layouts[ index_buffer_index ].optimized.size() <= size_t( primitive.generated_index ) )
+          throw vw::invalid_argument( "参照されたインデックスが存在しない", __FILE__, __LINE__ );
+        primitive.meshlet = layouts[ index_buffer_index ].optimized[ primitive.generated_index ].meshlet;
+      }
+  }
 }
 
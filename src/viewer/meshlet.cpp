@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vw/exceptions.h>
+#include <viewer/meshlet.h>
+namespace viewer {
+  namespace {
+    using vec3_t = std::array< float, 3u >;
+    vec3_t get_position(
+      const uint8_t *position,
+      size_t stride,
+      uint32_t vertex
+    ) {
+      vec3_t value;
+      std::memcpy( value.data(), position + stride * vertex, sizeof( float ) * 3u );
+      return value;
+    }
+    vec3_t sub( const vec3_t &l, const vec3_t &r ) {
+      return vec3_t{ l[ 0 ] - r[ 0 ], l[ 1 ] - r[ 1 ], l[ 2 ] - r[ 2 ] };
+    }
+    float dot( const vec3_t &l, const vec3_t &r ) {
+      return l[ 0 ] * r[ 0 ] + l[ 1 ] * r[ 1 ] + l[ 2 ] * r[ 2 ];
+    }
+    vec3_t cross( const vec3_t &l, const vec3_t &r ) {
+      return vec3_t{
+        l[ 1 ] * r[ 2 ] - l[ 2 ] * r[ 1 ],
+        l[ 2 ] * r[ 0 ] - l[ 0 ] * r[ 2 ],
+        l[ 0 ] * r[ 1 ] - l[ 1 ] * r[ 0 ]
+      };
+    }
+    void compute_bounds(
+      meshlet_t &meshlet,
+      const uint32_t *index,
+      const uint8_t *position,
+      size_t stride
+    ) {
+      // 頂点の平均を中心にした球で包む
+      vec3_t center{ 0.f, 0.f, 0.f };
+      for( uint32_t i = 0u; i != meshlet.count; ++i ) {
+        const auto p = get_position( position, stride, index[ i ] );
+        for( unsigned int k = 0u; k != 3u; ++k ) center[ k ] += p[ k ];
+      }
+      for( auto &c: center ) c /= float( meshlet.count );
+      float radius = 0.f;
+      for( uint32_t i = 0u; i != meshlet.count; ++i ) {
+        const auto d = sub( get_position( position, stride, index[ i ] ), center );
+        radius = std::max( radius, dot( d, d ) );
+      }
+      meshlet.center = center;
+      meshlet.radius = std::sqrt( radius );
+      std::vector< vec3_t > normals;
+      normals.reserve( meshlet.count / 3u );
+      vec3_t axis{ 0.f, 0.f, 0.f };
+      for( uint32_t i = 0u; i != meshlet.count; i += 3u ) {
+        const auto p0 = get_position( position, stride, index[ i ] );
+        const auto n = cross( sub( get_position( position, stride, index[ i + 1u ] ), p0 ), sub( get_position( position, stride, index[ i + 2u ] ), p0 ) );
+        const float length = std::sqrt( dot( n, n ) );
+        if( !( length > 0.f ) ) continue;
+        normals.push_back( vec3_t{ n[ 0 ] / length, n[ 1 ] / length, n[ 2 ] / length } );
+        for( unsigned int k = 0u; k != 3u; ++k ) axis[ k ] += normals.back()[ k ];
+      }
+      const float axis_length = std::sqrt( dot( axis, axis ) );
+      meshlet.axis = vec3_t{ 0.f, 0.f, 0.f };
+      // 法線が半球より広がっている場合は裏向きの判定に使えない
+      meshlet.cutoff = 1.f;
+      if( normals.empty() || !( axis_length > 0.f ) ) return;
+      for( auto &a: axis ) a /= axis_length;
+      float min_dot = 1.f;
+      for( const auto &n: normals ) min_dot = std::min( min_dot, dot( n, axis ) );
+      meshlet.axis = axis;
+      if( min_dot > 0.1f ) meshlet.cutoff = std::sqrt( 1.f - min_dot * min_dot );
+    }
+  }
+  std::vector< meshlet_t > build_meshlets(
+    std::vector< uint32_t > &index,
+    const uint8_t *position,
+    size_t stride,
+    size_t vertex_count,
+    size_t max_vertices,
+    size_t max_triangles
+  ) {
+    if( index.size() % 3u ) throw vw::invalid_argument( "インデックスの数が3の倍数ではない", __FILE__, __LINE__ );
+    if( max_vertices < 3u || max_triangles < 1u ) throw vw::invalid_argument( "meshletの大きさが小さすぎる", __FILE__, __LINE__ );
+    for( const auto v: index )
+      if( v >= vertex_count ) throw vw::invalid_argument( "インデックスが頂点の数を超えている", __FILE__, __LINE__ );
+    const size_t triangle_count = index.size() / 3u;
+    std::vector< uint32_t > adjacency_offset( vertex_count + 1u, 0u );
+    for( const auto v: index ) ++adjacency_offset[ v + 1u ];
+    std::partial_sum( adjacency_offset.begin(), adjacency_offset.end(), adjacency_offset.begin() );
+    std::vector< uint32_t > adjacency( index.size() );
+    {
+      std::vector< uint32_t > filled( adjacency_offset.begin(), std::prev( adjacency_offset.end() ) );
+      for( size_t i = 0u; i != index.size(); ++i )
+        adjacency[ filled[ index[ i ] ]++ ] = uint32_t( i / 3u );
+    }
+    std::vector< bool > emitted( triangle_count, false );
+    // 頂点が今のmeshletに含まれている場合はmeshletの番号+1
+    std::vector< uint32_t > used( vertex_count, 0u );
+    std::vector< uint32_t > result;
+    result.reserve( index.size() );
+    std::vector< meshlet_t > meshlets;
+    std::vector< uint32_t > candidates;
+    size_t cursor = 0u;
+    while( true ) {
+      while( cursor != triangle_count && emitted[ cursor ] ) ++cursor;
+      if( cursor == triangle_count ) break;
+      const uint32_t id = uint32_t( meshlets.size() + 1u );
+      meshlet_t meshlet;
+      meshlet.offset = uint32_t( result.size() );
+      meshlet.count = 0u;
+      size_t vertices = 0u;
+      vec3_t sum{ 0.f, 0.f, 0.f };
+      candidates.clear();
+      const auto add_triangle = [&]( uint32_t triangle ) {
+        emitted[ triangle ] = true;
+        for( unsigned int k = 0u; k != 3u; ++k ) {
+          const uint32_t v = index[ triangle * 3u + k ];
+          result.push_back( v );
+          if( used[ v ] != id ) {
+            used[ v ] = id;
+            ++vertices;
+            const auto p = get_position( position, stride, v );
+            for( unsigned int l = 0u; l != 3u; ++l ) sum[ l ] += p[ l ];
+            for( uint32_t a = adjacency_offset[ v ]; a != adjacency_offset[ v + 1u ]; ++a )
+              if( !emitted[ adjacency[ a ] ] ) candidates.push_back( adjacency[ a ] );
+          }
+        }
+        meshlet.count += 3u;
+      };
+      add_triangle( uint32_t( cursor ) );
+      // 新たに増える頂点が最も少ない隣接する三角形を順に加える
+      while( meshlet.count / 3u < max_triangles ) {
+        int64_t best = -1;
+        unsigned int best_extra = 4u;
+        float best_distance = std::numeric_limits< float >::max();
+        for( size_t c = 0u; c != candidates.size(); ) {
+          const uint32_t triangle = candidates[ c ];
+          if( emitted[ triangle ] ) {
+            candidates[ c ] = candidates.back();
+            candidates.pop_back();
+            continue;
+          }
+          ++c;
+          unsigned int extra = 0u;
+          for( unsigned int k = 0u; k != 3u; ++k )
+            if( used[ index[ triangle * 3u + k ] ] != id ) ++extra;
+          if( vertices + extra > max_vertices || extra > best_extra ) continue;
+          // 増える頂点の数が同じ場合はmeshletの中心に近い三角形を選んで丸く広げる
+          vec3_t centroid{ 0.f, 0.f, 0.f };
+          for( unsigned int k = 0u; k != 3u; ++k ) {
+            const auto p = get_position( position, stride, index[ triangle * 3u + k ] );
+            for( unsigned int l = 0u; l != 3u; ++l ) centroid[ l ] += p[ l ] / 3.f;
+          }
+          const auto d = sub( centroid, vec3_t{ sum[ 0 ] / float( vertices ), sum[ 1 ] / float( vertices ), sum[ 2 ] / float( vertices ) } );
+          const float distance = dot( d, d );
+          if( extra == best_extra && distance >= best_distance ) continue;
+          best = triangle;
+          best_extra = extra;
+          best_distance = distance;
+        }
+        if( best < 0 ) break;
+        add_triangle( uint32_t( best ) );
+      }
+      meshlets.push_back( meshlet );
+    }
+    index = std::move( result );
+    for( auto &meshlet: meshlets )
+      compute_bounds( meshlet, index.data() + meshlet.offset, position, stride );
+    return meshlets;
+  }
+}
@@ -20,11 +20,84 @@
  * IN THE SOFTWARE.
  */
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <vw/node.h>
 #include <vw/exceptions.h>
 #include <viewer/node.h>
 namespace viewer {
+  namespace {
+    const lod_t *select_lod(
+      const primitive_t &primitive,
+      const glm::mat4 &matrix,
+      const lod_selector_t &selector
+    ) {
+      if( primitive.lod.empty() || !( selector.threshold > 0.f ) || !( selector.pixels_per_unit > 0.f ) ) return nullptr;
+      const float scale = std::max( {
+        glm::length( glm::vec3( matrix[ 0 ] ) ),
+        glm::length( glm::vec3( matrix[ 1 ] ) ),
+        glm::length( glm::vec3( matrix[ 2 ] ) )
+      } );
+      float pixels = selector.pixels_per_unit * scale;
+      if( !selector.orthographic ) {
+        // 境界球の視点に最も近い点での大きさで判断する
+        const auto center = glm::vec3( matrix * glm::vec4( ( primitive.min + primitive.max ) * 0.5f, 1.f ) );
+        const float radius = glm::length( primitive.max - primitive.min ) * 0.5f * scale;
+        const float distance = glm::length( center - selector.eye ) - radius;
+        if( !( distance > 0.f ) ) return nullptr;
+        pixels /= distance;
+      }
+      for( auto lod = primitive.lod.rbegin(); lod != primitive.lod.rend(); ++lod )
+        if( lod->error * pixels <= selector.threshold ) return &*lod;
+      return nullptr;
+    }
+    // 見えるmeshletだけを描き、インデックスが連続するmeshletは1回のdrawIndexedにまとめる
+    void draw_meshlets(
+      vk::CommandBuffer &commands,
+      const primitive_t &primitive,
+      const glm::mat4 &matrix,
+      const meshlet_culling_t &culling
+    ) {
+      // 視錐台の平面をメッシュの座標系で求め、meshletの境界球をそのまま判定に使う
+      const glm::mat4 clip = culling.view_projection * matrix;
+      const auto row = [&]( int i ) { return glm::vec4( clip[ 0 ][ i ], clip[ 1 ][ i ], clip[ 2 ][ i ], clip[ 3 ][ i ] ); };
+      std::array< glm::vec4, 6u > planes{
+        row( 3 ) + row( 0 ), row( 3 ) - row( 0 ),
+        row( 3 ) + row( 1 ), row( 3 ) - row( 1 ),
+        row( 3 ) + row( 2 ), row( 3 ) - row( 2 )
+      };
+      for( auto &plane: planes ) {
+        const float length = glm::length( glm::vec3( plane ) );
+        if( length > 0.f ) plane /= length;
+      }
+      const auto eye = glm::vec3( glm::inverse( matrix ) * glm::vec4( culling.eye, 1.f ) );
+      uint32_t first = 0u;
+      uint32_t count = 0u;
+      for( const auto &meshlet: primitive.meshlet ) {
+        const glm::vec3 center( meshlet.center[ 0 ], meshlet.center[ 1 ], meshlet.center[ 2 ] );
+        bool visible = std::all_of( planes.begin(), planes.end(), [&]( const auto &plane ) {
+          return glm::dot( glm::vec3( plane ), center ) + plane[ 3 ] >= -meshlet.radius;
+        } );
+        if( visible && !primitive.double_sided && meshlet.cutoff < 1.f ) {
+          const auto axis = glm::vec3( meshlet.axis[ 0 ], meshlet.axis[ 1 ], meshlet.axis[ 2 ] ) * ( culling.back_side ? -1.f : 1.f );
+          const auto view = center - eye;
+          if( glm::dot( view, axis ) >= meshlet.cutoff * glm::length( view ) + meshlet.radius ) visible = false;
+        }
+        if( !visible ) continue;
+        if( count && first + count == meshlet.offset ) count += meshlet.count;
+        else {
+          if( count ) commands.drawIndexed( count, 1, first, 0, 0 );
+          first = meshlet.offset;
+          count = meshlet.count;
+        }
+      }
+      if( count ) commands.drawIndexed( count, 1, first, 0, 0 );
+    }
+  }
   node_t create_node(
     const fx::gltf::Document &doc,
     int32_t index,
@@ -154,6 +227,100 @@ namespace viewer {
     root.set_max( max );
     return root;
   }
+  lod_selector_t get_lod_selector(
+    const glm::mat4 &projection,
+    const glm::mat4 &camera,
+    uint32_t height,
+    float threshold
+  ) {
+    return lod_selector_t()
+      .set_eye( glm::vec3( glm::inverse( camera )[ 3 ] ) )
+      .set_pixels_per_unit( std::abs( projection[ 1 ][ 1 ] ) * float( height ) * 0.5f )
+      .set_orthographic( projection[ 2 ][ 3 ] == 0.f )
+      .set_threshold( threshold );
+  }
+  lod_selector_t get_shadow_lod_selector(
+    const glm::mat4 &projection,
+    const glm::mat4 &camera,
+    uint32_t height,
+    float threshold
+  ) {
+    return get_lod_selector( projection, camera, height, threshold );
+  }
+  void bind_primitive(
+    vk::CommandBuffer &commands,
+    const primitive_t &primitive,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const glm::mat4 &matrix,
+    int32_t fid
+  ) {
+    commands.bindPipeline( vk::PipelineBindPoint::eGraphics, *primitive.pipeline[ pipeline_index ].pipeline );
+    auto pc = push_constants_t()
+      .set_world_matrix( matrix * primitive.dequantize )
+      .set_fid( fid );
+    commands.pushConstants( *primitive.pipeline[ pipeline_index ].pipeline_layout, vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, 0, sizeof( push_constants_t ), &pc );
+    std::vector< vk::DescriptorSet > descriptor_set;
+    descriptor_set.reserve( primitive.descriptor_set[ current_frame ].descriptor_set.size() );
+    std::transform(
+      primitive.descriptor_set[ current_frame ].descriptor_set.begin(),
+      primitive.descriptor_set[ current_frame ].descriptor_set.end(),
+      std::back_inserter( descriptor_set ),
+      []( const auto &v ) { return *v; }
+    );
+    commands.bindDescriptorSets(
+      vk::PipelineBindPoint::eGraphics,
+      *primitive.pipeline[ pipeline_index ].pipeline_layout,
+      0,
+      descriptor_set,
+      {}
+    );
+    std::vector< vk::Buffer > vb;
+    std::vector< vk::DeviceSize > vb_offset;
+    vb.reserve( primitive.vertex_buffer.size() );
+    vb_offset.reserve( primitive.vertex_buffer.size() );
+    for( const auto &view: primitive.vertex_buffer ) {
+      vb.push_back( *buffers[ view.index ].buffer.buffer );
+      vb_offset.push_back( view.offset );
+    }
+    commands.bindVertexBuffers( 0, vb, vb_offset );
+  }
+  bool use_impostor(
+    const mesh_t &mesh,
+    const glm::mat4 &matrix,
+    const lod_selector_t &selector
+  ) {
+    if( !mesh.impostor || !( selector.impostor_distance > 0.f ) ) return false;
+    const auto center = glm::vec3( matrix * glm::vec4( ( mesh.min + mesh.max ) * 0.5f, 1.f ) );
+    return glm::length( center - selector.eye ) > selector.impostor_distance;
+  }
+  void draw_mesh(
+    const vw::context_t&,
+    vk::CommandBuffer &commands,
+    const mesh_t &mesh,
+    const glm::mat4 &matrix,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod_selector,
+    const meshlet_culling_t &culling
+  ) {
+    if( use_impostor( mesh, matrix, lod_selector ) ) return;
+    for( const auto &primitive: mesh.primitive ) {
+      bind_primitive( commands, primitive, buffers, current_frame, pipeline_index, matrix, pipeline_index );
+      if( !primitive.indexed ) {
+        commands.draw( primitive.count, 1, 0, 0 );
+      }
+      else {
+        const auto lod = select_lod( primitive, matrix, lod_selector );
+        commands.bindIndexBuffer( *buffers[ primitive.index_buffer.index ].buffer.buffer, lod ? lod->offset : primitive.index_buffer.offset, primitive.index_buffer_type );
+        if( lod ) commands.drawIndexed( lod->count, 1, 0, 0, 0 );
+        else if( culling.enabled && !primitive.meshlet.empty() ) draw_meshlets( commands, primitive, matrix, culling );
+        else commands.drawIndexed( primitive.count, 1, 0, 0, 0 );
+      }
+    }
+  }
   void draw_node(
     const vw::context_t &context,
     vk::CommandBuffer &commands,
@@ -162,45 +329,47 @@ namespace viewer {
     const buffers_t &buffers,
     uint32_t current_frame,
     uint32_t pipeline_index
+  ) {
+    draw_node( context, commands, node, meshes, buffers, current_frame, pipeline_index, lod_selector_t() );
+  }
+  meshlet_culling_t get_meshlet_culling(
+    const glm::mat4 &projection,
+    const glm::mat4 &camera,
+    bool back_side
+  ) {
+    return meshlet_culling_t()
+      .set_enabled( true )
+      .set_view_projection( projection * camera )
+      .set_eye( glm::vec3( glm::inverse( camera )[ 3 ] ) )
+      .set_back_side( back_side );
+  }
+  void draw_node(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const node_t &node,
+    const meshes_t &meshes,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod_selector
+  ) {
+    draw_node( context, commands, node, meshes, buffers, current_frame, pipeline_index, lod_selector, meshlet_culling_t() );
+  }
+  void draw_node(
+    const vw::context_t &context,
+    vk::CommandBuffer &commands,
+    const node_t &node,
+    const meshes_t &meshes,
+    const buffers_t &buffers,
+    uint32_t current_frame,
+    uint32_t pipeline_index,
+    const lod_selector_t &lod_selector,
+    const meshlet_culling_t &culling
   ) {
     for( const auto &n: node.children )
-      draw_node( context, commands, n, meshes, buffers, current_frame, pipeline_index );
-    if( node.has_mesh ) {
-      const auto &mesh = meshes[ node.mesh ];
-      for( const auto &primitive: mesh.primitive ) {
-        commands.bindPipeline( vk::PipelineBindPoint::eGraphics, *primitive.pipeline[ pipeline_index ].pipeline );
-        auto pc = push_constants_t()
-          .set_world_matrix( node.matrix )
-          .set_fid( pipeline_index );
-        commands.pushConstants( *primitive.pipeline[ pipeline_index ].pipeline_layout, vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, 0, sizeof( push_constants_t ), &pc );
-        std::vector< vk::DescriptorSet > descriptor_set;
-        descriptor_set.reserve( primitive.descriptor_set[ current_frame ].descriptor_set.size() );
-        std::transform(
-          primitive.descriptor_set[ current_frame ].descriptor_set.begin(),
-          primitive.descriptor_set[ current_frame ].descriptor_set.end(),
-          std::back_inserter( descriptor_set ),
-          []( const auto &v ) { return *v; }
-        );
-        commands.bindDescriptorSets(
-          vk::PipelineBindPoint::eGraphics,
-          *primitive.pipeline[ pipeline_index ].pipeline_layout,
-          0,
-          descriptor_set,
-          {}
-        );
-        for( const auto &[bind_point,view]: primitive.vertex_buffer ) {
-          std::vector< vk::Buffer > vb{ *buffers[ view.index ].buffer.buffer };
-          commands.bindVertexBuffers( bind_point, vb, view.offset );
-        }
-        if( !primitive.indexed ) {
-          commands.draw( primitive.count, 1, 0, 0 );
-        }
-        else {
-          commands.bindIndexBuffer( *buffers[ primitive.index_buffer.index ].buffer.buffer, primitive.index_buffer.offset, primitive.index_buffer_type );
-          commands.drawIndexed( primitive.count, 1, 0, 0, 0 );
-        }
-      }
-    }
+      draw_node( context, commands, n, meshes, buffers, current_frame, pipeline_index, lod_selector, culling );
+    if( node.has_mesh )
+      draw_mesh( context, commands, meshes[ node.mesh ], node.matrix, buffers, current_frame, pipeline_index, lod_selector, culling );
   }
   point_lights_t get_point_lights(
     const node_t &node,
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vw/exceptions.h>
+#include <viewer/optimize.h>
+namespace viewer {
+  namespace {
+    // 頂点毎に最後にキャッシュに入った時刻を持つFIFOの頂点キャッシュ
+    class vertex_cache_t {
+    public:
+      vertex_cache_t( size_t vertex_count, size_t cache_size_ ) : cache_size( cache_size_ ), timestamp( cache_size_ + 1u ), cached( vertex_count, 0u ) {}
+      unsigned int add_triangle( const uint32_t *triangle ) {
+        unsigned int misses = 0u;
+        for( unsigned int k = 0u; k != 3u; ++k ) {
+          if( timestamp - cached[ triangle[ k ] ] > cache_size ) {
+            cached[ triangle[ k ] ] = timestamp++;
+            ++misses;
+          }
+        }
+        return misses;
+      }
+      void clear() {
+        timestamp += cache_size + 1u;
+      }
+    private:
+      size_t cache_size;
+      size_t timestamp;
+      std::vector< size_t > cached;
+    };
+    std::array< float, 3u > get_position(
+      const uint8_t *position,
+      size_t stride,
+      uint32_t vertex
+    ) {
+      std::array< float, 3u > value;
+      std::memcpy( value.data(), position + stride * vertex, sizeof( float ) * 3u );
+      return value;
+    }
+  }
+  float get_acmr(
+    const std::vector< uint32_t > &index,
+    size_t vertex_count,
+    size_t cache_size
+  ) {
+    if( index.size() < 3u ) return 0.f;
+    vertex_cache_t cache( vertex_count, cache_size );
+    size_t misses = 0u;
+    for( size_t i = 0u; i + 3u <= index.size(); i += 3u )
+      misses += cache.add_triangle( index.data() + i );
+    return float( misses ) / float( index.size() / 3u );
+  }
+  std::vector< uint32_t > optimize_vertex_cache(
+    const std::vector< uint32_t > &index,
+    size_t vertex_count,
+    size_t cache_size
+  ) {
+    const size_t triangle_count = index.size() / 3u;
+    std::vector< uint32_t > live( vertex_count, 0u );
+    for( const auto v: index ) ++live[ v ];
+    std::vector< uint32_t > adjacency_offset( vertex_count + 1u, 0u );
+    std::partial_sum( live.begin(), live.end(), std::next( adjacency_offset.begin() ) );
+    std::vector< uint32_t > adjacency( index.size() );
+    {
+      std::vector< uint32_t > filled( adjacency_offset.begin(), std::prev( adjacency_offset.end() ) );
+      for( size_t i = 0u; i != triangle_count * 3u; ++i )
+        adjacency[ filled[ index[ i ] ]++ ] = uint32_t( i / 3u );
+    }
+    std::vector< size_t > cache_time( vertex_count, 0u );
+    std::vector< bool > emitted( triangle_count, false );
+    std::vector< uint32_t > dead_end;
+    dead_end.reserve( index.size() );
+    std::vector< uint32_t > candidates;
+    std::vector< uint32_t > result;
+    result.reserve( triangle_count * 3u );
+    size_t timestamp = cache_size + 1u;
+    size_t cursor = 0u;
+    const auto next_live = [&]() -> int64_t {
+      // 候補が無くなったら直前に出力した頂点から、それも無ければ先頭から残っている頂点を探す
+      while( !dead_end.empty() ) {
+        const uint32_t v = dead_end.back();
+        dead_end.pop_back();
+        if( live[ v ] ) return v;
+      }
+      for( ; cursor != vertex_count; ++cursor )
+        if( live[ cursor ] ) return cursor;
+      return -1;
+    };
+    for( int64_t fanning = next_live(); fanning >= 0; ) {
+      candidates.clear();
+      for( uint32_t a = adjacency_offset[ fanning ]; a != adjacency_offset[ fanning + 1 ]; ++a ) {
+        const uint32_t triangle = adjacency[ a ];
+        if( emitted[ triangle ] ) continue;
+        emitted[ triangle ] = true;
+        for( unsigned int k = 0u; k != 3u; ++k ) {
+          const uint32_t v = index[ triangle * 3u + k ];
+          result.push_back( v );
+          dead_end.push_back( v );
+          candidates.push_back( v );
+          --live[ v ];
+          if( timestamp - cache_time[ v ] > cache_size ) cache_time[ v ] = timestamp++;
+        }
+      }
+      // 扇を広げた後もキャッシュに残っている頂点のうち最も古いものを次の中心にする
+      fanning = -1;
+      size_t best_priority = 0u;
+      for( const auto v: candidates ) {
+        if( !live[ v ] ) continue;
+        size_t priority = 0u;
+        if( timestamp - cache_time[ v ] + 2u * live[ v ] <= cache_size ) priority = timestamp - cache_time[ v ];
+        if( fanning < 0 || priority > best_priority ) {
+          fanning = v;
+          best_priority = priority;
+        }
+      }
+      if( fanning < 0 ) fanning = next_live();
+    }
+    return result;
+  }
+  std::vector< uint32_t > optimize_overdraw(
+    const std::vector< uint32_t > &index,
+    const uint8_t *position,
+    size_t stride,
+    size_t vertex_count,
+    size_t cache_size,
+    float threshold
+  ) {
+    const size_t triangle_count = index.size() / 3u;
+    if( !position || triangle_count < 2u ) return index;
+    // 全ての頂点がキャッシュに無い三角形の位置で大きく分ける
+    std::vector< size_t > hard;
+    {
+      vertex_cache_t cache( vertex_count, cache_size );
+      for( size_t t = 0u; t != triangle_count; ++t )
+        if( cache.add_triangle( index.data() + t * 3u ) == 3u || t == 0u ) hard.push_back( t );
+    }
+    hard.push_back( triangle_count );
+    // 更にクラスタ内のACMRが元のthreshold倍に収まる所で細かく分ける
+    std::vector< size_t > clusters;
+    vertex_cache_t cache( vertex_count, cache_size );
+    for( size_t h = 0u; h + 1u != hard.size(); ++h ) {
+      const size_t start = hard[ h ];
+      const size_t end = hard[ h + 1u ];
+      cache.clear();
+      size_t cluster_misses = 0u;
+      for( size_t t = start; t != end; ++t )
+        cluster_misses += cache.add_triangle( index.data() + t * 3u );
+      const float cluster_threshold = threshold * float( cluster_misses ) / float( end - start );
+      clusters.push_back( start );
+      cache.clear();
+      size_t running_misses = 0u;
+      size_t running_triangles = 0u;
+      for( size_t t = start; t != end; ++t ) {
+        running_misses += cache.add_triangle( index.data() + t * 3u );
+        ++running_triangles;
+        if( float( running_misses ) / float( running_triangles ) <= cluster_threshold ) {
+          clusters.push_back( t + 1u );
+          cache.clear();
+          running_misses = 0u;
+          running_triangles = 0u;
+        }
+      }
+      // 最後のクラスタは小さくACMRが悪くなりやすいので直前のクラスタと繋げる
+      if( clusters.back() != start ) clusters.pop_back();
+    }
+    clusters.push_back( triangle_count );
+    std::array< float, 3u > mesh_centroid{ 0.f, 0.f, 0.f };
+    for( const auto v: index ) {
+      const auto p = get_position( position, stride, v );
+      for( unsigned int k = 0u; k != 3u; ++k ) mesh_centroid[ k ] += p[ k ];
+    }
+    for( auto &c: mesh_centroid ) c /= float( index.size() );
+    // クラスタの中心がメッシュの中心から見てクラスタの法線の方向にある程先に描く
+    std::vector< float > key( clusters.size() - 1u );
+    for( size_t c = 0u; c + 1u != clusters.size(); ++c ) {
+      std::array< float, 3u > centroid{ 0.f, 0.f, 0.f };
+      std::array< float, 3u > normal{ 0.f, 0.f, 0.f };
+      float area = 0.f;
+      for( size_t t = clusters[ c ]; t != clusters[ c + 1u ]; ++t ) {
+        const auto p0 = get_position( position, stride, index[ t * 3u ] );
+        const auto p1 = get_position( position, stride, index[ t * 3u + 1u ] );
+        const auto p2 = get_position( position, stride, index[ t * 3u + 2u ] );
+        const std::array< float, 3u > p10{ p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] };
+        const std::array< float, 3u > p20{ p2[ 0 ] - p0[ 0 ], p2[ 1 ] - p0[ 1 ], p2[ 2 ] - p0[ 2 ] };
+        const std::array< float, 3u > n{
+          p10[ 1 ] * p20[ 2 ] - p10[ 2 ] * p20[ 1 ],
+          p10[ 2 ] * p20[ 0 ] - p10[ 0 ] * p20[ 2 ],
+          p10[ 0 ] * p20[ 1 ] - p10[ 1 ] * p20[ 0 ]
+        };
+        const float a = std::sqrt( n[ 0 ] * n[ 0 ] + n[ 1 ] * n[ 1 ] + n[ 2 ] * n[ 2 ] );
+        for( unsigned int k = 0u; k != 3u; ++k ) {
+          centroid[ k ] += ( p0[ k ] + p1[ k ] + p2[ k ] ) * ( a / 3.f );
+          normal[ k ] += n[ k ];
+        }
+        area += a;
+      }
+      const float normal_length = std::sqrt( normal[ 0 ] * normal[ 0 ] + normal[ 1 ] * normal[ 1 ] + normal[ 2 ] * normal[ 2 ] );
+      const float inv_area = area > 0.f ? 1.f / area : 0.f;
+      const float inv_normal_length = normal_length > 0.f ? 1.f / normal_length : 0.f;
+      key[ c ] = 0.f;
+      for( unsigned int k = 0u; k != 3u; ++k )
+        key[ c ] += ( centroid[ k ] * inv_area - mesh_centroid[ k ] ) * normal[ k ] * inv_normal_length;
+    }
+    std::vector< size_t > order( key.size() );
+    std::iota( order.begin(), order.end(), 0u );
+    std::stable_sort( order.begin(), order.end(), [&]( size_t l, size_t r ) { return key[ l ] > key[ r ]; } );
+    std::vector< uint32_t > result;
+    result.reserve( index.size() );
+    for( const auto c: order )
+      result.insert( result.end(), index.begin() + clusters[ c ] * 3u, index.begin() + clusters[ c + 1u ] * 3u );
+    return result;
+  }
+  std::vector< uint32_t > optimize_vertex_fetch(
+    std::vector< uint32_t > &index,
+    size_t vertex_count
+  ) {
+    constexpr uint32_t unused = std::numeric_limits< uint32_t >::max();
+    std::vector< uint32_t > old2new( vertex_count, unused );
+    uint32_t next = 0u;
+    for( auto &v: index ) {
+      if( old2new[ v ] == unused ) old2new[ v ] = next++;
+      v = old2new[ v ];
+    }
+    for( auto &v: old2new )
+      if( v == unused ) v = next++;
+    std::vector< uint32_t > new2old( vertex_count );
+    for( size_t v = 0u; v != vertex_count; ++v )
+      new2old[ old2new[ v ] ] = uint32_t( v );
+    return new2old;
+  }
+  optimized_indices_t optimize_indices(
+    const std::vector< uint32_t > &index,
+    const uint8_t *position,
+    size_t stride,
+    size_t vertex_count
+  ) {
+    if( index.size() % 3u ) throw vw::invalid_gltf( "三角形リストのインデックスの数が3の倍数でない", __FILE__, __LINE__ );
+    if( std::any_of( index.begin(), index.end(), [&]( uint32_t v ) { return v >= vertex_count; } ) )
+      throw vw::invalid_gltf( "インデックスが頂点の数を超えている", __FILE__, __LINE__ );
+    optimized_indices_t optimized;
+    optimized.acmr_before = get_acmr( index, vertex_count );
+    optimized.index = optimize_overdraw( optimize_vertex_cache( index, vertex_count ), position, stride, vertex_count );
+    optimized.remap = optimize_vertex_fetch( optimized.index, vertex_count );
+    optimized.acmr_after = get_acmr( optimized.index, vertex_count );
+    return optimized;
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <vw/mapped_file.h>
+#include <vw/exceptions.h>
+#include <viewer/parse.h>
+namespace viewer {
+  fx::gltf::Document parse_gltf(
+    const uint8_t *begin,
+    const uint8_t *end,
+    json_parser_t parser
+  ) {
+    if( parser == json_parser_t::lean ) return parse_gltf_lean( begin, end );
+    auto json = nlohmann::json::parse( begin, end, nullptr, false );
+    if( json.is_discarded() ) throw vw::invalid_gltf( "JSONとして解釈できない", __FILE__, __LINE__ );
+    return json.get< fx::gltf::Document >();
+  }
+  const nlohmann::json *get_extension(
+    const nlohmann::json &extensions_and_extras,
+    const std::string &name
+  ) {
+    if( !extensions_and_extras.is_object() ) return nullptr;
+    const auto extensions = extensions_and_extras.find( "extensions" );
+    if( extensions == extensions_and_extras.end() || !extensions->is_object() ) return nullptr;
+    const auto extension = extensions->find( name );
+    if( extension == extensions->end() || !extension->is_object() ) return nullptr;
+    return &*extension;
+  }
+  bool is_fallback_buffer( const fx::gltf::Buffer &buffer ) {
+    const auto extension = get_extension( buffer.extensionsAndExtras, "EXT_meshopt_compression" );
+    if( !extension ) return false;
+    const auto fallback = extension->find( "fallback" );
+    return fallback != extension->end() && fallback->is_boolean() && fallback->get< bool >();
+  }
+  fx::gltf::Document load_document(
+    const std::filesystem::path &path,
+    glb_t &glb,
+    json_parser_t parser
+  ) {
+    if( is_glb( path ) ) {
+      glb = map_glb( path );
+      return parse_glb( glb, parser );
+    }
+    const auto file = vw::map_file( path.string() );
+    return parse_gltf( file.begin(), file.end(), parser );
+  }
+}
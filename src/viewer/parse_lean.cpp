@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fx/gltf.h>
+#include <vw/exceptions.h>
+#include <viewer/parse.h>
+namespace viewer {
+  namespace {
+    // 要素の多いnodes, meshes, accessors, bufferViewsをDOMを作らずに読むための最小限のJSONリーダ
+    class json_reader_t {
+    public:
+      json_reader_t( const char *begin, const char *end_ ) : head( begin ), end( end_ ) {}
+      [[noreturn]] void fail() const {
+        throw vw::invalid_gltf( "JSONとして解釈できない", __FILE__, __LINE__ );
+      }
+      void skip_space() {
+        while( head != end && ( *head == ' ' || *head == '\n' || *head == '\r' || *head == '\t' ) ) ++head;
+      }
+      char peek() {
+        skip_space();
+        if( head == end ) fail();
+        return *head;
+      }
+      bool consume( char c ) {
+        if( peek() != c ) return false;
+        ++head;
+        return true;
+      }
+      void expect( char c ) {
+        if( !consume( c ) ) fail();
+      }
+      bool finished() {
+        skip_space();
+        return head == end;
+      }
+      // エスケープを含まない文字列はコピーせずに返す
+      std::string_view read_key( std::string &buffer ) {
+        expect( '"' );
+        const char *begin = head;
+        while( head != end && *head != '"' && *head != '\\' ) {
+          if( uint8_t( *head ) < 0x20u ) fail();
+          ++head;
+        }
+        if( head == end ) fail();
+        if( *head == '"' ) return std::string_view( begin, std::distance( begin, head++ ) );
+        buffer.assign( begin, head );
+        read_string_tail( buffer );
+        return buffer;
+      }
+      void read_string( std::string &value ) {
+        std::string buffer;
+        const auto view = read_key( buffer );
+        value.assign( view.begin(), view.end() );
+      }
+      bool read_bool() {
+        skip_space();
+        if( std::distance( head, end ) >= 4 && std::string_view( head, 4u ) == "true" ) {
+          head += 4;
+          return true;
+        }
+        if( std::distance( head, end ) >= 5 && std::string_view( head, 5u ) == "false" ) {
+          head += 5;
+          return false;
+        }
+        fail();
+      }
+      template< typename T >
+      void read_integer( T &value ) {
+        skip_space();
+        int64_t v = 0;
+        const auto [next,ec] = std::from_chars( head, end, v );
+        if( ec != std::errc() ) fail();
+        if( next != end && ( *next == '.' || *next == 'e' || *next == 'E' ) ) {
+          // 整数の欄に小数で書かれている場合はnlohmann::jsonと同様に切り捨てる
+          double d = 0.0;
+          const auto [fnext,fec] = std::from_chars( head, end, d );
+          if( fec != std::errc() ) fail();
+          head = fnext;
+          value = T( d );
+          return;
+        }
+        head = next;
+        value = T( v );
+      }
+      template< typename T >
+      void read_float( T &value ) {
+        skip_space();
+        double v = 0.0;
+        const auto [next,ec] = std::from_chars( head, end, v );
+        if( ec != std::errc() ) fail();
+        head = next;
+        value = T( v );
+      }
+      // 値を読み飛ばしてその範囲を返す
+      std::pair< const char*, const char* > skip_value() {
+        skip_space();
+        const char *begin = head;
+        int depth = 0;
+        do {
+          if( head == end ) fail();
+          const char c = *head;
+          if( c == '"' ) {
+            ++head;
+            while( head != end && *head != '"' ) {
+              if( *head == '\\' && ++head == end ) fail();
+              ++head;
+            }
+            if( head == end ) fail();
+            ++head;
+          }
+          else if( c == '{' || c == '[' ) {
+            ++depth;
+            ++head;
+          }
+          else if( c == '}' || c == ']' ) {
+            if( depth == 0 ) fail();
+            --depth;
+            ++head;
+          }
+          else if( depth == 0 ) {
+            while( head != end && *head != ',' && *head != '}' && *head != ']' && *head != ' ' && *head != '\n' && *head != '\r' && *head != '\t' ) ++head;
+          }
+          else ++head;
+        } while( depth != 0 );
+        if( begin == head ) fail();
+        return std::make_pair( begin, head );
+      }
+      template< typename F >
+      void read_object( F &&f ) {
+        expect( '{' );
+        if( consume( '}' ) ) return;
+        std::string buffer;
+        do {
+          const auto key = read_key( buffer );
+          expect( ':' );
+          f( key );
+        } while( consume( ',' ) );
+        expect( '}' );
+      }
+      template< typename F >
+      void read_array( F &&f ) {
+        expect( '[' );
+        if( consume( ']' ) ) return;
+        do {
+          f();
+        } while( consume( ',' ) );
+        expect( ']' );
+      }
+    private:
+      uint32_t read_hex4() {
+        if( std::distance( head, end ) < 4 ) fail();
+        uint32_t v = 0u;
+        const auto [next,ec] = std::from_chars( head, head + 4, v, 16 );
+        if( ec != std::errc() || next != head + 4 ) fail();
+        head += 4;
+        return v;
+      }
+      void append_utf8( std::string &buffer, uint32_t c ) {
+        if( c < 0x80u ) buffer.push_back( char( c ) );
+        else if( c < 0x800u ) {
+          buffer.push_back( char( 0xC0u | ( c >> 6 ) ) );
+          buffer.push_back( char( 0x80u | ( c & 0x3Fu ) ) );
+        }
+        else if( c < 0x10000u ) {
+          buffer.push_back( char( 0xE0u | ( c >> 12 ) ) );
+          buffer.push_back( char( 0x80u | ( ( c >> 6 ) & 0x3Fu ) ) );
+          buffer.push_back( char( 0x80u | ( c & 0x3Fu ) ) );
+        }
+        else {
+          buffer.push_back( char( 0xF0u | ( c >> 18 ) ) );
+          buffer.push_back( char( 0x80u | ( ( c >> 12 ) & 0x3Fu ) ) );
+          buffer.push_back( char( 0x80u | ( ( c >> 6 ) & 0x3Fu ) ) );
+          buffer.push_back( char( 0x80u | ( c & 0x3Fu ) ) );
+        }
+      }
+      // headは最初のエスケープを指している
+      void read_string_tail( std::string &buffer ) {
+        while( head != end && *head != '"' ) {
+          if( uint8_t( *head ) < 0x20u ) fail();
+          if( *head != '\\' ) {
+            buffer.push_back( *head++ );
+            continue;
+          }
+          if( ++head == end ) fail();
+          const char c = *head++;
+          if( c == '"' || c == '\\' || c == '/' ) buffer.push_back( c );
+          else if( c == 'b' ) buffer.push_back( '\b' );
+          else if( c == 'f' ) buffer.push_back( '\f' );
+          else if( c == 'n' ) buffer.push_back( '\n' );
+          else if( c == 'r' ) buffer.push_back( '\r' );
+          else if( c == 't' ) buffer.push_back( '\t' );
+          else if( c == 'u' ) {
+            uint32_t code = read_hex4();
+            if( code >= 0xD800u && code < 0xDC00u ) {
+              if( std::distance( head, end ) < 2 || head[ 0 ] != '\\' || head[ 1 ] != 'u' ) fail();
+              head += 2;
+              const uint32_t low = read_hex4();
+              if( low < 0xDC00u || low >= 0xE000u ) fail();
+              code = 0x10000u + ( ( code - 0xD800u ) << 10 ) + ( low - 0xDC00u );
+            }
+            else if( code >= 0xDC00u && code < 0xE000u ) fail();
+            append_utf8( buffer, code );
+          }
+          else fail();
+        }
+        if( head == end ) fail();
+        ++head;
+      }
+      const char *head;
+      const char *end;
+    };
+    template< typename T >
+    std::enable_if_t< std::is_arithmetic_v< T > || std::is_enum_v< T > > read_value( json_reader_t &reader, T &value );
+    void read_value( json_reader_t &reader, std::string &value );
+    template< typename T >
+    void read_value( json_reader_t &reader, std::vector< T > &value );
+    template< typename T, size_t N >
+    void read_value( json_reader_t &reader, std::array< T, N > &value );
+    template< typename K, typename V, typename ...Rest >
+    void read_value( json_reader_t &reader, std::unordered_map< K, V, Rest... > &value );
+    template< typename K, typename V, typename ...Rest >
+    void read_value( json_reader_t &reader, std::map< K, V, Rest... > &value );
+    template< typename T >
+    std::enable_if_t< std::is_arithmetic_v< T > || std::is_enum_v< T > > read_value( json_reader_t &reader, T &value ) {
+      if constexpr( std::is_same_v< T, bool > ) value = reader.read_bool();
+      else if constexpr( std::is_enum_v< T > ) {
+        std::underlying_type_t< T > v;
+        reader.read_integer( v );
+        value = T( v );
+      }
+      else if constexpr( std::is_integral_v< T > ) reader.read_integer( value );
+      else reader.read_float( value );
+    }
+    void read_value( json_reader_t &reader, std::string &value ) {
+      reader.read_string( value );
+    }
+    template< typename T >
+    void read_value( json_reader_t &reader, std::vector< T > &value ) {
+      value.clear();
+      reader.read_array( [&]() {
+        value.emplace_back();
+        read_value( reader, value.back() );
+      } );
+    }
+    template< typename T, size_t N >
+    void read_value( json_reader_t &reader, std::array< T, N > &value ) {
+      size_t count = 0u;
+      reader.read_array( [&]() {
+        if( count == N ) reader.fail();
+        read_value( reader, value[ count++ ] );
+      } );
+      if( count != N ) reader.fail();
+    }
+    template< typename Map >
+    void read_map( json_reader_t &reader, Map &value ) {
+      value.clear();
+      reader.read_object( [&]( std::string_view key ) {
+        read_value( reader, value[ std::string( key ) ] );
+      } );
+    }
+    template< typename K, typename V, typename ...Rest >
+    void read_value( json_reader_t &reader, std::unordered_map< K, V, Rest... > &value ) {
+      read_map( reader, value );
+    }
+    template< typename K, typename V, typename ...Rest >
+    void read_value( json_reader_t &reader, std::map< K, V, Rest... > &value ) {
+      read_map( reader, value );
+    }
+    // 拡張とextrasは小さいのでfx::gltfと同じ形のnlohmann::jsonにする
+    nlohmann::json parse_raw( json_reader_t &reader ) {
+      const auto [begin,end] = reader.skip_value();
+      auto json = nlohmann::json::parse( begin, end, nullptr, false );
+      if( json.is_discarded() ) reader.fail();
+      return json;
+    }
+    bool read_extensions_and_extras( json_reader_t &reader, std::string_view key, nlohmann::json &extensions_and_extras ) {
+      if( key != "extensions" && key != "extras" ) return false;
+      extensions_and_extras[ std::string( key ) ] = parse_raw( reader );
+      return true;
+    }
+    void read_node( json_reader_t &reader, fx::gltf::Node &node ) {
+      reader.read_object( [&]( std::string_view key ) {
+        if( key == "name" ) read_value( reader, node.name );
+        else if( key == "camera" ) read_value( reader, node.camera );
+        else if( key == "children" ) read_value( reader, node.children );
+        else if( key == "skin" ) read_value( reader, node.skin );
+        else if( key == "matrix" ) read_value( reader, node.matrix );
+        else if( key == "mesh" ) read_value( reader, node.mesh );
+        else if( key == "rotation" ) read_value( reader, node.rotation );
+        else if( key == "scale" ) read_value( reader, node.scale );
+        else if( key == "translation" ) read_value( reader, node.translation );
+        else if( key == "weights" ) read_value( reader, node.weights );
+        else if( !read_extensions_and_extras( reader, key, node.extensionsAndExtras ) ) reader.skip_value();
+      } );
+    }
+    fx::gltf::Accessor::Type get_accessor_type( const std::string &type ) {
+      using type_t = fx::gltf::Accessor::Type;
+      if( type == "SCALAR" ) return type_t::Scalar;
+      if( type == "VEC2" ) return type_t::Vec2;
+      if( type == "VEC3" ) return type_t::Vec3;
+      if( type == "VEC4" ) return type_t::Vec4;
+      if( type == "MAT2" ) return type_t::Mat2;
+      if( type == "MAT3" ) return type_t::Mat3;
+      if( type == "MAT4" ) return type_t::Mat4;
+      throw vw::invalid_gltf( "不明なaccessor.type: " + type );
+    }
+    void read_accessor( json_reader_t &reader, fx::gltf::Accessor &accessor ) {
+      bool has_component_type = false;
+      bool has_count = false;
+      bool has_type = false;
+      std::string type;
+      reader.read_object( [&]( std::string_view key ) {
+        if( key == "bufferView" ) read_value( reader, accessor.bufferView );
+        else if( key == "byteOffset" ) read_value( reader, accessor.byteOffset );
+        else if( key == "componentType" ) {
+          read_value( reader, accessor.componentType );
+          has_component_type = true;
+        }
+        else if( key == "count" ) {
+          read_value( reader, accessor.count );
+          has_count = true;
+        }
+        else if( key == "normalized" ) read_value( reader, accessor.normalized );
+        else if( key == "type" ) {
+          read_value( reader, type );
+          has_type = true;
+        }
+        else if( key == "max" ) read_value( reader, accessor.max );
+        else if( key == "min" ) read_value( reader, accessor.min );
+        else if( key == "name" ) read_value( reader, accessor.name );
+        // 疎なアクセサは少ないのでfx::gltfの変換に任せる
+        else if( key == "sparse" ) accessor.sparse = parse_raw( reader ).get< decltype( accessor.sparse ) >();
+        else if( !read_extensions_and_extras( reader, key, accessor.extensionsAndExtras ) ) reader.skip_value();
+      } );
+      if( !has_component_type || !has_count || !has_type ) throw vw::invalid_gltf( "accessorに必須の項目が無い", __FILE__, __LINE__ );
+      accessor.type = get_accessor_type( type );
+    }
+    void read_buffer_view( json_reader_t &reader, fx::gltf::BufferView &view ) {
+      bool has_buffer = false;
+      bool has_byte_length = false;
+      reader.read_object( [&]( std::string_view key ) {
+        if( key == "name" ) read_value( reader, view.name );
+        else if( key == "buffer" ) {
+          read_value( reader, view.buffer );
+          has_buffer = true;
+        }
+        else if( key == "byteOffset" ) read_value( reader, view.byteOffset );
+        else if( key == "byteLength" ) {
+          read_value( reader, view.byteLength );
+          has_byte_length = true;
+        }
+        else if( key == "byteStride" ) read_value( reader, view.byteStride );
+        else if( key == "target" ) read_value( reader, view.target );
+        else if( !read_extensions_and_extras( reader, key, view.extensionsAndExtras ) ) reader.skip_value();
+      } );
+      if( !has_buffer || !has_byte_length ) throw vw::invalid_gltf( "bufferViewに必須の項目が無い", __FILE__, __LINE__ );
+    }
+    void read_primitive( json_reader_t &reader, fx::gltf::Primitive &primitive ) {
+      bool has_attributes = false;
+      reader.read_object( [&]( std::string_view key ) {
+        if( key == "attributes" ) {
+          read_value( reader, primitive.attributes );
+          has_attributes = true;
+        }
+        else if( key == "indices" ) read_value( reader, primitive.indices );
+        else if( key == "material" ) read_value( reader, primitive.material );
+        else if( key == "mode" ) read_value( reader, primitive.mode );
+        else if( key == "targets" ) read_value( reader, primitive.targets );
+        else if( !read_extensions_and_extras( reader, key, primitive.extensionsAndExtras ) ) reader.skip_value();
+      } );
+      if( !has_attributes ) throw vw::invalid_gltf( "primitiveにattributesが無い", __FILE__, __LINE__ );
+    }
+    void read_mesh( json_reader_t &reader, fx::gltf::Mesh &mesh ) {
+      bool has_primitives = false;
+      reader.read_object( [&]( std::string_view key ) {
+        if( key == "name" ) read_value( reader, mesh.name );
+        else if( key == "weights" ) read_value( reader, mesh.weights );
+        else if( key == "primitives" ) {
+          mesh.primitives.clear();
+          reader.read_array( [&]() {
+            mesh.primitives.emplace_back();
+            read_primitive( reader, mesh.primitives.back() );
+          } );
+          has_primitives = true;
+        }
+        else if( !read_extensions_and_extras( reader, key, mesh.extensionsAndExtras ) ) reader.skip_value();
+      } );
+      if( !has_primitives ) throw vw::invalid_gltf( "meshにprimitivesが無い", __FILE__, __LINE__ );
+    }
+    template< typename T, typename F >
+    void read_elements( json_reader_t &reader, std::vector< T > &elements, F &&read ) {
+      elements.clear();
+      reader.read_array( [&]() {
+        elements.emplace_back();
+        read( reader, elements.back() );
+      } );
+    }
+  }
+  fx::gltf::Document parse_gltf_lean(
+    const uint8_t *begin,
+    const uint8_t *end
+  ) {
+    json_reader_t reader( reinterpret_cast< const char* >( begin ), reinterpret_cast< const char* >( end ) );
+    std::vector< fx::gltf::Node > nodes;
+    std::vector< fx::gltf::Accessor > accessors;
+    std::vector< fx::gltf::BufferView > buffer_views;
+    std::vector< fx::gltf::Mesh > meshes;
+    // 残りの項目は小さいのでDOMにしてfx::gltfの変換に任せる
+    auto rest = nlohmann::json::object();
+    reader.read_object( [&]( std::string_view key ) {
+      if( key == "nodes" ) read_elements( reader, nodes, read_node );
+      else if( key == "accessors" ) read_elements( reader, accessors, read_accessor );
+      else if( key == "bufferViews" ) read_elements( reader, buffer_views, read_buffer_view );
+      else if( key == "meshes" ) read_elements( reader, meshes, read_mesh );
+      else rest[ std::string( key ) ] = parse_raw( reader );
+    } );
+    if( !reader.finished() ) reader.fail();
+    auto document = rest.get< fx::gltf::Document >();
+    document.nodes = std::move( nodes );
+    document.accessors = std::move( accessors );
+    document.bufferViews = std::move( buffer_views );
+    document.meshes = std::move( meshes );
+    return document;
+  }
+}
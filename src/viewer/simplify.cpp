@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <string>
+#include <unordered_map>
+#include <vw/exceptions.h>
+#include <viewer/simplify.h>
+namespace viewer {
+  namespace {
+    using vec3_t = std::array< double, 3u >;
+    vec3_t get_vec3( const float *position, uint32_t vertex ) {
+      return vec3_t{ position[ vertex * 3u ], position[ vertex * 3u + 1u ], position[ vertex * 3u + 2u ] };
+    }
+    vec3_t sub( const vec3_t &l, const vec3_t &r ) {
+      return vec3_t{ l[ 0 ] - r[ 0 ], l[ 1 ] - r[ 1 ], l[ 2 ] - r[ 2 ] };
+    }
+    vec3_t cross( const vec3_t &l, const vec3_t &r ) {
+      return vec3_t{
+        l[ 1 ] * r[ 2 ] - l[ 2 ] * r[ 1 ],
+        l[ 2 ] * r[ 0 ] - l[ 0 ] * r[ 2 ],
+        l[ 0 ] * r[ 1 ] - l[ 1 ] * r[ 0 ]
+      };
+    }
+    double dot( const vec3_t &l, const vec3_t &r ) {
+      return l[ 0 ] * r[ 0 ] + l[ 1 ] * r[ 1 ] + l[ 2 ] * r[ 2 ];
+    }
+    // 平面からの距離の二乗の和を表す対称行列の上三角と重みの和
+    struct quadric_t {
+      quadric_t() : a{ 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 }, weight( 0.0 ) {}
+      void add_plane( const vec3_t &n, double d, double w ) {
+        a[ 0 ] += w * n[ 0 ] * n[ 0 ];
+        a[ 1 ] += w * n[ 0 ] * n[ 1 ];
+        a[ 2 ] += w * n[ 0 ] * n[ 2 ];
+        a[ 3 ] += w * n[ 0 ] * d;
+        a[ 4 ] += w * n[ 1 ] * n[ 1 ];
+        a[ 5 ] += w * n[ 1 ] * n[ 2 ];
+        a[ 6 ] += w * n[ 1 ] * d;
+        a[ 7 ] += w * n[ 2 ] * n[ 2 ];
+        a[ 8 ] += w * n[ 2 ] * d;
+        a[ 9 ] += w * d * d;
+        weight += w;
+      }
+      quadric_t &operator+=( const quadric_t &r ) {
+        for( size_t i = 0u; i != a.size(); ++i ) a[ i ] += r.a[ i ];
+        weight += r.weight;
+        return *this;
+      }
+      double evaluate( const vec3_t &p ) const {
+        const double value =
+          a[ 0 ] * p[ 0 ] * p[ 0 ] + 2.0 * a[ 1 ] * p[ 0 ] * p[ 1 ] + 2.0 * a[ 2 ] * p[ 0 ] * p[ 2 ] + 2.0 * a[ 3 ] * p[ 0 ] +
+          a[ 4 ] * p[ 1 ] * p[ 1 ] + 2.0 * a[ 5 ] * p[ 1 ] * p[ 2 ] + 2.0 * a[ 6 ] * p[ 1 ] +
+          a[ 7 ] * p[ 2 ] * p[ 2 ] + 2.0 * a[ 8 ] * p[ 2 ] +
+          a[ 9 ];
+        return weight > 0.0 ? std::max( value / weight, 0.0 ) : 0.0;
+      }
+      std::array< double, 10u > a;
+      double weight;
+    };
+    struct collapse_t {
+      uint32_t from;
+      uint32_t to;
+      double cost;
+      double error;
+    };
+    uint64_t get_edge_key( uint32_t from, uint32_t to ) {
+      return ( uint64_t( from ) << 32u ) | uint64_t( to );
+    }
+  }
+  std::vector< simplified_indices_t > simplify(
+    const std::vector< uint32_t > &index_,
+    const float *position,
+    const float *attribute,
+    size_t attribute_count,
+    size_t vertex_count,
+    const std::vector< size_t > &target_index_count,
+    float attribute_weight
+  ) {
+    if( index_.size() % 3u ) throw vw::invalid_argument( "インデックスの数が3の倍数ではない", __FILE__, __LINE__ );
+    for( const auto v: index_ )
+      if( v >= vertex_count ) throw vw::invalid_argument( "インデックスが頂点の数を超えている", __FILE__, __LINE__ );
+    if( !std::is_sorted( target_index_count.begin(), target_index_count.end(), std::greater< size_t >() ) )
+      throw vw::invalid_argument( "簡略化の目標が降順になっていない", __FILE__, __LINE__ );
+    std::vector< simplified_indices_t > result;
+    result.reserve( target_index_count.size() );
+    std::vector< uint32_t > index = index_;
+    // 位置が同じ頂点を1つの代表にまとめ、縮約は代表の頂点の間で行う
+    std::vector< uint32_t > canonical( vertex_count );
+    {
+      std::unordered_map< std::string, uint32_t > found;
+      for( uint32_t v = 0u; v != vertex_count; ++v ) {
+        const std::string key( reinterpret_cast< const char* >( position + v * 3u ), sizeof( float ) * 3u );
+        canonical[ v ] = found.insert( std::make_pair( key, v ) ).first->second;
+      }
+    }
+    std::vector< std::vector< uint32_t > > wedge( vertex_count );
+    for( uint32_t v = 0u; v != vertex_count; ++v ) wedge[ canonical[ v ] ].push_back( v );
+    // 開いた辺と3つ以上の三角形が共有する辺に接する頂点は動かさない
+    std::vector< bool > locked( vertex_count, false );
+    {
+      std::unordered_map< uint64_t, uint32_t > edge;
+      for( size_t i = 0u; i != index.size(); i += 3u )
+        for( size_t k = 0u; k != 3u; ++k ) {
+          const uint32_t from = canonical[ index[ i + k ] ];
+          const uint32_t to = canonical[ index[ i + ( k + 1u ) % 3u ] ];
+          if( from != to ) ++edge[ get_edge_key( from, to ) ];
+        }
+      for( const auto &[key,count]: edge ) {
+        const uint32_t from = uint32_t( key >> 32u );
+        const uint32_t to = uint32_t( key & 0xFFFFFFFFu );
+        const auto twin = edge.find( get_edge_key( to, from ) );
+        if( count != 1u || twin == edge.end() || twin->second != 1u ) {
+          locked[ from ] = true;
+          locked[ to ] = true;
+        }
+      }
+    }
+    std::vector< quadric_t > quadric( vertex_count );
+    vec3_t lower{ std::numeric_limits< double >::max(), std::numeric_limits< double >::max(), std::numeric_limits< double >::max() };
+    vec3_t upper{ std::numeric_limits< double >::lowest(), std::numeric_limits< double >::lowest(), std::numeric_limits< double >::lowest() };
+    for( size_t i = 0u; i != index.size(); i += 3u ) {
+      const auto p0 = get_vec3( position, index[ i ] );
+      const auto p1 = get_vec3( position, index[ i + 1u ] );
+      const auto p2 = get_vec3( position, index[ i + 2u ] );
+      for( const auto &p: { p0, p1, p2 } )
+        for( size_t k = 0u; k != 3u; ++k ) {
+          lower[ k ] = std::min( lower[ k ], p[ k ] );
+          upper[ k ] = std::max( upper[ k ], p[ k ] );
+        }
+      auto n = cross( sub( p1, p0 ), sub( p2, p0 ) );
+      const double length = std::sqrt( dot( n, n ) );
+      if( length <= 0.0 ) continue;
+      n = vec3_t{ n[ 0 ] / length, n[ 1 ] / length, n[ 2 ] / length };
+      const double d = -dot( n, p0 );
+      for( size_t k = 0u; k != 3u; ++k )
+        quadric[ canonical[ index[ i + k ] ] ].add_plane( n, d, length * 0.5 );
+    }
+    const double extent = index.empty() ? 0.0 : std::sqrt( dot( sub( upper, lower ), sub( upper, lower ) ) );
+    const double attribute_scale = double( attribute_weight ) * extent * double( attribute_weight ) * extent;
+    double max_error = 0.0;
+    std::vector< uint32_t > triangle_offset( vertex_count + 1u );
+    std::vector< uint32_t > adjacent;
+    std::vector< uint32_t > wedge_remap( vertex_count );
+    std::vector< bool > touched( vertex_count );
+    // 縮約するとfromの全ての継ぎ目の頂点がtoの継ぎ目の頂点に対応する場合だけ縮約できる
+    const auto get_wedge_remap = [&]( uint32_t from, uint32_t to, std::vector< std::pair< uint32_t, uint32_t > > &pairs ) {
+      pairs.clear();
+      for( uint32_t t = triangle_offset[ from ]; t != triangle_offset[ from + 1u ]; ++t ) {
+        const uint32_t *triangle = index.data() + adjacent[ t ] * 3u;
+        uint32_t source = vertex_count;
+        uint32_t dest = vertex_count;
+        for( size_t k = 0u; k != 3u; ++k ) {
+          if( canonical[ triangle[ k ] ] == from ) source = triangle[ k ];
+          else if( canonical[ triangle[ k ] ] == to ) dest = triangle[ k ];
+        }
+        const auto existing = std::find_if( pairs.begin(), pairs.end(), [&]( const auto &p ) { return p.first == source; } );
+        if( existing == pairs.end() ) pairs.push_back( std::make_pair( source, dest ) );
+        else if( existing->second == vertex_count ) existing->second = dest;
+        else if( dest != vertex_count && existing->second != dest ) return false;
+      }
+      return std::all_of( pairs.begin(), pairs.end(), [&]( const auto &p ) { return p.second != vertex_count; } );
+    };
+    const auto get_attribute_error = [&]( const std::vector< std::pair< uint32_t, uint32_t > > &pairs ) {
+      double error = 0.0;
+      if( !attribute ) return error;
+      for( const auto &[source,dest]: pairs )
+        for( size_t k = 0u; k != attribute_count; ++k ) {
+          const double diff = double( attribute[ source * attribute_count + k ] ) - double( attribute[ dest * attribute_count + k ] );
+          error += diff * diff;
+        }
+      return error * attribute_scale;
+    };
+    // 縮約で裏返る三角形がある場合は縮約しない
+    const auto flips = [&]( uint32_t from, uint32_t to ) {
+      const auto dest = get_vec3( position, to );
+      for( uint32_t t = triangle_offset[ from ]; t != triangle_offset[ from + 1u ]; ++t ) {
+        const uint32_t *triangle = index.data() + adjacent[ t ] * 3u;
+        std::array< vec3_t, 3u > before;
+        std::array< vec3_t, 3u > after;
+        bool shared = false;
+        for( size_t k = 0u; k != 3u; ++k ) {
+          const uint32_t c = canonical[ triangle[ k ] ];
+          if( c == to ) shared = true;
+          before[ k ] = get_vec3( position, c );
+          after[ k ] = c == from ? dest : before[ k ];
+        }
+        if( shared ) continue;
+        const auto nb = cross( sub( before[ 1 ], before[ 0 ] ), sub( before[ 2 ], before[ 0 ] ) );
+        const auto na = cross( sub( after[ 1 ], after[ 0 ] ), sub( after[ 2 ], after[ 0 ] ) );
+        if( dot( nb, na ) <= 0.25 * std::sqrt( dot( nb, nb ) * dot( na, na ) ) ) return true;
+      }
+      return false;
+    };
+    std::vector< std::pair< uint32_t, uint32_t > > pairs;
+    std::vector< collapse_t > collapses;
+    for( const auto target: target_index_count ) {
+      while( index.size() > target ) {
+        std::fill( triangle_offset.begin(), triangle_offset.end(), 0u );
+        for( const auto v: index ) ++triangle_offset[ canonical[ v ] + 1u ];
+        for( size_t v = 0u; v != vertex_count; ++v ) triangle_offset[ v + 1u ] += triangle_offset[ v ];
+        adjacent.resize( index.size() );
+        {
+          std::vector< uint32_t > head( triangle_offset.begin(), triangle_offset.end() - 1 );
+          for( size_t i = 0u; i != index.size(); ++i ) adjacent[ head[ canonical[ index[ i ] ] ]++ ] = uint32_t( i / 3u );
+        }
+        collapses.clear();
+        for( size_t i = 0u; i != index.size(); i += 3u )
+          for( size_t k = 0u; k != 3u; ++k ) {
+            const uint32_t a = canonical[ index[ i + k ] ];
+            const uint32_t b = canonical[ index[ i + ( k + 1u ) % 3u ] ];
+            if( a >= b ) continue;
+            for( const auto &[from,to]: { std::make_pair( a, b ), std::make_pair( b, a ) } ) {
+              if( locked[ from ] ) continue;
+              if( !get_wedge_remap( from, to, pairs ) ) continue;
+              quadric_t merged = quadric[ from ];
+              merged += quadric[ to ];
+              const double error = merged.evaluate( get_vec3( position, to ) );
+              collapses.push_back( collapse_t{ from, to, error + get_attribute_error( pairs ), error } );
+            }
+          }
+        if( collapses.empty() ) break;
+        std::sort( collapses.begin(), collapses.end(), []( const auto &l, const auto &r ) { return l.cost < r.cost; } );
+        // 1回の縮約で概ね2つの三角形が消える
+        const size_t removable = ( index.size() - target ) / 3u;
+        size_t removed = 0u;
+        std::fill( touched.begin(), touched.end(), false );
+        for( uint32_t v = 0u; v != vertex_count; ++v ) wedge_remap[ v ] = v;
+        for( const auto &collapse: collapses ) {
+          if( removed >= removable ) break;
+          if( touched[ collapse.from ] || touched[ collapse.to ] ) continue;
+          if( flips( collapse.from, collapse.to ) ) continue;
+          if( !get_wedge_remap( collapse.from, collapse.to, pairs ) ) continue;
+          for( const auto &[source,dest]: pairs ) wedge_remap[ source ] = dest;
+          for( uint32_t t = triangle_offset[ collapse.from ]; t != triangle_offset[ collapse.from + 1u ]; ++t ) {
+            const uint32_t *triangle = index.data() + adjacent[ t ] * 3u;
+            bool shared = false;
+            for( size_t k = 0u; k != 3u; ++k ) {
+              touched[ canonical[ triangle[ k ] ] ] = true;
+              if( canonical[ triangle[ k ] ] == collapse.to ) shared = true;
+            }
+            if( shared ) ++removed;
+          }
+          quadric[ collapse.to ] += quadric[ collapse.from ];
+          max_error = std::max( max_error, collapse.error );
+        }
+        if( removed == 0u ) break;
+        size_t tail = 0u;
+        for( size_t i = 0u; i != index.size(); i += 3u ) {
+          const uint32_t v0 = wedge_remap[ index[ i ] ];
+          const uint32_t v1 = wedge_remap[ index[ i + 1u ] ];
+          const uint32_t v2 = wedge_remap[ index[ i + 2u ] ];
+          if( canonical[ v0 ] == canonical[ v1 ] || canonical[ v1 ] == canonical[ v2 ] || canonical[ v2 ] == canonical[ v0 ] ) continue;
+          index[ tail++ ] = v0;
+          index[ tail++ ] = v1;
+          index[ tail++ ] = v2;
+        }
+        index.resize( tail );
+      }
+      result.push_back( simplified_indices_t{ index, float( std::sqrt( max_error ) ) } );
+    }
+    return result;
+  }
+}
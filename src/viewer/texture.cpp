@@ -39,16 +39,17 @@ namespace viewer {
     if( texture.source < 0 || images.size() <= size_t( texture.source ) ) throw vw::invalid_gltf( "参照されたimageが存在しない", __FILE__, __LINE__ );
     const auto &image = images[ texture.source ];
     texture_t texture_;
+    texture_.set_source( texture.source );
     texture_.set_unorm(
       vk::DescriptorImageInfo()
         .setImageLayout( vk::ImageLayout::eShaderReadOnlyOptimal )
-        .setImageView( *image.unorm.image_view )
+        .setImageView( image.unorm ? *image.unorm : vk::ImageView() )
         .setSampler( *sampler.sampler )
     );
     texture_.set_srgb(
       vk::DescriptorImageInfo()
         .setImageLayout( vk::ImageLayout::eShaderReadOnlyOptimal )
-        .setImageView( *image.srgb.image_view )
+        .setImageView( image.srgb ? *image.srgb : vk::ImageView() )
         .setSampler( *sampler.sampler )
     );
     return texture_;
@@ -88,5 +89,38 @@ namespace viewer {
     }
     return textures;
   }
+  void update_texture(
+    texture_t &texture,
+    const image_t &image
+  ) {
+    texture.unorm.setImageView( image.unorm ? *image.unorm : vk::ImageView() );
+    texture.srgb.setImageView( image.srgb ? *image.srgb : vk::ImageView() );
+  }
+  placeholder_t create_placeholder(
+    const vw::context_t &context,
+    const sampler_t &sampler
+  ) {
+    const auto create = [&]( uint8_t r, uint8_t g, uint8_t b ) {
+      return vw::load_image(
+        context,
+        vw::pixels_t()
+          .set_width( 1u )
+          .set_height( 1u )
+          .set_data( std::vector< uint8_t >{ r, g, b, 255u } ),
+        vk::ImageUsageFlagBits::eSampled,
+        false,
+        false
+      );
+    };
+    placeholder_t placeholder;
+    placeholder.set_white( create( 255u, 255u, 255u ) );
+    placeholder.set_black( create( 0u, 0u, 0u ) );
+    placeholder.set_normal( create( 128u, 128u, 255u ) );
+    placeholder.set_white_texture( create_texture( placeholder.white, sampler ) );
+    placeholder.set_black_texture( create_texture( placeholder.black, sampler ) );
+    placeholder.set_normal_texture( create_texture( placeholder.normal, sampler ) );
+    for( auto *texture: { &placeholder.white_texture, &placeholder.black_texture, &placeholder.normal_texture } )
+      texture->set_srgb( texture->unorm );
+    return placeholder;
+  }
 }
-
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <array>
+#include <algorithm>
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __GNUC__ )
+#include <immintrin.h>
+#define VW_BASE64_X86
+#endif
+#include <vw/base64.h>
+#include <vw/exceptions.h>
+namespace vw {
+  namespace {
+    constexpr uint8_t invalid = 0xFFu;
+    constexpr std::array< uint8_t, 256u > create_decode_table() {
+      std::array< uint8_t, 256u > table{};
+      for( auto &v: table ) v = invalid;
+      for( unsigned int i = 0u; i != 26u; ++i ) {
+        table[ 'A' + i ] = i;
+        table[ 'a' + i ] = i + 26u;
+      }
+      for( unsigned int i = 0u; i != 10u; ++i )
+        table[ '0' + i ] = i + 52u;
+      table[ '+' ] = 62u;
+      table[ '/' ] = 63u;
+      return table;
+    }
+    constexpr auto decode_table = create_decode_table();
+    size_t get_padding( const char *begin, const char *end ) {
+      size_t padding = 0u;
+      while( end != begin && padding != 2u && *( end - 1 ) == '=' ) {
+        --end;
+        ++padding;
+      }
+      return padding;
+    }
+    size_t decode_scalar(
+      const char *begin,
+      const char *end,
+      uint8_t *out
+    ) {
+      end -= get_padding( begin, end );
+      uint8_t *head = out;
+      while( std::distance( begin, end ) >= 4 ) {
+        const uint32_t a = decode_table[ uint8_t( begin[ 0 ] ) ];
+        const uint32_t b = decode_table[ uint8_t( begin[ 1 ] ) ];
+        const uint32_t c = decode_table[ uint8_t( begin[ 2 ] ) ];
+        const uint32_t d = decode_table[ uint8_t( begin[ 3 ] ) ];
+        if( ( a | b | c | d ) & 0x80u ) throw invalid_base64();
+        const uint32_t v = ( a << 18 ) | ( b << 12 ) | ( c << 6 ) | d;
+        head[ 0 ] = uint8_t( v >> 16 );
+        head[ 1 ] = uint8_t( v >> 8 );
+        head[ 2 ] = uint8_t( v );
+        head += 3;
+        begin += 4;
+      }
+      const auto rest = std::distance( begin, end );
+      if( rest == 1 ) throw invalid_base64();
+      if( rest >= 2 ) {
+        const uint32_t a = decode_table[ uint8_t( begin[ 0 ] ) ];
+        const uint32_t b = decode_table[ uint8_t( begin[ 1 ] ) ];
+        const uint32_t c = rest == 3 ? decode_table[ uint8_t( begin[ 2 ] ) ] : 0u;
+        if( ( a | b | c ) & 0x80u ) throw invalid_base64();
+        const uint32_t v = ( a << 18 ) | ( b << 12 ) | ( c << 6 );
+        *head++ = uint8_t( v >> 16 );
+        if( rest == 3 ) *head++ = uint8_t( v >> 8 );
+      }
+      return std::distance( out, head );
+    }
+#ifdef VW_BASE64_X86
+    // 16文字を12バイトにデコードする(Muła, Lemireの手法)
+    // 不正な文字を含む場合は何もせずにfalseを返す
+    __attribute__((target("ssse3")))
+    bool decode_ssse3_block( const char *in, uint8_t *out ) {
+      const __m128i lut_lo = _mm_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+      );
+      const __m128i lut_hi = _mm_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+      );
+      const __m128i lut_roll = _mm_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0
+      );
+      const __m128i mask_2f = _mm_set1_epi8( 0x2f );
+      __m128i str = _mm_loadu_si128( reinterpret_cast< const __m128i* >( in ) );
+      const __m128i hi_nibbles = _mm_and_si128( _mm_srli_epi32( str, 4 ), mask_2f );
+      const __m128i lo_nibbles = _mm_and_si128( str, mask_2f );
+      const __m128i lo = _mm_shuffle_epi8( lut_lo, lo_nibbles );
+      const __m128i hi = _mm_shuffle_epi8( lut_hi, hi_nibbles );
+      if( _mm_movemask_epi8( _mm_cmpgt_epi8( _mm_and_si128( lo, hi ), _mm_setzero_si128() ) ) ) return false;
+      const __m128i eq_2f = _mm_cmpeq_epi8( str, mask_2f );
+      const __m128i roll = _mm_shuffle_epi8( lut_roll, _mm_add_epi8( eq_2f, hi_nibbles ) );
+      str = _mm_add_epi8( str, roll );
+      const __m128i merged = _mm_maddubs_epi16( str, _mm_set1_epi32( 0x01400140 ) );
+      __m128i packed = _mm_madd_epi16( merged, _mm_set1_epi32( 0x00011000 ) );
+      packed = _mm_shuffle_epi8( packed, _mm_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+      ) );
+      _mm_storeu_si128( reinterpret_cast< __m128i* >( out ), packed );
+      return true;
+    }
+    // 32文字を24バイトにデコードする
+    __attribute__((target("avx2")))
+    bool decode_avx2_block( const char *in, uint8_t *out ) {
+      const __m256i lut_lo = _mm256_setr_epi8(
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+        0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+      );
+      const __m256i lut_hi = _mm256_setr_epi8(
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+        0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+      );
+      const __m256i lut_roll = _mm256_setr_epi8(
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0, 16, 19, 4, -65, -65, -71, -71,
+        0, 0, 0, 0, 0, 0, 0, 0
+      );
+      const __m256i mask_2f = _mm256_set1_epi8( 0x2f );
+      __m256i str = _mm256_loadu_si256( reinterpret_cast< const __m256i* >( in ) );
+      const __m256i hi_nibbles = _mm256_and_si256( _mm256_srli_epi32( str, 4 ), mask_2f );
+      const __m256i lo_nibbles = _mm256_and_si256( str, mask_2f );
+      const __m256i lo = _mm256_shuffle_epi8( lut_lo, lo_nibbles );
+      const __m256i hi = _mm256_shuffle_epi8( lut_hi, hi_nibbles );
+      if( !_mm256_testz_si256( lo, hi ) ) return false;
+      const __m256i eq_2f = _mm256_cmpeq_epi8( str, mask_2f );
+      const __m256i roll = _mm256_shuffle_epi8( lut_roll, _mm256_add_epi8( eq_2f, hi_nibbles ) );
+      str = _mm256_add_epi8( str, roll );
+      const __m256i merged = _mm256_maddubs_epi16( str, _mm256_set1_epi32( 0x01400140 ) );
+      __m256i packed = _mm256_madd_epi16( merged, _mm256_set1_epi32( 0x00011000 ) );
+      packed = _mm256_shuffle_epi8( packed, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+      ) );
+      packed = _mm256_permutevar8x32_epi32( packed, _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, -1, -1 ) );
+      _mm256_storeu_si256( reinterpret_cast< __m256i* >( out ), packed );
+      return true;
+    }
+    enum class simd_t {
+      none,
+      ssse3,
+      avx2
+    };
+    simd_t get_simd() {
+      static const simd_t simd = []() {
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports( "avx2" ) ) return simd_t::avx2;
+        if( __builtin_cpu_supports( "ssse3" ) ) return simd_t::ssse3;
+        return simd_t::none;
+      }();
+      return simd;
+    }
+#endif
+  }
+  size_t get_base64_decoded_size( const char *begin, const char *end ) {
+    const size_t size = std::distance( begin, end ) - get_padding( begin, end );
+    return size / 4u * 3u + ( size % 4u ? size % 4u - 1u : 0u );
+  }
+  size_t decode_base64_scalar( const char *begin, const char *end, uint8_t *out ) {
+    return decode_scalar( begin, end, out );
+  }
+  size_t decode_base64( const char *begin, const char *end, uint8_t *out ) {
+    uint8_t *head = out;
+#ifdef VW_BASE64_X86
+    // ブロックは書き込み先の末尾を超えて書くので、後続のデコードで上書きされる範囲でのみ使う
+    const uint8_t *out_end = out + get_base64_decoded_size( begin, end );
+    const auto simd = get_simd();
+    if( simd == simd_t::avx2 ) {
+      while( std::distance( begin, end ) >= 45 && std::distance( const_cast< const uint8_t* >( head ), out_end ) >= 32 ) {
+        if( !decode_avx2_block( begin, head ) ) break;
+        begin += 32;
+        head += 24;
+      }
+    }
+    if( simd != simd_t::none ) {
+      while( std::distance( begin, end ) >= 24 && std::distance( const_cast< const uint8_t* >( head ), out_end ) >= 16 ) {
+        if( !decode_ssse3_block( begin, head ) ) break;
+        begin += 16;
+        head += 12;
+      }
+    }
+#endif
+    return std::distance( out, head ) + decode_scalar( begin, end, head );
+  }
+  void decode_base64( const char *begin, const char *end, size_t offset, size_t size, uint8_t *out ) {
+    if( size == 0u ) return;
+    if( offset + size > get_base64_decoded_size( begin, end ) ) throw invalid_argument( "base64のデコード結果の範囲外" );
+    size_t group = offset / 3u;
+    size_t skip = offset % 3u;
+    const auto decode_group = [&]( size_t index, uint8_t *dest ) {
+      const char *group_begin = begin + index * 4u;
+      const char *group_end = std::min( group_begin + 4, end );
+      return decode_scalar( group_begin, group_end, dest );
+    };
+    if( skip ) {
+      std::array< uint8_t, 3u > temp;
+      const size_t decoded = decode_group( group, temp.data() );
+      const size_t copy = std::min( decoded - skip, size );
+      std::copy( temp.data() + skip, temp.data() + skip + copy, out );
+      out += copy;
+      size -= copy;
+      ++group;
+    }
+    const size_t full = size / 3u;
+    if( full ) {
+      decode_base64( begin + group * 4u, begin + ( group + full ) * 4u, out );
+      out += full * 3u;
+      size -= full * 3u;
+      group += full;
+    }
+    if( size ) {
+      std::array< uint8_t, 3u > temp;
+      decode_group( group, temp.data() );
+      std::copy( temp.data(), temp.data() + size, out );
+    }
+  }
+}
@@ -19,12 +19,28 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
-#include <iterator>
-#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
 #include <vw/buffer.h>
+#include <vw/uploader.h>
+#include <vw/parallel.h>
+#include <vw/mapped_file.h>
 #include <vw/command_buffer.h>
 #include <vw/exceptions.h>
 namespace vw {
+  namespace {
+    constexpr size_t staging_alignment = 16u;
+    void fill_region(
+      const buffer_region_t &region,
+      size_t offset,
+      size_t size,
+      uint8_t *out
+    ) {
+      if( region.fill ) region.fill( offset, size, out );
+      else std::copy( region.begin + offset, region.begin + offset + size, out );
+    }
+  }
   buffer_t get_buffer(
     const context_t &context,
     const vk::BufferCreateInfo &buffer_create_info,
@@ -114,60 +130,132 @@ namespace vw {
   }
   buffer_t load_buffer(
     const context_t &context,
-    const std::vector< uint8_t > &data,
+    const std::vector< buffer_region_t > &regions,
+    size_t size,
     vk::BufferUsageFlags usage
   ) {
     auto final_buffer = get_buffer(
       context,
       vk::BufferCreateInfo()
-        .setSize( data.size() )
+        .setSize( size )
         .setUsage( usage | vk::BufferUsageFlagBits::eTransferDst ),
       VMA_MEMORY_USAGE_GPU_ONLY
     );
-    auto temporary = create_staging_buffer( context, data.size() );
-    {
-      void* mapped_memory;
-      const auto result = vmaMapMemory( *context.allocator, *temporary.allocation, &mapped_memory );
-      if( result != VK_SUCCESS ) vk::throwResultException( vk::Result( result ), "バッファをマップできない" );
-      std::shared_ptr< uint8_t > mapped(
-        reinterpret_cast< uint8_t* >( mapped_memory ),
-        [allocator=context.allocator,allocation=temporary.allocation]( uint8_t *p ) {
-          if( p ) vmaUnmapMemory( *allocator, *allocation );
+    auto uploader = get_uploader( context, size );
+    // stageの途中で送出されることがあるので、コピーを積むたびにその送出が終わるまで転送先を保持させる
+    const auto destination = std::make_shared< buffer_t >( final_buffer );
+    const size_t capacity = uploader->get_capacity();
+    std::vector< size_t > region_size;
+    region_size.reserve( regions.size() );
+    for( const auto &region: regions ) {
+      region_size.push_back( region.fill ? region.size : size_t( std::distance( region.begin, region.end ) ) );
+      if( region.offset + region_size.back() > size ) throw invalid_argument( "転送先のバッファに収まらない" );
+    }
+    for( size_t head = 0u; head != regions.size(); ) {
+      const auto &region = regions[ head ];
+      if( region_size[ head ] > capacity ) {
+        for( size_t offset = 0u; offset != region_size[ head ]; ) {
+          const auto staging = uploader->stage( std::min( region_size[ head ] - offset, capacity ) );
+          fill_region( region, offset, staging.size, staging.data );
+          uploader->commit( staging );
+          uploader->get_commands()->copyBuffer(
+            staging.buffer,
+            *final_buffer.buffer,
+            {
+              vk::BufferCopy()
+                .setSrcOffset( staging.offset )
+                .setDstOffset( region.offset + offset )
+                .setSize( staging.size )
+            }
+          );
+          uploader->retain( destination );
+          offset += staging.size;
         }
-      );
-      std::copy( data.begin(), data.end(), mapped.get() );
+        ++head;
+        continue;
+      }
+      // ステージングバッファに収まる分の領域をまとめて確保し、並列に生成してから1回のコピーで転送する
+      std::vector< size_t > placement;
+      size_t tail = head;
+      size_t total = 0u;
+      while( tail != regions.size() && region_size[ tail ] <= capacity ) {
+        const size_t aligned = ( ( total + staging_alignment - 1u ) / staging_alignment ) * staging_alignment;
+        if( aligned + region_size[ tail ] > capacity ) break;
+        placement.push_back( aligned );
+        total = aligned + region_size[ tail ];
+        ++tail;
+      }
+      if( total != 0u ) {
+        const auto staging = uploader->stage( total );
+        // 各領域の生成は互いに独立しているので並列に行う
+        parallel_for( tail - head, [&]( size_t i ) {
+          fill_region( regions[ head + i ], 0u, region_size[ head + i ], staging.data + placement[ i ] );
+        } );
+        uploader->commit( staging );
+        std::vector< vk::BufferCopy > copies;
+        for( size_t i = head; i != tail; ++i )
+          if( region_size[ i ] )
+            copies.push_back(
+              vk::BufferCopy()
+                .setSrcOffset( staging.offset + placement[ i - head ] )
+                .setDstOffset( regions[ i ].offset )
+                .setSize( region_size[ i ] )
+            );
+        uploader->get_commands()->copyBuffer( staging.buffer, *final_buffer.buffer, copies );
+        uploader->retain( destination );
+      }
+      head = tail;
     }
-    auto commands = get_command_buffer( context, true );
-    commands->begin(
-      vk::CommandBufferBeginInfo()
-        .setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+    uploader->release_buffer( final_buffer );
+    uploader->retain( destination );
+    finish_upload( *uploader );
+    return final_buffer;
+  }
+  buffer_t load_buffer(
+    const context_t &context,
+    const uint8_t *begin,
+    const uint8_t *end,
+    vk::BufferUsageFlags usage
+  ) {
+    return load_buffer(
+      context,
+      std::vector< buffer_region_t >{
+        buffer_region_t()
+          .set_begin( begin )
+          .set_end( end )
+      },
+      std::distance( begin, end ),
+      usage
     );
-    transfer_buffer_internal( commands, temporary, final_buffer );
-    commands->end();
-    auto graphics_queue = context.device->getQueue( context.graphics_queue_index, 0 );
-    graphics_queue.submit(
-    vk::SubmitInfo()
-      .setCommandBufferCount( 1 )
-      .setPCommandBuffers( &*commands ),
-      vk::Fence()
+  }
+  buffer_t load_buffer(
+    const context_t &context,
+    const std::vector< uint8_t > &data,
+    vk::BufferUsageFlags usage
+  ) {
+    return load_buffer(
+      context,
+      data.data(),
+      data.data() + data.size(),
+      usage
     );
-    graphics_queue.waitIdle();
-    return final_buffer;
   }
   buffer_t load_buffer_from_file(
     const context_t &context,
     const std::string &filename,
     vk::BufferUsageFlags usage
   ) {
-    std::ifstream file( filename, std::ios::in | std::ios::binary );
-    std::vector< uint8_t > data(
-      ( std::istreambuf_iterator< char >( file ) ),
-      std::istreambuf_iterator< char >()
-    );
-    return load_buffer(
+    const auto begin_time = std::chrono::high_resolution_clock::now();
+    const auto file = map_file( filename );
+    auto buffer = load_buffer(
       context,
-      data,
+      file.begin(),
+      file.end(),
       usage
     );
+    const auto end_time = std::chrono::high_resolution_clock::now();
+    const double elapsed = std::chrono::duration_cast< std::chrono::duration< double > >( end_time - begin_time ).count();
+    std::cout << filename << " " << file.size << "バイトを " << ( elapsed > 0.0 ? double( file.size ) / elapsed / 1.0e9 : 0.0 ) << "GB/s で転送" << std::endl;
+    return buffer;
   }
 }
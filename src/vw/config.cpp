@@ -38,6 +38,15 @@ namespace vw {
     bool purple = false;
     bool light = false;
     int shader_mask = 0;
+    std::string vertex_layout;
+    bool quantize = false;
+    bool optimize = false;
+    unsigned int lod_levels = 0u;
+    bool meshlet = false;
+    float impostor_distance = 0.f;
+    bool hlod = false;
+    std::string cache;
+    std::string json_parser;
     desc.add_options()
       ( "help,h", "show this message" )
       ( "list,l", "show all available devices" )
@@ -50,6 +59,15 @@ namespace vw {
       ( "shader,s", po::value< std::string >(&shader)->default_value( "../shaders/" ), "shader dir" )
       ( "shader_mask,m", po::value< int >(&shader_mask)->default_value( 0 ), "shader mask" )
       ( "light,g", po::bool_switch(&light), "render from light space" )
+      ( "vertex_layout", po::value< std::string >(&vertex_layout)->default_value( "separate" ), "vertex layout (separate|interleaved|split_position)" )
+      ( "quantize,q", po::bool_switch(&quantize), "quantize vertex attributes" )
+      ( "optimize,o", po::bool_switch(&optimize), "optimize index and vertex order" )
+      ( "lod", po::value< unsigned int >(&lod_levels)->default_value( 0u ), "number of generated LOD levels" )
+      ( "meshlet", po::bool_switch(&meshlet), "split primitives into meshlets for cluster culling" )
+      ( "impostor", po::value< float >(&impostor_distance)->default_value( 0.f ), "draw meshes farther than this distance as impostors" )
+      ( "hlod", po::bool_switch(&hlod), "merge spatially clustered nodes into simplified proxy meshes" )
+      ( "cache", po::value< std::string >(&cache)->default_value( "" ), "directory to store processed scenes and decoded images" )
+      ( "json_parser", po::value< std::string >(&json_parser)->default_value( "dom" ), "glTF JSON parser (dom|lean)" )
       ( "input,i", po::value< std::string >(&input)->default_value( "hoge.gltf" ), "glTF file path" );
     po::variables_map vm;
     po::store( po::parse_command_line( argc, argv, desc ), vm );
@@ -92,7 +110,16 @@ namespace vw {
         .set_purple( purple )
         .set_light( light )
         .set_shader( std::move( shader ) )
-        .set_shader_mask( shader_mask );
+        .set_shader_mask( shader_mask )
+        .set_vertex_layout( std::move( vertex_layout ) )
+        .set_quantize( quantize )
+        .set_optimize( optimize )
+        .set_lod_levels( lod_levels )
+        .set_meshlet( meshlet )
+        .set_impostor_distance( impostor_distance )
+        .set_hlod( hlod )
+        .set_cache( std::move( cache ) )
+        .set_json_parser( std::move( json_parser ) );
     }
     else {
       return configs_t()
@@ -108,7 +135,16 @@ namespace vw {
         .set_input( std::move( input ) )
         .set_purple( purple )
         .set_shader( std::move( shader ) )
-        .set_shader_mask( shader_mask );
+        .set_shader_mask( shader_mask )
+        .set_vertex_layout( std::move( vertex_layout ) )
+        .set_quantize( quantize )
+        .set_optimize( optimize )
+        .set_lod_levels( lod_levels )
+        .set_meshlet( meshlet )
+        .set_impostor_distance( impostor_distance )
+        .set_hlod( hlod )
+        .set_cache( std::move( cache ) )
+        .set_json_parser( std::move( json_parser ) );
     }
   }
 }
@@ -20,6 +20,7 @@
  * IN THE SOFTWARE.
  */
 #include <string>
+#include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <iostream>
@@ -29,6 +30,9 @@
 #include <vulkan/vulkan.hpp>
 #include <vw/config.h>
 #include <vw/context.h>
+#include <vw/uploader.h>
+#include <vw/converter.h>
+#include <vw/to_size.h>
 #include <vw/exceptions.h>
 #include <vw/glfw.h>
 namespace vw {
@@ -188,6 +192,18 @@ namespace vw {
       std::cerr << "必要なキューが備わっていない " << std::endl;
       throw unable_to_create_surface{};
     }
+    // 転送専用のキューがあれば転送に使う。転送の粒度が1でないキューは任意の位置への転送ができないので使わない
+    const auto transfer_queue = std::find_if( queue_props.begin(), queue_props.end(), []( const auto &v ) {
+      return
+        bool( v.queueFlags & vk::QueueFlagBits::eTransfer ) &&
+        !( v.queueFlags & ( vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute ) ) &&
+        v.minImageTransferGranularity == vk::Extent3D( 1, 1, 1 );
+    } );
+    context.set_transfer_queue_index(
+      transfer_queue != queue_props.end() ?
+      uint32_t( std::distance( queue_props.begin(), transfer_queue ) ) :
+      context.graphics_queue_index
+    );
     const float priority = 0.0f;
     std::vector< vk::DeviceQueueCreateInfo > queues{
       vk::DeviceQueueCreateInfo()
@@ -199,6 +215,12 @@ namespace vw {
           .setQueueFamilyIndex( context.present_queue_index ).setQueueCount( 1 ).setPQueuePriorities( &priority )
       );
     }
+    if ( context.transfer_queue_index != context.graphics_queue_index && context.transfer_queue_index != context.present_queue_index ) {
+      queues.emplace_back(
+        vk::DeviceQueueCreateInfo()
+          .setQueueFamilyIndex( context.transfer_queue_index ).setQueueCount( 1 ).setPQueuePriorities( &priority )
+      );
+    }
     const auto features = context.physical_device.getFeatures();
     context.set_device( context.physical_device.createDeviceUnique(
       vk::DeviceCreateInfo()
@@ -220,6 +242,11 @@ namespace vw {
         .setQueueFamilyIndex( context.present_queue_index )
         .setFlags( vk::CommandPoolCreateFlagBits::eResetCommandBuffer )
     ) );
+    context.set_transfer_command_pool( context.device->createCommandPoolUnique(
+      vk::CommandPoolCreateInfo()
+        .setQueueFamilyIndex( context.transfer_queue_index )
+        .setFlags( vk::CommandPoolCreateFlagBits::eResetCommandBuffer )
+    ) );
   }
 
   void create_swapchain(
@@ -343,10 +370,33 @@ namespace vw {
     );
   }
 
-  void create_pipeline_cache(
+  void create_format_support(
     context_t &context
   ) {
-    context.set_pipeline_cache( context.device->createPipelineCacheUnique( vk::PipelineCacheCreateInfo() ) );
+    using component_t = fx::gltf::Accessor::ComponentType;
+    using type_t = fx::gltf::Accessor::Type;
+    std::vector< vk::Format > candidates{
+      vk::Format::eR32Sfloat,
+      vk::Format::eR32G32Sfloat,
+      vk::Format::eR32G32B32Sfloat,
+      vk::Format::eR32G32B32A32Sfloat
+    };
+    for( const auto component: { component_t::Byte, component_t::UnsignedByte, component_t::Short, component_t::UnsignedShort } )
+      for( const auto type: { type_t::Scalar, type_t::Vec2, type_t::Vec3, type_t::Vec4 } )
+        for( const bool normalized: { false, true } )
+          candidates.push_back( to_vulkan_format( component, type, normalized ) );
+    std::vector< vk::Format > supported;
+    for( const auto format: candidates )
+      if( context.physical_device.getFormatProperties( format ).bufferFeatures & vk::FormatFeatureFlagBits::eVertexBuffer )
+        supported.push_back( format );
+    std::sort( supported.begin(), supported.end() );
+    context.set_vertex_buffer_formats( std::move( supported ) );
+  }
+  bool is_vertex_buffer_format_supported(
+    const context_t &context,
+    vk::Format format
+  ) {
+    return std::binary_search( context.vertex_buffer_formats.begin(), context.vertex_buffer_formats.end(), format );
   }
 
   context_t create_context(
@@ -363,7 +413,11 @@ namespace vw {
     create_swapchain( context );
     create_descriptor_set( context, descriptor_pool_size, descriptor_set_layout_bindings );
     create_allocator( context );
-    create_pipeline_cache( context );
+    create_pipeline_cache( context, configs.cache );
+    create_pipeline_registry( context );
+    create_format_support( context );
+    create_converter( context, configs.shader );
+    create_uploader( context );
     return context;
   }
 }
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <system_error>
+#include <vw/converter.h>
+#include <vw/uploader.h>
+#include <vw/shader.h>
+#include <vw/exceptions.h>
+namespace vw {
+  namespace {
+    // convert.compのlocal_size_x
+    constexpr uint32_t conversion_group_size = 64u;
+    constexpr uint32_t max_conversion_sets = 64u;
+    struct conversion_push_constants_t {
+      uint32_t source_offset;
+      uint32_t source_stride;
+      uint32_t size;
+      uint32_t offset;
+      uint32_t stride;
+      uint32_t count;
+      // このディスパッチで書き始める32bit単位の位置
+      uint32_t first;
+      uint32_t fill;
+    };
+  }
+  converter_t::converter_t(
+    const context_t &context,
+    const std::string &filename
+  ) :
+    device( *context.device ),
+    max_group_count( 0u ),
+    max_range( 0u ),
+    guard( new std::mutex() ) {
+    const auto limits = context.physical_device.getProperties().limits;
+    max_group_count = limits.maxComputeWorkGroupCount[ 0 ];
+    max_range = limits.maxStorageBufferRange;
+    shader = get_shader( context, filename );
+    const std::vector< vk::DescriptorSetLayoutBinding > bindings{
+      vk::DescriptorSetLayoutBinding()
+        .setBinding( 0 )
+        .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+        .setDescriptorCount( 1 )
+        .setStageFlags( vk::ShaderStageFlagBits::eCompute ),
+      vk::DescriptorSetLayoutBinding()
+        .setBinding( 1 )
+        .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+        .setDescriptorCount( 1 )
+        .setStageFlags( vk::ShaderStageFlagBits::eCompute )
+    };
+    descriptor_set_layout = device.createDescriptorSetLayoutUnique(
+      vk::DescriptorSetLayoutCreateInfo()
+        .setBindingCount( bindings.size() )
+        .setPBindings( bindings.data() )
+    );
+    const auto push_constant_range = vk::PushConstantRange()
+      .setStageFlags( vk::ShaderStageFlagBits::eCompute )
+      .setOffset( 0 )
+      .setSize( sizeof( conversion_push_constants_t ) );
+    pipeline_layout = device.createPipelineLayoutUnique(
+      vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount( 1 )
+        .setPSetLayouts( &*descriptor_set_layout )
+        .setPushConstantRangeCount( 1 )
+        .setPPushConstantRanges( &push_constant_range )
+    );
+    auto raw_pipeline = device.createComputePipeline(
+      *context.pipeline_cache,
+      vk::ComputePipelineCreateInfo()
+        .setStage(
+          vk::PipelineShaderStageCreateInfo()
+            .setStage( vk::ShaderStageFlagBits::eCompute )
+            .setModule( *shader )
+            .setPName( "main" )
+        )
+        .setLayout( *pipeline_layout )
+    );
+    if( raw_pipeline.result != vk::Result::eSuccess )
+      vk::throwResultException( raw_pipeline.result, "変換のパイプラインを作成できない" );
+    vk::ObjectDestroy< vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > deleter( device, nullptr, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE () );
+    pipeline = vk::UniqueHandle< vk::Pipeline, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE >( raw_pipeline.value, deleter );
+    const auto pool_size = vk::DescriptorPoolSize()
+      .setType( vk::DescriptorType::eStorageBuffer )
+      .setDescriptorCount( max_conversion_sets * 2u );
+    descriptor_pool = device.createDescriptorPoolUnique(
+      vk::DescriptorPoolCreateInfo()
+        .setPoolSizeCount( 1 )
+        .setPPoolSizes( &pool_size )
+        .setMaxSets( max_conversion_sets )
+        .setFlags( vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet )
+    );
+  }
+  void converter_t::convert(
+    uploader_t &uploader,
+    const buffer_t &source,
+    const buffer_t &destination,
+    const std::vector< buffer_conversion_t > &conversions
+  ) {
+    if( conversions.empty() ) return;
+    if( source.size > max_range || destination.size > max_range ) throw invalid_argument( "バッファがディスクリプタで指せる大きさを超えている", __FILE__, __LINE__ );
+    for( const auto &conversion: conversions ) {
+      if( conversion.offset % 4u || conversion.size > conversion.stride ) throw invalid_argument( "変換の配置が不正", __FILE__, __LINE__ );
+      if( conversion.count && conversion.source_offset + conversion.source_stride * ( conversion.count - 1u ) + conversion.size > source.size ) throw invalid_argument( "変換元がsourceの範囲を超えている", __FILE__, __LINE__ );
+      if( conversion.offset + ( conversion.stride * conversion.count + 3u ) / 4u * 4u > destination.size ) throw invalid_argument( "変換先がdestinationの範囲を超えている", __FILE__, __LINE__ );
+    }
+    const auto allocate_info = vk::DescriptorSetAllocateInfo()
+      .setDescriptorPool( *descriptor_pool )
+      .setDescriptorSetCount( 1 )
+      .setPSetLayouts( &*descriptor_set_layout );
+    vk::DescriptorSet raw_descriptor_set;
+    try {
+      std::scoped_lock< std::mutex > lock( *guard );
+      raw_descriptor_set = device.allocateDescriptorSets( allocate_info ).front();
+    }
+    catch( const vk::OutOfPoolMemoryError& ) {
+      // 完了していない変換のディスクリプタで埋まっている場合は転送の完了を待って空ける
+      uploader.flush( true );
+      std::scoped_lock< std::mutex > lock( *guard );
+      raw_descriptor_set = device.allocateDescriptorSets( allocate_info ).front();
+    }
+    const std::shared_ptr< vk::DescriptorSet > descriptor_set(
+      new vk::DescriptorSet( raw_descriptor_set ),
+      [device=device,pool=*descriptor_pool,guard=guard]( vk::DescriptorSet *p ) {
+        if( p ) {
+          {
+            std::scoped_lock< std::mutex > lock( *guard );
+            static_cast< void >( device.freeDescriptorSets( pool, 1u, p ) );
+          }
+          delete p;
+        }
+      }
+    );
+    const auto source_info = vk::DescriptorBufferInfo()
+      .setBuffer( *source.buffer )
+      .setOffset( 0u )
+      .setRange( source.size );
+    const auto destination_info = vk::DescriptorBufferInfo()
+      .setBuffer( *destination.buffer )
+      .setOffset( 0u )
+      .setRange( destination.size );
+    device.updateDescriptorSets(
+      std::vector< vk::WriteDescriptorSet >{
+        vk::WriteDescriptorSet()
+          .setDstSet( *descriptor_set )
+          .setDstBinding( 0 )
+          .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+          .setDescriptorCount( 1 )
+          .setPBufferInfo( &source_info ),
+        vk::WriteDescriptorSet()
+          .setDstSet( *descriptor_set )
+          .setDstBinding( 1 )
+          .setDescriptorType( vk::DescriptorType::eStorageBuffer )
+          .setDescriptorCount( 1 )
+          .setPBufferInfo( &destination_info )
+      },
+      nullptr
+    );
+    auto &commands = uploader.get_graphics_commands();
+    // submitの最後のバリアはこのディスパッチより後に積まれるので、同じコマンドバッファ内のコピーはここで待つ
+    // 専用の転送キューから所有権を移した場合もその後に続けて待つ
+    commands->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer|vk::PipelineStageFlagBits::eVertexInput|vk::PipelineStageFlagBits::eVertexShader|vk::PipelineStageFlagBits::eFragmentShader,
+      vk::PipelineStageFlagBits::eComputeShader,
+      vk::DependencyFlagBits( 0 ),
+      {
+        vk::MemoryBarrier()
+          .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+          .setDstAccessMask( vk::AccessFlagBits::eShaderRead|vk::AccessFlagBits::eShaderWrite )
+      },
+      {},
+      {}
+    );
+    commands->bindPipeline( vk::PipelineBindPoint::eCompute, *pipeline );
+    commands->bindDescriptorSets( vk::PipelineBindPoint::eCompute, *pipeline_layout, 0u, { *descriptor_set }, {} );
+    for( const auto &conversion: conversions ) {
+      const size_t words = ( conversion.stride * conversion.count + 3u ) / 4u;
+      for( size_t first = 0u; first < words; ) {
+        const size_t groups = std::min( ( words - first + conversion_group_size - 1u ) / conversion_group_size, size_t( max_group_count ) );
+        const conversion_push_constants_t push_constants{
+          uint32_t( conversion.source_offset ),
+          uint32_t( conversion.source_stride ),
+          uint32_t( conversion.size ),
+          uint32_t( conversion.offset ),
+          uint32_t( conversion.stride ),
+          uint32_t( conversion.count ),
+          uint32_t( first ),
+          uint32_t( conversion.fill )
+        };
+        commands->pushConstants( *pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0u, sizeof( conversion_push_constants_t ), &push_constants );
+        commands->dispatch( uint32_t( groups ), 1u, 1u );
+        first += groups * conversion_group_size;
+      }
+    }
+    commands->pipelineBarrier(
+      vk::PipelineStageFlagBits::eComputeShader,
+      vk::PipelineStageFlagBits::eVertexInput|vk::PipelineStageFlagBits::eVertexShader|vk::PipelineStageFlagBits::eFragmentShader|vk::PipelineStageFlagBits::eComputeShader,
+      vk::DependencyFlagBits( 0 ),
+      {
+        vk::MemoryBarrier()
+          .setSrcAccessMask( vk::AccessFlagBits::eShaderWrite )
+          .setDstAccessMask(
+            vk::AccessFlagBits::eVertexAttributeRead|
+            vk::AccessFlagBits::eIndexRead|
+            vk::AccessFlagBits::eShaderRead
+          )
+      },
+      {},
+      {}
+    );
+    uploader.retain( descriptor_set );
+    uploader.retain( std::make_shared< buffer_t >( source ) );
+    uploader.retain( std::make_shared< buffer_t >( destination ) );
+  }
+  void create_converter(
+    context_t &context,
+    const std::string &shader_dir
+  ) {
+    // シェーダが無い場合とグラフィクスキューでコンピュートシェーダを使えない場合は変換をCPUで行う
+    std::error_code error;
+    const auto filename = std::filesystem::path( shader_dir ) / std::filesystem::path( "convert.comp.spv" );
+    if( !std::filesystem::exists( filename, error ) ) {
+      std::cerr << filename.string() << " が無いため頂点属性の変換をCPUで行う" << std::endl;
+      return;
+    }
+    const auto queue_props = context.physical_device.getQueueFamilyProperties();
+    if( queue_props.size() <= context.graphics_queue_index || !( queue_props[ context.graphics_queue_index ].queueFlags & vk::QueueFlagBits::eCompute ) ) {
+      std::cerr << "グラフィクスキューでコンピュートシェーダが使えないため頂点属性の変換をCPUで行う" << std::endl;
+      return;
+    }
+    context.set_converter( std::make_shared< converter_t >( context, filename.string() ) );
+  }
+  void convert_buffer(
+    const context_t &context,
+    const buffer_t &source,
+    const buffer_t &destination,
+    const std::vector< buffer_conversion_t > &conversions
+  ) {
+    if( !context.converter ) throw invalid_argument( "コンピュートシェーダによる変換が使えない", __FILE__, __LINE__ );
+    auto uploader = get_uploader( context, 0u );
+    context.converter->convert( *uploader, source, destination, conversions );
+    finish_upload( *uploader );
+  }
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <algorithm>
+#include <vw/decode_queue.h>
+namespace vw {
+  struct decode_queue_t::state_t {
+    struct item_t {
+      size_t index;
+      pixels_t pixels;
+      std::exception_ptr error;
+    };
+    std::vector< job_t > jobs;
+    size_t memory_limit;
+    std::mutex guard;
+    std::condition_variable memory_available;
+    std::condition_variable item_available;
+    size_t next = 0u;
+    size_t popped = 0u;
+    size_t in_flight = 0u;
+    bool stop = false;
+    std::deque< item_t > completed;
+  };
+  namespace {
+    std::shared_ptr< void > reserve_memory(
+      const std::shared_ptr< decode_queue_t::state_t > &state,
+      size_t size
+    );
+  }
+  decode_queue_t::decode_queue_t(
+    std::vector< job_t > &&jobs,
+    size_t thread_count,
+    size_t memory_limit
+  ) : state( new state_t() ) {
+    state->jobs = std::move( jobs );
+    state->memory_limit = memory_limit;
+    thread_count = std::min( std::max( thread_count, size_t( 1u ) ), state->jobs.size() );
+    for( size_t i = 0u; i != thread_count; ++i ) {
+      threads.emplace_back( [state=state]() {
+        const reserve_t reserve = [state]( size_t size ) { return reserve_memory( state, size ); };
+        while( true ) {
+          size_t index;
+          {
+            std::lock_guard< std::mutex > lock( state->guard );
+            if( state->stop || state->next == state->jobs.size() ) return;
+            index = state->next++;
+          }
+          state_t::item_t item;
+          item.index = index;
+          try {
+            item.pixels = state->jobs[ index ]( reserve );
+          }
+          catch( ... ) {
+            item.error = std::current_exception();
+          }
+          {
+            std::lock_guard< std::mutex > lock( state->guard );
+            state->completed.push_back( std::move( item ) );
+          }
+          state->item_available.notify_one();
+        }
+      } );
+    }
+  }
+  decode_queue_t::~decode_queue_t() {
+    {
+      std::lock_guard< std::mutex > lock( state->guard );
+      state->stop = true;
+    }
+    state->memory_available.notify_all();
+    for( auto &t: threads ) t.join();
+  }
+  namespace {
+    std::shared_ptr< void > reserve_memory(
+      const std::shared_ptr< decode_queue_t::state_t > &state,
+      size_t size
+    ) {
+      std::unique_lock< std::mutex > lock( state->guard );
+      state->memory_available.wait( lock, [&]() {
+        return state->stop || state->in_flight == 0u || state->in_flight + size <= state->memory_limit;
+      } );
+      state->in_flight += size;
+      return std::shared_ptr< void >(
+        static_cast< void* >( nullptr ),
+        [state,size]( void* ) {
+          {
+            std::lock_guard< std::mutex > lock( state->guard );
+            state->in_flight -= size;
+          }
+          state->memory_available.notify_all();
+        }
+      );
+    }
+    std::optional< std::pair< size_t, pixels_t > > take(
+      decode_queue_t::state_t &state
+    ) {
+      auto item = std::move( state.completed.front() );
+      state.completed.pop_front();
+      ++state.popped;
+      if( item.error ) std::rethrow_exception( item.error );
+      return std::make_pair( item.index, std::move( item.pixels ) );
+    }
+  }
+  std::optional< std::pair< size_t, pixels_t > > decode_queue_t::pop() {
+    std::unique_lock< std::mutex > lock( state->guard );
+    state->item_available.wait( lock, [&]() {
+      return !state->completed.empty() || state->popped == state->jobs.size();
+    } );
+    if( state->completed.empty() ) return std::nullopt;
+    return take( *state );
+  }
+  std::optional< std::pair< size_t, pixels_t > > decode_queue_t::try_pop() {
+    std::lock_guard< std::mutex > lock( state->guard );
+    if( state->completed.empty() ) return std::nullopt;
+    return take( *state );
+  }
+  bool decode_queue_t::done() const {
+    std::lock_guard< std::mutex > lock( state->guard );
+    return state->popped == state->jobs.size();
+  }
+  size_t decode_queue_t::size() const {
+    return state->jobs.size();
+  }
+}
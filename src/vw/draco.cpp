@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <array>
+#include <cstring>
+#ifdef HAVE_DRACO
+#include <draco/compression/decode.h>
+#include <draco/mesh/mesh.h>
+#endif
+#include <vw/draco.h>
+#include <vw/exceptions.h>
+namespace vw {
+#ifdef HAVE_DRACO
+  struct draco_mesh_t {
+    std::unique_ptr< draco::Mesh > mesh;
+  };
+  namespace {
+    template< typename T >
+    void copy_attribute(
+      const draco::PointAttribute &attribute,
+      uint32_t components,
+      size_t stride,
+      size_t first,
+      size_t count,
+      uint8_t *out
+    ) {
+      std::array< T, 4u > value;
+      for( size_t i = 0u; i != count; ++i ) {
+        const auto index = attribute.mapped_index( draco::PointIndex( uint32_t( first + i ) ) );
+        if( !attribute.ConvertValue< T >( index, int8_t( components ), value.data() ) )
+          throw invalid_compressed_data( "Dracoの頂点属性を変換できない", __FILE__, __LINE__ );
+        std::memcpy( out + i * stride, value.data(), sizeof( T ) * components );
+      }
+    }
+  }
+#else
+  struct draco_mesh_t {};
+#endif
+  bool is_draco_available() {
+#ifdef HAVE_DRACO
+    return true;
+#else
+    return false;
+#endif
+  }
+  std::shared_ptr< draco_mesh_t > decode_draco(
+    [[maybe_unused]] const uint8_t *begin,
+    [[maybe_unused]] const uint8_t *end
+  ) {
+#ifdef HAVE_DRACO
+    draco::DecoderBuffer buffer;
+    buffer.Init( reinterpret_cast< const char* >( begin ), size_t( end - begin ) );
+    draco::Decoder decoder;
+    auto decoded = decoder.DecodeMeshFromBuffer( &buffer );
+    if( !decoded.ok() ) throw invalid_compressed_data( decoded.status().error_msg(), __FILE__, __LINE__ );
+    auto mesh = std::make_shared< draco_mesh_t >();
+    mesh->mesh = std::move( decoded ).value();
+    return mesh;
+#else
+    throw invalid_compressed_data( "Dracoを使わずにビルドされている", __FILE__, __LINE__ );
+#endif
+  }
+  size_t get_point_count( [[maybe_unused]] const draco_mesh_t &mesh ) {
+#ifdef HAVE_DRACO
+    return mesh.mesh->num_points();
+#else
+    return 0u;
+#endif
+  }
+  size_t get_index_count( [[maybe_unused]] const draco_mesh_t &mesh ) {
+#ifdef HAVE_DRACO
+    return size_t( mesh.mesh->num_faces() ) * 3u;
+#else
+    return 0u;
+#endif
+  }
+  void copy_draco_attribute(
+    [[maybe_unused]] const draco_mesh_t &mesh,
+    [[maybe_unused]] uint32_t unique_id,
+    [[maybe_unused]] fx::gltf::Accessor::ComponentType type,
+    [[maybe_unused]] uint32_t components,
+    [[maybe_unused]] size_t stride,
+    [[maybe_unused]] size_t first,
+    [[maybe_unused]] size_t count,
+    [[maybe_unused]] uint8_t *out
+  ) {
+#ifdef HAVE_DRACO
+    const auto attribute = mesh.mesh->GetAttributeByUniqueId( unique_id );
+    if( !attribute ) throw invalid_compressed_data( "参照されたDracoの頂点属性が存在しない", __FILE__, __LINE__ );
+    if( components == 0u || components > 4u ) throw invalid_argument( "頂点属性の要素数は1から4", __FILE__, __LINE__ );
+    if( first + count > get_point_count( mesh ) ) throw invalid_compressed_data( "Dracoの頂点が足りない", __FILE__, __LINE__ );
+    using component_t = fx::gltf::Accessor::ComponentType;
+    if( type == component_t::Byte ) copy_attribute< int8_t >( *attribute, components, stride, first, count, out );
+    else if( type == component_t::UnsignedByte ) copy_attribute< uint8_t >( *attribute, components, stride, first, count, out );
+    else if( type == component_t::Short ) copy_attribute< int16_t >( *attribute, components, stride, first, count, out );
+    else if( type == component_t::UnsignedShort ) copy_attribute< uint16_t >( *attribute, components, stride, first, count, out );
+    else if( type == component_t::UnsignedInt ) copy_attribute< uint32_t >( *attribute, components, stride, first, count, out );
+    else if( type == component_t::Float ) copy_attribute< float >( *attribute, components, stride, first, count, out );
+    else throw invalid_argument( "未対応の頂点属性の型", __FILE__, __LINE__ );
+#else
+    throw invalid_compressed_data( "Dracoを使わずにビルドされている", __FILE__, __LINE__ );
+#endif
+  }
+  void copy_draco_indices(
+    [[maybe_unused]] const draco_mesh_t &mesh,
+    [[maybe_unused]] size_t index_size,
+    [[maybe_unused]] size_t first,
+    [[maybe_unused]] size_t count,
+    [[maybe_unused]] uint8_t *out
+  ) {
+#ifdef HAVE_DRACO
+    if( first + count > get_index_count( mesh ) ) throw invalid_compressed_data( "Dracoのインデックスが足りない", __FILE__, __LINE__ );
+    for( size_t i = 0u; i != count; ++i ) {
+      const uint32_t value = mesh.mesh->face( draco::FaceIndex( uint32_t( ( first + i ) / 3u ) ) )[ ( first + i ) % 3u ].value();
+      if( index_size == 1u ) out[ i ] = uint8_t( value );
+      else if( index_size == 2u ) {
+        const uint16_t narrow = uint16_t( value );
+        std::memcpy( out + i * 2u, &narrow, 2u );
+      }
+      else std::memcpy( out + i * 4u, &value, 4u );
+    }
+#else
+    throw invalid_compressed_data( "Dracoを使わずにビルドされている", __FILE__, __LINE__ );
+#endif
+  }
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <algorithm>
+#include <iterator>
+#include <cerrno>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+#include <vw/file_reader.h>
+#include <vw/exceptions.h>
+namespace vw {
+  struct file_reader_t::state_t {
+    struct file_t {
+      file_t() : fd( -1 ), size( 0 ), remaining( 0 ) {}
+      ~file_t() {
+        if( fd >= 0 ) close( fd );
+      }
+      std::string filename;
+      int fd;
+      std::shared_ptr< uint8_t > data;
+      size_t size;
+      size_t remaining;
+      std::exception_ptr error;
+      std::promise< mapped_file_t > promise;
+    };
+    struct chunk_t {
+      std::shared_ptr< file_t > file;
+      size_t file_offset;
+      size_t offset;
+      size_t size;
+      struct iovec iov;
+    };
+    size_t queue_depth = 1u;
+    std::mutex guard;
+    std::condition_variable chunk_available;
+    std::deque< std::unique_ptr< chunk_t > > pending;
+    size_t in_flight = 0u;
+    bool stop = false;
+    bool uring = false;
+#ifdef HAVE_LIBURING
+    io_uring ring;
+#endif
+  };
+  namespace {
+    constexpr size_t read_chunk_size = 1024u * 1024u;
+    // state_t::guardを確保した状態で呼ぶ
+    void complete_chunk(
+      file_reader_t::state_t::chunk_t &chunk,
+      std::exception_ptr error
+    ) {
+      auto &file = *chunk.file;
+      if( error && !file.error ) file.error = error;
+      if( --file.remaining ) return;
+      close( file.fd );
+      file.fd = -1;
+      if( file.error ) file.promise.set_exception( file.error );
+      else file.promise.set_value( mapped_file_t().set_data( file.data ).set_size( file.size ) );
+    }
+    void read_chunks(
+      const std::shared_ptr< file_reader_t::state_t > &state
+    ) {
+      while( true ) {
+        std::unique_ptr< file_reader_t::state_t::chunk_t > chunk;
+        {
+          std::unique_lock< std::mutex > lock( state->guard );
+          state->chunk_available.wait( lock, [&]() { return state->stop || !state->pending.empty(); } );
+          if( state->stop ) return;
+          chunk = std::move( state->pending.front() );
+          state->pending.pop_front();
+        }
+        std::exception_ptr error;
+        for( size_t done = 0u; done != chunk->size; ) {
+          const auto result = pread( chunk->file->fd, chunk->file->data.get() + chunk->offset + done, chunk->size - done, chunk->file_offset + done );
+          if( result < 0 && errno == EINTR ) continue;
+          if( result <= 0 ) {
+            error = std::make_exception_ptr( unable_to_load_file( chunk->file->filename ) );
+            break;
+          }
+          done += size_t( result );
+        }
+        std::lock_guard< std::mutex > lock( state->guard );
+        complete_chunk( *chunk, error );
+      }
+    }
+#ifdef HAVE_LIBURING
+    // state_t::guardを確保した状態で呼ぶ
+    void submit_pending(
+      file_reader_t::state_t &state
+    ) {
+      if( state.stop ) state.pending.clear();
+      bool submitted = false;
+      while( !state.pending.empty() && state.in_flight < state.queue_depth ) {
+        auto sqe = io_uring_get_sqe( &state.ring );
+        if( !sqe ) break;
+        auto chunk = state.pending.front().release();
+        state.pending.pop_front();
+        chunk->iov.iov_base = chunk->file->data.get() + chunk->offset;
+        chunk->iov.iov_len = chunk->size;
+        io_uring_prep_readv( sqe, chunk->file->fd, &chunk->iov, 1, chunk->file_offset );
+        io_uring_sqe_set_data( sqe, chunk );
+        ++state.in_flight;
+        submitted = true;
+      }
+      if( submitted ) io_uring_submit( &state.ring );
+    }
+    void complete_uring(
+      const std::shared_ptr< file_reader_t::state_t > &state
+    ) {
+      while( true ) {
+        io_uring_cqe *cqe = nullptr;
+        const int wait_result = io_uring_wait_cqe( &state->ring, &cqe );
+        if( wait_result == -EINTR ) continue;
+        if( wait_result < 0 ) return;
+        std::unique_ptr< file_reader_t::state_t::chunk_t > chunk(
+          static_cast< file_reader_t::state_t::chunk_t* >( io_uring_cqe_get_data( cqe ) )
+        );
+        const int result = cqe->res;
+        io_uring_cqe_seen( &state->ring, cqe );
+        std::lock_guard< std::mutex > lock( state->guard );
+        --state->in_flight;
+        // user_dataが無いのはデストラクタが起こす為のNOP
+        if( chunk ) {
+          if( result == -EINTR || result == -EAGAIN )
+            state->pending.push_front( std::move( chunk ) );
+          else if( result <= 0 )
+            complete_chunk( *chunk, std::make_exception_ptr( unable_to_load_file( chunk->file->filename ) ) );
+          else if( size_t( result ) < chunk->size ) {
+            chunk->file_offset += size_t( result );
+            chunk->offset += size_t( result );
+            chunk->size -= size_t( result );
+            state->pending.push_front( std::move( chunk ) );
+          }
+          else complete_chunk( *chunk, std::exception_ptr() );
+        }
+        submit_pending( *state );
+        if( state->stop && state->in_flight == 0u ) return;
+      }
+    }
+#endif
+  }
+  file_reader_t::file_reader_t(
+    size_t queue_depth,
+    size_t thread_count
+  ) : state( new state_t() ) {
+    state->queue_depth = std::max( queue_depth, size_t( 1u ) );
+#ifdef HAVE_LIBURING
+    if( io_uring_queue_init( unsigned( state->queue_depth ), &state->ring, 0 ) == 0 ) {
+      state->uring = true;
+      threads.emplace_back( [state=state]() { complete_uring( state ); } );
+      return;
+    }
+#endif
+    thread_count = std::max( thread_count, size_t( 1u ) );
+    for( size_t i = 0u; i != thread_count; ++i )
+      threads.emplace_back( [state=state]() { read_chunks( state ); } );
+  }
+  file_reader_t::~file_reader_t() {
+    {
+      std::lock_guard< std::mutex > lock( state->guard );
+      state->stop = true;
+      state->pending.clear();
+#ifdef HAVE_LIBURING
+      if( state->uring ) {
+        // 投入キューが埋まっている場合は投入して空きを作ってからNOPを積む
+        auto sqe = io_uring_get_sqe( &state->ring );
+        while( !sqe ) {
+          io_uring_submit( &state->ring );
+          sqe = io_uring_get_sqe( &state->ring );
+        }
+        io_uring_prep_nop( sqe );
+        io_uring_sqe_set_data( sqe, nullptr );
+        ++state->in_flight;
+        io_uring_submit( &state->ring );
+      }
+#endif
+    }
+    state->chunk_available.notify_all();
+    for( auto &t: threads ) t.join();
+#ifdef HAVE_LIBURING
+    if( state->uring ) io_uring_queue_exit( &state->ring );
+#endif
+  }
+  std::vector< file_reader_t::file_t > file_reader_t::read(
+    const std::vector< read_request_t > &requests
+  ) {
+    std::vector< file_t > files;
+    files.reserve( requests.size() );
+    std::deque< std::unique_ptr< state_t::chunk_t > > chunks;
+    for( const auto &request: requests ) {
+      auto file = std::make_shared< state_t::file_t >();
+      file->filename = request.filename;
+      files.push_back( file->promise.get_future().share() );
+      file->fd = open( request.filename.c_str(), O_RDONLY );
+      struct stat st;
+      if( file->fd < 0 || fstat( file->fd, &st ) < 0 ) {
+        file->promise.set_exception( std::make_exception_ptr( unable_to_load_file( request.filename ) ) );
+        continue;
+      }
+      const size_t file_size = size_t( st.st_size );
+      const size_t offset = std::min( request.offset, file_size );
+      file->size = std::min( request.size, file_size - offset );
+      if( file->size == 0u ) {
+        file->promise.set_value( mapped_file_t() );
+        continue;
+      }
+      posix_fadvise( file->fd, off_t( offset ), off_t( file->size ), POSIX_FADV_SEQUENTIAL );
+      file->data.reset( new uint8_t[ file->size ], std::default_delete< uint8_t[] >() );
+      for( size_t chunk_offset = 0u; chunk_offset < file->size; chunk_offset += read_chunk_size ) {
+        auto chunk = std::make_unique< state_t::chunk_t >();
+        chunk->file = file;
+        chunk->file_offset = offset + chunk_offset;
+        chunk->offset = chunk_offset;
+        chunk->size = std::min( read_chunk_size, file->size - chunk_offset );
+        chunks.push_back( std::move( chunk ) );
+        ++file->remaining;
+      }
+    }
+    {
+      std::lock_guard< std::mutex > lock( state->guard );
+      std::move( chunks.begin(), chunks.end(), std::back_inserter( state->pending ) );
+#ifdef HAVE_LIBURING
+      if( state->uring ) submit_pending( *state );
+#endif
+    }
+    state->chunk_available.notify_all();
+    return files;
+  }
+  file_reader_t::file_t file_reader_t::read(
+    const std::string &filename
+  ) {
+    return read( std::vector< read_request_t >{ read_request_t().set_filename( filename ) } ).front();
+  }
+  const char *file_reader_t::get_backend() const {
+    return state->uring ? "io_uring" : "pread";
+  }
+}
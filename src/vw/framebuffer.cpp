@@ -126,7 +126,7 @@ namespace vw {
         vk::ImageCreateInfo()
           .setImageType( vk::ImageType::e2D )
           .setFormat( vk::Format::eD16Unorm )
-          .setExtent( { context.width, context.height, 1 } )
+          .setExtent( { width, height, 1 } )
           .setMipLevels( 1 )
           .setArrayLayers( 1 )
           .setUsage( vk::ImageUsageFlagBits::eDepthStencilAttachment ),
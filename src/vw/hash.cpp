@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <cstring>
+#include <vw/hash.h>
+namespace vw {
+  namespace {
+    constexpr uint64_t prime1 = 11400714785074694791ull;
+    constexpr uint64_t prime2 = 14029467366897019727ull;
+    constexpr uint64_t prime3 = 1609587929392839161ull;
+    constexpr uint64_t prime4 = 9650029242287828579ull;
+    constexpr uint64_t prime5 = 2870177450012600261ull;
+    uint64_t rotate( uint64_t v, unsigned int n ) {
+      return ( v << n ) | ( v >> ( 64u - n ) );
+    }
+    uint64_t read64( const uint8_t *p ) {
+      uint64_t v;
+      std::memcpy( &v, p, sizeof( uint64_t ) );
+      return v;
+    }
+    uint32_t read32( const uint8_t *p ) {
+      uint32_t v;
+      std::memcpy( &v, p, sizeof( uint32_t ) );
+      return v;
+    }
+    uint64_t round( uint64_t acc, uint64_t input ) {
+      acc += input * prime2;
+      acc = rotate( acc, 31u );
+      return acc * prime1;
+    }
+    uint64_t merge( uint64_t acc, uint64_t v ) {
+      acc ^= round( 0u, v );
+      return acc * prime1 + prime4;
+    }
+  }
+  uint64_t hash(
+    const uint8_t *begin,
+    const uint8_t *end,
+    uint64_t seed
+  ) {
+    const size_t size = size_t( end - begin );
+    const uint8_t *p = begin;
+    uint64_t h;
+    if( size >= 32u ) {
+      uint64_t v1 = seed + prime1 + prime2;
+      uint64_t v2 = seed + prime2;
+      uint64_t v3 = seed;
+      uint64_t v4 = seed - prime1;
+      for( ; p + 32u <= end; p += 32u ) {
+        v1 = round( v1, read64( p ) );
+        v2 = round( v2, read64( p + 8u ) );
+        v3 = round( v3, read64( p + 16u ) );
+        v4 = round( v4, read64( p + 24u ) );
+      }
+      h = rotate( v1, 1u ) + rotate( v2, 7u ) + rotate( v3, 12u ) + rotate( v4, 18u );
+      h = merge( h, v1 );
+      h = merge( h, v2 );
+      h = merge( h, v3 );
+      h = merge( h, v4 );
+    }
+    else h = seed + prime5;
+    h += uint64_t( size );
+    for( ; p + 8u <= end; p += 8u ) {
+      h ^= round( 0u, read64( p ) );
+      h = rotate( h, 27u ) * prime1 + prime4;
+    }
+    if( p + 4u <= end ) {
+      h ^= uint64_t( read32( p ) ) * prime1;
+      h = rotate( h, 23u ) * prime2 + prime3;
+      p += 4u;
+    }
+    for( ; p != end; ++p ) {
+      h ^= uint64_t( *p ) * prime5;
+      h = rotate( h, 11u ) * prime1;
+    }
+    h ^= h >> 33u;
+    h *= prime2;
+    h ^= h >> 29u;
+    h *= prime3;
+    h ^= h >> 32u;
+    return h;
+  }
+}
@@ -20,14 +20,20 @@
  * IN THE SOFTWARE.
  */
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
 #include <fstream>
 #include <iterator>
 #include <vector>
+#include <unistd.h>
 #include <vulkan/vulkan.hpp>
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/version.h>
+#include <OpenImageIO/filesystem.h>
 #include <vw/image.h>
 #include <vw/buffer.h>
+#include <vw/uploader.h>
 #include <vw/command_buffer.h>
 #include <vw/exceptions.h>
 namespace vw {
@@ -57,6 +63,7 @@ namespace vw {
     image.set_width( image_create_info.extent.width );
     image.set_height( image_create_info.extent.height );
     image.set_format( image_create_info.format );
+    image.set_mipmap_count( image_create_info.mipLevels );
     return image;
   }
   uint32_t get_pot( uint32_t v ) {
@@ -142,6 +149,9 @@ namespace vw {
         vk::ImageLayout::eShaderReadOnlyOptimal
       );
     }
+    else {
+      convert_image( *commands, destination, 0, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal );
+    }
 /*
     convert_image( *commands, destination, 0, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferSrcOptimal );
     for( uint32_t i = 1u; i < mipmap_count; ++i ) {
@@ -196,12 +206,54 @@ namespace vw {
         .setPSignalSemaphores( &*signal_to );
     graphics_queue.submit( submit_info, vk::Fence() );*/
   }
-  image_t load_image(
-    const context_t &context,
+  namespace {
+    template< typename Input >
+    pixels_t read_pixels(
+      Input &texture_file,
+      const std::function< std::shared_ptr< void >( size_t ) > &reserve
+    ) {
+      using namespace OIIO_NAMESPACE;
+      if( !texture_file ) throw unable_to_load_texture();
+      const ImageSpec &spec = texture_file->spec();
+      if( spec.width <= 0 || spec.height <= 0 || spec.nchannels <= 0 ) throw unable_to_load_texture();
+      const size_t pixel_count = size_t( spec.width ) * size_t( spec.height );
+      pixels_t pixels;
+      pixels.set_width( spec.width );
+      pixels.set_height( spec.height );
+      if( reserve ) pixels.set_reservation( reserve( pixel_count * 4u ) );
+      pixels.data.resize( pixel_count * 4u );
+      if( spec.nchannels == 4 ) {
+        if( !texture_file->read_image( TypeDesc::UINT8, pixels.data.data() ) ) throw unable_to_load_texture();
+      }
+      else if( spec.nchannels > 4 ) {
+        const size_t channels = spec.nchannels;
+        std::vector< uint8_t > temp( pixel_count * channels );
+        if( !texture_file->read_image( TypeDesc::UINT8, temp.data() ) ) throw unable_to_load_texture();
+        for( size_t i = 0u; i != pixel_count; ++i )
+          std::copy( temp.data() + i * channels, temp.data() + i * channels + 4u, pixels.data.data() + i * 4u );
+      }
+      else {
+        const size_t channels = spec.nchannels;
+        if( !texture_file->read_image( TypeDesc::UINT8, pixels.data.data() ) ) throw unable_to_load_texture();
+        for( size_t i = pixel_count; i; --i ) {
+          const uint8_t *src = pixels.data.data() + ( i - 1u ) * channels;
+          uint8_t *dest = pixels.data.data() + ( i - 1u ) * 4u;
+          const uint8_t r = src[ 0 ];
+          const uint8_t g = channels >= 3u ? src[ 1 ] : r;
+          const uint8_t b = channels >= 3u ? src[ 2 ] : r;
+          const uint8_t a = channels == 2u ? src[ 1 ] : 255u;
+          dest[ 0 ] = r;
+          dest[ 1 ] = g;
+          dest[ 2 ] = b;
+          dest[ 3 ] = a;
+        }
+      }
+      return pixels;
+    }
+  }
+  pixels_t decode_image(
     const std::string &filename,
-    vk::ImageUsageFlagBits usage,
-    bool mipmap,
-    bool srgb
+    const std::function< std::shared_ptr< void >( size_t ) > &reserve
   ) {
     using namespace OIIO_NAMESPACE;
 #if OIIO_VERSION_MAJOR >= 2 
@@ -212,93 +264,169 @@ namespace vw {
       []( auto p ) { if( p ) ImageInput::destroy( p ); }
     );
 #endif
-    if( !texture_file ) throw unable_to_load_texture();
-    const ImageSpec &spec = texture_file->spec();
+    return read_pixels( texture_file, reserve );
+  }
+  pixels_t decode_image(
+    const uint8_t *begin,
+    const uint8_t *end,
+    const std::string &format,
+    const std::function< std::shared_ptr< void >( size_t ) > &reserve
+  ) {
+    using namespace OIIO_NAMESPACE;
+#if OIIO_VERSION >= 20200
+    Filesystem::IOMemReader reader( const_cast< uint8_t* >( begin ), std::distance( begin, end ) );
+    auto texture_file = ImageInput::open( "embedded." + format, nullptr, &reader );
+    return read_pixels( texture_file, reserve );
+#else
+    // メモリ上のイメージを読めないOpenImageIOでは一時ファイルを経由する
+    static std::atomic< unsigned int > serial( 0u );
+    const auto path = std::filesystem::temp_directory_path() / ( "vw_embedded_" + std::to_string( getpid() ) + "_" + std::to_string( serial++ ) + "." + format );
+    {
+      std::ofstream file( path, std::ios::out | std::ios::binary );
+      file.write( reinterpret_cast< const char* >( begin ), std::distance( begin, end ) );
+      if( !file ) throw unable_to_load_texture();
+    }
+    std::shared_ptr< void > remove_on_exit( nullptr, [path]( void* ) { std::error_code ec; std::filesystem::remove( path, ec ); } );
+    return decode_image( path.string(), reserve );
+#endif
+  }
+  image_t load_image(
+    const context_t &context,
+    const pixels_t &pixels,
+    vk::ImageUsageFlagBits usage,
+    bool mipmap,
+    const std::vector< vk::Format > &formats
+  ) {
+    if( formats.empty() ) throw invalid_argument( "イメージのフォーマットが指定されていない" );
     uint32_t mipmap_count = 1u;
-    if( mipmap && spec.width == spec.height && is_pot( spec.width ) ) {
-      mipmap_count = get_pot( spec.width );
+    if( mipmap && pixels.width == pixels.height && is_pot( pixels.width ) ) {
+      mipmap_count = get_pot( pixels.width );
+    }
+    const auto format_list = vk::ImageFormatListCreateInfoKHR()
+      .setViewFormatCount( formats.size() )
+      .setPViewFormats( formats.data() );
+    auto image_create_info = vk::ImageCreateInfo()
+      .setImageType( vk::ImageType::e2D )
+      .setFormat( formats[ 0 ] )
+      .setExtent( { pixels.width, pixels.height, 1 } )
+      .setMipLevels( mipmap_count )
+      .setArrayLayers( 1 )
+      .setSamples( vk::SampleCountFlagBits::e1 )
+      .setTiling( vk::ImageTiling::eOptimal )
+      .setUsage( usage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled )
+      .setSharingMode( vk::SharingMode::eExclusive )
+      .setQueueFamilyIndexCount( 0 )
+      .setPQueueFamilyIndices( nullptr )
+      .setInitialLayout( vk::ImageLayout::eUndefined );
+    if( formats.size() > 1u ) {
+      image_create_info
+        .setFlags( vk::ImageCreateFlagBits::eMutableFormat )
+        .setPNext( &format_list );
     }
     auto final_image = get_image(
       context,
-      vk::ImageCreateInfo()
-        .setImageType( vk::ImageType::e2D )
-        .setFormat( srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm )
-        .setExtent( { (uint32_t)spec.width, (uint32_t)spec.height, 1 } )
-        .setMipLevels( mipmap_count )
-        .setArrayLayers( 1 )
-        .setSamples( vk::SampleCountFlagBits::e1 )
-        .setTiling( vk::ImageTiling::eOptimal )
-        .setUsage( usage | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled )
-        .setSharingMode( vk::SharingMode::eExclusive )
-        .setQueueFamilyIndexCount( 0 )
-        .setPQueueFamilyIndices( nullptr )
-        .setInitialLayout( vk::ImageLayout::eUndefined ),
-        VMA_MEMORY_USAGE_GPU_ONLY
-    );
-    auto temporary = create_staging_buffer(
-      context,
-      spec.width * spec.height * 4
+      image_create_info,
+      VMA_MEMORY_USAGE_GPU_ONLY
     );
-    {
-      void* mapped_memory;
-      const auto result = vmaMapMemory( *context.allocator, *temporary.allocation, &mapped_memory );
-      if( result != VK_SUCCESS ) vk::throwResultException( vk::Result( result ), "イメージをマップできない" );
-      std::shared_ptr< uint8_t > mapped(
-        reinterpret_cast< uint8_t* >( mapped_memory ),
-        [allocator=context.allocator,allocation=temporary.allocation]( uint8_t *p ) {
-          if( p ) vmaUnmapMemory( *allocator, *allocation );
-        }
+    const size_t row_size = size_t( pixels.width ) * 4u;
+    if( pixels.data.size() != row_size * pixels.height ) throw invalid_argument( "ピクセルデータのサイズが合わない" );
+    auto uploader = get_uploader( context, pixels.data.size() );
+    const size_t rows_per_stage = uploader->get_capacity() / row_size;
+    if( rows_per_stage == 0u ) throw invalid_argument( "イメージの幅がステージングバッファに収まらない" );
+    // 転送キューが書くのはレベル0だけで、残りのレベルはミップマップの生成時にグラフィクスキューで遷移させる
+    uploader->begin_transfer( final_image, 1u );
+    for( uint32_t y = 0u; y != pixels.height; ) {
+      const uint32_t rows = std::min( size_t( pixels.height - y ), rows_per_stage );
+      const auto staging = uploader->stage( rows * row_size );
+      std::copy(
+        std::next( pixels.data.begin(), y * row_size ),
+        std::next( pixels.data.begin(), ( y + rows ) * row_size ),
+        staging.data
       );
-      texture_file->read_image( TypeDesc::UINT8, mapped.get() );
-      if( spec.nchannels == 3 ) {
-        std::vector< uint8_t > temp( spec.width * spec.height * 4u  );
-        texture_file->read_image( TypeDesc::UINT8, temp.data() );
-        for( size_t i = spec.width * spec.height - 1; i; --i ) {
-          temp[ i * 4 ] = temp[ i * spec.nchannels ];
-          temp[ i * 4 + 1 ] = temp[ i * spec.nchannels + 1 ];
-          temp[ i * 4 + 2 ] = temp[ i * spec.nchannels + 2 ];
-          temp[ i * 4 + 3 ] = 255u;
+      uploader->commit( staging );
+      uploader->get_commands()->copyBufferToImage(
+        staging.buffer,
+        *final_image.image,
+        vk::ImageLayout::eTransferDstOptimal,
+        {
+          vk::BufferImageCopy()
+            .setBufferOffset( staging.offset )
+            .setImageSubresource(
+              vk::ImageSubresourceLayers()
+                .setAspectMask( vk::ImageAspectFlagBits::eColor )
+                .setMipLevel( 0 )
+                .setLayerCount( 1 )
+            )
+            .setImageOffset( vk::Offset3D( 0, y, 0 ) )
+            .setImageExtent(
+              vk::Extent3D()
+                .setWidth( pixels.width )
+                .setHeight( rows )
+                .setDepth( 1 )
+            )
         }
-        std::copy( temp.begin(), temp.end(), mapped.get() );
-      }
-      else {
-        texture_file->read_image( TypeDesc::UINT8, mapped.get() );
-      }
+      );
+      // stageの途中で送出されることがあるので、コピーを積むたびにその送出が終わるまで転送先を保持させる
+      uploader->retain( final_image.image );
+      y += rows;
     }
-    vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > commands =
-      get_command_buffer( context, true );
-    commands->begin(
-      vk::CommandBufferBeginInfo()
-        .setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
-    );
-    transfer_image_internal( commands, mipmap, temporary, final_image );
-    final_image.set_image_view(
-      context.device->createImageViewUnique(
-        vk::ImageViewCreateInfo()
-          .setImage( *final_image.image )
-          .setViewType( vk::ImageViewType::e2D )
-          .setFormat( srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm )
-          .setSubresourceRange(
-            vk::ImageSubresourceRange()
-              .setAspectMask( vk::ImageAspectFlagBits::eColor )
-              .setBaseMipLevel( 0 )
-              .setLevelCount( mipmap_count )
-              .setBaseArrayLayer( 0 )
-              .setLayerCount( 1 )
-          )
-      )
-    );
-    commands->end();
-    auto graphics_queue = context.device->getQueue( context.graphics_queue_index, 0 );
-    graphics_queue.submit(
-    vk::SubmitInfo()
-      .setCommandBufferCount( 1 )
-      .setPCommandBuffers( &*commands ),
-      vk::Fence()
-    );
-    graphics_queue.waitIdle();
+    // ミップマップの生成はblitが使えるグラフィクスキューで行う
+    if( mipmap_count > 1u ) {
+      uploader->release_image( final_image, 0, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eTransferDstOptimal );
+      create_mipmap(
+        uploader->get_graphics_commands(),
+        final_image,
+        vk::ImageLayout::eTransferDstOptimal,
+        vk::ImageLayout::eShaderReadOnlyOptimal
+      );
+    }
+    else
+      uploader->release_image( final_image, 0, 1, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal );
+    uploader->retain( final_image.image );
+    finish_upload( *uploader );
+    return final_image;
+  }
+  image_t load_image(
+    const context_t &context,
+    const pixels_t &pixels,
+    vk::ImageUsageFlagBits usage,
+    bool mipmap,
+    bool srgb
+  ) {
+    const auto format = srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+    auto final_image = load_image( context, pixels, usage, mipmap, std::vector< vk::Format >{ format } );
+    final_image.set_image_view( create_image_view( context, final_image, format ) );
     return final_image;
   }
+  vk::UniqueHandle< vk::ImageView, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > create_image_view(
+    const context_t &context,
+    const image_t &image,
+    vk::Format format
+  ) {
+    return context.device->createImageViewUnique(
+      vk::ImageViewCreateInfo()
+        .setImage( *image.image )
+        .setViewType( vk::ImageViewType::e2D )
+        .setFormat( format )
+        .setSubresourceRange(
+          vk::ImageSubresourceRange()
+            .setAspectMask( vk::ImageAspectFlagBits::eColor )
+            .setBaseMipLevel( 0 )
+            .setLevelCount( image.mipmap_count )
+            .setBaseArrayLayer( 0 )
+            .setLayerCount( 1 )
+        )
+    );
+  }
+  image_t load_image(
+    const context_t &context,
+    const std::string &filename,
+    vk::ImageUsageFlagBits usage,
+    bool mipmap,
+    bool srgb
+  ) {
+    return load_image( context, decode_image( filename ), usage, mipmap, srgb );
+  }
   void create_mipmap(
     vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &commands,
     const image_t &image,
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <vw/mapped_file.h>
+#include <vw/exceptions.h>
+namespace vw {
+  mapped_file_t map_file( const std::string &filename ) {
+    const int fd = open( filename.c_str(), O_RDONLY );
+    if( fd < 0 ) throw unable_to_load_file( filename );
+    struct stat st;
+    if( fstat( fd, &st ) < 0 ) {
+      close( fd );
+      throw unable_to_load_file( filename );
+    }
+    mapped_file_t file;
+    file.set_size( size_t( st.st_size ) );
+    if( file.size == 0u ) {
+      close( fd );
+      return file;
+    }
+    void *mapped = mmap( nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( mapped == MAP_FAILED ) throw unable_to_load_file( filename );
+    madvise( mapped, file.size, MADV_SEQUENTIAL );
+    madvise( mapped, file.size, MADV_WILLNEED );
+    file.emplace_data(
+      reinterpret_cast< uint8_t* >( mapped ),
+      [size=file.size]( uint8_t *p ) {
+        if( p ) munmap( p, size );
+      }
+    );
+    return file;
+  }
+}
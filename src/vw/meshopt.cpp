@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vw/meshopt.h>
+#include <vw/exceptions.h>
+namespace vw {
+  namespace {
+    constexpr uint8_t vertex_header = 0xA0u;
+    constexpr uint8_t index_header = 0xE0u;
+    constexpr uint8_t sequence_header = 0xD0u;
+    constexpr size_t vertex_block_size_bytes = 8192u;
+    constexpr size_t vertex_block_max_size = 256u;
+    constexpr size_t byte_group_size = 16u;
+    constexpr size_t byte_group_decode_limit = 24u;
+    constexpr size_t tail_max_size = 32u;
+    size_t get_vertex_block_size( size_t vertex_size ) {
+      return std::min( ( vertex_block_size_bytes / vertex_size ) & ~( byte_group_size - 1u ), vertex_block_max_size );
+    }
+    uint8_t unzigzag8( uint8_t v ) {
+      return uint8_t( -( v & 1 ) ^ ( v >> 1 ) );
+    }
+    const uint8_t *decode_bytes_group(
+      const uint8_t *data,
+      uint8_t *out,
+      unsigned int bitslog2
+    ) {
+      if( bitslog2 == 0u ) {
+        std::fill( out, out + byte_group_size, 0u );
+        return data;
+      }
+      if( bitslog2 == 3u ) {
+        std::copy( data, data + byte_group_size, out );
+        return data + byte_group_size;
+      }
+      // 全ビットが1の値は後続の生のバイトで置き換える
+      const unsigned int bits = bitslog2 == 1u ? 2u : 4u;
+      const unsigned int sentinel = ( 1u << bits ) - 1u;
+      const uint8_t *raw = data + byte_group_size * bits / 8u;
+      for( size_t i = 0u; i != byte_group_size; ++i ) {
+        const unsigned int shift = 8u - bits - ( i * bits ) % 8u;
+        const unsigned int encoded = ( data[ i * bits / 8u ] >> shift ) & sentinel;
+        out[ i ] = encoded == sentinel ? *raw++ : uint8_t( encoded );
+      }
+      return raw;
+    }
+    const uint8_t *decode_bytes(
+      const uint8_t *data,
+      const uint8_t *end,
+      uint8_t *out,
+      size_t size
+    ) {
+      const size_t header_size = ( size / byte_group_size + 3u ) / 4u;
+      if( size_t( end - data ) < header_size ) throw invalid_compressed_data( "頂点ブロックが途中で切れている", __FILE__, __LINE__ );
+      const uint8_t *header = data;
+      data += header_size;
+      for( size_t i = 0u; i != size; i += byte_group_size ) {
+        // 末尾に必ずtail_max_sizeバイト以上あるのでグループ毎の範囲の確認はこれで足りる
+        if( size_t( end - data ) < byte_group_decode_limit ) throw invalid_compressed_data( "頂点ブロックが途中で切れている", __FILE__, __LINE__ );
+        const size_t group = i / byte_group_size;
+        const unsigned int bitslog2 = ( header[ group / 4u ] >> ( ( group % 4u ) * 2u ) ) & 3u;
+        data = decode_bytes_group( data, out + i, bitslog2 );
+      }
+      return data;
+    }
+    void decode_vertex_buffer(
+      const uint8_t *data,
+      const uint8_t *end,
+      size_t count,
+      size_t vertex_size,
+      uint8_t *out
+    ) {
+      if( vertex_size == 0u || vertex_size > 256u || vertex_size % 4u ) throw invalid_compressed_data( "頂点の大きさが4の倍数でないか256バイトを超えている", __FILE__, __LINE__ );
+      if( size_t( end - data ) < 1u + vertex_size ) throw invalid_compressed_data( "頂点バッファが途中で切れている", __FILE__, __LINE__ );
+      if( ( *data & 0xF0u ) != vertex_header || ( *data & 0x0Fu ) > 0u ) throw invalid_compressed_data( "未対応の頂点バッファの形式", __FILE__, __LINE__ );
+      ++data;
+      std::array< uint8_t, 256u > last_vertex;
+      std::copy( end - vertex_size, end, last_vertex.begin() );
+      std::array< uint8_t, vertex_block_max_size > bytes;
+      const size_t block_size = get_vertex_block_size( vertex_size );
+      for( size_t vertex_offset = 0u; vertex_offset < count; vertex_offset += block_size ) {
+        const size_t block_count = std::min( block_size, count - vertex_offset );
+        const size_t aligned_count = ( block_count + byte_group_size - 1u ) & ~( byte_group_size - 1u );
+        uint8_t *block = out + vertex_offset * vertex_size;
+        // 頂点のkバイト目毎に並べられた差分を元の並びに戻す
+        for( size_t k = 0u; k != vertex_size; ++k ) {
+          data = decode_bytes( data, end, bytes.data(), aligned_count );
+          uint8_t p = last_vertex[ k ];
+          for( size_t i = 0u; i != block_count; ++i ) {
+            p = uint8_t( unzigzag8( bytes[ i ] ) + p );
+            block[ i * vertex_size + k ] = p;
+          }
+          last_vertex[ k ] = p;
+        }
+      }
+      if( size_t( end - data ) != std::max( vertex_size, tail_max_size ) ) throw invalid_compressed_data( "頂点バッファの長さが合わない", __FILE__, __LINE__ );
+    }
+    uint32_t decode_vbyte(
+      const uint8_t *&data,
+      const uint8_t *end
+    ) {
+      uint32_t result = 0u;
+      for( unsigned int shift = 0u; shift != 35u; shift += 7u ) {
+        if( data == end ) throw invalid_compressed_data( "インデックスが途中で切れている", __FILE__, __LINE__ );
+        const uint8_t group = *data++;
+        result |= uint32_t( group & 0x7Fu ) << shift;
+        if( group < 0x80u ) break;
+      }
+      return result;
+    }
+    uint32_t decode_index(
+      const uint8_t *&data,
+      const uint8_t *end,
+      uint32_t last
+    ) {
+      const uint32_t v = decode_vbyte( data, end );
+      return last + ( ( v >> 1 ) ^ uint32_t( -int32_t( v & 1u ) ) );
+    }
+    void write_index(
+      uint8_t *out,
+      size_t index,
+      size_t index_size,
+      uint32_t value
+    ) {
+      if( index_size == 2u ) {
+        const uint16_t narrow = uint16_t( value );
+        std::memcpy( out + index * 2u, &narrow, 2u );
+      }
+      else std::memcpy( out + index * 4u, &value, 4u );
+    }
+    class fifo_t {
+    public:
+      fifo_t() : edge_offset( 0u ), vertex_offset( 0u ) {
+        for( auto &e: edge ) e.fill( ~uint32_t( 0u ) );
+        vertex.fill( ~uint32_t( 0u ) );
+      }
+      const std::array< uint32_t, 2u > &get_edge( unsigned int distance ) const {
+        return edge[ ( edge_offset - 1u - distance ) & 15u ];
+      }
+      uint32_t get_vertex( unsigned int distance ) const {
+        return vertex[ ( vertex_offset - distance ) & 15u ];
+      }
+      void push_edge( uint32_t a, uint32_t b ) {
+        edge[ edge_offset ] = { a, b };
+        edge_offset = ( edge_offset + 1u ) & 15u;
+      }
+      void push_vertex( uint32_t v, bool cond = true ) {
+        vertex[ vertex_offset ] = v;
+        vertex_offset = ( vertex_offset + ( cond ? 1u : 0u ) ) & 15u;
+      }
+    private:
+      std::array< std::array< uint32_t, 2u >, 16u > edge;
+      std::array< uint32_t, 16u > vertex;
+      unsigned int edge_offset;
+      unsigned int vertex_offset;
+    };
+    void decode_index_buffer(
+      const uint8_t *begin,
+      const uint8_t *end,
+      size_t count,
+      size_t index_size,
+      uint8_t *out
+    ) {
+      if( count % 3u ) throw invalid_compressed_data( "インデックスの数が3の倍数でない", __FILE__, __LINE__ );
+      if( size_t( end - begin ) < 1u + count / 3u + 16u ) throw invalid_compressed_data( "インデックスバッファが途中で切れている", __FILE__, __LINE__ );
+      if( ( *begin & 0xF0u ) != index_header || ( *begin & 0x0Fu ) > 1u ) throw invalid_compressed_data( "未対応のインデックスバッファの形式", __FILE__, __LINE__ );
+      const unsigned int version = *begin & 0x0Fu;
+      // バージョン1では13と14が直前のインデックスとの差-1と1を表す
+      const unsigned int fecmax = version >= 1u ? 13u : 15u;
+      fifo_t fifo;
+      uint32_t next = 0u;
+      uint32_t last = 0u;
+      const uint8_t *code = begin + 1u;
+      const uint8_t *data = code + count / 3u;
+      const uint8_t *data_end = end - 16u;
+      const uint8_t *codeaux_table = data_end;
+      for( size_t i = 0u; i != count; i += 3u ) {
+        const uint8_t codetri = *code++;
+        if( codetri < 0xF0u ) {
+          // fifoにある辺と1頂点からなる三角形
+          const auto edge = fifo.get_edge( codetri >> 4 );
+          const uint32_t a = edge[ 0 ];
+          const uint32_t b = edge[ 1 ];
+          const unsigned int fec = codetri & 15u;
+          uint32_t c;
+          if( fec < fecmax ) {
+            c = fec == 0u ? next++ : fifo.get_vertex( fec + 1u );
+            fifo.push_vertex( c, fec == 0u );
+          }
+          else {
+            c = last = fec != 15u ? last + ( fec == 13u ? -1 : 1 ) : decode_index( data, data_end, last );
+            fifo.push_vertex( c );
+          }
+          write_index( out, i, index_size, a );
+          write_index( out, i + 1u, index_size, b );
+          write_index( out, i + 2u, index_size, c );
+          fifo.push_edge( c, b );
+          fifo.push_edge( a, c );
+        }
+        else {
+          uint32_t a, b, c;
+          unsigned int feb, fec;
+          bool explicit_index = false;
+          if( codetri < 0xFEu ) {
+            // 頻出する頂点の組み合わせは末尾のテーブルを参照する
+            const uint8_t codeaux = codeaux_table[ codetri & 15u ];
+            feb = codeaux >> 4;
+            fec = codeaux & 15u;
+            a = next++;
+            b = feb == 0u ? next++ : fifo.get_vertex( feb );
+            c = fec == 0u ? next++ : fifo.get_vertex( fec );
+          }
+          else {
+            if( data == data_end ) throw invalid_compressed_data( "インデックスバッファが途中で切れている", __FILE__, __LINE__ );
+            const uint8_t codeaux = *data++;
+            if( codeaux == 0u ) next = 0u;
+            feb = codeaux >> 4;
+            fec = codeaux & 15u;
+            a = codetri == 0xFEu ? next++ : 0u;
+            b = feb == 0u ? next++ : fifo.get_vertex( feb );
+            c = fec == 0u ? next++ : fifo.get_vertex( fec );
+            explicit_index = true;
+            if( codetri == 0xFFu ) a = last = decode_index( data, data_end, last );
+            if( feb == 15u ) b = last = decode_index( data, data_end, last );
+            if( fec == 15u ) c = last = decode_index( data, data_end, last );
+          }
+          write_index( out, i, index_size, a );
+          write_index( out, i + 1u, index_size, b );
+          write_index( out, i + 2u, index_size, c );
+          fifo.push_vertex( a );
+          fifo.push_vertex( b, feb == 0u || ( explicit_index && feb == 15u ) );
+          fifo.push_vertex( c, fec == 0u || ( explicit_index && fec == 15u ) );
+          fifo.push_edge( b, a );
+          fifo.push_edge( c, b );
+          fifo.push_edge( a, c );
+        }
+      }
+      if( data != data_end ) throw invalid_compressed_data( "インデックスバッファの長さが合わない", __FILE__, __LINE__ );
+    }
+    void decode_index_sequence(
+      const uint8_t *begin,
+      const uint8_t *end,
+      size_t count,
+      size_t index_size,
+      uint8_t *out
+    ) {
+      if( size_t( end - begin ) < 1u + count + 4u ) throw invalid_compressed_data( "インデックス列が途中で切れている", __FILE__, __LINE__ );
+      if( ( *begin & 0xF0u ) != sequence_header || ( *begin & 0x0Fu ) > 1u ) throw invalid_compressed_data( "未対応のインデックス列の形式", __FILE__, __LINE__ );
+      const uint8_t *data = begin + 1u;
+      const uint8_t *data_end = end - 4u;
+      // 2つの基準値のどちらからの差分かを最下位ビットで選ぶ
+      std::array< uint32_t, 2u > last{ 0u, 0u };
+      for( size_t i = 0u; i != count; ++i ) {
+        uint32_t v = decode_vbyte( data, data_end );
+        const unsigned int current = v & 1u;
+        v >>= 1;
+        last[ current ] += ( v >> 1 ) ^ uint32_t( -int32_t( v & 1u ) );
+        write_index( out, i, index_size, last[ current ] );
+      }
+      if( data != data_end ) throw invalid_compressed_data( "インデックス列の長さが合わない", __FILE__, __LINE__ );
+    }
+    template< typename T >
+    void decode_filter_octahedral( uint8_t *data, size_t count ) {
+      const float max = float( ( 1 << ( sizeof( T ) * 8u - 1u ) ) - 1 );
+      for( size_t i = 0u; i != count; ++i ) {
+        std::array< T, 4u > v;
+        std::memcpy( v.data(), data + i * sizeof( v ), sizeof( v ) );
+        float x = float( v[ 0 ] );
+        float y = float( v[ 1 ] );
+        const float z = float( v[ 2 ] ) - std::fabs( x ) - std::fabs( y );
+        const float t = std::min( z, 0.f );
+        x += x >= 0.f ? t : -t;
+        y += y >= 0.f ? t : -t;
+        const float s = max / std::sqrt( x * x + y * y + z * z );
+        v[ 0 ] = T( int( x * s + ( x >= 0.f ? 0.5f : -0.5f ) ) );
+        v[ 1 ] = T( int( y * s + ( y >= 0.f ? 0.5f : -0.5f ) ) );
+        v[ 2 ] = T( int( z * s + ( z >= 0.f ? 0.5f : -0.5f ) ) );
+        std::memcpy( data + i * sizeof( v ), v.data(), sizeof( v ) );
+      }
+    }
+    void decode_filter_quaternion( uint8_t *data, size_t count ) {
+      const float scale = 1.f / std::sqrt( 2.f );
+      for( size_t i = 0u; i != count; ++i ) {
+        std::array< int16_t, 4u > v;
+        std::memcpy( v.data(), data + i * sizeof( v ), sizeof( v ) );
+        // 4要素目の下位2ビットが省略された要素の位置、残りが拡大率
+        const float ss = scale / float( v[ 3 ] | 3 );
+        const float x = float( v[ 0 ] ) * ss;
+        const float y = float( v[ 1 ] ) * ss;
+        const float z = float( v[ 2 ] ) * ss;
+        const float w = std::sqrt( std::max( 1.f - x * x - y * y - z * z, 0.f ) );
+        const unsigned int qc = v[ 3 ] & 3;
+        std::array< int16_t, 4u > decoded;
+        decoded[ ( qc + 1u ) & 3u ] = int16_t( int( x * 32767.f + ( x >= 0.f ? 0.5f : -0.5f ) ) );
+        decoded[ ( qc + 2u ) & 3u ] = int16_t( int( y * 32767.f + ( y >= 0.f ? 0.5f : -0.5f ) ) );
+        decoded[ ( qc + 3u ) & 3u ] = int16_t( int( z * 32767.f + ( z >= 0.f ? 0.5f : -0.5f ) ) );
+        decoded[ qc ] = int16_t( int( w * 32767.f + 0.5f ) );
+        std::memcpy( data + i * sizeof( v ), decoded.data(), sizeof( v ) );
+      }
+    }
+    void decode_filter_exponential( uint8_t *data, size_t count ) {
+      for( size_t i = 0u; i != count; ++i ) {
+        uint32_t v;
+        std::memcpy( &v, data + i * sizeof( v ), sizeof( v ) );
+        const int32_t mantissa = int32_t( v << 8 ) >> 8;
+        const int32_t exponent = int32_t( v ) >> 24;
+        const float value = std::ldexp( float( mantissa ), exponent );
+        std::memcpy( data + i * sizeof( v ), &value, sizeof( v ) );
+      }
+    }
+  }
+  void decode_meshopt(
+    const uint8_t *begin,
+    const uint8_t *end,
+    size_t count,
+    size_t stride,
+    meshopt_mode_t mode,
+    meshopt_filter_t filter,
+    uint8_t *out
+  ) {
+    if( mode == meshopt_mode_t::attributes ) {
+      if( filter == meshopt_filter_t::octahedral && stride != 4u && stride != 8u ) throw invalid_compressed_data( "OCTAHEDRALフィルタの要素の大きさは4か8", __FILE__, __LINE__ );
+      if( filter == meshopt_filter_t::quaternion && stride != 8u ) throw invalid_compressed_data( "QUATERNIONフィルタの要素の大きさは8", __FILE__, __LINE__ );
+      decode_vertex_buffer( begin, end, count, stride, out );
+      if( filter == meshopt_filter_t::octahedral ) {
+        if( stride == 4u ) decode_filter_octahedral< int8_t >( out, count );
+        else decode_filter_octahedral< int16_t >( out, count );
+      }
+      else if( filter == meshopt_filter_t::quaternion ) decode_filter_quaternion( out, count );
+      else if( filter == meshopt_filter_t::exponential ) decode_filter_exponential( out, count * stride / 4u );
+      return;
+    }
+    if( stride != 2u && stride != 4u ) throw invalid_compressed_data( "インデックスの大きさは2か4", __FILE__, __LINE__ );
+    if( filter != meshopt_filter_t::none ) throw invalid_compressed_data( "インデックスにはフィルタを使用できない", __FILE__, __LINE__ );
+    if( mode == meshopt_mode_t::triangles ) decode_index_buffer( begin, end, count, stride, out );
+    else decode_index_sequence( begin, end, count, stride, out );
+  }
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+#include <vw/parallel.h>
+namespace vw {
+  void parallel_for(
+    size_t count,
+    const std::function< void( size_t ) > &f,
+    size_t thread_count
+  ) {
+    if( thread_count == 0u ) thread_count = std::max( std::thread::hardware_concurrency(), 1u );
+    thread_count = std::min( thread_count, count );
+    if( thread_count <= 1u ) {
+      for( size_t i = 0u; i != count; ++i ) f( i );
+      return;
+    }
+    std::atomic< size_t > next( 0u );
+    std::vector< std::exception_ptr > errors( thread_count );
+    std::vector< std::thread > threads;
+    threads.reserve( thread_count );
+    for( size_t t = 0u; t != thread_count; ++t )
+      threads.emplace_back( [&,t]() {
+        try {
+          for( size_t i = next++; i < count; i = next++ ) f( i );
+        }
+        catch( ... ) {
+          errors[ t ] = std::current_exception();
+          next = count;
+        }
+      } );
+    for( auto &thread: threads ) thread.join();
+    for( const auto &error: errors )
+      if( error ) std::rethrow_exception( error );
+  }
+}
@@ -19,13 +19,233 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
  * IN THE SOFTWARE.
  */
+#include <chrono>
 #include <iterator>
 #include <vector>
 #include <glm/glm.hpp>
 #include <vulkan/vulkan.hpp>
+#include <vw/hash.h>
 #include <vw/pipeline.h>
 namespace vw {
-  pipeline_t create_pipeline(
+  namespace {
+    template< typename T >
+    void append_key( std::string &key, const T &value ) {
+      key.append( reinterpret_cast< const char* >( &value ), sizeof( T ) );
+    }
+    std::string get_pipeline_key(
+      const context_t &context,
+      const render_pass_t &render_pass,
+      uint32_t push_constant_size,
+      const vk::ShaderModule &vs,
+      const vk::ShaderModule &fs,
+      const std::vector< vk::VertexInputBindingDescription > &vertex_input_binding,
+      const std::vector< vk::VertexInputAttributeDescription > &vertex_input_attribute,
+      bool cull,
+      bool blend,
+      bool back_side
+    ) {
+      std::string key;
+      // サブパスの構成は固定なのでアタッチメントのフォーマットとサンプル数が同じレンダーパスは互換
+      append_key( key, uint32_t( render_pass.attachments.size() ) );
+      for( const auto &a: render_pass.attachments ) {
+        append_key( key, VkFormat( a.format ) );
+        append_key( key, VkSampleCountFlags( a.samples ) );
+      }
+      append_key( key, push_constant_size );
+      append_key( key, VkShaderModule( vs ) );
+      append_key( key, VkShaderModule( fs ) );
+      append_key( key, uint32_t( context.descriptor_set_layout.size() ) );
+      for( const auto &l: context.descriptor_set_layout )
+        append_key( key, VkDescriptorSetLayout( *l ) );
+      append_key( key, uint32_t( vertex_input_binding.size() ) );
+      for( const auto &b: vertex_input_binding ) {
+        append_key( key, b.binding );
+        append_key( key, b.stride );
+        append_key( key, VkVertexInputRate( b.inputRate ) );
+      }
+      append_key( key, uint32_t( vertex_input_attribute.size() ) );
+      for( const auto &a: vertex_input_attribute ) {
+        append_key( key, a.location );
+        append_key( key, a.binding );
+        append_key( key, VkFormat( a.format ) );
+        append_key( key, a.offset );
+      }
+      append_key( key, uint8_t( ( cull ? 1u : 0u )|( blend ? 2u : 0u )|( back_side ? 4u : 0u ) ) );
+      return key;
+    }
+    std::vector< vk::PushConstantRange > get_push_constant_range(
+      uint32_t push_constant_size
+    ) {
+      return std::vector< vk::PushConstantRange >{
+        vk::PushConstantRange()
+          .setStageFlags( vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment )
+          .setOffset( 0 )
+          .setSize( push_constant_size )
+      };
+    }
+    std::vector< vk::DescriptorSetLayout > get_raw_descriptor_set_layout(
+      const context_t &context
+    ) {
+      std::vector< vk::DescriptorSetLayout > raw_descriptor_set_layout;
+      raw_descriptor_set_layout.reserve( context.descriptor_set_layout.size() );
+      std::transform(
+        context.descriptor_set_layout.begin(),
+        context.descriptor_set_layout.end(),
+        std::back_inserter( raw_descriptor_set_layout ),
+        []( const auto &v ) { return *v; }
+      );
+      return raw_descriptor_set_layout;
+    }
+    std::string get_pipeline_layout_key(
+      const std::vector< vk::DescriptorSetLayout > &descriptor_set_layout,
+      const std::vector< vk::PushConstantRange > &push_constant_range
+    ) {
+      std::string key;
+      append_key( key, uint32_t( descriptor_set_layout.size() ) );
+      for( const auto &l: descriptor_set_layout )
+        append_key( key, VkDescriptorSetLayout( l ) );
+      append_key( key, uint32_t( push_constant_range.size() ) );
+      for( const auto &r: push_constant_range ) {
+        append_key( key, VkShaderStageFlags( r.stageFlags ) );
+        append_key( key, r.offset );
+        append_key( key, r.size );
+      }
+      return key;
+    }
+    std::shared_ptr< vk::PipelineLayout > build_pipeline_layout(
+      const context_t &context,
+      const std::vector< vk::DescriptorSetLayout > &descriptor_set_layout,
+      const std::vector< vk::PushConstantRange > &push_constant_range
+    ) {
+      const vk::Device device = *context.device;
+      return std::shared_ptr< vk::PipelineLayout >(
+        new vk::PipelineLayout( device.createPipelineLayout(
+          vk::PipelineLayoutCreateInfo()
+            .setSetLayoutCount( descriptor_set_layout.size() )
+            .setPSetLayouts( descriptor_set_layout.data() )
+            .setPushConstantRangeCount( push_constant_range.size() )
+            .setPPushConstantRanges( push_constant_range.data() )
+        ) ),
+        [device]( vk::PipelineLayout *p ) {
+          if( p ) {
+            device.destroyPipelineLayout( *p );
+            delete p;
+          }
+        }
+      );
+    }
+    pipeline_t build_pipeline(
+      const context_t &context,
+      const render_pass_t &render_pass,
+      const std::shared_ptr< vk::PipelineLayout > &pipeline_layout,
+      const vk::ShaderModule &vs,
+      const vk::ShaderModule &fs,
+      const std::vector< vk::VertexInputBindingDescription > &vertex_input_binding,
+      const std::vector< vk::VertexInputAttributeDescription > &vertex_input_attribute,
+      bool cull,
+      bool blend,
+      bool back_side
+    ) {
+      pipeline_t pipeline;
+      pipeline.set_pipeline_layout( pipeline_layout );
+      const vk::Device device = *context.device;
+      std::vector< vk::PipelineShaderStageCreateInfo > pipeline_shader_stages;
+      pipeline_shader_stages.push_back(
+        vk::PipelineShaderStageCreateInfo()
+          .setStage( vk::ShaderStageFlagBits::eVertex )
+          .setModule( vs )
+          .setPName( "main" )
+      );
+      pipeline_shader_stages.push_back(
+        vk::PipelineShaderStageCreateInfo()
+          .setStage( vk::ShaderStageFlagBits::eFragment )
+          .setModule( fs )
+          .setPName( "main" )
+      );
+      const auto input_assembly_info = vk::PipelineInputAssemblyStateCreateInfo()
+        .setTopology( vk::PrimitiveTopology::eTriangleList );
+      const auto viewport_info = vk::PipelineViewportStateCreateInfo().setViewportCount( 1 ).setScissorCount( 1 );
+      const auto rasterization_info = vk::PipelineRasterizationStateCreateInfo()
+        .setDepthClampEnable( VK_FALSE )
+        .setRasterizerDiscardEnable( VK_FALSE )
+        .setPolygonMode( vk::PolygonMode::eFill )
+        .setCullMode( cull ? ( back_side ? vk::CullModeFlagBits::eFront : vk::CullModeFlagBits::eBack ) : vk::CullModeFlagBits::eNone )
+        .setFrontFace( vk::FrontFace::eCounterClockwise )
+        .setDepthBiasEnable( back_side ? VK_TRUE : VK_FALSE )
+        .setLineWidth( 1.0f );
+      const auto multisample_info = vk::PipelineMultisampleStateCreateInfo();
+      const auto stencil_op = vk::StencilOpState()
+        .setFailOp( vk::StencilOp::eKeep )
+        .setPassOp( vk::StencilOp::eKeep )
+        .setCompareOp( vk::CompareOp::eAlways );
+      const auto depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo()
+        .setDepthTestEnable( VK_TRUE )
+        .setDepthWriteEnable( VK_TRUE )
+        .setDepthCompareOp( vk::CompareOp::eLessOrEqual )
+        .setDepthBoundsTestEnable( VK_FALSE )
+        .setStencilTestEnable( VK_FALSE )
+        .setFront( stencil_op )
+        .setBack( stencil_op );
+      const std::array< vk::PipelineColorBlendAttachmentState, 1u > color_blend_attachments{
+        vk::PipelineColorBlendAttachmentState()
+          .setBlendEnable( blend )
+          .setColorWriteMask(
+            vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB |
+            vk::ColorComponentFlagBits::eA
+          )
+      };
+      const auto color_blend_info =
+        vk::PipelineColorBlendStateCreateInfo()
+          .setAttachmentCount( color_blend_attachments.size() )
+          .setPAttachments( color_blend_attachments.data() );
+      const std::array< vk::DynamicState, 2u > dynamic_states{
+        vk::DynamicState::eViewport, vk::DynamicState::eScissor
+      };
+      const auto dynamic_state_info =
+        vk::PipelineDynamicStateCreateInfo()
+          .setDynamicStateCount( dynamic_states.size() )
+         .setPDynamicStates( dynamic_states.data() );
+      const vk::PipelineVertexInputStateCreateInfo vertex_input_state = vk::PipelineVertexInputStateCreateInfo()
+        .setVertexAttributeDescriptionCount( vertex_input_attribute.size() )
+        .setPVertexAttributeDescriptions( vertex_input_attribute.data() )
+        .setVertexBindingDescriptionCount( vertex_input_binding.size() )
+        .setPVertexBindingDescriptions( vertex_input_binding.data() );
+      const std::vector< vk::GraphicsPipelineCreateInfo > pipeline_create_info{
+        vk::GraphicsPipelineCreateInfo()
+          .setStageCount( pipeline_shader_stages.size() )
+          .setPStages( pipeline_shader_stages.data() )
+          .setPVertexInputState( &vertex_input_state )
+          .setPInputAssemblyState( &input_assembly_info )
+          .setPViewportState( &viewport_info )
+          .setPRasterizationState( &rasterization_info )
+          .setPMultisampleState( &multisample_info )
+          .setPDepthStencilState( &depth_stencil_info )
+          .setPColorBlendState( &color_blend_info )
+          .setPDynamicState( &dynamic_state_info )
+          .setLayout( *pipeline.pipeline_layout )
+          .setRenderPass( *render_pass.render_pass )
+          .setSubpass( 0 )
+      };
+      auto raw_pipeline = context.device->createGraphicsPipelines(
+        *context.pipeline_cache, pipeline_create_info
+      );
+      pipeline.emplace_pipeline(
+        new vk::Pipeline( raw_pipeline.value[ 0 ] ),
+        [device]( vk::Pipeline *p ) {
+          if( p ) {
+            device.destroyPipeline( *p );
+            delete p;
+          }
+        }
+      );
+      return pipeline;
+    }
+  }
+  size_t pipeline_registry_t::key_hash_t::operator()( const std::string &key ) const {
+    const auto data = reinterpret_cast< const uint8_t* >( key.data() );
+    return hash( data, data + key.size() );
+  }
+  pipeline_t pipeline_registry_t::get(
     const context_t &context,
     const render_pass_t &render_pass,
     uint32_t push_constant_size,
@@ -37,111 +257,87 @@ namespace vw {
     bool blend,
     bool back_side
   ) {
-    pipeline_t pipeline;
-    const std::vector< vk::PushConstantRange > push_constant_range{
-      vk::PushConstantRange()
-        .setStageFlags( vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment )
-        .setOffset( 0 )
-        .setSize( push_constant_size )
-    };
-    std::vector< vk::DescriptorSetLayout > raw_descriptor_set_layout;
-    raw_descriptor_set_layout.reserve( context.descriptor_set_layout.size() );
-    std::transform(
-      context.descriptor_set_layout.begin(),
-      context.descriptor_set_layout.end(),
-      std::back_inserter( raw_descriptor_set_layout ),
-      []( const auto &v ) { return *v; }
+    const auto key = get_pipeline_key(
+      context, render_pass, push_constant_size, vs, fs,
+      vertex_input_binding, vertex_input_attribute, cull, blend, back_side
     );
-    pipeline.set_pipeline_layout( context.device->createPipelineLayoutUnique(
-      vk::PipelineLayoutCreateInfo()
-        .setSetLayoutCount( context.descriptor_set_layout.size() )
-        .setPSetLayouts( raw_descriptor_set_layout.data() )
-        .setPushConstantRangeCount( push_constant_range.size() )
-        .setPPushConstantRanges( push_constant_range.data() )
-    ) );
-    std::vector< vk::PipelineShaderStageCreateInfo > pipeline_shader_stages;
-    pipeline_shader_stages.push_back(
-      vk::PipelineShaderStageCreateInfo()
-        .setStage( vk::ShaderStageFlagBits::eVertex )
-        .setModule( vs )
-        .setPName( "main" )
+    const auto pipeline_layout = get_pipeline_layout(
+      context,
+      get_raw_descriptor_set_layout( context ),
+      get_push_constant_range( push_constant_size )
     );
-    pipeline_shader_stages.push_back(
-      vk::PipelineShaderStageCreateInfo()
-        .setStage( vk::ShaderStageFlagBits::eFragment )
-        .setModule( fs )
-        .setPName( "main" )
+    std::lock_guard< std::mutex > lock( guard );
+    const auto existing = pipelines.find( key );
+    if( existing != pipelines.end() ) {
+      pipeline_t pipeline;
+      pipeline.set_pipeline_layout( pipeline_layout );
+      pipeline.set_pipeline( existing->second.lock() );
+      if( pipeline.pipeline ) {
+        ++statistics.hit;
+        return pipeline;
+      }
+      pipelines.erase( existing );
+    }
+    const auto begin = std::chrono::high_resolution_clock::now();
+    auto pipeline = build_pipeline(
+      context, render_pass, pipeline_layout, vs, fs,
+      vertex_input_binding, vertex_input_attribute, cull, blend, back_side
     );
-    const auto input_assembly_info = vk::PipelineInputAssemblyStateCreateInfo()
-      .setTopology( vk::PrimitiveTopology::eTriangleList );
-    const auto viewport_info = vk::PipelineViewportStateCreateInfo().setViewportCount( 1 ).setScissorCount( 1 );
-    const auto rasterization_info = vk::PipelineRasterizationStateCreateInfo()
-      .setDepthClampEnable( VK_FALSE )
-      .setRasterizerDiscardEnable( VK_FALSE )
-      .setPolygonMode( vk::PolygonMode::eFill )
-      .setCullMode( cull ? ( back_side ? vk::CullModeFlagBits::eFront : vk::CullModeFlagBits::eBack ) : vk::CullModeFlagBits::eNone )
-      .setFrontFace( vk::FrontFace::eCounterClockwise )
-      .setDepthBiasEnable( back_side ? VK_TRUE : VK_FALSE )
-      .setLineWidth( 1.0f );
-    const auto multisample_info = vk::PipelineMultisampleStateCreateInfo();
-    const auto stencil_op = vk::StencilOpState()
-      .setFailOp( vk::StencilOp::eKeep )
-      .setPassOp( vk::StencilOp::eKeep )
-      .setCompareOp( vk::CompareOp::eAlways );
-    const auto depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo()
-      .setDepthTestEnable( VK_TRUE )
-      .setDepthWriteEnable( VK_TRUE )
-      .setDepthCompareOp( vk::CompareOp::eLessOrEqual )
-      .setDepthBoundsTestEnable( VK_FALSE )
-      .setStencilTestEnable( VK_FALSE )
-      .setFront( stencil_op )
-      .setBack( stencil_op );
-    const std::array< vk::PipelineColorBlendAttachmentState, 1u > color_blend_attachments{
-      vk::PipelineColorBlendAttachmentState()
-        .setBlendEnable( blend )
-        .setColorWriteMask(
-          vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB |
-          vk::ColorComponentFlagBits::eA
-        )
-    };
-    const auto color_blend_info =
-      vk::PipelineColorBlendStateCreateInfo()
-        .setAttachmentCount( color_blend_attachments.size() )
-        .setPAttachments( color_blend_attachments.data() );
-    const std::array< vk::DynamicState, 2u > dynamic_states{
-      vk::DynamicState::eViewport, vk::DynamicState::eScissor
-    };
-    const auto dynamic_state_info =
-      vk::PipelineDynamicStateCreateInfo()
-        .setDynamicStateCount( dynamic_states.size() )
-       .setPDynamicStates( dynamic_states.data() );
-    const vk::PipelineVertexInputStateCreateInfo vertex_input_state = vk::PipelineVertexInputStateCreateInfo()
-      .setVertexAttributeDescriptionCount( vertex_input_attribute.size() )
-      .setPVertexAttributeDescriptions( vertex_input_attribute.data() )
-      .setVertexBindingDescriptionCount( vertex_input_binding.size() )
-      .setPVertexBindingDescriptions( vertex_input_binding.data() );
-    const std::vector< vk::GraphicsPipelineCreateInfo > pipeline_create_info{
-      vk::GraphicsPipelineCreateInfo()
-        .setStageCount( pipeline_shader_stages.size() )
-        .setPStages( pipeline_shader_stages.data() )
-        .setPVertexInputState( &vertex_input_state )
-        .setPInputAssemblyState( &input_assembly_info )
-        .setPViewportState( &viewport_info )
-        .setPRasterizationState( &rasterization_info )
-        .setPMultisampleState( &multisample_info )
-        .setPDepthStencilState( &depth_stencil_info )
-        .setPColorBlendState( &color_blend_info )
-        .setPDynamicState( &dynamic_state_info )
-        .setLayout( *pipeline.pipeline_layout )
-        .setRenderPass( *render_pass.render_pass )
-        .setSubpass( 0 )
-    };
-    auto raw_pipeline = context.device->createGraphicsPipelines(
-      *context.pipeline_cache, pipeline_create_info
-    );
-    vk::ObjectDestroy< vk::Device, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > deleter( *context.device, nullptr, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE () );
-    pipeline.set_pipeline( vk::UniqueHandle< vk::Pipeline, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE >( raw_pipeline.value[ 0 ], deleter ) );
+    const auto end = std::chrono::high_resolution_clock::now();
+    ++statistics.miss;
+    statistics.creation_time += std::chrono::duration_cast< std::chrono::microseconds >( end - begin ).count() / 1000.0;
+    pipelines.emplace( key, pipeline.pipeline );
     return pipeline;
   }
+  std::shared_ptr< vk::PipelineLayout > pipeline_registry_t::get_pipeline_layout(
+    const context_t &context,
+    const std::vector< vk::DescriptorSetLayout > &descriptor_set_layout,
+    const std::vector< vk::PushConstantRange > &push_constant_range
+  ) {
+    const auto key = get_pipeline_layout_key( descriptor_set_layout, push_constant_range );
+    std::lock_guard< std::mutex > lock( layout_guard );
+    const auto existing = pipeline_layouts.find( key );
+    if( existing != pipeline_layouts.end() ) return existing->second;
+    const auto pipeline_layout = build_pipeline_layout( context, descriptor_set_layout, push_constant_range );
+    pipeline_layouts.emplace( key, pipeline_layout );
+    return pipeline_layout;
+  }
+  pipeline_statistics_t pipeline_registry_t::get_statistics() const {
+    std::lock_guard< std::mutex > lock( guard );
+    return statistics;
+  }
+  void create_pipeline_registry(
+    context_t &context
+  ) {
+    context.set_pipeline_registry( std::make_shared< pipeline_registry_t >() );
+  }
+  pipeline_t create_pipeline(
+    const context_t &context,
+    const render_pass_t &render_pass,
+    uint32_t push_constant_size,
+    const vk::ShaderModule &vs,
+    const vk::ShaderModule &fs,
+    const std::vector< vk::VertexInputBindingDescription > &vertex_input_binding,
+    const std::vector< vk::VertexInputAttributeDescription > &vertex_input_attribute,
+    bool cull,
+    bool blend,
+    bool back_side
+  ) {
+    if( context.pipeline_registry )
+      return context.pipeline_registry->get(
+        context, render_pass, push_constant_size, vs, fs,
+        vertex_input_binding, vertex_input_attribute, cull, blend, back_side
+      );
+    return build_pipeline(
+      context,
+      render_pass,
+      build_pipeline_layout(
+        context,
+        get_raw_descriptor_set_layout( context ),
+        get_push_constant_range( push_constant_size )
+      ),
+      vs, fs,
+      vertex_input_binding, vertex_input_attribute, cull, blend, back_side
+    );
+  }
 }
-
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+#include <vw/context.h>
+namespace vw {
+  namespace {
+    // VkPipelineCacheHeaderVersionOneの大きさ
+    constexpr size_t pipeline_cache_header_size = 16u + VK_UUID_SIZE;
+    std::filesystem::path get_pipeline_cache_path(
+      const std::filesystem::path &cache_dir,
+      const vk::PhysicalDeviceProperties &props
+    ) {
+      std::stringstream name;
+      name << "pipeline_" << std::hex << std::setfill( '0' ) << std::setw( 4 ) << props.vendorID << "_" << std::setw( 4 ) << props.deviceID << ".bin";
+      return cache_dir / name.str();
+    }
+    std::vector< uint8_t > read_pipeline_cache( const std::filesystem::path &filename ) {
+      std::ifstream stream( filename, std::ios::binary );
+      if( !stream ) return std::vector< uint8_t >();
+      return std::vector< uint8_t >(
+        std::istreambuf_iterator< char >( stream ),
+        std::istreambuf_iterator< char >()
+      );
+    }
+    // ドライバやGPUが変わった後の古いキャッシュを渡さない
+    bool is_valid_pipeline_cache(
+      const context_t &context,
+      const std::vector< uint8_t > &data
+    ) {
+      if( data.size() < pipeline_cache_header_size ) return false;
+      uint32_t header[ 4 ];
+      std::memcpy( header, data.data(), sizeof( header ) );
+      const auto props = context.physical_device.getProperties();
+      return
+        header[ 0 ] >= pipeline_cache_header_size &&
+        header[ 0 ] <= data.size() &&
+        header[ 1 ] == uint32_t( VK_PIPELINE_CACHE_HEADER_VERSION_ONE ) &&
+        header[ 2 ] == props.vendorID &&
+        header[ 3 ] == props.deviceID &&
+        std::equal( props.pipelineCacheUUID.begin(), props.pipelineCacheUUID.end(), std::next( data.begin(), 16 ) );
+    }
+  }
+  void create_pipeline_cache(
+    context_t &context,
+    const std::filesystem::path &cache_dir
+  ) {
+    if( cache_dir.empty() ) {
+      context.set_pipeline_cache( context.device->createPipelineCacheUnique( vk::PipelineCacheCreateInfo() ) );
+      return;
+    }
+    context.set_pipeline_cache_path( get_pipeline_cache_path( cache_dir, context.physical_device.getProperties() ) );
+    const auto data = read_pipeline_cache( context.pipeline_cache_path );
+    const bool valid = is_valid_pipeline_cache( context, data );
+    if( !data.empty() && !valid )
+      std::cerr << "別のデバイスかドライバのパイプラインキャッシュなので使わない: " << context.pipeline_cache_path.string() << std::endl;
+    if( valid ) {
+      context.set_pipeline_cache( context.device->createPipelineCacheUnique(
+        vk::PipelineCacheCreateInfo()
+          .setInitialDataSize( data.size() )
+          .setPInitialData( data.data() )
+      ) );
+      context.set_warm_pipeline_cache( true );
+    }
+    else
+      context.set_pipeline_cache( context.device->createPipelineCacheUnique( vk::PipelineCacheCreateInfo() ) );
+  }
+  void save_pipeline_cache(
+    const context_t &context
+  ) {
+    if( context.pipeline_cache_path.empty() ) return;
+    // 同じディレクトリを使う他のプロセスが先に保存したパイプラインを失わないように合流させてから書く
+    const auto existing = read_pipeline_cache( context.pipeline_cache_path );
+    if( is_valid_pipeline_cache( context, existing ) ) {
+      const auto other = context.device->createPipelineCacheUnique(
+        vk::PipelineCacheCreateInfo()
+          .setInitialDataSize( existing.size() )
+          .setPInitialData( existing.data() )
+      );
+      context.device->mergePipelineCaches( *context.pipeline_cache, { *other } );
+    }
+    const auto data = context.device->getPipelineCacheData( *context.pipeline_cache );
+    std::error_code ec;
+    if( context.pipeline_cache_path.has_parent_path() ) std::filesystem::create_directories( context.pipeline_cache_path.parent_path(), ec );
+    auto temporary = context.pipeline_cache_path;
+    temporary += ".tmp";
+    {
+      std::ofstream stream( temporary, std::ios::binary | std::ios::trunc );
+      stream.write( reinterpret_cast< const char* >( data.data() ), data.size() );
+      if( !stream ) {
+        std::cerr << "パイプラインキャッシュを書き込めない: " << temporary.string() << std::endl;
+        std::filesystem::remove( temporary, ec );
+        return;
+      }
+    }
+    std::filesystem::rename( temporary, context.pipeline_cache_path, ec );
+    if( ec ) {
+      std::cerr << "パイプラインキャッシュを置き換えられない: " << context.pipeline_cache_path.string() << " " << ec.message() << std::endl;
+      std::filesystem::remove( temporary, ec );
+    }
+  }
+}
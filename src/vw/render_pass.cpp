@@ -28,7 +28,8 @@ namespace vw {
   render_pass_t create_render_pass(
     const context_t &context,
     bool off_screen,
-    bool shadow
+    bool shadow,
+    bool impostor
   ) {
     render_pass_t render_pass;
     const std::vector< vk::AttachmentDescription > attachments{
@@ -72,6 +73,7 @@ namespace vw {
         .setPSubpasses( subpass.data() )
     ) );
     render_pass.set_shadow( shadow );
+    render_pass.set_impostor( impostor );
     return render_pass;
   }
 }
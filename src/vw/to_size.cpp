@@ -100,7 +100,7 @@ namespace vw {
       }
       else if( type == fx::gltf::Accessor::Type::Vec2 ) {
         if( normalize ) return vk::Format::eR16G16Snorm;
-        else return vk::Format::eR8G8Sscaled;
+        else return vk::Format::eR16G16Sscaled;
       }
       else if( type == fx::gltf::Accessor::Type::Vec3 ) {
         if( normalize ) return vk::Format::eR16G16B16Snorm;
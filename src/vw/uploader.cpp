@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2020 Naomasa Matsubayashi
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <algorithm>
+#include <limits>
+#include <vw/uploader.h>
+#include <vw/exceptions.h>
+namespace vw {
+  namespace {
+    constexpr size_t default_capacity = 64u * 1024u * 1024u;
+    vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &begin_commands(
+      const vk::Device &device,
+      const vk::CommandPool &pool,
+      std::vector< vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > &free_commands,
+      vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &current
+    ) {
+      if( current ) return current;
+      if( free_commands.empty() ) {
+        auto cbs = device.allocateCommandBuffersUnique(
+          vk::CommandBufferAllocateInfo()
+            .setCommandPool( pool )
+            .setLevel( vk::CommandBufferLevel::ePrimary )
+            .setCommandBufferCount( 1 )
+        );
+        current = std::move( cbs.front() );
+      }
+      else {
+        current = std::move( free_commands.back() );
+        free_commands.pop_back();
+      }
+      current->begin(
+        vk::CommandBufferBeginInfo()
+          .setFlags( vk::CommandBufferUsageFlagBits::eOneTimeSubmit )
+      );
+      return current;
+    }
+    void discard_commands(
+      std::vector< vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > > &free_commands,
+      vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &current
+    ) {
+      if( !current ) return;
+      current->reset( vk::CommandBufferResetFlags() );
+      free_commands.push_back( std::move( current ) );
+    }
+  }
+  uploader_t::uploader_t(
+    const context_t &context,
+    size_t capacity_
+  ) :
+    device( *context.device ),
+    allocator( context.allocator ),
+    transfer_queue_index( context.transfer_command_pool ? context.transfer_queue_index : context.graphics_queue_index ),
+    graphics_queue_index( context.graphics_queue_index ),
+    transfer_queue( context.device->getQueue( transfer_queue_index, 0 ) ),
+    graphics_queue( context.device->getQueue( graphics_queue_index, 0 ) ),
+    capacity( 0u ),
+    alignment( 16u ),
+    head( 0u ),
+    used( 0u ),
+    batch_head( 0u ),
+    batch_consumed( 0u ),
+    batch_depth( 0u ) {
+    alignment = std::max(
+      alignment,
+      size_t( context.physical_device.getProperties().limits.optimalBufferCopyOffsetAlignment )
+    );
+    capacity = std::max( ( ( capacity_ + alignment - 1u ) / alignment ) * alignment, alignment );
+    graphics_command_pool = device.createCommandPoolUnique(
+      vk::CommandPoolCreateInfo()
+        .setQueueFamilyIndex( graphics_queue_index )
+        .setFlags( vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient )
+    );
+    if( is_dedicated() ) {
+      transfer_command_pool = device.createCommandPoolUnique(
+        vk::CommandPoolCreateInfo()
+          .setQueueFamilyIndex( transfer_queue_index )
+          .setFlags( vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient )
+      );
+    }
+    ring = create_staging_buffer( context, capacity );
+    void* mapped_memory;
+    const auto result = vmaMapMemory( *allocator, *ring.allocation, &mapped_memory );
+    if( result != VK_SUCCESS ) vk::throwResultException( vk::Result( result ), "バッファをマップできない" );
+    mapped.reset(
+      reinterpret_cast< uint8_t* >( mapped_memory ),
+      [allocator=allocator,allocation=ring.allocation]( uint8_t *p ) {
+        if( p ) vmaUnmapMemory( *allocator, *allocation );
+      }
+    );
+  }
+  uploader_t::~uploader_t() {
+    try {
+      flush( true );
+    }
+    catch( ... ) {
+      device.waitIdle();
+    }
+  }
+  uploader_t::staging_t uploader_t::stage( size_t size ) {
+    if( size == 0u || size > capacity ) throw invalid_argument( "ステージングバッファに収まらない" );
+    while( retire( false ) );
+    while( 1 ) {
+      size_t offset = ( ( head + alignment - 1u ) / alignment ) * alignment;
+      size_t consumed = offset + size - head;
+      if( offset + size > capacity ) {
+        offset = 0u;
+        consumed = capacity - head + size;
+      }
+      if( used + consumed <= capacity ) {
+        head = offset + size;
+        used += consumed;
+        batch_consumed += consumed;
+        get_commands();
+        return staging_t{ *ring.buffer, offset, mapped.get() + offset, size };
+      }
+      if( !retire( true ) ) {
+        if( transfer_commands || graphics_commands ) submit();
+        else {
+          head = 0u;
+          used = 0u;
+          batch_head = 0u;
+        }
+      }
+    }
+  }
+  void uploader_t::commit( const staging_t &staging ) {
+    vmaFlushAllocation( *allocator, *ring.allocation, staging.offset, staging.size );
+  }
+  vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &uploader_t::get_commands() {
+    if( !is_dedicated() ) return get_graphics_commands();
+    return begin_commands( device, *transfer_command_pool, free_transfer_commands, transfer_commands );
+  }
+  vk::UniqueHandle< vk::CommandBuffer, VULKAN_HPP_DEFAULT_DISPATCHER_TYPE > &uploader_t::get_graphics_commands() {
+    return begin_commands( device, *graphics_command_pool, free_graphics_commands, graphics_commands );
+  }
+  void uploader_t::begin_transfer( const image_t &image, uint32_t mip_count ) {
+    get_commands()->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTopOfPipe,
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::DependencyFlagBits( 0 ),
+      {},
+      {},
+      {
+        vk::ImageMemoryBarrier()
+          .setOldLayout( vk::ImageLayout::eUndefined )
+          .setNewLayout( vk::ImageLayout::eTransferDstOptimal )
+          .setDstAccessMask( vk::AccessFlagBits::eTransferWrite )
+          .setSrcQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+          .setDstQueueFamilyIndex( VK_QUEUE_FAMILY_IGNORED )
+          .setImage( *image.image )
+          .setSubresourceRange(
+            vk::ImageSubresourceRange()
+              .setAspectMask( vk::ImageAspectFlagBits::eColor )
+              .setBaseMipLevel( 0 )
+              .setLevelCount( mip_count )
+              .setBaseArrayLayer( 0 )
+              .setLayerCount( 1 )
+          )
+      }
+    );
+  }
+  void uploader_t::release_buffer( const buffer_t &buffer ) {
+    if( !is_dedicated() ) return;
+    const auto barrier = vk::BufferMemoryBarrier()
+      .setSrcQueueFamilyIndex( transfer_queue_index )
+      .setDstQueueFamilyIndex( graphics_queue_index )
+      .setBuffer( *buffer.buffer )
+      .setOffset( 0u )
+      .setSize( VK_WHOLE_SIZE );
+    get_commands()->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eBottomOfPipe,
+      vk::DependencyFlagBits( 0 ),
+      {},
+      { vk::BufferMemoryBarrier( barrier ).setSrcAccessMask( vk::AccessFlagBits::eTransferWrite ) },
+      {}
+    );
+    get_graphics_commands()->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTopOfPipe,
+      vk::PipelineStageFlagBits::eVertexInput|vk::PipelineStageFlagBits::eVertexShader|vk::PipelineStageFlagBits::eFragmentShader|vk::PipelineStageFlagBits::eComputeShader,
+      vk::DependencyFlagBits( 0 ),
+      {},
+      {
+        vk::BufferMemoryBarrier( barrier )
+          .setDstAccessMask(
+            vk::AccessFlagBits::eVertexAttributeRead|
+            vk::AccessFlagBits::eIndexRead|
+            vk::AccessFlagBits::eUniformRead|
+            vk::AccessFlagBits::eShaderRead
+          )
+      },
+      {}
+    );
+  }
+  void uploader_t::release_image(
+    const image_t &image,
+    uint32_t mip_base,
+    uint32_t mip_count,
+    vk::ImageLayout from,
+    vk::ImageLayout to
+  ) {
+    const auto dest_stage = to == vk::ImageLayout::eShaderReadOnlyOptimal ?
+      vk::PipelineStageFlagBits::eFragmentShader|vk::PipelineStageFlagBits::eComputeShader :
+      vk::PipelineStageFlagBits::eTransfer;
+    const auto dest_access = to == vk::ImageLayout::eShaderReadOnlyOptimal ?
+      vk::AccessFlagBits::eShaderRead :
+      vk::AccessFlagBits::eTransferRead|vk::AccessFlagBits::eTransferWrite;
+    const auto barrier = vk::ImageMemoryBarrier()
+      .setOldLayout( from )
+      .setNewLayout( to )
+      .setSrcQueueFamilyIndex( is_dedicated() ? transfer_queue_index : VK_QUEUE_FAMILY_IGNORED )
+      .setDstQueueFamilyIndex( is_dedicated() ? graphics_queue_index : VK_QUEUE_FAMILY_IGNORED )
+      .setImage( *image.image )
+      .setSubresourceRange(
+        vk::ImageSubresourceRange()
+          .setAspectMask( vk::ImageAspectFlagBits::eColor )
+          .setBaseMipLevel( mip_base )
+          .setLevelCount( mip_count )
+          .setBaseArrayLayer( 0 )
+          .setLayerCount( 1 )
+      );
+    if( !is_dedicated() ) {
+      get_graphics_commands()->pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        dest_stage,
+        vk::DependencyFlagBits( 0 ),
+        {},
+        {},
+        {
+          vk::ImageMemoryBarrier( barrier )
+            .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+            .setDstAccessMask( dest_access )
+        }
+      );
+      return;
+    }
+    get_commands()->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eBottomOfPipe,
+      vk::DependencyFlagBits( 0 ),
+      {},
+      {},
+      { vk::ImageMemoryBarrier( barrier ).setSrcAccessMask( vk::AccessFlagBits::eTransferWrite ) }
+    );
+    get_graphics_commands()->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTopOfPipe,
+      dest_stage,
+      vk::DependencyFlagBits( 0 ),
+      {},
+      {},
+      { vk::ImageMemoryBarrier( barrier ).setDstAccessMask( dest_access ) }
+    );
+  }
+  void uploader_t::submit() {
+    if( !transfer_commands && !graphics_commands ) {
+      batch_head = head;
+      return;
+    }
+    submission_t submission;
+    if( free_fences.empty() ) submission.fence = device.createFenceUnique( vk::FenceCreateInfo() );
+    else {
+      submission.fence = std::move( free_fences.back() );
+      free_fences.pop_back();
+    }
+    if( transfer_commands ) {
+      if( free_semaphores.empty() ) submission.semaphore = device.createSemaphoreUnique( vk::SemaphoreCreateInfo() );
+      else {
+        submission.semaphore = std::move( free_semaphores.back() );
+        free_semaphores.pop_back();
+      }
+      transfer_commands->end();
+      transfer_queue.submit(
+        vk::SubmitInfo()
+          .setCommandBufferCount( 1 )
+          .setPCommandBuffers( &*transfer_commands )
+          .setSignalSemaphoreCount( 1 )
+          .setPSignalSemaphores( &*submission.semaphore ),
+        vk::Fence()
+      );
+    }
+    // 転送した内容はグラフィクスとコンピュートのどちらのシェーダからも読めるようにする
+    get_graphics_commands()->pipelineBarrier(
+      vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eVertexInput|vk::PipelineStageFlagBits::eVertexShader|vk::PipelineStageFlagBits::eFragmentShader|vk::PipelineStageFlagBits::eComputeShader,
+      vk::DependencyFlagBits( 0 ),
+      {
+        vk::MemoryBarrier()
+          .setSrcAccessMask( vk::AccessFlagBits::eTransferWrite )
+          .setDstAccessMask(
+            vk::AccessFlagBits::eVertexAttributeRead|
+            vk::AccessFlagBits::eIndexRead|
+            vk::AccessFlagBits::eUniformRead|
+            vk::AccessFlagBits::eShaderRead
+          )
+      },
+      {},
+      {}
+    );
+    graphics_commands->end();
+    const vk::PipelineStageFlags wait_stage = vk::PipelineStageFlagBits::eAllCommands;
+    auto submit_info = vk::SubmitInfo()
+      .setCommandBufferCount( 1 )
+      .setPCommandBuffers( &*graphics_commands );
+    if( submission.semaphore ) {
+      submit_info
+        .setWaitSemaphoreCount( 1 )
+        .setPWaitSemaphores( &*submission.semaphore )
+        .setPWaitDstStageMask( &wait_stage );
+    }
+    graphics_queue.submit( submit_info, *submission.fence );
+    submission.transfer_commands = std::move( transfer_commands );
+    submission.graphics_commands = std::move( graphics_commands );
+    submission.retained = std::move( retained );
+    retained.clear();
+    submission.consumed = batch_consumed;
+    in_flight.push_back( std::move( submission ) );
+    batch_head = head;
+    batch_consumed = 0u;
+  }
+  bool uploader_t::retire( bool wait ) {
+    if( in_flight.empty() ) return false;
+    auto &oldest = in_flight.front();
+    if( wait ) {
+      const auto result = device.waitForFences( 1, &*oldest.fence, VK_TRUE, std::numeric_limits< uint64_t >::max() );
+      if( result != vk::Result::eSuccess ) vk::throwResultException( result, "転送の完了を待てない" );
+    }
+    else if( device.getFenceStatus( *oldest.fence ) != vk::Result::eSuccess ) return false;
+    {
+      const auto result = device.resetFences( 1, &*oldest.fence );
+      if( result != vk::Result::eSuccess ) vk::throwResultException( result, "フェンスをリセットできない" );
+    }
+    discard_commands( free_transfer_commands, oldest.transfer_commands );
+    discard_commands( free_graphics_commands, oldest.graphics_commands );
+    free_fences.push_back( std::move( oldest.fence ) );
+    if( oldest.semaphore ) free_semaphores.push_back( std::move( oldest.semaphore ) );
+    oldest.retained.clear();
+    used -= oldest.consumed;
+    in_flight.pop_front();
+    if( used == 0u && !transfer_commands && !graphics_commands ) {
+      head = 0u;
+      batch_head = 0u;
+    }
+    return true;
+  }
+  void uploader_t::retain( std::shared_ptr< void > object ) {
+    retained.push_back( std::move( object ) );
+  }
+  void uploader_t::flush( bool wait ) {
+    submit();
+    if( wait ) while( retire( true ) );
+  }
+  void uploader_t::begin_batch() {
+    ++batch_depth;
+  }
+  void uploader_t::end_batch() {
+    if( batch_depth == 0u ) throw invalid_argument( "バッチが開始されていない" );
+    if( --batch_depth == 0u ) flush( false );
+  }
+  void uploader_t::abort_batch() {
+    if( batch_depth != 0u ) --batch_depth;
+    if( transfer_commands ) transfer_commands->end();
+    if( graphics_commands ) graphics_commands->end();
+    discard_commands( free_transfer_commands, transfer_commands );
+    discard_commands( free_graphics_commands, graphics_commands );
+    retained.clear();
+    used -= batch_consumed;
+    head = batch_head;
+    batch_consumed = 0u;
+  }
+  upload_batch_t::upload_batch_t( const context_t &context ) : uploader( context.uploader ) {
+    if( uploader ) uploader->begin_batch();
+  }
+  upload_batch_t::~upload_batch_t() {
+    if( uploader ) uploader->abort_batch();
+  }
+  void upload_batch_t::submit() {
+    if( uploader ) {
+      auto u = std::move( uploader );
+      u->end_batch();
+    }
+  }
+  void create_uploader(
+    context_t &context
+  ) {
+    context.set_uploader( std::make_shared< uploader_t >( context, default_capacity ) );
+  }
+  std::shared_ptr< uploader_t > get_uploader(
+    const context_t &context,
+    size_t size
+  ) {
+    if( context.uploader ) return context.uploader;
+    return std::make_shared< uploader_t >( context, std::min( size, default_capacity ) );
+  }
+  void finish_upload(
+    uploader_t &uploader
+  ) {
+    // 後続のグラフィクスキューのコマンドとはsubmitで積んだバリアで順序が付くので完了は待たない
+    // 転送先は呼び出し側がretainしておき、フェンスが通るまで破棄されないようにする
+    if( !uploader.in_batch() ) uploader.flush( false );
+  }
+}